@@ -0,0 +1,522 @@
+// Microbenchmarks for the data structures under the keyspace, on Google Benchmark:
+//
+//   g++ -std=c++23 -O2 -DNDEBUG -march=native -I. bench/bench_ds.cpp -o bench_ds -lbenchmark -lpthread
+//   ./bench_ds --benchmark_filter=Map --benchmark_counters_tabular=true
+//
+// Every structure is exercised the way the server uses it: string keys hashed with hash_string, nodes
+// allocated before the timed region so the allocator is not what gets measured, and a fresh structure
+// built and torn down under PauseTiming wherever an iteration needs one.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "flat_hashtable.hpp"
+#include "hash.hpp"
+#include "hashtable.hpp"
+#include "heap.hpp"
+#include "include/entry_manager.hpp"
+#include "include/metrics.hpp"
+#include "thread_pool.hpp"
+#include "zset.hpp"
+
+namespace {
+
+constexpr uint64_t k_seed = 0x6b76626e6368ull; // fixed, so every run sees the same keys and probe order
+
+struct BenchNode : HNode<BenchNode> {
+    explicit BenchNode(std::string k)
+        : HNode<BenchNode>(hash_string(reinterpret_cast<const uint8_t*>(k.data()), k.size())), key(std::move(k)) {}
+    std::string key;
+};
+
+std::vector<std::string> make_keys(size_t n) {
+    std::vector<std::string> keys;
+    keys.reserve(n);
+    for (size_t i = 0; i < n; ++i) keys.push_back("key:" + std::to_string(i));
+    return keys;
+}
+
+// Nodes for the first `n` keys (all of them by default).
+std::vector<std::unique_ptr<BenchNode>> make_nodes(const std::vector<std::string>& keys, size_t n = SIZE_MAX) {
+    n = std::min(n, keys.size());
+    std::vector<std::unique_ptr<BenchNode>> nodes;
+    nodes.reserve(n);
+    for (size_t i = 0; i < n; ++i) nodes.push_back(std::make_unique<BenchNode>(keys[i]));
+    return nodes;
+}
+
+template<typename Map>
+BenchNode* find(Map& map, std::string_view key) {
+    uint64_t hcode = hash_string(reinterpret_cast<const uint8_t*>(key.data()), key.size());
+    return map.find(hcode, [key](const BenchNode& node) { return node.key == key; });
+}
+
+// Indices into [0, n) in random order, drawn once.
+std::vector<uint32_t> probe_order(size_t n, size_t count) {
+    std::mt19937_64 rng(k_seed);
+    std::uniform_int_distribution<uint32_t> pick(0, static_cast<uint32_t>(n - 1));
+    std::vector<uint32_t> order(count);
+    for (auto& i : order) i = pick(rng);
+    return order;
+}
+
+void report_tail(benchmark::State& state, const LatencyHistogram& histogram) {
+    LatencySummary summary;
+    summary.add(histogram);
+    state.counters["p99_ns"] = static_cast<double>(summary.percentile(0.99));
+    state.counters["p99.99_ns"] = static_cast<double>(summary.percentile(0.9999));
+    state.counters["max_ns"] = static_cast<double>(summary.max());
+}
+
+// ---- HMap / FlatHMap -------------------------------------------------------------------------------
+
+// Builds a map of range(0) keys from empty, so every resize on the way is paid for.
+template<template<typename> class Map>
+void BM_MapInsert(benchmark::State& state) {
+    auto keys = make_keys(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto nodes = make_nodes(keys);
+        auto map = std::make_unique<Map<BenchNode>>();
+        state.ResumeTiming();
+        for (auto& node : nodes) map->insert(std::move(node));
+        benchmark::DoNotOptimize(map->size());
+        state.PauseTiming();
+        map.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The same build, timing every insert on its own: the incremental rehash is there to bound the worst
+// insert, which the mean above hides. (The clock reads add ~20ns to each sample.)
+template<template<typename> class Map>
+void BM_MapInsertTail(benchmark::State& state) {
+    auto keys = make_keys(static_cast<size_t>(state.range(0)));
+    auto histogram = std::make_unique<LatencyHistogram>();
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto nodes = make_nodes(keys);
+        auto map = std::make_unique<Map<BenchNode>>();
+        state.ResumeTiming();
+        for (auto& node : nodes) {
+            auto start = std::chrono::steady_clock::now();
+            map->insert(std::move(node));
+            histogram->record(static_cast<uint64_t>((std::chrono::steady_clock::now() - start).count()));
+        }
+        state.PauseTiming();
+        map.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    report_tail(state, *histogram);
+}
+
+// Hits on a map that is not resizing.
+template<template<typename> class Map>
+void BM_MapLookup(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    auto keys = make_keys(n);
+    Map<BenchNode> map;
+    for (auto& node : make_nodes(keys)) map.insert(std::move(node));
+    while (map.rehash_step(std::chrono::milliseconds(10))) {}
+    auto order = probe_order(n, 1 << 16);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(find(map, keys[order[i++ & (order.size() - 1)]]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Hits while a resize is in flight: each find also moves its slice of the old table and may have to
+// probe both tables. The map is rebuilt (untimed) up to the insert that starts a resize whenever the
+// previous one finishes, so every timed lookup runs against a resizing map.
+template<template<typename> class Map>
+void BM_MapLookupResizing(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    auto keys = make_keys(n * 4);
+    auto order = probe_order(n, 1 << 16);
+    std::unique_ptr<Map<BenchNode>> map;
+    auto rebuild = [&] {
+        map = std::make_unique<Map<BenchNode>>();
+        for (auto& node : make_nodes(keys, n)) map->insert(std::move(node));
+        while (map->rehash_step(std::chrono::milliseconds(10))) {}
+        // Keep going (with keys never probed) to the insert that starts the next resize.
+        for (size_t next = n; !map->resizing() && next < keys.size(); ++next) map->insert(std::make_unique<BenchNode>(keys[next]));
+    };
+    rebuild();
+    size_t i = 0;
+    uint64_t rebuilds = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(find(*map, keys[order[i++ & (order.size() - 1)]]));
+        if (!map->resizing()) {
+            state.PauseTiming();
+            rebuild();
+            ++rebuilds;
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["lookups_per_resize"] =
+        static_cast<double>(state.iterations()) / static_cast<double>(std::max<uint64_t>(1, rebuilds));
+}
+
+BENCHMARK_TEMPLATE(BM_MapInsert, HMap)->RangeMultiplier(16)->Range(1 << 12, 1 << 20)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_MapInsert, FlatHMap)->RangeMultiplier(16)->Range(1 << 12, 1 << 20)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_MapInsertTail, HMap)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_MapInsertTail, FlatHMap)->Arg(1 << 20)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_MapLookup, HMap)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+BENCHMARK_TEMPLATE(BM_MapLookup, FlatHMap)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+BENCHMARK_TEMPLATE(BM_MapLookupResizing, HMap)->Arg(1 << 12)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_MapLookupResizing, FlatHMap)->Arg(1 << 12)->Arg(1 << 16);
+
+// ---- hash_string -----------------------------------------------------------------------------------
+
+// By key length, across the switch from the short path to the striped one at k_stripe_threshold.
+void BM_HashString(benchmark::State& state) {
+    std::string key(static_cast<size_t>(state.range(0)), 'k');
+    std::mt19937_64 rng(k_seed);
+    for (auto& c : key) c = static_cast<char>('a' + rng() % 26);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(key.data());
+        benchmark::DoNotOptimize(hash_string(reinterpret_cast<const uint8_t*>(key.data()), key.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_HashString)
+    ->Arg(8)->Arg(16)->Arg(24)->Arg(32)->Arg(64)->Arg(128)
+    ->Arg(hash_detail::k_stripe_threshold)->Arg(hash_detail::k_stripe_threshold + 1)
+    ->Arg(1024)->Arg(4096)->Arg(64 * 1024);
+
+// ---- ZSet ------------------------------------------------------------------------------------------
+
+std::vector<std::pair<std::string, double>> make_members(size_t n) {
+    std::mt19937_64 rng(k_seed);
+    std::uniform_real_distribution<double> score(0, 1e6);
+    std::vector<std::pair<std::string, double>> members;
+    members.reserve(n);
+    for (size_t i = 0; i < n; ++i) members.emplace_back("member:" + std::to_string(i), score(rng));
+    return members;
+}
+
+void fill(ds::ZSet& zset, const std::vector<std::pair<std::string, double>>& members) {
+    for (const auto& [name, score] : members) zset.add(name, score);
+}
+
+// range(0) new members in random score order; small sizes stay listpack-encoded, larger ones convert.
+void BM_ZSetAdd(benchmark::State& state) {
+    auto members = make_members(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto zset = std::make_unique<ds::ZSet>();
+        state.ResumeTiming();
+        fill(*zset, members);
+        benchmark::DoNotOptimize(zset->size());
+        state.PauseTiming();
+        zset.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Re-scoring existing members: the ZADD of a leaderboard, unlink + reinsert in the score index.
+void BM_ZSetUpdate(benchmark::State& state) {
+    auto members = make_members(static_cast<size_t>(state.range(0)));
+    ds::ZSet zset;
+    fill(zset, members);
+    auto order = probe_order(members.size(), 1 << 16);
+    std::mt19937_64 rng(k_seed + 1);
+    std::uniform_real_distribution<double> score(0, 1e6);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(zset.add(members[order[i++ & (order.size() - 1)]].first, score(rng)));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_ZSetScore(benchmark::State& state) {
+    auto members = make_members(static_cast<size_t>(state.range(0)));
+    ds::ZSet zset;
+    fill(zset, members);
+    auto order = probe_order(members.size(), 1 << 16);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(zset.score(members[order[i++ & (order.size() - 1)]].first));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_ZSetRank(benchmark::State& state) {
+    auto members = make_members(static_cast<size_t>(state.range(0)));
+    ds::ZSet zset;
+    fill(zset, members);
+    auto order = probe_order(members.size(), 1 << 16);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(zset.rank(members[order[i++ & (order.size() - 1)]].first));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// ZRANGEBYSCORE ... LIMIT 0 10 from a random starting score.
+void BM_ZSetRangeByScore(benchmark::State& state) {
+    auto members = make_members(static_cast<size_t>(state.range(0)));
+    ds::ZSet zset;
+    fill(zset, members);
+    std::mt19937_64 rng(k_seed + 2);
+    std::uniform_real_distribution<double> score(0, 1e6);
+    for (auto _ : state) {
+        auto cursor = zset.range_by_score({score(rng)}, {1e6}).limit(10);
+        while (auto member = cursor.next()) benchmark::DoNotOptimize(member->score);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_ZSetAdd)->Arg(64)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ZSetUpdate)->Arg(64)->Arg(1 << 16)->Arg(1 << 20);
+BENCHMARK(BM_ZSetScore)->Arg(64)->Arg(1 << 16)->Arg(1 << 20);
+BENCHMARK(BM_ZSetRank)->Arg(64)->Arg(1 << 16)->Arg(1 << 20);
+BENCHMARK(BM_ZSetRangeByScore)->Arg(64)->Arg(1 << 16)->Arg(1 << 20);
+
+// ---- BinaryHeap ------------------------------------------------------------------------------------
+
+// Items carry position refs, as the heap TTL index's do, so every sift also writes back through them.
+struct HeapFixture {
+    ds::BinaryHeap<uint64_t> heap;
+    std::vector<size_t> positions; // positions[i]: where item i sits now
+
+    explicit HeapFixture(size_t n) : positions(n) {}
+
+    void push(size_t i, uint64_t value) {
+        ds::HeapItem<uint64_t> item(value);
+        item.set_position(&positions[i]);
+        heap.push(std::move(item));
+    }
+};
+
+void BM_HeapPush(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    std::mt19937_64 rng(k_seed);
+    std::vector<uint64_t> values(n);
+    for (auto& v : values) v = rng();
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto fixture = std::make_unique<HeapFixture>(n);
+        state.ResumeTiming();
+        for (size_t i = 0; i < n; ++i) fixture->push(i, values[i]);
+        benchmark::DoNotOptimize(fixture->heap.top().value());
+        state.PauseTiming();
+        fixture.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// A random item re-keyed in place (an EXPIRE on a key that already has a TTL), then re-sifted.
+void BM_HeapUpdate(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    std::mt19937_64 rng(k_seed);
+    HeapFixture fixture(n);
+    for (size_t i = 0; i < n; ++i) fixture.push(i, rng());
+    auto order = probe_order(n, 1 << 16);
+    size_t i = 0;
+    for (auto _ : state) {
+        size_t pos = fixture.positions[order[i++ & (order.size() - 1)]];
+        fixture.heap.value_at(pos) = rng();
+        fixture.heap.update(pos);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_HeapPush)->Arg(1 << 16)->Arg(1 << 20)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_HeapUpdate)->Arg(1 << 16)->Arg(1 << 20)->Arg(10'000'000);
+
+// ---- TTL index: WheelTtl / HeapTtl ----------------------------------------------------------------
+
+// Keyspace entries, slab-allocated as the keyspace's are, with deadlines spread over the next hour. The
+// deadlines are offsets, applied to the clock when a fresh index is built, so none is in the past yet.
+struct TtlFixture {
+    static constexpr uint64_t k_window_us = 3'600'000'000;
+
+    std::vector<std::unique_ptr<Entry>> entries;
+    std::vector<uint64_t> offsets;
+
+    explicit TtlFixture(size_t n) {
+        std::mt19937_64 rng(k_seed);
+        std::uniform_int_distribution<uint64_t> offset(1000, k_window_us);
+        entries.reserve(n);
+        offsets.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            entries.push_back(std::make_unique<Entry>(std::string_view{}, i));
+            offsets.push_back(offset(rng));
+        }
+    }
+
+    template<typename Ttl>
+    void arm_all(Ttl& ttl, uint64_t base_us) {
+        for (size_t i = 0; i < entries.size(); ++i) ttl.arm(*entries[i], base_us + offsets[i]);
+    }
+
+    // Leaves every entry disarmed, as the keyspace would before freeing it.
+    template<typename Ttl>
+    static void disarm_all(Ttl& ttl) {
+        ttl.expire(UINT64_MAX, SIZE_MAX, [](Entry&) {});
+    }
+};
+
+// range(0) keys given a TTL on an empty index: a bulk load of SETs with EX.
+template<typename Ttl>
+void BM_TtlArm(benchmark::State& state) {
+    TtlFixture fixture(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto ttl = std::make_unique<Ttl>();
+        uint64_t base = EntryManager::get_monotonic_usec();
+        state.ResumeTiming();
+        fixture.arm_all(*ttl, base);
+        benchmark::DoNotOptimize(ttl->size());
+        state.PauseTiming();
+        TtlFixture::disarm_all(*ttl);
+        ttl.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// A random key's deadline moved (an EXPIRE on a key that already has one), range(0) keys armed.
+template<typename Ttl>
+void BM_TtlRearm(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    TtlFixture fixture(n);
+    Ttl ttl;
+    uint64_t base = EntryManager::get_monotonic_usec();
+    fixture.arm_all(ttl, base);
+    auto order = probe_order(n, 1 << 16);
+    auto targets = probe_order(n, 1 << 16); // reuse the offsets as fresh deadlines
+    size_t i = 0;
+    for (auto _ : state) {
+        size_t at = i++ & (order.size() - 1);
+        ttl.arm(*fixture.entries[order[at]], base + fixture.offsets[targets[at]]);
+    }
+    state.SetItemsProcessed(state.iterations());
+    TtlFixture::disarm_all(ttl);
+}
+
+// PERSISTs of random keys out of range(0) armed ones, k_ttl_batch per iteration; the keys get their
+// TTLs back untimed before the next batch.
+constexpr size_t k_ttl_batch = 4096;
+
+template<typename Ttl>
+void BM_TtlCancel(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    TtlFixture fixture(n);
+    Ttl ttl;
+    uint64_t base = EntryManager::get_monotonic_usec();
+    fixture.arm_all(ttl, base);
+    std::vector<uint32_t> order(n);
+    for (uint32_t i = 0; i < n; ++i) order[i] = i;
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(k_seed));
+    size_t next = 0;
+    for (auto _ : state) {
+        if (next + k_ttl_batch > n) next = 0;
+        for (size_t i = next; i < next + k_ttl_batch; ++i) ttl.cancel(*fixture.entries[order[i]]);
+        state.PauseTiming();
+        for (size_t i = next; i < next + k_ttl_batch; ++i) ttl.arm(*fixture.entries[order[i]], base + fixture.offsets[order[i]]);
+        next += k_ttl_batch;
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(k_ttl_batch));
+    TtlFixture::disarm_all(ttl);
+}
+
+// All range(0) deadlines come due and are expired in one pass - the wheel cascading its levels down, the
+// heap popping in order.
+template<typename Ttl>
+void BM_TtlExpire(benchmark::State& state) {
+    TtlFixture fixture(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto ttl = std::make_unique<Ttl>();
+        uint64_t base = EntryManager::get_monotonic_usec();
+        fixture.arm_all(*ttl, base);
+        size_t fired = 0;
+        state.ResumeTiming();
+        // A tick past the window: the wheel rounds deadlines up to one.
+        ttl->expire(base + TtlFixture::k_window_us + WheelTtl::k_tick_us, SIZE_MAX, [&fired](Entry&) { fired++; });
+        benchmark::DoNotOptimize(fired);
+        state.PauseTiming();
+        ttl.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_TEMPLATE(BM_TtlArm, WheelTtl)->Arg(1 << 20)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_TtlArm, HeapTtl)->Arg(1 << 20)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_TtlRearm, WheelTtl)->Arg(1 << 20)->Arg(10'000'000);
+BENCHMARK_TEMPLATE(BM_TtlRearm, HeapTtl)->Arg(1 << 20)->Arg(10'000'000);
+BENCHMARK_TEMPLATE(BM_TtlCancel, WheelTtl)->Arg(1 << 20)->Arg(10'000'000)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_TtlCancel, HeapTtl)->Arg(1 << 20)->Arg(10'000'000)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_TtlExpire, WheelTtl)->Arg(1 << 20)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_TtlExpire, HeapTtl)->Arg(1 << 20)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+
+// ---- ThreadPool ------------------------------------------------------------------------------------
+
+constexpr size_t k_pool_batch = 1024;
+
+// enqueue(): a task with a future - the packaged_task's shared state is one allocation per task.
+void BM_ThreadPoolEnqueue(benchmark::State& state) {
+    threading::ThreadPool pool(static_cast<size_t>(state.range(0)));
+    std::vector<std::future<uint64_t>> results;
+    results.reserve(k_pool_batch);
+    for (auto _ : state) {
+        for (uint64_t i = 0; i < k_pool_batch; ++i) results.push_back(pool.enqueue([i] { return i * 2; }));
+        for (auto& result : results) benchmark::DoNotOptimize(result.get());
+        results.clear();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(k_pool_batch));
+}
+
+// submit(): fire-and-forget, what the server's background work (lazy free, snapshots) uses.
+void BM_ThreadPoolSubmit(benchmark::State& state) {
+    threading::ThreadPool pool(static_cast<size_t>(state.range(0)));
+    std::atomic<uint64_t> sink{0};
+    for (auto _ : state) {
+        for (size_t i = 0; i < k_pool_batch; ++i) pool.submit([&sink] { sink.fetch_add(1, std::memory_order_relaxed); });
+        pool.wait_for_tasks();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(k_pool_batch));
+}
+
+// submit_batch(): the same tasks behind one wakeup round.
+void BM_ThreadPoolSubmitBatch(benchmark::State& state) {
+    threading::ThreadPool pool(static_cast<size_t>(state.range(0)));
+    std::atomic<uint64_t> sink{0};
+    std::vector<threading::Task> tasks;
+    tasks.reserve(k_pool_batch);
+    for (auto _ : state) {
+        for (size_t i = 0; i < k_pool_batch; ++i) tasks.emplace_back([&sink] { sink.fetch_add(1, std::memory_order_relaxed); });
+        pool.submit_batch(tasks);
+        tasks.clear();
+        pool.wait_for_tasks();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(k_pool_batch));
+}
+
+BENCHMARK(BM_ThreadPoolEnqueue)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+BENCHMARK(BM_ThreadPoolSubmit)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+BENCHMARK(BM_ThreadPoolSubmitBatch)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,447 @@
+// kvbench: load generator for the server's length-prefixed protocol.
+//
+//   g++ -std=c++23 -O2 -DNDEBUG -I. bench/kvbench.cpp -o kvbench -lpthread
+//   ./kvbench --port 1234 --connections 8 --pipeline 16 --keys 100000 --dist zipf --set-ratio 0.1 --preload
+//   ./kvbench --port 1234 --connections 8 --rate 200000 --duration 30
+//
+// Closed loop (the default) keeps --pipeline requests in flight on every connection and sends the next one
+// as each reply comes back, which finds the peak throughput but undercounts the tail: while the server
+// stalls, the generator stalls with it and the requests it would have sent are never timed (coordinated
+// omission). Open loop (--rate) sends on a fixed schedule whatever the server is doing, and times every
+// request from when it was due rather than when it went out, so a stall shows up in every request it
+// delayed. For closed-loop runs the corrected percentiles are estimated afterwards the way HdrHistogram
+// does it, by back-filling the samples a long reply held up at the run's mean request interval.
+//
+// Latencies go into the server's own LatencyHistogram (metrics.hpp), one per connection, summed at the end.
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include "include/common.hpp"
+#include "include/metrics.hpp"
+#include "include/request_parser.hpp"
+#include "include/response_serializer.hpp"
+#include "include/socket.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Distribution : uint8_t { Uniform, Zipf };
+
+struct Options {
+    std::string host{"127.0.0.1"};
+    uint16_t port{SERVER_PORT};
+    size_t connections{4};
+    size_t pipeline{1};          // requests in flight per connection
+    double duration_s{10};
+    double warmup_s{1};          // run, but not timed
+    double rate{0};              // total requests/s across all connections; 0 = closed loop
+    uint64_t keys{100000};
+    size_t value_size{64};
+    double set_ratio{0.1};
+    Distribution dist{Distribution::Uniform};
+    double zipf_theta{0.99};
+    bool preload{false};         // SET every key once before the run, so GETs hit
+};
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: kvbench [--host H] [--port P] [--connections N] [--pipeline N] [--duration S]\n"
+                 "               [--warmup S] [--rate OPS] [--keys N] [--value-size B] [--set-ratio F]\n"
+                 "               [--dist uniform|zipf] [--zipf-theta T] [--preload]\n");
+}
+
+template<typename T>
+bool parse_number(std::string_view text, T& out) {
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+    return ec == std::errc{} && ptr == text.data() + text.size();
+}
+
+std::optional<Options> parse_options(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view flag = argv[i];
+        if (flag == "--preload") {
+            options.preload = true;
+            continue;
+        }
+        if (i + 1 >= argc) return std::nullopt;
+        std::string_view value = argv[++i];
+        bool ok = true;
+        if (flag == "--host") options.host = value;
+        else if (flag == "--port") ok = parse_number(value, options.port);
+        else if (flag == "--connections") ok = parse_number(value, options.connections) && options.connections > 0;
+        else if (flag == "--pipeline") ok = parse_number(value, options.pipeline) && options.pipeline > 0;
+        else if (flag == "--duration") ok = parse_number(value, options.duration_s) && options.duration_s > 0;
+        else if (flag == "--warmup") ok = parse_number(value, options.warmup_s) && options.warmup_s >= 0;
+        else if (flag == "--rate") ok = parse_number(value, options.rate) && options.rate >= 0;
+        else if (flag == "--keys") ok = parse_number(value, options.keys) && options.keys > 0;
+        else if (flag == "--value-size") ok = parse_number(value, options.value_size);
+        else if (flag == "--set-ratio") ok = parse_number(value, options.set_ratio) && options.set_ratio >= 0 && options.set_ratio <= 1;
+        else if (flag == "--zipf-theta") ok = parse_number(value, options.zipf_theta) && options.zipf_theta > 0 && options.zipf_theta != 1;
+        else if (flag == "--dist" && value == "uniform") options.dist = Distribution::Uniform;
+        else if (flag == "--dist" && value == "zipf") options.dist = Distribution::Zipf;
+        else ok = false;
+        if (!ok) return std::nullopt;
+    }
+    return options;
+}
+
+// Zipfian ranks over [0, n) - rank 0 the most popular - by Gray et al.'s method ("Quickly Generating
+// Billion-Record Synthetic Databases"), as YCSB does: zeta(n) once up front, then O(1) per draw.
+class ZipfGenerator {
+public:
+    ZipfGenerator(uint64_t n, double theta)
+        : n_(n), theta_(theta), alpha_(1 / (1 - theta)), zetan_(zeta(n, theta)) {
+        double zeta2 = zeta(2, theta);
+        eta_ = (1 - std::pow(2.0 / static_cast<double>(n), 1 - theta)) / (1 - zeta2 / zetan_);
+    }
+
+    template<typename Rng>
+    uint64_t operator()(Rng& rng) const {
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        double uz = u * zetan_;
+        if (uz < 1) return 0;
+        if (uz < 1 + std::pow(0.5, theta_)) return std::min<uint64_t>(1, n_ - 1);
+        auto rank = static_cast<uint64_t>(static_cast<double>(n_) * std::pow(eta_ * u - eta_ + 1, alpha_));
+        return std::min(rank, n_ - 1);
+    }
+
+private:
+    uint64_t n_;
+    double theta_;
+    double alpha_;
+    double zetan_;
+    double eta_;
+
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i) sum += 1 / std::pow(static_cast<double>(i), theta);
+        return sum;
+    }
+};
+
+struct WorkerStats {
+    LatencyHistogram latency;
+    uint64_t sum_ns{0};
+    uint64_t gets{0};
+    uint64_t sets{0};
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t errors{0};
+    uint64_t max_lag_ns{0}; // open loop: how far sending fell behind the schedule
+};
+
+Result<Socket> connect_to(const Options& options) {
+    auto socket = connect_nonblocking(options.host, options.port);
+    if (!socket) return std::unexpected(socket.error());
+    pollfd pfd{socket->get(), POLLOUT, 0};
+    if (::poll(&pfd, 1, 5000) != 1) return std::unexpected(std::make_error_code(std::errc::timed_out));
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(socket->get(), SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0) return std::unexpected(std::error_code(err, std::system_category()));
+    int one = 1;
+    setsockopt(socket->get(), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return socket;
+}
+
+// One connection's load, run on a thread of its own.
+class Worker {
+public:
+    Worker(const Options& options, size_t index, const ZipfGenerator* zipf)
+        : options_(options), index_(index), zipf_(zipf), rng_(0x6b76626e6368ull + index),
+          value_(options.value_size, 'v') {}
+
+    WorkerStats& stats() noexcept { return stats_; }
+
+    Result<void> connect() {
+        auto socket = connect_to(options_);
+        if (!socket) return std::unexpected(socket.error());
+        socket_ = std::move(*socket);
+        return {};
+    }
+
+    // SETs this worker's share of the keys (every connections-th one), pipelined, untimed.
+    Result<void> preload() {
+        uint64_t next = index_;
+        size_t awaiting = 0;
+        while (next < options_.keys || awaiting > 0) {
+            while (next < options_.keys && awaiting < std::max<size_t>(options_.pipeline, 64)) {
+                key_ = "key:" + std::to_string(next);
+                RequestParser::encode(out_, {"set", key_, value_});
+                next += options_.connections;
+                ++awaiting;
+            }
+            if (auto r = exchange(std::nullopt); !r) return r;
+            awaiting -= take_replies([](uint8_t) {});
+        }
+        return {};
+    }
+
+    // Runs until `end` (connected first), timing the requests sent from `measure_from` on.
+    Result<void> run(Clock::time_point start, Clock::time_point measure_from, Clock::time_point end) {
+        bool open_loop = options_.rate > 0;
+        auto interval = open_loop ? std::chrono::nanoseconds(static_cast<int64_t>(
+                                        1e9 * static_cast<double>(options_.connections) / options_.rate))
+                                  : std::chrono::nanoseconds(0);
+        // Spread the connections' schedules over one interval instead of firing them together.
+        Clock::time_point next_due = start + interval * index_ / options_.connections;
+        while (true) {
+            auto now = Clock::now();
+            if (now >= end && sent_at_.empty()) break;
+            while (now < end && sent_at_.size() < options_.pipeline && (!open_loop || next_due <= now)) {
+                Clock::time_point due = open_loop ? next_due : now;
+                if (open_loop) {
+                    if (due >= measure_from) {
+                        stats_.max_lag_ns = std::max<uint64_t>(stats_.max_lag_ns, static_cast<uint64_t>((now - due).count()));
+                    }
+                    next_due += interval;
+                }
+                issue(due);
+            }
+            std::chrono::nanoseconds timeout = k_max_wait;
+            if (open_loop && now < end && sent_at_.size() < options_.pipeline) {
+                timeout = std::clamp<std::chrono::nanoseconds>(next_due - now, std::chrono::nanoseconds(0), k_max_wait);
+            }
+            if (auto r = exchange(timeout); !r) return r;
+            take_replies([&](uint8_t tag) {
+                auto sent = sent_at_.front();
+                auto done = Clock::now();
+                if (sent >= measure_from) record(send_kind_.front(), tag, static_cast<uint64_t>((done - sent).count()));
+                sent_at_.pop_front();
+                send_kind_.pop_front();
+            });
+        }
+        return {};
+    }
+
+private:
+    static constexpr std::chrono::seconds k_drain_timeout{5}; // for the replies still due when the run ends
+    static constexpr std::chrono::milliseconds k_max_wait{100};
+
+    const Options& options_;
+    size_t index_;
+    const ZipfGenerator* zipf_;
+    std::mt19937_64 rng_;
+    std::string value_;
+    std::string key_;
+    std::optional<Socket> socket_;
+    std::vector<uint8_t> out_;
+    size_t out_sent_{0};
+    std::vector<uint8_t> in_;
+    size_t in_used_{0};
+    std::deque<Clock::time_point> sent_at_; // in flight, oldest first: replies come back in order
+    std::deque<bool> send_kind_;            // ... and whether each one is a SET
+    WorkerStats stats_;
+
+    uint64_t next_key() {
+        if (zipf_) return (*zipf_)(rng_);
+        return std::uniform_int_distribution<uint64_t>(0, options_.keys - 1)(rng_);
+    }
+
+    void issue(Clock::time_point due) {
+        key_ = "key:" + std::to_string(next_key());
+        bool set = options_.set_ratio > 0 && std::uniform_real_distribution<double>(0, 1)(rng_) < options_.set_ratio;
+        if (set) {
+            RequestParser::encode(out_, {"set", key_, value_});
+        } else {
+            RequestParser::encode(out_, {"get", key_});
+        }
+        sent_at_.push_back(due);
+        send_kind_.push_back(set);
+    }
+
+    void record(bool set, uint8_t tag, uint64_t ns) {
+        stats_.latency.record(ns);
+        stats_.sum_ns += ns;
+        (set ? stats_.sets : stats_.gets)++;
+        auto type = static_cast<ds::SerializationType>(tag);
+        if (type == ds::SerializationType::Error) {
+            stats_.errors++;
+        } else if (!set) {
+            (type == ds::SerializationType::Nil ? stats_.misses : stats_.hits)++;
+        }
+    }
+
+    // Writes what it can of out_, then waits up to `timeout` (none: until something happens) and reads
+    // whatever has arrived.
+    Result<void> exchange(std::optional<std::chrono::nanoseconds> timeout) {
+        int fd = socket_->get();
+        while (out_sent_ < out_.size()) {
+            ssize_t n = ::send(fd, out_.data() + out_sent_, out_.size() - out_sent_, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n <= 0) return std::unexpected(last_error());
+            out_sent_ += static_cast<size_t>(n);
+        }
+        if (out_sent_ == out_.size()) {
+            out_.clear();
+            out_sent_ = 0;
+        }
+        pollfd pfd{fd, static_cast<short>(POLLIN | (out_.empty() ? 0 : POLLOUT)), 0};
+        // ppoll, not poll: an open-loop schedule runs in microseconds, and poll would round each wait up to 1ms.
+        timespec ts{};
+        if (timeout) {
+            ts.tv_sec = static_cast<time_t>(timeout->count() / 1'000'000'000);
+            ts.tv_nsec = static_cast<long>(timeout->count() % 1'000'000'000);
+        }
+        if (::ppoll(&pfd, 1, timeout ? &ts : nullptr, nullptr) < 0 && errno != EINTR) return std::unexpected(last_error());
+        if (!(pfd.revents & (POLLIN | POLLERR | POLLHUP))) return {};
+        while (true) {
+            if (in_.size() - in_used_ < 64 * 1024) in_.resize(in_used_ + 64 * 1024);
+            ssize_t n = ::recv(fd, in_.data() + in_used_, in_.size() - in_used_, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return {};
+            if (n == 0) return std::unexpected(std::make_error_code(std::errc::connection_reset));
+            if (n < 0) return std::unexpected(last_error());
+            in_used_ += static_cast<size_t>(n);
+        }
+    }
+
+    // Hands each complete reply's tag to `fn`, drops the replies, and returns how many there were.
+    template<typename Fn>
+    size_t take_replies(Fn&& fn) {
+        size_t pos = 0;
+        size_t count = 0;
+        while (size_t n = ResponseSerializer::reply_length(std::span<const uint8_t>(in_.data() + pos, in_used_ - pos))) {
+            fn(in_[pos]);
+            pos += n;
+            ++count;
+        }
+        if (pos > 0) {
+            std::memmove(in_.data(), in_.data() + pos, in_used_ - pos);
+            in_used_ -= pos;
+        }
+        return count;
+    }
+
+    static std::error_code last_error() { return std::error_code(errno, std::system_category()); }
+};
+
+// HdrHistogram's copyCorrectedForCoordinatedOmission: a sample of v at expected interval i also stands for
+// the requests that would have been sent during it and waited v - i, v - 2i, ... down to i.
+void add_corrected(LatencyHistogram& out, const LatencyHistogram& in, uint64_t interval_ns) {
+    for (size_t bucket = 0; bucket < LatencyHistogram::k_buckets; ++bucket) {
+        uint64_t count = in.count_at(bucket);
+        if (count == 0) continue;
+        uint64_t value = std::min(LatencyHistogram::highest_in(bucket), in.max());
+        out.record(value, count);
+        if (interval_ns == 0 || value < interval_ns * 2) continue;
+        for (uint64_t missed = value - interval_ns; missed >= interval_ns; missed -= interval_ns) out.record(missed, count);
+    }
+}
+
+void print_latency(const char* label, const LatencySummary& summary) {
+    auto us = [&summary](double q) { return static_cast<double>(summary.percentile(q)) / 1000.0; };
+    std::printf("%-22s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", label, us(0.5), us(0.9), us(0.99), us(0.999),
+                us(0.9999), static_cast<double>(summary.max()) / 1000.0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    auto parsed = parse_options(argc, argv);
+    if (!parsed) {
+        usage();
+        return 2;
+    }
+    const Options& options = *parsed;
+
+    std::optional<ZipfGenerator> zipf;
+    if (options.dist == Distribution::Zipf) zipf.emplace(options.keys, options.zipf_theta);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t i = 0; i < options.connections; ++i) {
+        workers.push_back(std::make_unique<Worker>(options, i, zipf ? &*zipf : nullptr));
+    }
+
+    std::atomic<bool> failed{false};
+    auto run_all = [&](auto&& body) {
+        std::vector<std::jthread> threads;
+        for (auto& worker : workers) {
+            threads.emplace_back([&, w = worker.get()] {
+                if (auto r = body(*w); !r) {
+                    std::fprintf(stderr, "kvbench: %s:%u: %s\n", options.host.c_str(), options.port, r.error().message().c_str());
+                    failed.store(true);
+                }
+            });
+        }
+    };
+
+    run_all([](Worker& w) { return w.connect(); });
+    if (failed) return 1;
+    if (options.preload) {
+        run_all([](Worker& w) { return w.preload(); });
+        if (failed) return 1;
+    }
+
+    auto start = Clock::now();
+    auto measure_from = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.warmup_s));
+    auto end = measure_from + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration_s));
+    run_all([&](Worker& w) { return w.run(start, measure_from, end); });
+    if (failed) return 1;
+
+    WorkerStats total;
+    LatencySummary measured;
+    for (auto& worker : workers) {
+        const WorkerStats& s = worker->stats();
+        measured.add(s.latency);
+        total.sum_ns += s.sum_ns;
+        total.gets += s.gets;
+        total.sets += s.sets;
+        total.hits += s.hits;
+        total.misses += s.misses;
+        total.errors += s.errors;
+        total.max_lag_ns = std::max(total.max_lag_ns, s.max_lag_ns);
+    }
+    uint64_t ops = total.gets + total.sets;
+
+    std::printf("%zu connections, pipeline %zu, %s, %s over %llu keys, %.0f%% SET, %zu-byte values\n",
+                options.connections, options.pipeline, options.rate > 0 ? "open loop" : "closed loop",
+                options.dist == Distribution::Zipf ? "zipf" : "uniform", static_cast<unsigned long long>(options.keys),
+                options.set_ratio * 100, options.value_size);
+    std::printf("throughput: %.0f ops/s", static_cast<double>(ops) / options.duration_s);
+    if (options.rate > 0) std::printf(" (target %.0f, max schedule lag %.1f ms)", options.rate, static_cast<double>(total.max_lag_ns) / 1e6);
+    std::printf("\nrequests: %llu GET (%llu hit, %llu miss), %llu SET, %llu errors\n",
+                static_cast<unsigned long long>(total.gets), static_cast<unsigned long long>(total.hits),
+                static_cast<unsigned long long>(total.misses), static_cast<unsigned long long>(total.sets),
+                static_cast<unsigned long long>(total.errors));
+    if (ops == 0) return 1;
+
+    std::printf("%-22s %10s %10s %10s %10s %10s %10s\n", "latency (us)", "p50", "p90", "p99", "p99.9", "p99.99", "max");
+    if (options.rate > 0) {
+        print_latency("from schedule", measured);
+    } else {
+        // Each of the connections x pipeline slots sends once per reply, so the mean latency is its interval.
+        uint64_t interval_ns = total.sum_ns / ops;
+        LatencySummary corrected;
+        for (auto& worker : workers) {
+            auto histogram = std::make_unique<LatencyHistogram>();
+            add_corrected(*histogram, worker->stats().latency, interval_ns);
+            corrected.add(*histogram);
+        }
+        print_latency("measured", measured);
+        print_latency("corrected (CO)", corrected);
+    }
+    return total.errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,468 @@
+#ifndef BTREE_HPP
+#define BTREE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace ds {
+
+// Order-statistic B+tree over small trivially-copyable items, ordered by Less (a stateless functor).
+// Leaves hold up to LeafCap items inline and are doubly linked, so a range scan is a sequential walk over
+// wide arrays instead of one pointer hop per element. Inner nodes keep, per child, the child's smallest item
+// (the separator) and how many items sit below it (the weight) - weights make rank/select O(log n) with a
+// branching factor of InnerCap rather than 2.
+// Separators are always the exact minimum of their child: that keeps routing simple and means a separator
+// never refers to an item that has been erased (items may point at memory the caller frees afterwards).
+// Items must be unique under Less.
+
+template<typename T, typename Less, size_t LeafCap = 64, size_t InnerCap = 32>
+class BPlusTree {
+    static_assert(LeafCap >= 4 && InnerCap >= 4);
+
+    struct NodeBase {
+        uint16_t count{0};
+        bool leaf;
+        explicit NodeBase(bool is_leaf) noexcept : leaf(is_leaf) {}
+    };
+
+public:
+    struct Leaf : NodeBase {
+        Leaf() noexcept : NodeBase(true) {}
+        Leaf* prev{nullptr};
+        Leaf* next{nullptr};
+        T items[LeafCap];
+    };
+
+    // A slot in a leaf; what cursors walk with.
+    struct Position {
+        Leaf* leaf{nullptr};
+        uint32_t index{0};
+
+        [[nodiscard]] bool valid() const noexcept { return leaf != nullptr; }
+        [[nodiscard]] const T& get() const noexcept { return leaf->items[index]; }
+        void advance() noexcept {
+            if (++index >= leaf->count) {
+                leaf = leaf->next;
+                index = 0;
+            }
+        }
+    };
+
+    BPlusTree() = default;
+    ~BPlusTree() { clear(); }
+
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+
+    BPlusTree(BPlusTree&& other) noexcept
+        : root_(std::exchange(other.root_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+    BPlusTree& operator=(BPlusTree&& other) noexcept {
+        if (this != &other) {
+            clear();
+            root_ = std::exchange(other.root_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    [[nodiscard]] uint64_t size() const noexcept { return size_; }
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+
+    void insert(const T& item) {
+        if (!root_) {
+            root_ = new Leaf();
+        }
+        if (auto split = insert_into(root_, item)) {
+            auto* root = new Inner();
+            root->count = 2;
+            root->seps[0] = min_of(root_);
+            root->child[0] = root_;
+            root->weight[0] = size_ + 1 - split->weight;
+            root->seps[1] = split->sep;
+            root->child[1] = split->right;
+            root->weight[1] = split->weight;
+            root_ = root;
+        }
+        size_++;
+    }
+
+    // Replaces the contents with `n` items that next() returns in strictly ascending order. O(n): leaves are
+    // filled left to right to about 3/4 (room for later inserts before the first split) and each inner level
+    // is built over the one below, with no comparisons and no splits.
+    template<typename Next>
+    void assign_sorted(uint64_t n, Next&& next) {
+        clear();
+        if (n == 0) return;
+        std::vector<NodeBase*> level;
+        std::vector<uint64_t> weights;
+        Leaf* prev = nullptr;
+        uint64_t leaves = (n + k_bulk_leaf - 1) / k_bulk_leaf;
+        for (uint64_t i = 0; i < leaves; ++i) {
+            auto* leaf = new Leaf();
+            auto fill = static_cast<uint16_t>(n / leaves + (i < n % leaves ? 1 : 0));
+            for (uint16_t k = 0; k < fill; ++k) leaf->items[k] = next();
+            leaf->count = fill;
+            leaf->prev = prev;
+            if (prev) prev->next = leaf;
+            prev = leaf;
+            level.push_back(leaf);
+            weights.push_back(fill);
+        }
+        while (level.size() > 1) {
+            std::vector<NodeBase*> up;
+            std::vector<uint64_t> up_weights;
+            size_t parents = (level.size() + k_bulk_inner - 1) / k_bulk_inner;
+            size_t child = 0;
+            for (size_t i = 0; i < parents; ++i) {
+                auto* inner = new Inner();
+                size_t fill = level.size() / parents + (i < level.size() % parents ? 1 : 0);
+                uint64_t total = 0;
+                for (size_t k = 0; k < fill; ++k, ++child) {
+                    inner->seps[k] = min_of(level[child]);
+                    inner->child[k] = level[child];
+                    inner->weight[k] = weights[child];
+                    total += weights[child];
+                }
+                inner->count = static_cast<uint16_t>(fill);
+                up.push_back(inner);
+                up_weights.push_back(total);
+            }
+            level = std::move(up);
+            weights = std::move(up_weights);
+        }
+        root_ = level.front();
+        size_ = n;
+    }
+
+    // Returns false if no equal item exists.
+    bool erase(const T& item) {
+        if (!root_ || !erase_from(root_, item)) {
+            return false;
+        }
+        size_--;
+        if (root_->count == 0) {
+            free_node(root_);
+            root_ = nullptr;
+        } else {
+            while (!root_->leaf && root_->count == 1) {
+                auto* old = static_cast<Inner*>(root_);
+                root_ = old->child[0];
+                delete old;
+            }
+        }
+        return true;
+    }
+
+    // How many items satisfy before(item); before must hold for a prefix of the order.
+    template<typename Before>
+    [[nodiscard]] uint64_t count_before(Before&& before) const {
+        uint64_t count = 0;
+        const NodeBase* node = root_;
+        while (node && !node->leaf) {
+            auto* inner = static_cast<const Inner*>(node);
+            size_t i = 0;
+            while (i + 1 < inner->count && before(inner->seps[i + 1])) {
+                count += inner->weight[i];
+                ++i;
+            }
+            node = inner->child[i];
+        }
+        if (node) {
+            auto* leaf = static_cast<const Leaf*>(node);
+            const T* end = leaf->items + leaf->count;
+            count += static_cast<uint64_t>(std::partition_point(leaf->items, end, before) - leaf->items);
+        }
+        return count;
+    }
+
+    // Position of the item at 0-based `rank`; invalid past the end.
+    [[nodiscard]] Position at(uint64_t rank) const noexcept {
+        if (rank >= size_) return {};
+        NodeBase* node = root_;
+        while (!node->leaf) {
+            auto* inner = static_cast<Inner*>(node);
+            size_t i = 0;
+            while (rank >= inner->weight[i]) {
+                rank -= inner->weight[i];
+                ++i;
+            }
+            node = inner->child[i];
+        }
+        return {static_cast<Leaf*>(node), static_cast<uint32_t>(rank)};
+    }
+
+    // Rank of an item that compares equal to `item` (the item must be present).
+    [[nodiscard]] uint64_t rank_of(const T& item) const {
+        return count_before([&](const T& x) { return Less{}(x, item); });
+    }
+
+    [[nodiscard]] Position begin() const noexcept { return at(0); }
+
+    void clear() noexcept {
+        if (root_) {
+            destroy(root_);
+            root_ = nullptr;
+        }
+        size_ = 0;
+    }
+
+    // Rough footprint of the nodes, for memory accounting.
+    [[nodiscard]] size_t node_bytes() const noexcept { return root_ ? bytes_of(root_) : 0; }
+
+private:
+    struct Inner : NodeBase {
+        Inner() noexcept : NodeBase(false) {}
+        T seps[InnerCap];
+        NodeBase* child[InnerCap];
+        uint64_t weight[InnerCap];
+    };
+
+    struct Split {
+        NodeBase* right;
+        T sep;
+        uint64_t weight;
+    };
+
+    static constexpr size_t k_bulk_leaf = LeafCap * 3 / 4;
+    static constexpr size_t k_bulk_inner = InnerCap * 3 / 4;
+
+    NodeBase* root_{nullptr};
+    uint64_t size_{0};
+
+    static bool less(const T& a, const T& b) { return Less{}(a, b); }
+
+    static const T& min_of(const NodeBase* node) noexcept {
+        while (!node->leaf) node = static_cast<const Inner*>(node)->child[0];
+        return static_cast<const Leaf*>(node)->items[0];
+    }
+
+    static uint64_t weight_of(const NodeBase* node) noexcept {
+        if (node->leaf) return node->count;
+        auto* inner = static_cast<const Inner*>(node);
+        uint64_t w = 0;
+        for (size_t i = 0; i < inner->count; ++i) w += inner->weight[i];
+        return w;
+    }
+
+    // Last child whose separator is <= item (child 0 catches everything smaller).
+    static size_t child_for(const Inner* inner, const T& item) {
+        auto* first = inner->seps + 1;
+        auto* last = inner->seps + inner->count;
+        return static_cast<size_t>(std::upper_bound(first, last, item, [](const T& a, const T& b) { return less(a, b); }) - first);
+    }
+
+    std::optional<Split> insert_into(NodeBase* node, const T& item) {
+        if (node->leaf) {
+            return insert_leaf(static_cast<Leaf*>(node), item);
+        }
+        auto* inner = static_cast<Inner*>(node);
+        size_t i = child_for(inner, item);
+        if (i == 0 && less(item, inner->seps[0])) {
+            inner->seps[0] = item; // new overall minimum of this subtree
+        }
+        inner->weight[i]++;
+        auto split = insert_into(inner->child[i], item);
+        if (!split) {
+            return std::nullopt;
+        }
+        inner->weight[i] -= split->weight;
+        return insert_child(inner, i + 1, *split);
+    }
+
+    static std::optional<Split> insert_leaf(Leaf* leaf, const T& item) {
+        size_t pos = static_cast<size_t>(std::upper_bound(leaf->items, leaf->items + leaf->count, item,
+                                                          [](const T& a, const T& b) { return less(a, b); }) - leaf->items);
+        if (leaf->count < LeafCap) {
+            std::copy_backward(leaf->items + pos, leaf->items + leaf->count, leaf->items + leaf->count + 1);
+            leaf->items[pos] = item;
+            leaf->count++;
+            return std::nullopt;
+        }
+        // Full: move the upper half into a new right sibling, then insert into whichever half owns pos.
+        auto* right = new Leaf();
+        size_t half = LeafCap / 2;
+        std::copy(leaf->items + half, leaf->items + LeafCap, right->items);
+        right->count = static_cast<uint16_t>(LeafCap - half);
+        leaf->count = static_cast<uint16_t>(half);
+        right->next = leaf->next;
+        right->prev = leaf;
+        if (leaf->next) leaf->next->prev = right;
+        leaf->next = right;
+
+        Leaf* target = pos <= half ? leaf : right;
+        size_t at = pos <= half ? pos : pos - half;
+        std::copy_backward(target->items + at, target->items + target->count, target->items + target->count + 1);
+        target->items[at] = item;
+        target->count++;
+        return Split{right, right->items[0], right->count};
+    }
+
+    // Put split.right at index `pos` of inner, splitting inner itself if it's full.
+    static std::optional<Split> insert_child(Inner* inner, size_t pos, const Split& split) {
+        auto place = [](Inner* n, size_t at, const Split& s) {
+            std::copy_backward(n->seps + at, n->seps + n->count, n->seps + n->count + 1);
+            std::copy_backward(n->child + at, n->child + n->count, n->child + n->count + 1);
+            std::copy_backward(n->weight + at, n->weight + n->count, n->weight + n->count + 1);
+            n->seps[at] = s.sep;
+            n->child[at] = s.right;
+            n->weight[at] = s.weight;
+            n->count++;
+        };
+        if (inner->count < InnerCap) {
+            place(inner, pos, split);
+            return std::nullopt;
+        }
+        auto* right = new Inner();
+        size_t half = InnerCap / 2;
+        std::copy(inner->seps + half, inner->seps + InnerCap, right->seps);
+        std::copy(inner->child + half, inner->child + InnerCap, right->child);
+        std::copy(inner->weight + half, inner->weight + InnerCap, right->weight);
+        right->count = static_cast<uint16_t>(InnerCap - half);
+        inner->count = static_cast<uint16_t>(half);
+        if (pos <= half) {
+            place(inner, pos, split);
+        } else {
+            place(right, pos - half, split);
+        }
+        return Split{right, right->seps[0], weight_of(right)};
+    }
+
+    // Erase from the subtree; afterwards merge the touched child into a neighbour if it got sparse.
+    bool erase_from(NodeBase* node, const T& item) {
+        if (node->leaf) {
+            auto* leaf = static_cast<Leaf*>(node);
+            T* end = leaf->items + leaf->count;
+            T* it = std::lower_bound(leaf->items, end, item, [](const T& a, const T& b) { return less(a, b); });
+            if (it == end || less(item, *it)) {
+                return false;
+            }
+            std::copy(it + 1, end, it);
+            leaf->count--;
+            return true;
+        }
+        auto* inner = static_cast<Inner*>(node);
+        size_t i = child_for(inner, item);
+        bool was_min = !less(inner->seps[i], item); // seps[i] <= item always, so this means equal
+        if (!erase_from(inner->child[i], item)) {
+            return false;
+        }
+        inner->weight[i]--;
+        NodeBase* child = inner->child[i];
+        if (child->count == 0) {
+            // Only reachable when child was our sole child or couldn't be merged yet: drop it outright so no
+            // empty node ever stays in the tree (min_of and the leaf chain rely on that).
+            if (child->leaf) unlink_leaf(static_cast<Leaf*>(child));
+            free_node(child);
+            remove_slot(inner, i);
+            return true;
+        }
+        if (was_min) {
+            inner->seps[i] = min_of(child);
+        }
+        if (child->count < min_fill(child) && inner->count > 1) {
+            rebalance(inner, i);
+        }
+        return true;
+    }
+
+    static size_t min_fill(const NodeBase* node) noexcept { return (node->leaf ? LeafCap : InnerCap) / 4; }
+    static size_t capacity(const NodeBase* node) noexcept { return node->leaf ? LeafCap : InnerCap; }
+
+    // Merge child i with a neighbour when both fit in one node; otherwise leave it (it's still valid, just sparse).
+    static void rebalance(Inner* inner, size_t i) {
+        size_t left = i > 0 ? i - 1 : i;
+        size_t right = left + 1;
+        if (right >= inner->count) return;
+        NodeBase* l = inner->child[left];
+        NodeBase* r = inner->child[right];
+        if (static_cast<size_t>(l->count) + r->count > capacity(l)) return;
+
+        if (l->leaf) {
+            auto* ll = static_cast<Leaf*>(l);
+            auto* rl = static_cast<Leaf*>(r);
+            std::copy(rl->items, rl->items + rl->count, ll->items + ll->count);
+            ll->count = static_cast<uint16_t>(ll->count + rl->count);
+            ll->next = rl->next;
+            if (rl->next) rl->next->prev = ll;
+            delete rl;
+        } else {
+            auto* li = static_cast<Inner*>(l);
+            auto* ri = static_cast<Inner*>(r);
+            std::copy(ri->seps, ri->seps + ri->count, li->seps + li->count);
+            std::copy(ri->child, ri->child + ri->count, li->child + li->count);
+            std::copy(ri->weight, ri->weight + ri->count, li->weight + li->count);
+            li->count = static_cast<uint16_t>(li->count + ri->count);
+            delete ri;
+        }
+        inner->weight[left] += inner->weight[right];
+        remove_slot(inner, right);
+    }
+
+    static void remove_slot(Inner* inner, size_t i) noexcept {
+        std::copy(inner->seps + i + 1, inner->seps + inner->count, inner->seps + i);
+        std::copy(inner->child + i + 1, inner->child + inner->count, inner->child + i);
+        std::copy(inner->weight + i + 1, inner->weight + inner->count, inner->weight + i);
+        inner->count--;
+    }
+
+    static void unlink_leaf(Leaf* leaf) noexcept {
+        if (leaf->prev) leaf->prev->next = leaf->next;
+        if (leaf->next) leaf->next->prev = leaf->prev;
+    }
+
+    static void free_node(NodeBase* node) noexcept {
+        if (node->leaf) delete static_cast<Leaf*>(node);
+        else delete static_cast<Inner*>(node);
+    }
+
+    // Iterative-enough: depth is log_InnerCap(n), so recursion here is a handful of frames.
+    // Deepest possible tree: every non-root inner node has at least two children, so 64 levels would
+    // already hold more items than fit in memory.
+    static constexpr size_t k_max_depth = 64;
+
+    // Post-order teardown with an explicit stack, so freeing a huge tree costs no recursion.
+    static void destroy(NodeBase* root) noexcept {
+        struct Frame {
+            Inner* node;
+            size_t next;
+        };
+        Frame stack[k_max_depth];
+        size_t depth = 0;
+        NodeBase* node = root;
+        while (true) {
+            if (node->leaf) {
+                free_node(node);
+            } else {
+                stack[depth++] = {static_cast<Inner*>(node), 0};
+            }
+            node = nullptr;
+            while (depth > 0) {
+                Frame& top = stack[depth - 1];
+                if (top.next < top.node->count) {
+                    node = top.node->child[top.next++];
+                    break;
+                }
+                free_node(top.node);
+                depth--;
+            }
+            if (!node) return;
+        }
+    }
+
+    static size_t bytes_of(const NodeBase* node) noexcept {
+        if (node->leaf) return sizeof(Leaf);
+        auto* inner = static_cast<const Inner*>(node);
+        size_t total = sizeof(Inner);
+        for (size_t i = 0; i < inner->count; ++i) total += bytes_of(inner->child[i]);
+        return total;
+    }
+};
+
+} // namespace ds
+
+#endif // BTREE_HPP
@@ -0,0 +1,84 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ds {
+
+struct BufferPoolStats {
+    size_t acquired{0};    // buffers handed out so far
+    size_t reused{0};      // ... of which came off the free list rather than the allocator
+    size_t idle{0};        // buffers on the free list now
+    size_t idle_bytes{0};  // ... and their capacity
+    size_t dropped{0};     // returned buffers freed instead of kept: oversized, or the list was full
+};
+
+// Recycled I/O buffers for one reactor's connections. A connection holds its read and write buffers only
+// while it has bytes in them and hands them back when it goes idle, so memory follows the connections that
+// are busy right now rather than every one that is open - and short-lived connections reuse buffers
+// instead of allocating fresh ones.
+//
+// Every buffer starts at k_chunk_size capacity. One that had to grow past k_max_pooled for a large request
+// or reply is freed when returned, so the pool never keeps what one outsized payload needed. At most
+// `max_idle` buffers are kept. Owned by one reactor thread: no locking.
+class BufferPool {
+public:
+    static constexpr size_t k_chunk_size = 16 * 1024;
+    static constexpr size_t k_max_pooled = 4 * k_chunk_size;
+
+    explicit BufferPool(size_t max_idle = 1024) : max_idle_(max_idle) {}
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Capacity of at least k_chunk_size; size and contents are whatever the last user left.
+    [[nodiscard]] std::vector<uint8_t> acquire() {
+        stats_.acquired++;
+        if (free_.empty()) {
+            std::vector<uint8_t> buf;
+            buf.reserve(k_chunk_size);
+            return buf;
+        }
+        stats_.reused++;
+        std::vector<uint8_t> buf = std::move(free_.back());
+        free_.pop_back();
+        stats_.idle_bytes -= buf.capacity();
+        return buf;
+    }
+
+    void release(std::vector<uint8_t>&& buf) {
+        if (buf.capacity() < k_chunk_size) return; // never came from here (or was taken apart)
+        if (buf.capacity() > k_max_pooled || free_.size() >= max_idle_) {
+            stats_.dropped++;
+            std::vector<uint8_t>().swap(buf);
+            return;
+        }
+        stats_.idle_bytes += buf.capacity();
+        free_.push_back(std::move(buf));
+    }
+
+    // Gives the idle buffers back to the allocator, e.g. after a burst of connections has gone.
+    void trim() {
+        free_.clear();
+        free_.shrink_to_fit();
+        stats_.idle_bytes = 0;
+    }
+
+    [[nodiscard]] BufferPoolStats stats() const noexcept {
+        BufferPoolStats s = stats_;
+        s.idle = free_.size();
+        return s;
+    }
+
+private:
+    size_t max_idle_;
+    std::vector<std::vector<uint8_t>> free_;
+    BufferPoolStats stats_;
+};
+
+} // namespace ds
+
+#endif // BUFFER_POOL_HPP
@@ -0,0 +1,8 @@
+// Compile check: instantiates every member of the keyspace for each hash and expiry backend, so a change
+// that only works with the default HMap/WheelTtl pair fails the build instead of lying dormant.
+#include "include/keyspace.hpp"
+
+template class BasicKeyspace<HMap, WheelTtl>;
+template class BasicKeyspace<HMap, HeapTtl>;
+template class BasicKeyspace<FlatHMap, WheelTtl>;
+template class BasicKeyspace<FlatHMap, HeapTtl>;
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <string>
 #include <string_view>
 #include <type_traits>
 
@@ -21,15 +23,14 @@ Parent* container_of(Member* ptr, std::size_t offset) {
     return reinterpret_cast<Parent*>(reinterpret_cast<char*>(ptr) - offset);
 }
 
-#include <string>
-#include <type_traits>
-
+// Wire tags - the first byte of every serialized value.
 enum class SerializationType : uint8_t {
     Nil     = 0,
     Error   = 1,
     String  = 2,
     Integer = 3,
-    Double  = 4
+    Double  = 4,
+    Array   = 5
 };
 
 template<typename T>
@@ -45,4 +46,4 @@ constexpr SerializationType get_serialization_type() {
     }
 }
 
-} // namespece ds
\ No newline at end of file
+} // namespece ds
@@ -0,0 +1,492 @@
+#ifndef FLAT_HASH_TABLE_HPP
+#define FLAT_HASH_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <bit>
+#include <cassert>
+#include <utility>
+#include <chrono>
+#include <algorithm>
+#include "hashtable.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Swiss-table style open addressing, as a drop-in alternative to HMap for hot keyspaces.
+// Layout: three flat arrays indexed by slot - one control byte, the full 64-bit hash, and the element pointer.
+//   ctrl_   : EMPTY / DELETED / or the low 7 bits of the hash ("h2") for a full slot
+//   hashes_ : full hash code, so a 7-bit false positive is rejected without dereferencing the element
+//   slots_  : owning pointer to the element
+// Slots are probed 16 at a time: one SIMD compare of a 16-byte control group against h2 yields a bitmask of
+// candidates, so a lookup usually touches one control line, one hash line and then the element itself -
+// instead of one dependent pointer chase per chained node in HTable.
+// Elements still derive from HNode<T> (we read hcode() from it) so the same types work with either backend;
+// the chain link inside HNode simply goes unused here.
+
+namespace flat_detail {
+
+inline constexpr size_t k_group_width = 16;
+inline constexpr int8_t k_empty = static_cast<int8_t>(0x80);   // -128
+inline constexpr int8_t k_deleted = static_cast<int8_t>(0xFE); // -2, tombstone
+
+// Iterates set bits of a match mask. On NEON each byte lane contributes a nibble, hence Shift.
+template<int Shift>
+class BitMask {
+public:
+    explicit BitMask(uint64_t bits) noexcept : bits_(bits) {}
+    explicit operator bool() const noexcept { return bits_ != 0; }
+    [[nodiscard]] size_t lowest() const noexcept { return static_cast<size_t>(std::countr_zero(bits_)) >> Shift; }
+    void clear_lowest() noexcept { bits_ &= bits_ - 1; }
+
+private:
+    uint64_t bits_;
+};
+
+// One 16-byte control group loaded into a register.
+class Group {
+public:
+#if defined(__SSE2__)
+    using Mask = BitMask<0>;
+    explicit Group(const int8_t* ctrl) noexcept : v_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+    [[nodiscard]] Mask match(int8_t h2) const noexcept {
+        return Mask(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v_, _mm_set1_epi8(h2)))));
+    }
+    [[nodiscard]] Mask match_empty() const noexcept { return match(k_empty); }
+    // EMPTY and DELETED are the only negative control values, so the sign bit alone finds both.
+    [[nodiscard]] Mask match_empty_or_deleted() const noexcept {
+        return Mask(static_cast<uint32_t>(_mm_movemask_epi8(v_)));
+    }
+
+private:
+    __m128i v_;
+#elif defined(__ARM_NEON)
+    using Mask = BitMask<2>;
+    explicit Group(const int8_t* ctrl) noexcept : v_(vld1q_s8(ctrl)) {}
+
+    [[nodiscard]] Mask match(int8_t h2) const noexcept { return to_mask(vceqq_s8(v_, vdupq_n_s8(h2))); }
+    [[nodiscard]] Mask match_empty() const noexcept { return match(k_empty); }
+    [[nodiscard]] Mask match_empty_or_deleted() const noexcept { return to_mask(vcltzq_s8(v_)); }
+
+private:
+    int8x16_t v_;
+
+    // Narrow each 0x00/0xFF byte lane to a nibble, then keep one bit per nibble so clear_lowest() works.
+    static Mask to_mask(uint8x16_t cmp) noexcept {
+        uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4);
+        return Mask(vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & 0x8888888888888888ull);
+    }
+#else
+    using Mask = BitMask<0>;
+    explicit Group(const int8_t* ctrl) noexcept { std::memcpy(bytes_, ctrl, k_group_width); }
+
+    [[nodiscard]] Mask match(int8_t h2) const noexcept {
+        uint64_t bits = 0;
+        for (size_t i = 0; i < k_group_width; ++i) bits |= static_cast<uint64_t>(bytes_[i] == h2) << i;
+        return Mask(bits);
+    }
+    [[nodiscard]] Mask match_empty() const noexcept { return match(k_empty); }
+    [[nodiscard]] Mask match_empty_or_deleted() const noexcept {
+        uint64_t bits = 0;
+        for (size_t i = 0; i < k_group_width; ++i) bits |= static_cast<uint64_t>(bytes_[i] < 0) << i;
+        return Mask(bits);
+    }
+
+private:
+    int8_t bytes_[k_group_width];
+#endif
+};
+
+[[nodiscard]] inline size_t h1(uint64_t hcode) noexcept { return static_cast<size_t>(hcode >> 7); }
+[[nodiscard]] inline int8_t h2(uint64_t hcode) noexcept { return static_cast<int8_t>(hcode & 0x7F); }
+
+} // namespace flat_detail
+
+template<typename T>
+class FlatTable {
+public:
+    explicit FlatTable(size_t capacity = 0) {
+        if (capacity > 0) {
+            initialize(std::max(std::bit_ceil(capacity), flat_detail::k_group_width));
+        }
+    }
+    ~FlatTable() { clear(); }
+
+    FlatTable(const FlatTable&) = delete;
+    FlatTable& operator=(const FlatTable&) = delete;
+
+    FlatTable(FlatTable&& other) noexcept { swap(other); }
+    FlatTable& operator=(FlatTable&& other) noexcept {
+        if (this != &other) {
+            clear();
+            release();
+            swap(other);
+        }
+        return *this;
+    }
+
+    // Caller guarantees the key isn't already present (same contract as HTable::insert) and that
+    // has_room() is true.
+    void insert(std::unique_ptr<T> node) {
+        uint64_t hcode = node->hcode();
+        size_t slot = find_free_slot(hcode);
+        growth_left_ -= (ctrl_[slot] == flat_detail::k_empty) ? 1 : 0;
+        set_ctrl(slot, flat_detail::h2(hcode));
+        hashes_[slot] = hcode;
+        slots_[slot] = node.release();
+        size_++;
+    }
+
+    template<typename Eq>
+    T* lookup(std::uint64_t hcode, Eq&& eq) const {
+        auto slot = find_slot(hcode, eq);
+        return slot ? slots_[*slot] : nullptr;
+    }
+
+    // The first probe group's control bytes and hashes, which find_slot() reads before anything else.
+    void prefetch(std::uint64_t hcode) const noexcept {
+        if (capacity_ == 0) return;
+        size_t base = (flat_detail::h1(hcode) & group_mask()) * flat_detail::k_group_width;
+        __builtin_prefetch(ctrl_.get() + base);
+        __builtin_prefetch(&hashes_[base]);
+    }
+
+    // Every element whose home group - where its probe sequence starts - is `group`. They all sit on the probe
+    // sequence from there up to its first group with an EMPTY slot, which is as far as find_slot() looks.
+    template<typename Fn>
+    void for_each_homed_at(size_t group, Fn& fn) const {
+        if (capacity_ == 0) return;
+        const size_t home = group;
+        for (size_t step = 1; ; ++step) {
+            const size_t base = group * flat_detail::k_group_width;
+            for (size_t slot = base; slot < base + flat_detail::k_group_width; ++slot) {
+                if (ctrl_[slot] >= 0 && (flat_detail::h1(hashes_[slot]) & group_mask()) == home) fn(*slots_[slot]);
+            }
+            if (flat_detail::Group(ctrl_.get() + base).match_empty()) return;
+            if (step > group_mask()) return;
+            group = (group + step) & group_mask();
+        }
+    }
+
+    template<typename Eq>
+    std::unique_ptr<T> remove(std::uint64_t hcode, Eq&& eq) {
+        auto slot = find_slot(hcode, eq);
+        if (!slot) return nullptr;
+        return take(*slot);
+    }
+
+    template<typename Fn>
+    void for_each(Fn&& fn) const {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (ctrl_[i] >= 0) fn(*slots_[i]);
+        }
+    }
+
+    void clear() noexcept {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (ctrl_[i] >= 0) {
+                delete slots_[i];
+                ctrl_[i] = flat_detail::k_empty;
+            } else if (ctrl_[i] == flat_detail::k_deleted) {
+                ctrl_[i] = flat_detail::k_empty;
+            }
+        }
+        size_ = 0;
+        growth_left_ = max_load(capacity_);
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+    [[nodiscard]] size_t capacity() const noexcept { return capacity_; }
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+    [[nodiscard]] bool has_room() const noexcept { return growth_left_ > 0; }
+    // Non-zero capacity but nothing left to grow into, and at least half of the used slots are tombstones:
+    // rehashing in place will recover the space without doubling.
+    [[nodiscard]] bool mostly_tombstones() const noexcept {
+        return capacity_ > 0 && (max_load(capacity_) - growth_left_) >= 2 * size_;
+    }
+
+private:
+    std::unique_ptr<int8_t[]> ctrl_;
+    std::unique_ptr<std::uint64_t[]> hashes_;
+    std::unique_ptr<T*[]> slots_;
+    size_t capacity_{0};
+    size_t size_{0};
+    size_t growth_left_{0};
+
+    // 7/8 max load, counting tombstones - probe sequences stay short and always terminate at an EMPTY.
+    static constexpr size_t max_load(size_t capacity) noexcept { return capacity - capacity / 8; }
+
+    void initialize(size_t capacity) {
+        assert(std::has_single_bit(capacity) && capacity >= flat_detail::k_group_width);
+        ctrl_ = std::make_unique<int8_t[]>(capacity);
+        std::memset(ctrl_.get(), flat_detail::k_empty, capacity);
+        hashes_ = std::make_unique<std::uint64_t[]>(capacity);
+        slots_ = std::make_unique<T*[]>(capacity);
+        capacity_ = capacity;
+        size_ = 0;
+        growth_left_ = max_load(capacity);
+    }
+
+    void release() noexcept {
+        ctrl_.reset();
+        hashes_.reset();
+        slots_.reset();
+        capacity_ = size_ = growth_left_ = 0;
+    }
+
+    void swap(FlatTable& other) noexcept {
+        std::swap(ctrl_, other.ctrl_);
+        std::swap(hashes_, other.hashes_);
+        std::swap(slots_, other.slots_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(size_, other.size_);
+        std::swap(growth_left_, other.growth_left_);
+    }
+
+    void set_ctrl(size_t slot, int8_t value) noexcept { ctrl_[slot] = value; }
+
+    // Triangular probing over whole groups: visits every group exactly once for power-of-two group counts.
+    [[nodiscard]] size_t group_mask() const noexcept { return capacity_ / flat_detail::k_group_width - 1; }
+
+    template<typename Eq>
+    std::optional<size_t> find_slot(std::uint64_t hcode, Eq& eq) const {
+        if (capacity_ == 0) return std::nullopt;
+        const int8_t tag = flat_detail::h2(hcode);
+        size_t group = flat_detail::h1(hcode) & group_mask();
+        for (size_t step = 1; ; ++step) {
+            const size_t base = group * flat_detail::k_group_width;
+            flat_detail::Group g(ctrl_.get() + base);
+            for (auto m = g.match(tag); m; m.clear_lowest()) {
+                size_t slot = base + m.lowest();
+                if (hashes_[slot] == hcode && eq(*slots_[slot])) return slot;
+            }
+            if (g.match_empty()) return std::nullopt; // an EMPTY means the key was never pushed further
+            if (step > group_mask()) return std::nullopt;
+            group = (group + step) & group_mask();
+        }
+    }
+
+    size_t find_free_slot(std::uint64_t hcode) const {
+        size_t group = flat_detail::h1(hcode) & group_mask();
+        for (size_t step = 1; ; ++step) {
+            const size_t base = group * flat_detail::k_group_width;
+            flat_detail::Group g(ctrl_.get() + base);
+            if (auto m = g.match_empty_or_deleted()) return base + m.lowest();
+            group = (group + step) & group_mask();
+        }
+    }
+
+    std::unique_ptr<T> take(size_t slot) {
+        std::unique_ptr<T> node(slots_[slot]);
+        slots_[slot] = nullptr;
+        // If this group still has an EMPTY, no probe sequence can have walked past it, so the slot can go
+        // straight back to EMPTY. Otherwise leave a tombstone so longer probe chains stay intact.
+        const size_t base = slot & ~(flat_detail::k_group_width - 1);
+        if (flat_detail::Group(ctrl_.get() + base).match_empty()) {
+            set_ctrl(slot, flat_detail::k_empty);
+            growth_left_++;
+        } else {
+            set_ctrl(slot, flat_detail::k_deleted);
+        }
+        size_--;
+        return node;
+    }
+
+    template<typename> friend class FlatHMap;
+};
+
+// Same surface as HMap (insert / find / remove / for_each / scan / clear) and the same progressive-resize idea:
+// when the table fills we allocate the doubled table and migrate a bounded number of slots per operation,
+// so no single request pays for an O(n) rehash.
+template<typename T>
+class FlatHMap {
+public:
+    FlatHMap() = default;
+    ~FlatHMap() = default;
+
+    FlatHMap(const FlatHMap&) = delete;
+    FlatHMap& operator=(const FlatHMap&) = delete;
+
+    FlatHMap(FlatHMap&&) noexcept = default;
+    FlatHMap& operator=(FlatHMap&&) noexcept = default;
+
+    void insert(std::unique_ptr<T> node) {
+        if (primary_table_.capacity() == 0) {
+            primary_table_ = FlatTable<T>(k_min_cap);
+        }
+        if (!primary_table_.has_room()) {
+            if (temporary_table_) {
+                finish_resize(); // can only happen under pathological tombstone churn
+            }
+            start_resize();
+        }
+        primary_table_.insert(std::move(node));
+        help_resize();
+    }
+
+    // Same contract as HMap::reserve: room for `n` elements below the 7/8 load limit, no resize while filling.
+    void reserve(size_t n) {
+        if (!empty() || temporary_table_) return;
+        size_t capacity = n + n / 7 + 1;
+        if (capacity > primary_table_.capacity()) primary_table_ = FlatTable<T>(capacity);
+    }
+
+    // Same contract as HMap::prefetch.
+    void prefetch(std::uint64_t hcode) const noexcept {
+        primary_table_.prefetch(hcode);
+        if (temporary_table_) temporary_table_->prefetch(hcode);
+    }
+
+    template<typename Eq>
+    T* find(std::uint64_t hcode, Eq&& eq) {
+        help_resize();
+        if (T* node = primary_table_.lookup(hcode, eq)) {
+            return node;
+        }
+        if (temporary_table_) {
+            return temporary_table_->lookup(hcode, eq);
+        }
+        return nullptr;
+    }
+
+    template<typename Eq>
+    std::unique_ptr<T> remove(std::uint64_t hcode, Eq&& eq) {
+        help_resize();
+        auto node = primary_table_.remove(hcode, eq);
+        if (!node && temporary_table_) {
+            node = temporary_table_->remove(hcode, eq);
+        }
+        if (node) {
+            maybe_shrink();
+        }
+        return node;
+    }
+
+    template<typename Fn>
+    void for_each(Fn&& fn) const {
+        primary_table_.for_each(fn);
+        if (temporary_table_) {
+            temporary_table_->for_each(fn);
+        }
+    }
+
+    // Same contract as HMap::scan. Slots don't work as a cursor here - a resize reinserts every element
+    // wherever its probe finds room - but home groups do: like HTable buckets they are the low bits of the
+    // hash (h1), so a group of the smaller table splits into the groups of the larger one it maps onto.
+    template<typename Fn>
+    size_t scan(size_t cursor, Fn&& fn) const {
+        const FlatTable<T>* small = &primary_table_;
+        const FlatTable<T>* large = temporary_table_ ? &*temporary_table_ : nullptr;
+        if (large && large->capacity() < small->capacity()) std::swap(small, large);
+        if (small->capacity() == 0) return 0;
+
+        size_t m0 = small->group_mask();
+        small->for_each_homed_at(cursor & m0, fn);
+        if (large) {
+            size_t m1 = large->group_mask();
+            do {
+                large->for_each_homed_at(cursor & m1, fn);
+                cursor = (((cursor | m0) + 1) & ~m0) | (cursor & m0);
+            } while (cursor & (m0 ^ m1));
+        }
+        return htable_detail::next_cursor(cursor, m0);
+    }
+
+    void clear() noexcept {
+        primary_table_.clear();
+        temporary_table_.reset();
+        resizing_pos_ = 0;
+        migrated_ = 0;
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return primary_table_.size() + (temporary_table_ ? temporary_table_->size() : 0);
+    }
+    bool empty() const noexcept { return size() == 0; }
+
+    [[nodiscard]] bool resizing() const noexcept { return temporary_table_.has_value(); }
+
+    // Idle-time driver, same contract as HMap::rehash_step.
+    bool rehash_step(std::chrono::nanoseconds budget) {
+        auto start = std::chrono::steady_clock::now();
+        while (temporary_table_ && std::chrono::steady_clock::now() - start < budget) {
+            help_resize(k_idle_batch);
+        }
+        return temporary_table_.has_value();
+    }
+
+    [[nodiscard]] ResizeProgress resize_progress() const noexcept {
+        if (!temporary_table_) {
+            return {};
+        }
+        return {true, migrated_, temporary_table_->size(), temporary_table_->capacity(), primary_table_.capacity()};
+    }
+
+private:
+    // Slots scanned per operation. The new table is 2x the old one, so with 8 slots per op the old table
+    // is drained long before inserts could fill the new one.
+    static constexpr size_t max_work = 8;
+    static constexpr size_t k_min_cap = flat_detail::k_group_width;
+    static constexpr size_t k_idle_batch = 256;
+    static constexpr size_t k_shrink_divisor = 8;
+
+    FlatTable<T> primary_table_;
+    std::optional<FlatTable<T>> temporary_table_;
+    size_t resizing_pos_{0};
+    size_t migrated_{0};
+
+    void help_resize(size_t budget = max_work) {
+        if (!temporary_table_) {
+            return;
+        }
+        FlatTable<T>& old = *temporary_table_;
+        for (size_t scanned = 0; scanned < budget && resizing_pos_ < old.capacity_ && !old.empty(); ++scanned, ++resizing_pos_) {
+            if (old.ctrl_[resizing_pos_] >= 0) {
+                primary_table_.insert(old.take(resizing_pos_));
+                migrated_++;
+            }
+        }
+        if (old.empty()) {
+            temporary_table_.reset();
+            resizing_pos_ = 0;
+            migrated_ = 0;
+        }
+    }
+
+    void finish_resize() {
+        while (temporary_table_) {
+            help_resize(temporary_table_->capacity());
+        }
+    }
+
+    void maybe_shrink() {
+        size_t capacity = primary_table_.capacity();
+        if (temporary_table_ || capacity <= k_min_cap || primary_table_.size() * k_shrink_divisor >= capacity) {
+            return;
+        }
+        // Land at roughly half full: far from both the grow and the shrink threshold.
+        start_resize(std::max(k_min_cap, std::bit_ceil(primary_table_.size() * 2)));
+    }
+
+    void start_resize() {
+        // All-tombstone tables are rebuilt at the same size; genuinely full ones double.
+        start_resize(primary_table_.mostly_tombstones() ? primary_table_.capacity() : primary_table_.capacity() * 2);
+    }
+
+    void start_resize(size_t new_capacity) {
+        assert(!temporary_table_);
+        temporary_table_.emplace(std::move(primary_table_));
+        primary_table_ = FlatTable<T>(new_capacity);
+        resizing_pos_ = 0;
+        migrated_ = 0;
+    }
+};
+
+#endif // FLAT_HASH_TABLE_HPP
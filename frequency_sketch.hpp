@@ -0,0 +1,101 @@
+#ifndef FREQUENCY_SKETCH_HPP
+#define FREQUENCY_SKETCH_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ds {
+
+// Count-min sketch of 4-bit counters: how often each hash was seen recently, approximately and never
+// under-counted (short of the counters saturating at 15). It is the frequency filter of W-TinyLFU.
+// Each 64-bit word holds 16 counters; a hash owns one counter in each of k_depth words, picked by k_depth
+// independent mixes, and its estimate is the smallest of them. After sample_size increments every counter
+// is halved, so old popularity decays and the sketch follows a shifting workload.
+//
+// The table is sized to the number of keys it tracks, at one word per two keys (~4 bytes a key). Growing
+// it clears the counts; callers grow it by doubling, so that happens O(log n) times.
+class FrequencySketch {
+public:
+    static constexpr uint8_t k_max_count = 15;
+
+    // Sized for about `keys` distinct hashes. Never shrinks.
+    void ensure_capacity(size_t keys) {
+        size_t words = std::bit_ceil(std::max<size_t>(keys / 2, k_min_words));
+        if (words <= table_.size()) return;
+        table_.assign(words, 0);
+        mask_ = words - 1;
+        sample_size_ = 10 * std::max<size_t>(keys, 1);
+        additions_ = 0;
+    }
+
+    [[nodiscard]] size_t capacity() const noexcept { return table_.size() * 2; }
+
+    void increment(uint64_t hash) noexcept {
+        if (table_.empty()) return;
+        unsigned start = static_cast<unsigned>(hash & 3) << 2;
+        bool added = false;
+        for (unsigned i = 0; i < k_depth; ++i) added |= increment_at(index_of(hash, i), start + i);
+        if (added && ++additions_ >= sample_size_) reset();
+    }
+
+    [[nodiscard]] uint8_t estimate(uint64_t hash) const noexcept {
+        if (table_.empty()) return 0;
+        unsigned start = static_cast<unsigned>(hash & 3) << 2;
+        uint8_t count = k_max_count;
+        for (unsigned i = 0; i < k_depth; ++i) {
+            count = std::min(count, static_cast<uint8_t>((table_[index_of(hash, i)] >> ((start + i) << 2)) & 0xf));
+        }
+        return count;
+    }
+
+    void clear() noexcept {
+        std::fill(table_.begin(), table_.end(), 0);
+        additions_ = 0;
+    }
+
+private:
+    static constexpr unsigned k_depth = 4;
+    static constexpr size_t k_min_words = 64;
+    static constexpr uint64_t k_seeds[k_depth] = {0xc3a5c85c97cb3127ull, 0xb492b66fbe98f273ull,
+                                                  0x9ae16a3b2f90404full, 0xcbf29ce484222325ull};
+    static constexpr uint64_t k_reset_mask = 0x7777777777777777ull;
+    static constexpr uint64_t k_one_mask = 0x1111111111111111ull;
+
+    std::vector<uint64_t> table_;
+    size_t mask_{0};
+    size_t sample_size_{0};
+    size_t additions_{0};
+
+    [[nodiscard]] size_t index_of(uint64_t hash, unsigned i) const noexcept {
+        uint64_t h = (hash + k_seeds[i]) * k_seeds[i];
+        h += h >> 32;
+        return static_cast<size_t>(h) & mask_;
+    }
+
+    // Counter `j` (0..15) of word `i`; false if it is saturated.
+    bool increment_at(size_t i, unsigned j) noexcept {
+        unsigned offset = j << 2;
+        uint64_t mask = uint64_t{0xf} << offset;
+        if ((table_[i] & mask) == mask) return false;
+        table_[i] += uint64_t{1} << offset;
+        return true;
+    }
+
+    // Halves every counter. The odd ones lose their low bit, which the addition count accounts for - taken
+    // off before halving, and no more than there is: on a small table odd / 4 can exceed additions_ / 2.
+    void reset() noexcept {
+        size_t odd = 0;
+        for (uint64_t& word : table_) {
+            odd += static_cast<size_t>(std::popcount(word & k_one_mask));
+            word = (word >> 1) & k_reset_mask;
+        }
+        additions_ = (additions_ - std::min(additions_, odd >> 2)) >> 1;
+    }
+};
+
+} // namespace ds
+
+#endif // FREQUENCY_SKETCH_HPP
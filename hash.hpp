@@ -0,0 +1,270 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HASH_HAVE_X86 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// 64-bit seeded string hash used for every hash index (keyspace, zset members). Shard and cluster slot
+// placement hash the same way but under a fixed secret (key_slot() in include/cluster.hpp), so where a key
+// lives - and what a snapshot or another node expects - never depends on this process's seed.
+//  - up to k_stripe_threshold bytes: wyhash-style mixing of 8/16-byte reads through a 64x64->128 multiply.
+//    That covers nearly every real key and costs a handful of multiplies.
+//  - longer inputs: 8 independent 64-bit lanes fed 64 bytes per stripe (xxh3-style accumulate), so the work
+//    vectorizes - AVX2 (picked at runtime) or NEON, with a scalar loop doing the identical arithmetic.
+//    All paths produce the same value, so the choice never affects where a key lands.
+// The seed is drawn from std::random_device once per process, so bucket placement can't be precomputed by
+// a client trying to flood one chain.
+
+namespace hash_detail {
+
+inline constexpr std::uint64_t k_p0 = 0xa0761d6478bd642full;
+inline constexpr std::uint64_t k_p1 = 0xe7037ed1a0b428dbull;
+inline constexpr std::uint64_t k_p2 = 0x8ebc6af09c88c6e3ull;
+inline constexpr std::uint64_t k_p3 = 0x589965cc75374cc3ull;
+inline constexpr std::uint32_t k_prime32 = 0x9E3779B1u;
+
+inline constexpr size_t k_lanes = 8;
+inline constexpr size_t k_stripe = 64;
+inline constexpr size_t k_stripes_per_block = 16; // scramble the accumulators every 1KB
+inline constexpr size_t k_stripe_threshold = 256;
+
+struct Secret {
+    std::uint64_t seed;
+    std::uint64_t lanes[k_lanes];
+};
+
+[[nodiscard]] inline std::uint64_t read64(const std::uint8_t* p) noexcept {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+[[nodiscard]] inline std::uint64_t read32(const std::uint8_t* p) noexcept {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void mum(std::uint64_t& a, std::uint64_t& b) noexcept {
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    a = static_cast<std::uint64_t>(r);
+    b = static_cast<std::uint64_t>(r >> 64);
+}
+
+[[nodiscard]] inline std::uint64_t mix(std::uint64_t a, std::uint64_t b) noexcept {
+    mum(a, b);
+    return a ^ b;
+}
+
+[[nodiscard]] inline Secret make_secret(std::uint64_t seed) noexcept {
+    Secret s{};
+    s.seed = mix(seed ^ k_p0, k_p1);
+    for (size_t i = 0; i < k_lanes; ++i) {
+        s.lanes[i] = mix(s.seed + (i + 1) * k_p2, k_p3);
+    }
+    return s;
+}
+
+// The shared per-process secret. Function-local so static initializers elsewhere can hash safely.
+[[nodiscard]] inline const Secret& process_secret() noexcept {
+    static const Secret secret = [] {
+        std::random_device rd;
+        std::uint64_t seed = (static_cast<std::uint64_t>(rd()) << 32) ^ rd();
+        return make_secret(seed);
+    }();
+    return secret;
+}
+
+// Short and medium inputs (wyhash construction).
+[[nodiscard]] inline std::uint64_t hash_short(const std::uint8_t* p, size_t len, std::uint64_t seed) noexcept {
+    std::uint64_t a;
+    std::uint64_t b;
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (read32(p) << 32) | read32(p + ((len >> 3) << 2));
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = (static_cast<std::uint64_t>(p[0]) << 16) | (static_cast<std::uint64_t>(p[len >> 1]) << 8) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            std::uint64_t see1 = seed;
+            std::uint64_t see2 = seed;
+            do {
+                seed = mix(read64(p) ^ k_p1, read64(p + 8) ^ seed);
+                see1 = mix(read64(p + 16) ^ k_p2, read64(p + 24) ^ see1);
+                see2 = mix(read64(p + 32) ^ k_p3, read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = mix(read64(p) ^ k_p1, read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+    a ^= k_p1;
+    b ^= seed;
+    mum(a, b);
+    return mix(a ^ k_p0 ^ len, b ^ k_p1);
+}
+
+// One 64-byte stripe into 8 lanes: acc[i] += lo32(d ^ k) * hi32(d ^ k) + d[i ^ 1].
+inline void accumulate_scalar(std::uint64_t* acc, const std::uint8_t* p, const std::uint64_t* key) noexcept {
+    for (size_t i = 0; i < k_lanes; ++i) {
+        std::uint64_t data = read64(p + 8 * i);
+        std::uint64_t k = data ^ key[i];
+        acc[i ^ 1] += data;
+        acc[i] += (k & 0xFFFFFFFFu) * (k >> 32);
+    }
+}
+
+// Fold high bits back down so the 32x32 products keep seeing fresh entropy on long inputs.
+inline void scramble(std::uint64_t* acc, const Secret& s) noexcept {
+    for (size_t i = 0; i < k_lanes; ++i) {
+        std::uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= s.lanes[i];
+        acc[i] = a * k_prime32;
+    }
+}
+
+using StripeFn = void (*)(std::uint64_t* acc, const std::uint8_t* p, size_t stripes, std::uint64_t* key);
+
+// Per stripe the lane keys advance by k_p2, which keeps repeated stripes from cancelling.
+inline void stripes_scalar(std::uint64_t* acc, const std::uint8_t* p, size_t stripes, std::uint64_t* key) noexcept {
+    for (size_t s = 0; s < stripes; ++s, p += k_stripe) {
+        accumulate_scalar(acc, p, key);
+        for (size_t i = 0; i < k_lanes; ++i) key[i] += k_p2;
+    }
+}
+
+#if defined(HASH_HAVE_X86)
+__attribute__((target("avx2")))
+inline void stripes_avx2(std::uint64_t* acc, const std::uint8_t* p, size_t stripes, std::uint64_t* key) noexcept {
+    __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc));
+    __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + 4));
+    __m256i k0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key));
+    __m256i k1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + 4));
+    const __m256i step = _mm256_set1_epi64x(static_cast<long long>(k_p2));
+    for (size_t s = 0; s < stripes; ++s, p += k_stripe) {
+        __m256i d0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i d1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+        __m256i x0 = _mm256_xor_si256(d0, k0);
+        __m256i x1 = _mm256_xor_si256(d1, k1);
+        // mul_epu32 multiplies the low 32 bits of each 64-bit lane; shifting gives us the high half.
+        __m256i m0 = _mm256_mul_epu32(x0, _mm256_srli_epi64(x0, 32));
+        __m256i m1 = _mm256_mul_epu32(x1, _mm256_srli_epi64(x1, 32));
+        // Swap adjacent 64-bit lanes: that's the d[i ^ 1] term.
+        __m256i s0 = _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2));
+        __m256i s1 = _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2));
+        a0 = _mm256_add_epi64(a0, _mm256_add_epi64(m0, s0));
+        a1 = _mm256_add_epi64(a1, _mm256_add_epi64(m1, s1));
+        k0 = _mm256_add_epi64(k0, step);
+        k1 = _mm256_add_epi64(k1, step);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), a0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + 4), a1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(key), k0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(key + 4), k1);
+}
+#elif defined(__ARM_NEON)
+inline void stripes_neon(std::uint64_t* acc, const std::uint8_t* p, size_t stripes, std::uint64_t* key) noexcept {
+    uint64x2_t a[4];
+    uint64x2_t k[4];
+    for (size_t j = 0; j < 4; ++j) {
+        a[j] = vld1q_u64(acc + 2 * j);
+        k[j] = vld1q_u64(key + 2 * j);
+    }
+    const uint64x2_t step = vdupq_n_u64(k_p2);
+    for (size_t s = 0; s < stripes; ++s, p += k_stripe) {
+        for (size_t j = 0; j < 4; ++j) {
+            uint64x2_t d = vreinterpretq_u64_u8(vld1q_u8(p + 16 * j));
+            uint64x2_t x = veorq_u64(d, k[j]);
+            uint64x2_t m = vmull_u32(vmovn_u64(x), vshrn_n_u64(x, 32));
+            a[j] = vaddq_u64(a[j], vaddq_u64(m, vextq_u64(d, d, 1)));
+            k[j] = vaddq_u64(k[j], step);
+        }
+    }
+    for (size_t j = 0; j < 4; ++j) {
+        vst1q_u64(acc + 2 * j, a[j]);
+        vst1q_u64(key + 2 * j, k[j]);
+    }
+}
+#endif
+
+[[nodiscard]] inline StripeFn select_stripes() noexcept {
+#if defined(HASH_HAVE_X86)
+    if (__builtin_cpu_supports("avx2")) return stripes_avx2;
+    return stripes_scalar;
+#elif defined(__ARM_NEON)
+    return stripes_neon;
+#else
+    return stripes_scalar;
+#endif
+}
+
+[[nodiscard]] inline StripeFn stripes_impl() noexcept {
+    static const StripeFn fn = select_stripes();
+    return fn;
+}
+
+// len must exceed one stripe. The final 64 bytes are always fed as a (possibly overlapping) last stripe.
+[[nodiscard]] inline std::uint64_t hash_long(const std::uint8_t* p, size_t len, const Secret& secret, StripeFn stripes) noexcept {
+    std::uint64_t acc[k_lanes];
+    std::uint64_t key[k_lanes];
+    for (size_t i = 0; i < k_lanes; ++i) {
+        acc[i] = secret.lanes[i] ^ (i * k_p1);
+        key[i] = secret.lanes[i];
+    }
+
+    size_t full = (len - 1) / k_stripe;
+    const std::uint8_t* cur = p;
+    while (full > 0) {
+        size_t n = full < k_stripes_per_block ? full : k_stripes_per_block;
+        stripes(acc, cur, n, key);
+        cur += n * k_stripe;
+        full -= n;
+        if (n == k_stripes_per_block) scramble(acc, secret);
+    }
+    accumulate_scalar(acc, p + len - k_stripe, key);
+
+    std::uint64_t h = len * k_p0;
+    for (size_t i = 0; i < k_lanes; i += 2) {
+        h += mix(acc[i] ^ secret.lanes[i], acc[i + 1] ^ secret.lanes[i + 1]);
+    }
+    return mix(h ^ (h >> 29), secret.seed ^ k_p3);
+}
+
+} // namespace hash_detail
+
+// Hash with an explicit secret (e.g. hash_detail::make_secret(fixed_seed) for reproducible benchmarks).
+[[nodiscard]] inline std::uint64_t hash_bytes(const std::uint8_t* data, size_t len, const hash_detail::Secret& secret) noexcept {
+    if (len <= hash_detail::k_stripe_threshold) {
+        return hash_detail::hash_short(data, len, secret.seed);
+    }
+    return hash_detail::hash_long(data, len, secret, hash_detail::stripes_impl());
+}
+
+[[nodiscard]] inline std::uint64_t hash_string(const std::uint8_t* data, size_t len) noexcept {
+    return hash_bytes(data, len, hash_detail::process_secret());
+}
+
+#endif // HASH_HPP
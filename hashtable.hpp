@@ -7,65 +7,68 @@
 #include <functional>
 #include <type_traits>
 #include <vector>
+#include <utility>
 #include <optional>
 #include <bit>
 #include <cassert>
+#include <chrono>
+#include <algorithm>
+#include "hash.hpp"
 
-// To-Do: 
+// To-Do:
 /*
-1. Testing each Method - likely some inconsistencies in passing by ref/ptr (particularly in insert) 
-2. Multithreading/Concurrency applications & guardrails - MAJOR undertaking probably. Let's see if this shit runs first
+1. Multithreading/Concurrency applications & guardrails - each table is owned by one reactor thread for now.
 */
 
-// FNV-1a Hashing Algorithm with SIMD.
-// *** Some SIMD - Integrate with NEON later if you want. ***
+namespace htable_detail {
 
-[[nodiscard]] inline std::uint64_t hash_string(const std::uint8_t* data, size_t len) noexcept {
-    constexpr uint32_t INITIAL = 0x811C9DC5;
-    constexpr uint32_t MULTIPLIER = 0x01000193;
+[[nodiscard]] constexpr size_t reverse_bits(size_t v) noexcept {
+    static_assert(sizeof(size_t) == 8);
+    v = ((v >> 1) & 0x5555555555555555ull) | ((v & 0x5555555555555555ull) << 1);
+    v = ((v >> 2) & 0x3333333333333333ull) | ((v & 0x3333333333333333ull) << 2);
+    v = ((v >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((v & 0x0F0F0F0F0F0F0F0Full) << 4);
+    return std::byteswap(v);
+}
 
-    uint32_t hash = INITIAL;
-    size_t i = 0;
+// The scan cursor after `cursor`, for a table of mask + 1 buckets: the index incremented from its top bit
+// down, so it stays meaningful when the table doubles or halves (see HMap::scan). 0 once the walk is done.
+[[nodiscard]] constexpr size_t next_cursor(size_t cursor, size_t mask) noexcept {
+    return reverse_bits(reverse_bits(cursor | ~mask) + 1);
+}
 
-    for (; i + 4 <= len; i += 4) { 
-        hash = (hash ^ data[i]) * MULTIPLIER;
-        hash = (hash ^ data[i + 1]) * MULTIPLIER;
-        hash = (hash ^ data[i + 2]) * MULTIPLIER;
-        hash = (hash ^ data[i + 3]) * MULTIPLIER;
-    }
+} // namespace htable_detail
 
-    for (; i < len; i++) {
-        hash = (hash ^ data[i]) * MULTIPLIER;
-    }
+template<typename T>
+class HTable;
 
-    return hash;
-}
+template<typename T>
+class HMap;
 
 // Basic RAII - Delete copy-consructors, allow transfer of ownership only.
-// Our Node contains its HashCode (generated by FNV-1a) and next_ (pointing to a unique_ptr).
+// Intrusive node: the stored type T derives from HNode<T> (CRTP) so the chain link and the hash code live
+// inside the element itself - one allocation per element. The table owns elements through next_ (a
+// unique_ptr to the next element in the bucket) and the bucket heads.
 
 template<typename T>
 class HNode {
 public:
-    HNode() noexcept = default; 
-    ~HNode() = default; 
-    
-    HNode(const HNode&) = delete; 
-    HNode& operator=(const HNode&) = delete; 
-    
-    HNode(HNode&&) noexcept = default; 
-    HNode& operator=(HNode&&) noexcept = default; 
+    HNode() noexcept = default;
+    explicit HNode(std::uint64_t hcode) noexcept : hcode_(hcode) {}
+    ~HNode() = default;
+
+    HNode(const HNode&) = delete;
+    HNode& operator=(const HNode&) = delete;
+
+    [[nodiscard]] std::uint64_t hcode() const noexcept { return hcode_; }
 
 protected:
-    std::unique_ptr<HNode> next_; 
-    std::uint64_t hcode_{0}; 
+    std::unique_ptr<T> next_;
+    std::uint64_t hcode_{0};
     // Provide access to our 'parent modifiers'
-    friend class HTable<T>; 
-    friend class HMap<T>; 
+    friend class HTable<T>;
+    friend class HMap<T>;
 };
 
-
-
 template<typename T>
 class HTable {
 public:
@@ -76,232 +79,362 @@ public:
         }
     }
     // RAII - Delete Copy Construction & Allow ownership transfer of unique_pointer nodes
-    HTable(const HTable&) = delete; 
-    HTable& operator=(const HTable&) = delete; 
-
-    HTable(HTable&&) noexcept = default; 
-    HTable& operator=(HTable&&) noexcept = default; 
+    HTable(const HTable&) = delete;
+    HTable& operator=(const HTable&) = delete;
+
+    HTable(HTable&& other) noexcept
+        : buckets_(std::move(other.buckets_)), mask_(std::exchange(other.mask_, 0)), size_(std::exchange(other.size_, 0)) {}
+    HTable& operator=(HTable&& other) noexcept {
+        buckets_ = std::move(other.buckets_);
+        mask_ = std::exchange(other.mask_, 0);
+        size_ = std::exchange(other.size_, 0);
+        return *this;
+    }
 
     // Insert function with safety check (initialize on k_min_cap of 4 if empty) and move semantics.
-    void insert(std::unique_ptr<HNode<T>> node) {
+    // Push onto the front of the bucket's chain: O(1), no traversal.
+    void insert(std::unique_ptr<T> node) {
         if (buckets_.empty()) {
             initialize(k_min_cap);
         }
-        /
         size_t pos = node->hcode_ & mask_;
-        node->next = std::move(buckets_[pos]);
+        node->next_ = std::move(buckets_[pos]);
         buckets_[pos] = std::move(node);
         size_++;
     }
-    // Accept anonymous comparator function and key, given the mask_ and position, get index current with raw ptr
-    // and iterate until comparator is true to return a raw ptr to our requested data. Else, return nullptr.
-    HNode<T>* lookup(
-        const HNode<T>* key, 
-        const std::function<bool(const HNode<T>*, const HNode<T>*)>& comparator
-    ) const {
+    // Accept a hash code and an equality predicate, given the mask_ and position, get the bucket head and
+    // iterate until eq is true to return a raw ptr to our requested data. Else, return nullptr.
+    // The hash code is compared first so eq (usually a string compare) only runs on real candidates.
+    template<typename Eq>
+    T* lookup(std::uint64_t hcode, Eq&& eq) const {
         if (buckets_.empty()) {
             return nullptr;
         }
 
-        size_t pos = key->hcode_ & mask_;
-        HNode<T>* current = buckets_[pos].get();
-
+        T* current = buckets_[hcode & mask_].get();
         while (current) {
-            if (comparator(current, key)) { 
-                return current;  
+            if (current->hcode_ == hcode && eq(*current)) {
+                return current;
             }
             current = current->next_.get();
         }
         return nullptr;
     }
 
-    // Accept anonymous comparator function and key, given the mask_ and position, get index current with raw ptr
-    // and iterate until comparator is true, we return the unique_pointer after rechaining (avoid dangling ptrs).
-    std::unique_ptr<HNode<T>> remove(
-        const HNode<T>* key, 
-        const std::function<bool(const HNode<T>&, const HNode<T>&)>& comparator;
-    ) {
-            if (buckets.empty()) {
-                return nullptr;
-            }
+    // Pulls in the bucket slot lookup(hcode) would start from, for a caller about to look up a batch of keys.
+    void prefetch(std::uint64_t hcode) const noexcept {
+        if (!buckets_.empty()) __builtin_prefetch(&buckets_[hcode & mask_]);
+    }
 
-            size_t pos = key->hashcode & mask;
-            const HNode<T>* current = buckets[pos].get();
-            const HNode<T>* prev = nullptr;
-
-            while (current) {
-                if (comparator(current, key)) { 
-
-                    // if !first node
-                    if (prev) {
-                        auto node = std::move(prev->next); 
-                        prev->next = std::move(node->next);
-                        return node;
-                    // if first node
-                    } else {
-                        auto node = std::move(buckets[pos]);
-                        buckets[pos] = std::move(node->next);
-                        return node;
-                    }
-                }
-                prev = current;
-                current = current->next_.get();
+    // Same walk as lookup, but we keep hold of the owning pointer that points at the current node so we can
+    // splice it out and hand ownership back to the caller (avoid dangling ptrs).
+    template<typename Eq>
+    std::unique_ptr<T> remove(std::uint64_t hcode, Eq&& eq) {
+        if (buckets_.empty()) {
+            return nullptr;
+        }
+
+        std::unique_ptr<T>* from = &buckets_[hcode & mask_];
+        while (*from) {
+            T* current = from->get();
+            if (current->hcode_ == hcode && eq(*current)) {
+                std::unique_ptr<T> node = std::move(*from);
+                *from = std::move(node->next_);
+                size_--;
+                return node;
             }
+            from = &current->next_;
+        }
         return nullptr;
     }
-    
-    [[nodiscard]] size_t size() const noexcept { return size_; } 
-    [[nodiscard]] size_t capacity() const noexcept { return mask_ + 1; } 
-    bool empty() const noexcept { return size_ == 0; } 
+
+    // Visit every element. fn must not insert into or remove from this table.
+    template<typename Fn>
+    void for_each(Fn&& fn) const {
+        for (const auto& head : buckets_) {
+            for (T* node = head.get(); node; node = node->next_.get()) {
+                fn(*node);
+            }
+        }
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+    [[nodiscard]] size_t capacity() const noexcept { return buckets_.empty() ? 0 : mask_ + 1; }
+    bool empty() const noexcept { return size_ == 0; }
+
+    // Chains are unlinked one node at a time so a long bucket can't recurse through ~unique_ptr.
+    ~HTable() { clear(); }
+
+    void clear() noexcept {
+        for (auto& head : buckets_) {
+            while (head) {
+                head = std::move(head->next_);
+            }
+        }
+        size_ = 0;
+    }
 
 private:
-    std::vector<std::unique_ptr<HNode<T>>> buckets_; 
-    size_t mask_{0}; 
-    size_t size_{0}; 
+    std::vector<std::unique_ptr<T>> buckets_;
+    size_t mask_{0};
+    size_t size_{0};
 
     static constexpr size_t k_min_cap = 4;
 
-    // Helper function for our constructor, 
+    // Helper function for our constructor,
     // A. Check if capacity is exponent of 2, if true, continue
     // B. Ensure capacity is at least 4, and resize it
-    // C. Initilize mask_ as capacity - 1 (bitmasking operation for XOR replacement) and init size_ to 0. 
-    void initialize(size_t capacity) { 
-        assert(std::has_single_bit(capacity));  
-        capacity = std::max(capacity, k_min_cap); 
-        
+    // C. Initilize mask_ as capacity - 1 (bitmasking operation for modulo replacement) and init size_ to 0.
+    void initialize(size_t capacity) {
+        assert(std::has_single_bit(capacity));
+        capacity = std::max(capacity, k_min_cap);
+
         buckets_.resize(capacity);
-        mask_ = capacity - 1; 
-        size_ = 0; 
+        mask_ = capacity - 1;
+        size_ = 0;
     }
+
+    friend class HMap<T>;
+};
+
+// Snapshot of an in-flight incremental resize (all zero when none is running).
+struct ResizeProgress {
+    bool active{false};
+    size_t migrated{0};      // elements already moved into the new table
+    size_t remaining{0};     // elements still waiting in the old table
+    size_t from_capacity{0};
+    size_t to_capacity{0};
 };
 
 template<typename T>
 class HMap {
 public:
+    using Nanoseconds = std::chrono::nanoseconds;
+
     HMap() = default;
     ~HMap() = default;
 
     // RAII - Delete Copy Construction & Allow ownership transfer of unique_pointer nodes
-    HMap(const HMap&) = delete; 
-    HMap& operator=(const HMap&) = delete; 
+    HMap(const HMap&) = delete;
+    HMap& operator=(const HMap&) = delete;
 
     HMap(HMap&&) noexcept = default;
-    HMap& operator=(HMap&&) noexcept = default; 
+    HMap& operator=(HMap&&) noexcept = default;
 
-    // If our primary HTable is empty, we 
-    void insert(std::unique_ptr<HNode<T>> node) { 
-        // Initialize our primary_table to k_min_cap if empty. Ensuring capacity is at least 4. 
-        if (primary_table_.empty()) { 
+    // If our primary HTable is empty, we initialize it first.
+    void insert(std::unique_ptr<T> node) {
+        // Initialize our primary_table to k_min_cap if empty. Ensuring capacity is at least 4.
+        if (primary_table_.capacity() == 0) {
             primary_table_ = HTable<T>(k_min_cap);
         }
         primary_table_.insert(std::move(node)); // Then we'll insert our node on our HTable object!
-        
-        // Here, we want to check if a resizing_table operation is taking place. If true, we skip starting a new resize operation.
-        if (!temporary_table_) {
-            size_t load_factor = primary_table_.size() / primary_table_.capacity(); // We calculate our load factor here as size/capacity 
-            if (load_factor >= k_max_load_factor) { // If our ratio exceeds our maximum tolerable load factor, then we commence a resize op.
-                start_resize();
-            }
+
+        // Only one resize runs at a time. Compare with a multiply rather than size/capacity, which rounds down.
+        if (!temporary_table_ && primary_table_.size() > primary_table_.capacity() * k_max_load_factor) {
+            start_resize(primary_table_.capacity() * 2);
         }
-        help_resize(); // On every function call we'll find this method - it essentially offloads 15 items from our primary_table object
-        // As to not overwhelm our system when it does eventually get full! We do this to prevent HTable thrashing.
+        help_resize(work_per_op()); // move a time-budgeted slice of the old table on every call
+    }
+
+    // Sizes an empty map for `n` elements, so inserting them (e.g. loading a snapshot) never starts a resize.
+    void reserve(size_t n) {
+        if (!empty() || temporary_table_) return;
+        size_t capacity = std::max(k_min_cap, std::bit_ceil((n + k_max_load_factor - 1) / k_max_load_factor));
+        if (capacity > primary_table_.capacity()) primary_table_ = HTable<T>(capacity);
     }
 
-    // Pass in a key and comparator function. We call help_resize before to ensure our node isn't lost after the 15 swaps!
-    const HNode<T>* find(
-        const HNode<T>* key,
-        const std::function<bool(const HNode<T>*, const HNode<T>*)>& comparator)
-    {
-        help_resize();
+    // A hint ahead of find(hcode, ...) in a batch: the bucket loads of several keys then overlap instead of
+    // each lookup waiting on its own miss. Both tables during a resize - the key may be in either.
+    void prefetch(std::uint64_t hcode) const noexcept {
+        primary_table_.prefetch(hcode);
+        if (temporary_table_) temporary_table_->prefetch(hcode);
+    }
+
+    // Pass in a hash code and equality predicate. We call help_resize before so keys migrate towards the primary table.
+    template<typename Eq>
+    T* find(std::uint64_t hcode, Eq&& eq) {
+        help_resize(work_per_op());
         // Call the lookup method to find our key in our primary table.
-        if (auto node = primary_table_.lookup(key, comparator)) {
-            return node.get();
+        if (T* node = primary_table_.lookup(hcode, eq)) {
+            return node;
         }
-        // Remember we're also splitting our data into a resizing table of a larger magnitude, we need to search for nodes that were moved also!
+        // Remember we're also splitting our data into a resizing table, we need to search for nodes not yet moved also!
         if (temporary_table_) {
-            if (auto node = temporary_table_->lookup(key, comparator)) {
-                return node.get();
-            }
+            return temporary_table_->lookup(hcode, eq);
         }
         return nullptr;
     }
 
-    // Once again, similar to find - We pass in a key and comparator function, and we call help_resize. We should call it earlier here as 
-    // this improves our performance as keys are migrated to primary_DB, this increases our chances of finding the key in the first check.
-    std::unique_ptr<HNode<T>> remove(
-        const HNode<T>* key,
-        const std::function<bool(const HNode<T>*, const HNode<T>*)>& comparator)
-    {
-        help_resize();
-        
-        if (auto node = primary_table_.remove(key, comparator)) {
-            return node;
+    // Once again, similar to find - We pass in a hash code and predicate, and we call help_resize. We should call it earlier here as
+    // this improves our performance as keys are migrated to primary_table, this increases our chances of finding the key in the first check.
+    template<typename Eq>
+    std::unique_ptr<T> remove(std::uint64_t hcode, Eq&& eq) {
+        help_resize(work_per_op());
+
+        auto node = primary_table_.remove(hcode, eq);
+        if (!node && temporary_table_) {
+            node = temporary_table_->remove(hcode, eq);
         }
+        if (node) {
+            maybe_shrink();
+        }
+        return node;
+    }
+
+    template<typename Fn>
+    void for_each(Fn&& fn) const {
+        primary_table_.for_each(fn);
         if (temporary_table_) {
-            if (auto node = temporary_table_->remove(key, comparator)) {
-                return node;
-            }
+            temporary_table_->for_each(fn);
         }
-        return nullptr;
+    }
+
+    // Incremental walk that tolerates resizes between calls: start with cursor 0 and feed back the returned
+    // cursor until it comes back as 0. Cursors advance over bucket indexes with their bits reversed, so when
+    // the table doubles or halves in between, the buckets already covered map onto buckets still covered
+    // (the scheme Redis' SCAN uses). Every element present for the whole walk is visited at least once;
+    // elements inserted or removed meanwhile may or may not be, and one can be visited twice while a resize
+    // is moving it. fn must not insert into or remove from the map.
+    template<typename Fn>
+    size_t scan(size_t cursor, Fn&& fn) const {
+        const HTable<T>* small = &primary_table_;
+        const HTable<T>* large = temporary_table_ ? &*temporary_table_ : nullptr;
+        if (large && large->capacity() < small->capacity()) std::swap(small, large);
+        if (small->capacity() == 0) return 0;
+
+        auto visit = [&fn](const HTable<T>& table, size_t idx) {
+            for (T* node = table.buckets_[idx].get(); node; node = node->next_.get()) fn(*node);
+        };
+        size_t m0 = small->mask_;
+        visit(*small, cursor & m0);
+        if (large) {
+            // Every bucket of the larger table that the smaller one's bucket splits into.
+            size_t m1 = large->mask_;
+            do {
+                visit(*large, cursor & m1);
+                cursor = (((cursor | m0) + 1) & ~m0) | (cursor & m0);
+            } while (cursor & (m0 ^ m1));
+        }
+        return htable_detail::next_cursor(cursor, m0);
+    }
+
+    void clear() noexcept {
+        primary_table_.clear();
+        temporary_table_.reset();
+        resizing_pos_ = 0;
+        migrated_ = 0;
     }
 
     [[nodiscard]] size_t size() const noexcept {
-        return primary_table_.size() + 
+        return primary_table_.size() +
                (temporary_table_ ? temporary_table_->size() : 0); // Get the size of both primary and resizing table (if exists).
     }
-    
+
     bool empty() const noexcept { return size() == 0; } // method for checking if the above size()==0, for convenience.
 
+    [[nodiscard]] bool resizing() const noexcept { return temporary_table_.has_value(); }
+
+    // Idle-time driver: keep migrating until the resize is done or `budget` has elapsed.
+    // Returns true while there's still work left. Also recalibrates the per-operation slice.
+    bool rehash_step(Nanoseconds budget) {
+        if (!temporary_table_) {
+            return false;
+        }
+        auto start = std::chrono::steady_clock::now();
+        size_t units = 0;
+        Nanoseconds elapsed{0};
+        while (temporary_table_ && elapsed < budget) {
+            units += help_resize(k_idle_batch);
+            elapsed = std::chrono::steady_clock::now() - start;
+        }
+        if (units > 0) {
+            // EWMA (1/8 weight) so one slow, cache-cold step doesn't swing the per-op slice.
+            uint64_t sample = std::max<uint64_t>(1, static_cast<uint64_t>(elapsed.count()) / units);
+            ns_per_unit_ = ns_per_unit_ - ns_per_unit_ / 8 + std::max<uint64_t>(1, sample / 8);
+        }
+        return temporary_table_.has_value();
+    }
+
+    [[nodiscard]] ResizeProgress resize_progress() const noexcept {
+        if (!temporary_table_) {
+            return {};
+        }
+        return {true, migrated_, temporary_table_->size(), temporary_table_->capacity(), primary_table_.capacity()};
+    }
+
 private:
-    static constexpr size_t max_work = 15; // 15 transfers per help_resize call 
-    static constexpr size_t k_max_load_factor = 8; // Max Average of 8 nodes per bucket before start_resize is called!
-    static constexpr size_t k_min_cap = 4; // If constructor is called we want the minimum capacity to be 4 buckets!
+    static constexpr size_t k_max_load_factor = 2;  // grow once chains average more than 2 nodes
+    static constexpr size_t k_shrink_divisor = 8;   // shrink once they average under 1/8
+    static constexpr size_t k_min_cap = 4;          // If constructor is called we want the minimum capacity to be 4 buckets!
+    static constexpr size_t k_idle_batch = 64;      // work units between clock reads in rehash_step
+    static constexpr Nanoseconds k_op_budget{250};  // what each insert/find/remove spends migrating
 
     HTable<T> primary_table_;
     std::optional<HTable<T>> temporary_table_;
     size_t resizing_pos_{0};
+    size_t migrated_{0};
+    uint64_t ns_per_unit_{8}; // measured cost of one bucket visit or node move, refined by rehash_step
+
+    // The op budget converted to work units with the measured cost, so the hot path never reads the clock.
+    // During a write burst the primary table could reach its own growth threshold before the old one drains,
+    // so the slice is raised to whatever finishes the migration within the remaining headroom.
+    size_t work_per_op() const noexcept {
+        if (!temporary_table_) {
+            return 0;
+        }
+        size_t units = std::max<size_t>(1, static_cast<size_t>(k_op_budget.count()) / ns_per_unit_);
+        size_t limit = primary_table_.capacity() * k_max_load_factor;
+        size_t headroom = limit > primary_table_.size() ? limit - primary_table_.size() : 1;
+        return std::max(units, temporary_table_->size() / headroom + 1);
+    }
 
-    void help_resize() {
+    // Moves up to `budget` work units, where a unit is one node moved or one empty bucket skipped (a
+    // shrinking table is mostly empty buckets, so those have to count). Returns the units spent.
+    size_t help_resize(size_t budget) {
         // Sanity check! Do not proceed if resizing table does not exist
         if (!temporary_table_) {
-            return;
+            return 0;
         }
-        // we set work_done to be 15 meaning - if work_done > 15, or there are no more nodes to process we exit the loop
-        // If w
         size_t work_done = 0;
-        while (work_done < max_work && !temporary_table_->empty()) {
-            // 'defensive programming' but probably unnecessary as we only increment when moving through empty buckets.
-            // Will leave it as it wont cause problems... probably
-            if (resizing_pos_ >= temporary_table_->capacity()) {
-                resizing_pos_ = 0;
-            }
-
+        while (work_done < budget && !temporary_table_->empty() && resizing_pos_ < temporary_table_->capacity()) {
             // current bucket to process is indicating by resizing_pos_
             auto& bucket = temporary_table_->buckets_[resizing_pos_];
             if (bucket) {
-                auto node = std::move(bucket); // Let's take the bucket unique_ptr and give it to node. 
-                bucket = std::move(node->next_);// Now let's make the bucket's unique_ptr point to the node after. 
-                node->next_ = nullptr; // Then let's made node->next_ unique pointer (prev dangling) point to nullptr (probably redundant)
-                primary_table_.insert(std::move(node)); // Then we insert this node (see insert in HTable func) with its hashcode 
+                auto node = std::move(bucket); // Let's take the bucket unique_ptr and give it to node.
+                bucket = std::move(node->next_);// Now let's make the bucket's unique_ptr point to the node after.
+                primary_table_.insert(std::move(node)); // Then we insert this node (see insert in HTable func) with its hashcode
                 temporary_table_->size_--; // reduce size by 1!
-                work_done++; // increase work_done by 1!
+                migrated_++;
             } else {
                 resizing_pos_++; // if bucket does not exist (i.e empty) then continue to the next bucket. Works when we finish processing bucket to!
             }
+            work_done++;
         }
 
-        if (temporary_table_->empty()) { // If empty, we reset resizing_table (all buckets) and reinit resizing_pos to 0. Once LOAD FACTOR / CAPACITY > 8 it'll hold primary_table contents again via enplace node transfers.
+        if (temporary_table_->empty()) { // Done: drop the old buckets, and the next resize starts from scratch.
             temporary_table_.reset();
             resizing_pos_ = 0;
+            migrated_ = 0;
         }
+        return work_done;
     }
-    void start_resize() {
+
+    void maybe_shrink() {
+        size_t capacity = primary_table_.capacity();
+        if (temporary_table_ || capacity <= k_min_cap || primary_table_.size() * k_shrink_divisor >= capacity) {
+            return;
+        }
+        // Aim for a load of about 1, which leaves a wide gap before either threshold trips again.
+        start_resize(std::max(k_min_cap, std::bit_ceil(std::max<size_t>(primary_table_.size(), 1))));
+    }
+
+    void start_resize(size_t new_capacity) {
         assert(!temporary_table_); //  first a sanity check that resizing table doesn't already exist!
-        size_t new_capacity = primary_table_.capacity() * 2; // new_capacity will be 2x previous, this is fairly standard.
         temporary_table_.emplace(std::move(primary_table_)); // Mark primary_table as an rvalue, and then transfer the contents emplace to resizing_table
-        primary_table_ = HTable<T>(new_capacity); // Create a new primary_table with the new doubled capacity 
+        primary_table_ = HTable<T>(new_capacity); // Create a new primary_table with the new capacity
         resizing_pos_ = 0; // Pointer indicating which bucket we're putting into primary
+        migrated_ = 0;
     }
 };
 
-#endif // HASH_TABLE_HPP
\ No newline at end of file
+#endif // HASH_TABLE_HPP
@@ -6,9 +6,13 @@
 #include <vector>
 #include <memory>
 #include <stdexcept>
+#include <functional>
 
 namespace ds {
 
+template<typename T, typename Compare>
+class BinaryHeap;
+
 template<typename T>
 class HeapItem {
 public:
@@ -33,13 +37,12 @@ private:
     T value_{}; // value in heap
     std::size_t* position_ref_{nullptr}; // pointer to the position of this item in heap
 
-    friend class BinaryHeap<T>; // provide access/mod to BinaryHeap
+    template<typename, typename> friend class BinaryHeap; // provide access/mod to BinaryHeap
 };
 
 template<typename T, typename Compare = std::less<T>>
 class BinaryHeap {
 public:
-    BinaryHeap() = default;
     explicit BinaryHeap(const Compare& comp = Compare{}) : compare_(comp) {} // This constructor takes in a comparator function!
     
     void push(HeapItem<T> item) { // push method = push HeapItem<T> item to the back of our vector - we sift locations up accordingly thereafter
@@ -70,6 +73,31 @@ public:
         return result;
     }
 
+    // Remove the item at an arbitrary position (found through its position_ref_) - move the last item into the hole
+    // and let update() sift it whichever way it needs to go.
+    HeapItem<T> erase(std::size_t pos) {
+        if (pos >= items_.size()) {
+            throw std::out_of_range("Position out of range");
+        }
+
+        HeapItem<T> result = std::move(items_[pos]);
+        if (pos + 1 < items_.size()) {
+            items_[pos] = std::move(items_.back());
+            items_.pop_back();
+            update(pos);
+        } else {
+            items_.pop_back();
+        }
+        return result;
+    }
+
+    [[nodiscard]] const HeapItem<T>& at(std::size_t pos) const { return items_.at(pos); }
+
+    void clear() noexcept { items_.clear(); } // position refs are left stale - the owner is dropping the items too
+
+    // Mutable access for re-keying an item in place - call update(pos) afterwards to restore heap order.
+    [[nodiscard]] T& value_at(std::size_t pos) { return items_.at(pos).value_; }
+
     void update(std::size_t pos) {
         if (pos >= items_.size()) {
             throw std::out_of_range("Position out of range");
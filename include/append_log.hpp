@@ -0,0 +1,331 @@
+#ifndef APPEND_LOG_HPP
+#define APPEND_LOG_HPP
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "request_parser.hpp"
+#include "snapshot.hpp"
+#include "../thread_pool.hpp"
+
+// Append-only command log, one chain of files per shard. The shard's CommandFeed (command_feed.hpp) is
+// appended as it is, so replay is the connection path minus the socket:
+//   manifest  appendonly-<shard>.manifest        "base <seq>" (optional) then one "incr <seq>" per log
+//   base      appendonly-<shard>.<seq>.base.kvs  snapshot (see snapshot.hpp) the chain starts from
+//   incr      appendonly-<shard>.<seq>.incr.aof  [u32 len][u32 arg_len][arg]... per command
+// A rewrite starts a new incr file and writes a snapshot of the live keyspace as the matching base; once
+// that is in place the manifest drops everything older.
+
+enum class FsyncPolicy : uint8_t {
+    Always,   // fdatasync before the replies of a batch go out
+    EverySec, // fdatasync on the background pool about once a second
+    Never     // leave it to the kernel
+};
+
+struct AofConfig {
+    bool enabled{false};
+    FsyncPolicy fsync{FsyncPolicy::EverySec};
+    // Rewrite automatically once the incr log holds at least rewrite_min_bytes and has grown to
+    // rewrite_percent of the base written by the last rewrite. 0 = only on BGREWRITEAOF.
+    uint64_t rewrite_min_bytes{uint64_t{64} << 20};
+    uint32_t rewrite_percent{100};
+};
+
+inline std::string aof_manifest_path(std::string_view dir, uint32_t shard) {
+    return std::string(dir) + "/appendonly-" + std::to_string(shard) + ".manifest";
+}
+
+inline std::string aof_base_path(std::string_view dir, uint32_t shard, uint64_t seq) {
+    return std::string(dir) + "/appendonly-" + std::to_string(shard) + "." + std::to_string(seq) + ".base.kvs";
+}
+
+inline std::string aof_incr_path(std::string_view dir, uint32_t shard, uint64_t seq) {
+    return std::string(dir) + "/appendonly-" + std::to_string(shard) + "." + std::to_string(seq) + ".incr.aof";
+}
+
+namespace aof_detail {
+
+inline std::error_code last_errno() { return std::error_code(errno, std::system_category()); }
+
+inline std::error_code write_all(int fd, std::span<const uint8_t> data, size_t& written) {
+    written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return last_errno();
+        }
+        written += static_cast<size_t>(n);
+    }
+    return {};
+}
+
+inline std::error_code write_all(int fd, std::span<const uint8_t> data) {
+    size_t written;
+    return write_all(fd, data, written);
+}
+
+// Makes a rename or unlink in `dir` durable.
+inline Result<void> sync_dir(const std::string& dir) {
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return std::unexpected(last_errno());
+    int rc = ::fsync(fd);
+    auto ec = last_errno();
+    ::close(fd);
+    if (rc < 0) return std::unexpected(ec);
+    return {};
+}
+
+} // namespace aof_detail
+
+// Which files make up a shard's log, in replay order. Replaced atomically (tmp + fsync + rename).
+struct AofManifest {
+    std::optional<uint64_t> base;
+    std::vector<uint64_t> incrs;
+
+    static Result<AofManifest> load(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return std::unexpected(aof_detail::last_errno());
+        std::string text;
+        char buf[512];
+        while (true) {
+            ssize_t n = ::read(fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                auto ec = aof_detail::last_errno();
+                ::close(fd);
+                if (n < 0) return std::unexpected(ec);
+                break;
+            }
+            text.append(buf, static_cast<size_t>(n));
+        }
+
+        AofManifest manifest;
+        std::string_view rest = text;
+        while (!rest.empty()) {
+            size_t eol = rest.find('\n');
+            if (eol == std::string_view::npos) return std::unexpected(snapshot_format::corrupt()); // torn write
+            std::string_view line = rest.substr(0, eol);
+            rest.remove_prefix(eol + 1);
+            size_t space = line.find(' ');
+            if (space == std::string_view::npos) return std::unexpected(snapshot_format::corrupt());
+            std::string_view kind = line.substr(0, space);
+            std::string_view num = line.substr(space + 1);
+            uint64_t seq;
+            auto [ptr, ec] = std::from_chars(num.data(), num.data() + num.size(), seq);
+            if (ec != std::errc{} || ptr != num.data() + num.size()) return std::unexpected(snapshot_format::corrupt());
+            if (kind == "base" && !manifest.base && manifest.incrs.empty()) {
+                manifest.base = seq;
+            } else if (kind == "incr" && (manifest.incrs.empty() || seq > manifest.incrs.back())) {
+                manifest.incrs.push_back(seq);
+            } else {
+                return std::unexpected(snapshot_format::corrupt());
+            }
+        }
+        if (manifest.incrs.empty()) return std::unexpected(snapshot_format::corrupt());
+        return manifest;
+    }
+
+    Result<void> store(const std::string& dir, uint32_t shard) const {
+        std::string text;
+        if (base) text += "base " + std::to_string(*base) + "\n";
+        for (uint64_t seq : incrs) text += "incr " + std::to_string(seq) + "\n";
+
+        std::string path = aof_manifest_path(dir, shard);
+        std::string tmp = path + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return std::unexpected(aof_detail::last_errno());
+        std::error_code ec = aof_detail::write_all(fd, {reinterpret_cast<const uint8_t*>(text.data()), text.size()});
+        if (!ec && ::fsync(fd) < 0) ec = aof_detail::last_errno();
+        ::close(fd);
+        if (!ec && ::rename(tmp.c_str(), path.c_str()) < 0) ec = aof_detail::last_errno();
+        if (ec) {
+            ::unlink(tmp.c_str());
+            return std::unexpected(ec);
+        }
+        return aof_detail::sync_dir(dir);
+    }
+};
+
+// The open end of one incr file. The owning reactor hands it the shard's CommandFeed batch once per batch,
+// before the batch's replies leave - one write() (and, under Always, one fdatasync) covers a whole
+// pipeline, which is the group commit. Under EverySec tick() hands the fdatasync to the background pool at
+// most once a second, so the reactor never waits on the disk.
+class AppendLog {
+public:
+    static Result<std::unique_ptr<AppendLog>> open(const std::string& path, FsyncPolicy policy,
+                                                   threading::ThreadPool* io) {
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) return std::unexpected(aof_detail::last_errno());
+        struct stat st{};
+        if (::fstat(fd, &st) < 0) {
+            auto ec = aof_detail::last_errno();
+            ::close(fd);
+            return std::unexpected(ec);
+        }
+        std::unique_ptr<AppendLog> log(new AppendLog(std::make_shared<File>(fd), policy, io));
+        log->size_ = static_cast<uint64_t>(st.st_size);
+        return log;
+    }
+
+    // Whatever a failed write left behind is retried; the final fdatasync and close run on the pool, if
+    // there is one.
+    ~AppendLog() {
+        (void)write({});
+        auto sync_and_close = [file = file_] { (void)::fdatasync(file->fd); };
+        if (io_) {
+            try {
+                io_->submit(sync_and_close);
+                return;
+            } catch (const std::runtime_error&) {
+                // pool shutting down: do it here
+            }
+        }
+        sync_and_close();
+    }
+
+    AppendLog(const AppendLog&) = delete;
+    AppendLog& operator=(const AppendLog&) = delete;
+
+    // How often EverySec syncs, and so the longest an idle owner may sleep while unsynced().
+    static constexpr std::chrono::milliseconds k_sync_interval{1000};
+
+    // Commit point: appends `batch`, after anything an earlier failed write left behind, and under Always
+    // syncs it. A failed write keeps exactly the bytes that didn't make it, so a retry never duplicates a
+    // partial frame; a failed sync sticks (the kernel may have dropped the pages), see failed().
+    Result<void> write(std::span<const uint8_t> batch) {
+        if (!retry_.empty()) {
+            size_t done = 0;
+            auto ec = aof_detail::write_all(file_->fd, retry_, done);
+            size_ += done;
+            retry_.erase(retry_.begin(), retry_.begin() + static_cast<ptrdiff_t>(done));
+            if (ec) {
+                retry_.insert(retry_.end(), batch.begin(), batch.end());
+                write_error_ = ec;
+                return std::unexpected(ec);
+            }
+        }
+        if (!batch.empty()) {
+            size_t done = 0;
+            auto ec = aof_detail::write_all(file_->fd, batch, done);
+            size_ += done;
+            if (ec) {
+                retry_.assign(batch.begin() + static_cast<ptrdiff_t>(done), batch.end());
+                write_error_ = ec;
+                return std::unexpected(ec);
+            }
+            if (policy_ == FsyncPolicy::Always) {
+                if (::fdatasync(file_->fd) < 0) sync_error_ = aof_detail::last_errno();
+            } else {
+                unsynced_ = true;
+            }
+        }
+        write_error_.clear();
+        if (sync_error_) return std::unexpected(sync_error_);
+        return {};
+    }
+
+    // Once per loop iteration: under EverySec, starts a background fdatasync if one is due.
+    void tick() {
+        if (int err = file_->sync_errno.exchange(0, std::memory_order_acq_rel)) {
+            sync_error_ = std::error_code(err, std::system_category());
+        }
+        if (policy_ != FsyncPolicy::EverySec || !unsynced_) return;
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_sync_ < k_sync_interval || file_->syncing.load(std::memory_order_acquire)) return;
+        unsynced_ = false;
+        last_sync_ = now;
+        file_->syncing.store(true, std::memory_order_release);
+        auto sync = [file = file_] {
+            if (::fdatasync(file->fd) < 0) file->sync_errno.store(errno, std::memory_order_release);
+            file->syncing.store(false, std::memory_order_release);
+        };
+        if (io_) {
+            try {
+                io_->submit(sync);
+                return;
+            } catch (const std::runtime_error&) {
+            }
+        }
+        sync();
+    }
+
+    // Written but not yet synced under EverySec; the reactor keeps its sleep short enough to get to it.
+    [[nodiscard]] bool unsynced() const noexcept { return unsynced_; }
+    // Bytes a failed write left to retry.
+    [[nodiscard]] bool has_pending() const noexcept { return !retry_.empty(); }
+    // While true the shard refuses writes: they could not be made as durable as the policy promises.
+    [[nodiscard]] bool failed() const noexcept { return write_error_ || sync_error_; }
+    [[nodiscard]] std::error_code error() const noexcept { return sync_error_ ? sync_error_ : write_error_; }
+    // Bytes in the file, ones waiting for a retry not included.
+    [[nodiscard]] uint64_t size() const noexcept { return size_; }
+
+private:
+    // Shared with background syncs, so the descriptor outlives the last one.
+    struct File {
+        int fd;
+        std::atomic<bool> syncing{false};
+        std::atomic<int> sync_errno{0};
+        explicit File(int f) noexcept : fd(f) {}
+        ~File() { ::close(fd); }
+    };
+
+    std::shared_ptr<File> file_;
+    FsyncPolicy policy_;
+    threading::ThreadPool* io_;
+    std::vector<uint8_t> retry_;
+    uint64_t size_{0};
+    bool unsynced_{false};
+    std::chrono::steady_clock::time_point last_sync_{};
+    std::error_code write_error_;
+    std::error_code sync_error_;
+
+    AppendLog(std::shared_ptr<File> file, FsyncPolicy policy, threading::ThreadPool* io)
+        : file_(std::move(file)), policy_(policy), io_(io) {}
+};
+
+struct ReplayStats {
+    uint64_t commands{0};
+    uint64_t valid_bytes{0};     // prefix made of whole frames
+    uint64_t truncated_bytes{0}; // partial frame at the end, e.g. from a crash mid-write
+};
+
+// Runs every frame of the incr file at `path` through exec(const ArgList&), the views pointing straight
+// into a read-only mapping of the file. A malformed frame fails the replay; a partial one at the very end
+// is reported in truncated_bytes for the caller to decide on.
+template<typename Exec>
+Result<ReplayStats> replay_append_log(const std::string& path, Exec&& exec) {
+    auto mapped = snapshot_format::MappedFile::open(path);
+    if (!mapped) return std::unexpected(mapped.error());
+    std::span<const uint8_t> data = mapped->bytes();
+    ReplayStats stats;
+    while (!data.empty()) {
+        auto frame = RequestParser::parse_next(data, RequestParser::k_trusted);
+        if (!frame) return std::unexpected(snapshot_format::corrupt());
+        if (frame->consumed == 0) {
+            stats.truncated_bytes = data.size();
+            break;
+        }
+        exec(frame->args);
+        stats.commands++;
+        stats.valid_bytes += frame->consumed;
+        data = data.subspan(frame->consumed);
+    }
+    return stats;
+}
+
+#endif // APPEND_LOG_HPP
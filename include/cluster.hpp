@@ -0,0 +1,364 @@
+#ifndef CLUSTER_HPP
+#define CLUSTER_HPP
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include <sys/socket.h>
+#include "common.hpp"
+#include "keyspace.hpp"
+#include "request_parser.hpp"
+#include "response_serializer.hpp"
+#include "socket.hpp"
+#include "../hash.hpp"
+
+// Cluster mode: keys are partitioned into k_cluster_slots hash slots and every node holds a SlotMap saying
+// which node serves which slot. A command for a slot served elsewhere gets a MOVED reply naming the node;
+// clients follow it and cache the mapping. Within a node the slot also picks the shard (slot % shards), so
+// one reactor holds all of a slot's keys.
+//
+// Resharding moves a slot while both nodes keep serving it, the Redis way: the target is told it is
+// IMPORTING the slot, the source that it is MIGRATING it. The source's owning reactor then walks its keyspace
+// a slice per loop tick (the scan cursor tolerates resizes, like HMap's incremental rehash tolerates
+// lookups) and ships the slot's keys to the target in batches; each key is deleted locally once the
+// target acknowledged it. Meanwhile a command for a key that is still on the source runs there, one for a
+// key already gone gets ASK, telling the client to retry that one command on the target after ASKING, and
+// one for a key in a batch on the wire gets TRYAGAIN. When the walk is done the source hands the slot over
+// to the target and answers MOVED from then on.
+
+inline constexpr uint32_t k_cluster_slots = 16384;
+
+// A key containing "{...}" with something between the braces hashes by that part only, so related keys
+// can be put in one slot on purpose.
+[[nodiscard]] inline std::string_view hash_tag(std::string_view key) noexcept {
+    size_t open = key.find('{');
+    if (open == std::string_view::npos) return key;
+    size_t close = key.find('}', open + 1);
+    if (close == std::string_view::npos || close == open + 1) return key;
+    return key.substr(open + 1, close - open - 1);
+}
+
+// Every node, client and restart has to agree on a key's slot, so slots hash under a fixed secret rather
+// than the per-process one the tables use against chain flooding.
+[[nodiscard]] inline const hash_detail::Secret& slot_secret() noexcept {
+    static const hash_detail::Secret secret = hash_detail::make_secret(0x6b76736c6f747321ull);
+    return secret;
+}
+
+// High half of the hash, like the shard routing this replaces: the tables index by the low bits.
+[[nodiscard]] inline uint32_t key_slot(std::string_view key) noexcept {
+    std::string_view tag = hash_tag(key);
+    uint64_t h = hash_bytes(reinterpret_cast<const uint8_t*>(tag.data()), tag.size(), slot_secret());
+    return static_cast<uint32_t>((h >> 32) % k_cluster_slots);
+}
+
+struct ClusterNode {
+    std::string host;
+    uint16_t port{0};
+
+    [[nodiscard]] std::string address() const { return host + ":" + std::to_string(port); }
+
+    // "host:port"
+    static std::optional<ClusterNode> parse(std::string_view text) {
+        size_t colon = text.rfind(':');
+        if (colon == std::string_view::npos || colon == 0) return std::nullopt;
+        uint16_t port;
+        auto digits = text.substr(colon + 1);
+        auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), port);
+        if (ec != std::errc{} || ptr != digits.data() + digits.size() || port == 0) return std::nullopt;
+        return ClusterNode{std::string(text.substr(0, colon)), port};
+    }
+
+    bool operator==(const ClusterNode&) const = default;
+};
+
+struct ClusterConfig {
+    bool enabled{false};
+    std::string announce_host{"127.0.0.1"}; // how other nodes and clients reach this one; the port is the server's
+};
+
+// One reactor's copy of the slot map. All reactors of a node hold the same one: the CLUSTER commands that
+// change it are run by every reactor, the way BGSAVE is. Nodes are interned; index 0 is this node.
+class SlotMap {
+public:
+    static constexpr uint16_t k_none = 0xffff;
+
+    explicit SlotMap(ClusterNode self) {
+        nodes_.push_back(std::move(self));
+        owner_.fill(k_none);
+        migrating_.fill(k_none);
+        importing_.fill(k_none);
+    }
+
+    [[nodiscard]] uint16_t intern(const ClusterNode& node) {
+        auto it = std::find(nodes_.begin(), nodes_.end(), node);
+        if (it != nodes_.end()) return static_cast<uint16_t>(it - nodes_.begin());
+        nodes_.push_back(node);
+        return static_cast<uint16_t>(nodes_.size() - 1);
+    }
+
+    [[nodiscard]] const ClusterNode& node(uint16_t index) const noexcept { return nodes_[index]; }
+    [[nodiscard]] static bool is_self(uint16_t index) noexcept { return index == 0; }
+
+    [[nodiscard]] uint16_t owner(uint32_t slot) const noexcept { return owner_[slot]; }
+    [[nodiscard]] uint16_t migrating_to(uint32_t slot) const noexcept { return migrating_[slot]; }
+    [[nodiscard]] uint16_t importing_from(uint32_t slot) const noexcept { return importing_[slot]; }
+
+    // Ownership changes end any migration of the slot.
+    void assign(uint32_t first, uint32_t last, uint16_t node) noexcept {
+        for (uint32_t slot = first; slot <= last; ++slot) {
+            owner_[slot] = node;
+            migrating_[slot] = importing_[slot] = k_none;
+        }
+    }
+    void set_migrating(uint32_t slot, uint16_t node) noexcept { migrating_[slot] = node; }
+    void set_importing(uint32_t slot, uint16_t node) noexcept { importing_[slot] = node; }
+    void set_stable(uint32_t slot) noexcept { migrating_[slot] = importing_[slot] = k_none; }
+
+    struct Range {
+        uint32_t first;
+        uint32_t last;
+        uint16_t node;
+    };
+
+    // Runs of consecutive slots with the same owner, unassigned ones left out.
+    [[nodiscard]] std::vector<Range> ranges() const {
+        std::vector<Range> out;
+        for (uint32_t slot = 0; slot < k_cluster_slots; ++slot) {
+            if (owner_[slot] == k_none) continue;
+            if (!out.empty() && out.back().last + 1 == slot && out.back().node == owner_[slot]) {
+                out.back().last = slot;
+            } else {
+                out.push_back({slot, slot, owner_[slot]});
+            }
+        }
+        return out;
+    }
+
+private:
+    std::vector<ClusterNode> nodes_;
+    std::array<uint16_t, k_cluster_slots> owner_;
+    std::array<uint16_t, k_cluster_slots> migrating_;
+    std::array<uint16_t, k_cluster_slots> importing_;
+};
+
+// The source side of moving slots to one target node, driven by the reactor owning those slots' keys.
+// It sends plain commands on an ordinary client connection - ASKING before each, since the target does
+// not own the slots yet - so the target needs nothing special beyond knowing it is importing them. One
+// batch is on the wire at a time; its keys stay in place, answering TRYAGAIN, until every reply is in.
+class SlotMigration {
+public:
+    enum class State : uint8_t { Connecting, Moving, Handover, Failed };
+
+    SlotMigration(uint16_t target, Socket socket) : target_(target), socket_(std::move(socket)) {}
+
+    [[nodiscard]] uint16_t target() const noexcept { return target_; }
+    [[nodiscard]] int fd() const noexcept { return socket_.get(); }
+    [[nodiscard]] State state() const noexcept { return state_; }
+    [[nodiscard]] bool moves(uint32_t slot) const noexcept {
+        return std::find(slots_.begin(), slots_.end(), slot) != slots_.end() ||
+               std::find(handover_.begin(), handover_.end(), slot) != handover_.end();
+    }
+    [[nodiscard]] bool empty() const noexcept { return slots_.empty() && handover_.empty(); }
+    [[nodiscard]] bool in_flight(std::string_view key) const { return in_flight_.contains(std::string(key)); }
+    [[nodiscard]] bool idle() const noexcept { return expected_ == 0 && out_pos_ == out_.size(); }
+    [[nodiscard]] bool wants_write() const noexcept { return state_ == State::Connecting || out_pos_ < out_.size(); }
+    // Walk finished with nothing left on the wire: time to hand the slots over.
+    [[nodiscard]] bool walked() const noexcept { return state_ == State::Moving && cursor_ == 0 && started_ && idle(); }
+    // Has keyspace left to walk and nothing on the wire, so fill() can make progress right away.
+    [[nodiscard]] bool walking() const noexcept { return state_ == State::Moving && idle() && !slots_.empty() && !walked(); }
+
+    // A slot added midway restarts the walk, so it is covered from the beginning too. One added during a
+    // handover waits for the next walk.
+    void add_slot(uint32_t slot) {
+        if (moves(slot)) return;
+        slots_.push_back(slot);
+        cursor_ = 0;
+        started_ = false;
+    }
+    // Only slots not yet being handed over can be taken back.
+    void remove_slot(uint32_t slot) { std::erase(slots_, slot); }
+
+    // Connect finished (or not).
+    Result<void> connected() {
+        if (auto res = connect_result(socket_); !res) return fail(res.error());
+        state_ = State::Moving;
+        return {};
+    }
+
+    // Walks up to `buckets` buckets of `ks` while no batch is out, queueing commands that recreate the
+    // slots' keys there, at most k_batch_keys keys or k_batch_bytes bytes a batch. A cold value that cannot
+    // be read fails the migration: handing the key over without it would lose it on both nodes.
+    template<typename Keyspace>
+    Result<void> fill(Keyspace& ks, size_t buckets) {
+        if (state_ != State::Moving || !idle() || walked()) return {};
+        out_.clear();
+        out_pos_ = 0;
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < buckets && keys.size() < k_batch_keys && !slots_.empty(); ++i) {
+            cursor_ = ks.scan(cursor_, [&](Entry& e) {
+                if (moves(key_slot(e.key))) keys.push_back(e.key);
+            });
+            started_ = true;
+            if (cursor_ == 0) break;
+        }
+        for (const std::string& key : keys) {
+            Entry* entry = ks.find(key); // may have expired since the walk saw it
+            if (!entry || in_flight_.contains(key)) continue;
+            if (auto res = encode_key(ks, *entry); !res) return fail(res.error());
+            in_flight_.insert(key);
+            batch_.push_back(key);
+            if (out_.size() >= k_batch_bytes) break;
+        }
+        return {};
+    }
+
+    // After the walk: the target takes the slots over. Its replies are read like a batch's; once they are
+    // all in, the owner switches its own map for handed_over() and calls handover_done().
+    void hand_over(std::string_view target_address) {
+        out_.clear();
+        out_pos_ = 0;
+        handover_ = std::exchange(slots_, {});
+        for (uint32_t slot : handover_) {
+            std::string n = std::to_string(slot);
+            RequestParser::encode(out_, {"cluster", "setslot", n, "node", target_address});
+            expected_++;
+        }
+        state_ = State::Handover;
+    }
+
+    // Writes what fits and reads whatever replies arrived. Returns true once everything sent is answered;
+    // an error reply fails the migration.
+    Result<bool> on_io() {
+        while (out_pos_ < out_.size()) {
+            ssize_t n = ::send(fd(), out_.data() + out_pos_, out_.size() - out_pos_, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                return fail(std::error_code(errno, std::system_category()));
+            }
+            out_pos_ += static_cast<size_t>(n);
+        }
+        std::array<uint8_t, 16 * 1024> chunk;
+        while (true) {
+            ssize_t n = ::recv(fd(), chunk.data(), chunk.size(), 0);
+            if (n == 0) return fail(std::make_error_code(std::errc::connection_reset));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                return fail(std::error_code(errno, std::system_category()));
+            }
+            in_.insert(in_.end(), chunk.data(), chunk.data() + n);
+        }
+        size_t pos = 0;
+        while (expected_ > 0) {
+            size_t n = ResponseSerializer::reply_length(std::span(in_).subspan(pos));
+            if (n == 0) break;
+            if (in_[pos] == static_cast<uint8_t>(ds::SerializationType::Error)) {
+                return fail(std::make_error_code(std::errc::connection_refused));
+            }
+            pos += n;
+            expected_--;
+        }
+        in_.erase(in_.begin(), in_.begin() + static_cast<ptrdiff_t>(pos));
+        return expected_ == 0 && out_pos_ == out_.size();
+    }
+
+    [[nodiscard]] const std::vector<uint32_t>& handed_over() const noexcept { return handover_; }
+    void handover_done() {
+        handover_.clear();
+        state_ = State::Moving;
+        started_ = false; // walks again only if slots were added meanwhile
+    }
+
+    // The keys of the batch just acknowledged; the owner deletes them and calls batch_done().
+    [[nodiscard]] const std::vector<std::string>& batch() const noexcept { return batch_; }
+    void batch_done() {
+        in_flight_.clear();
+        batch_.clear();
+    }
+
+    [[nodiscard]] std::error_code error() const noexcept { return error_; }
+
+    // Whether the owner currently has write interest registered for fd().
+    [[nodiscard]] bool write_armed() const noexcept { return write_armed_; }
+    void set_write_armed(bool on) noexcept { write_armed_ = on; }
+
+private:
+    static constexpr size_t k_batch_keys = 128;
+    static constexpr size_t k_batch_bytes = 256 * 1024;
+
+    uint16_t target_;
+    Socket socket_;
+    State state_{State::Connecting};
+    std::error_code error_;
+    std::vector<uint32_t> slots_;
+    std::vector<uint32_t> handover_;
+    size_t cursor_{0};
+    bool started_{false};
+    std::unordered_set<std::string> in_flight_;
+    std::vector<std::string> batch_;
+    std::vector<uint8_t> out_;
+    size_t out_pos_{0};
+    std::vector<uint8_t> in_;
+    size_t expected_{0}; // replies still owed
+    bool write_armed_{false};
+
+    std::unexpected<std::error_code> fail(std::error_code ec) {
+        state_ = State::Failed;
+        error_ = ec;
+        return std::unexpected(ec);
+    }
+
+    void command(std::initializer_list<std::string_view> args) {
+        RequestParser::encode(out_, {"asking"});
+        RequestParser::encode(out_, args);
+        expected_ += 2;
+    }
+
+    // DEL first, in case an earlier attempt left a copy behind.
+    template<typename Keyspace>
+    Result<void> encode_key(Keyspace& ks, const Entry& entry) {
+        std::optional<std::string> cold;
+        if (entry.type == EntryType::Cold) {
+            auto value = ks.cold_value(entry);
+            if (!value) return std::unexpected(value.error());
+            cold = std::move(*value);
+        }
+        command({"del", entry.key});
+        if (entry.type == EntryType::ZSet) {
+            const ds::ZSet& zset = *entry.zset;
+            if (!zset.empty()) {
+                ds::ZCursor cursor = zset.range_by_rank(0, zset.size() - 1);
+                ds::ZMember batch[64];
+                char score[32];
+                while (size_t n = cursor.next_batch(batch)) {
+                    for (size_t i = 0; i < n; ++i) {
+                        auto [end, ec] = std::to_chars(score, score + sizeof(score), batch[i].score);
+                        command({"zadd", entry.key, std::string_view(score, static_cast<size_t>(end - score)), batch[i].name});
+                    }
+                }
+            }
+        } else if (cold) {
+            command({"set", entry.key, *cold});
+        } else {
+            command({"set", entry.key, entry.value});
+        }
+        if (int64_t ttl = ks.pttl(entry); ttl >= 0) {
+            std::string at = std::to_string(snapshot_format::unix_ms_after(ttl));
+            command({"pexpireat", entry.key, at});
+        }
+        return {};
+    }
+};
+
+#endif // CLUSTER_HPP
@@ -0,0 +1,483 @@
+#ifndef COLD_TIER_HPP
+#define COLD_TIER_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "logging.hpp"
+#include "../crc32c.hpp"
+#include "../thread_pool.hpp"
+
+// Optional second tier for one shard: string values the memory policy evicts are appended to a
+// log-structured file on local disk instead of being dropped, and the keyspace keeps just the key and a
+// ColdRef saying where the value went. Reading one back is asynchronous - a pool worker preads it and the
+// reactor is woken with the result - so a GET for a cold key suspends its connection, never the loop.
+//
+// The log is a series of segment files, cold-<shard>-<n>.seg in the data dir, the newest one taking
+// appends. A record is [u32 crc32c(rest)][u32 key_len][u32 value_len][key][value]; the key is there so
+// compaction can tell live records from dead ones. Appends are buffered and written behind by the pool, one
+// chunk at a time, and reads of bytes not on disk yet are served from those buffers. Values deleted,
+// overwritten or loaded back leave dead records; once half of a full segment is dead, compaction reads
+// it back a chunk at a time, the keyspace re-appends the records still live, and the file is removed.
+//
+// The files only extend memory: nothing in them survives a restart (snapshots and the log carry the
+// values), so open() clears whatever an earlier run left.
+
+// Where a cold value's record is. Packed into 12 bytes, well within ds::SharedString's k_inline: Entry
+// keeps its ColdRef in `value` and costs no allocation for it.
+struct ColdRef {
+    static constexpr size_t k_encoded_size = 12;
+
+    uint32_t segment{0};
+    uint32_t offset{0}; // of the record in the segment file
+    uint32_t length{0}; // of the whole record
+
+    [[nodiscard]] std::string encode() const {
+        std::string out(k_encoded_size, '\0');
+        std::memcpy(out.data(), &segment, 4);
+        std::memcpy(out.data() + 4, &offset, 4);
+        std::memcpy(out.data() + 8, &length, 4);
+        return out;
+    }
+
+    [[nodiscard]] static ColdRef decode(std::string_view bytes) noexcept {
+        ColdRef ref;
+        if (bytes.size() != k_encoded_size) return ref;
+        std::memcpy(&ref.segment, bytes.data(), 4);
+        std::memcpy(&ref.offset, bytes.data() + 4, 4);
+        std::memcpy(&ref.length, bytes.data() + 8, 4);
+        return ref;
+    }
+
+    bool operator==(const ColdRef&) const = default;
+};
+
+struct ColdTierConfig {
+    bool enabled{false};
+    size_t min_value_bytes{256}; // smaller values are evicted outright: the key would cost most of what they do
+};
+
+struct ColdTierStats {
+    uint64_t spilled{0};     // values written out
+    uint64_t loads{0};       // values read back for a client
+    uint64_t load_errors{0};
+    uint64_t write_errors{0}; // failed writes of a chunk, each retried
+    uint64_t compactions{0}; // segments compacted away
+    uint64_t relocated{0};   // ... and the live records moved out of them
+    size_t segments{0};
+    size_t file_bytes{0};    // all segments, dead records included
+    size_t dead_bytes{0};
+};
+
+class ColdTier {
+public:
+    static constexpr uint32_t k_segment_bytes = 64u << 20;
+    static constexpr size_t k_header_size = 12;
+
+    struct Loaded {
+        std::string key;
+        ColdRef ref;
+        Result<std::string> value;
+    };
+
+    // A record found in a segment being compacted; the keyspace re-appends it if `ref` is still the key's.
+    struct Record {
+        std::string key;
+        std::string value;
+        ColdRef ref;
+    };
+
+    // `wake` is called from pool threads when results are waiting for poll().
+    ColdTier(std::string dir, uint32_t shard, threading::ThreadPool* io, std::function<void()> wake)
+        : dir_(std::move(dir)), shard_(shard), io_(io), shared_(std::make_shared<Shared>()) {
+        shared_->wake = std::move(wake);
+    }
+
+    // Tasks still running hold the files open; the names go now.
+    ~ColdTier() {
+        for (const auto& [id, segment] : segments_) ::unlink(path_of(id).c_str());
+    }
+
+    ColdTier(const ColdTier&) = delete;
+    ColdTier& operator=(const ColdTier&) = delete;
+
+    Result<void> open() {
+        std::error_code ec;
+        std::string prefix = "cold-" + std::to_string(shard_) + "-";
+        for (const auto& file : std::filesystem::directory_iterator(dir_, ec)) {
+            std::string name = file.path().filename().string();
+            if (name.starts_with(prefix) && name.ends_with(".seg")) ::unlink(file.path().c_str());
+        }
+        return start_segment(0);
+    }
+
+    // Appends a record; the ref is good for read() and fetch() right away.
+    ColdRef append(std::string_view key, std::string_view value) {
+        uint32_t length = static_cast<uint32_t>(k_header_size + key.size() + value.size());
+        if (segments_.at(active_).bytes + length > k_segment_bytes && segments_.at(active_).bytes > 0) {
+            (void)start_segment(active_ + 1); // a failed open leaves appends going to the full segment
+        }
+        Segment& segment = segments_.at(active_);
+        ColdRef ref{active_, segment.bytes, length};
+        if (pending_.empty() || pending_.back().in_flight || pending_.back().ref.segment != active_ ||
+            pending_.back().bytes->size() >= k_write_chunk) {
+            pending_.push_back(Chunk{ColdRef{active_, segment.bytes, 0}, std::make_shared<std::vector<uint8_t>>()});
+        }
+        std::vector<uint8_t>& out = *pending_.back().bytes;
+        size_t at = out.size();
+        out.resize(at + length);
+        uint32_t klen = static_cast<uint32_t>(key.size()), vlen = static_cast<uint32_t>(value.size());
+        std::memcpy(out.data() + at + 4, &klen, 4);
+        std::memcpy(out.data() + at + 8, &vlen, 4);
+        std::memcpy(out.data() + at + k_header_size, key.data(), key.size());
+        std::memcpy(out.data() + at + k_header_size + key.size(), value.data(), value.size());
+        uint32_t crc = crc32c(out.data() + at + 4, length - 4);
+        std::memcpy(out.data() + at, &crc, 4);
+        pending_.back().ref.length += length;
+        segment.bytes += length;
+        stats_.spilled++;
+        stats_.file_bytes += length;
+        return ref;
+    }
+
+    // The record no longer backs a key.
+    void release(ColdRef ref) noexcept {
+        auto it = segments_.find(ref.segment);
+        if (it == segments_.end()) return;
+        it->second.dead += ref.length;
+        stats_.dead_bytes += ref.length;
+    }
+
+    // Reads the value on a pool worker; it comes back through poll(). Bytes not written yet are copied
+    // out of the buffers right here.
+    void fetch(std::string key, ColdRef ref) {
+        stats_.loads++;
+        if (auto buffered = from_buffers(ref)) {
+            return complete(Completion{Completion::Kind::Loaded, std::move(key), ref, decode(*buffered, ref), {}});
+        }
+        auto file = file_of(ref.segment);
+        if (!file) {
+            return complete(Completion{Completion::Kind::Loaded, std::move(key), ref, std::unexpected(missing()), {}});
+        }
+        run([shared = shared_, file, key = std::move(key), ref]() mutable {
+            auto value = read_record(file->fd, ref);
+            shared->push(Completion{Completion::Kind::Loaded, std::move(key), ref, std::move(value), {}});
+        });
+    }
+
+    // Blocking read, for the paths that walk the keyspace at their own pace (snapshots, slot migration).
+    [[nodiscard]] Result<std::string> read(ColdRef ref) const {
+        if (auto buffered = from_buffers(ref)) return decode(*buffered, ref);
+        auto file = file_of(ref.segment);
+        if (!file) return std::unexpected(missing());
+        return read_record(file->fd, ref);
+    }
+
+    // Once per loop tick: hands finished loads to on_loaded(Loaded&&) and the records of a segment being
+    // compacted to on_record(Record&&) - true if it re-appended one - then keeps the write-behind and
+    // compaction going.
+    template<typename OnLoaded, typename OnRecord>
+    void poll(OnLoaded&& on_loaded, OnRecord&& on_record) {
+        std::vector<Completion> done;
+        {
+            std::lock_guard lock(shared_->mutex);
+            done.swap(shared_->done);
+        }
+        for (Completion& c : done) {
+            switch (c.kind) {
+                case Completion::Kind::Written:
+                    writing_ = false;
+                    if (!c.value) {
+                        // The chunk is the only copy of its values: it stays buffered (and readable) and is
+                        // written again after k_write_retry.
+                        log_error("write", c.value.error());
+                        stats_.write_errors++;
+                        pending_.front().in_flight = false;
+                        write_retry_at_ = std::chrono::steady_clock::now() + k_write_retry;
+                        break;
+                    }
+                    pending_.pop_front();
+                    break;
+                case Completion::Kind::Loaded:
+                    if (!c.value) stats_.load_errors++;
+                    on_loaded(Loaded{std::move(c.key), c.ref, std::move(c.value)});
+                    break;
+                case Completion::Kind::Scanned:
+                    compact_scanned(c, on_record);
+                    break;
+            }
+        }
+        start_write();
+        start_compaction();
+    }
+
+    [[nodiscard]] ColdTierStats stats() const noexcept {
+        ColdTierStats s = stats_;
+        s.segments = segments_.size();
+        return s;
+    }
+
+private:
+    static constexpr size_t k_write_chunk = 1u << 20;   // appends gathered per write
+    static constexpr size_t k_compact_chunk = 4u << 20; // bytes read per compaction step
+    static constexpr std::chrono::seconds k_write_retry{1}; // after a failed write, before the next try
+
+    struct File {
+        int fd{-1};
+        ~File() { if (fd != -1) ::close(fd); }
+    };
+
+    struct Segment {
+        std::shared_ptr<File> file;
+        uint32_t bytes{0};
+        uint32_t dead{0};
+    };
+
+    // Appends of one segment waiting for (or in) a write; ref is the run they cover.
+    struct Chunk {
+        ColdRef ref;
+        std::shared_ptr<std::vector<uint8_t>> bytes;
+        bool in_flight{false};
+    };
+
+    struct Completion {
+        enum class Kind : uint8_t { Written, Loaded, Scanned };
+        Kind kind;
+        std::string key;
+        ColdRef ref;                      // Loaded: the record; Scanned: the range read
+        Result<std::string> value;        // Written: error only; Scanned: the bytes read
+        std::vector<Record> records;      // Scanned
+    };
+
+    // Between the pool tasks and poll(); outlives the tier if a task is still running.
+    struct Shared {
+        std::mutex mutex;
+        std::vector<Completion> done; // guarded by mutex
+        std::function<void()> wake;
+
+        void push(Completion c) {
+            {
+                std::lock_guard lock(mutex);
+                done.push_back(std::move(c));
+            }
+            if (wake) wake();
+        }
+    };
+
+    std::string dir_;
+    uint32_t shard_;
+    threading::ThreadPool* io_;
+    std::shared_ptr<Shared> shared_;
+    std::unordered_map<uint32_t, Segment> segments_;
+    uint32_t active_{0};
+    std::deque<Chunk> pending_;
+    bool writing_{false};
+    std::chrono::steady_clock::time_point write_retry_at_{}; // no write starts before it
+    std::optional<uint32_t> compacting_;
+    uint32_t compact_pos_{0};
+    bool scanning_{false};
+    ColdTierStats stats_;
+
+    [[nodiscard]] std::string path_of(uint32_t id) const {
+        return dir_ + "/cold-" + std::to_string(shard_) + "-" + std::to_string(id) + ".seg";
+    }
+
+    static std::error_code missing() { return std::make_error_code(std::errc::no_such_file_or_directory); }
+
+    Result<void> start_segment(uint32_t id) {
+        auto file = std::make_shared<File>();
+        file->fd = ::open(path_of(id).c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (file->fd < 0) return std::unexpected(std::error_code(errno, std::system_category()));
+        segments_[id] = Segment{std::move(file), 0, 0};
+        active_ = id;
+        return {};
+    }
+
+    [[nodiscard]] std::shared_ptr<File> file_of(uint32_t id) const {
+        auto it = segments_.find(id);
+        return it == segments_.end() ? nullptr : it->second.file;
+    }
+
+    // Without a pool (or once it is shutting down) the work is done inline.
+    template<typename Fn>
+    void run(Fn fn) {
+        if (io_) {
+            try {
+                io_->submit(fn);
+                return;
+            } catch (const std::runtime_error&) {
+            }
+        }
+        fn();
+    }
+
+    void complete(Completion c) { shared_->push(std::move(c)); }
+
+    // The record's bytes, if they are still in a write buffer.
+    [[nodiscard]] std::optional<std::string_view> from_buffers(ColdRef ref) const {
+        for (const Chunk& chunk : pending_) {
+            if (chunk.ref.segment != ref.segment || ref.offset < chunk.ref.offset ||
+                ref.offset + ref.length > chunk.ref.offset + chunk.ref.length) continue;
+            return std::string_view(reinterpret_cast<const char*>(chunk.bytes->data()) + (ref.offset - chunk.ref.offset), ref.length);
+        }
+        return std::nullopt;
+    }
+
+    // The value of a whole record, checked against its CRC.
+    static Result<std::string> decode(std::string_view record, ColdRef ref) {
+        if (record.size() != ref.length || record.size() < k_header_size) return std::unexpected(std::make_error_code(std::errc::bad_message));
+        uint32_t crc, klen, vlen;
+        std::memcpy(&crc, record.data(), 4);
+        std::memcpy(&klen, record.data() + 4, 4);
+        std::memcpy(&vlen, record.data() + 8, 4);
+        if (k_header_size + size_t{klen} + vlen != record.size() ||
+            crc32c(reinterpret_cast<const uint8_t*>(record.data()) + 4, record.size() - 4) != crc) {
+            return std::unexpected(std::make_error_code(std::errc::bad_message));
+        }
+        return std::string(record.substr(k_header_size + klen));
+    }
+
+    static Result<std::string> read_exact(int fd, uint32_t offset, uint32_t length) {
+        std::string buf(length, '\0');
+        size_t got = 0;
+        while (got < length) {
+            ssize_t n = ::pread(fd, buf.data() + got, length - got, static_cast<off_t>(offset + got));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return std::unexpected(std::error_code(errno, std::system_category()));
+            if (n == 0) return std::unexpected(std::make_error_code(std::errc::bad_message));
+            got += static_cast<size_t>(n);
+        }
+        return buf;
+    }
+
+    static Result<std::string> read_record(int fd, ColdRef ref) {
+        auto bytes = read_exact(fd, ref.offset, ref.length);
+        if (!bytes) return std::unexpected(bytes.error());
+        return decode(*bytes, ref);
+    }
+
+    // One write in flight at a time; the chunk stays readable in pending_ until it is on disk.
+    void start_write() {
+        if (writing_ || pending_.empty() || std::chrono::steady_clock::now() < write_retry_at_) return;
+        Chunk& chunk = pending_.front();
+        chunk.in_flight = true;
+        writing_ = true;
+        run([shared = shared_, file = file_of(chunk.ref.segment), bytes = chunk.bytes, ref = chunk.ref] {
+            Result<std::string> res{};
+            size_t done = 0;
+            while (file && done < bytes->size()) {
+                ssize_t n = ::pwrite(file->fd, bytes->data() + done, bytes->size() - done, static_cast<off_t>(ref.offset + done));
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0) {
+                    res = std::unexpected(std::error_code(errno, std::system_category()));
+                    break;
+                }
+                done += static_cast<size_t>(n);
+            }
+            shared->push(Completion{Completion::Kind::Written, {}, ref, std::move(res), {}});
+        });
+    }
+
+    void log_error(std::string_view what, std::error_code ec) const {
+        log_message(std::format("cold tier {}: {} failed: {}", shard_, what, ec.message()));
+    }
+
+    // Picks a full segment that is at least half dead and has nothing left to write.
+    void start_compaction() {
+        if (scanning_) return;
+        if (!compacting_) {
+            for (const auto& [id, segment] : segments_) {
+                if (id == active_ || segment.dead * 2 < segment.bytes) continue;
+                bool unwritten = std::any_of(pending_.begin(), pending_.end(), [id](const Chunk& c) { return c.ref.segment == id; });
+                if (unwritten) continue;
+                compacting_ = id;
+                compact_pos_ = 0;
+                break;
+            }
+            if (!compacting_) return;
+        }
+        const Segment& segment = segments_.at(*compacting_);
+        uint32_t length = static_cast<uint32_t>(std::min<size_t>(k_compact_chunk, segment.bytes - compact_pos_));
+        ColdRef range{*compacting_, compact_pos_, length};
+        scanning_ = true;
+        // The completion's ref.length is how far the whole records read reach; 0 ends the walk.
+        run([shared = shared_, file = segment.file, range, end = segment.bytes] {
+            Completion c{Completion::Kind::Scanned, {}, range, read_exact(file->fd, range.offset, range.length), {}};
+            size_t used = c.value ? parse_records(*c.value, range, c.records) : 0;
+            if (c.value && used == 0 && c.value->size() >= k_header_size) {
+                // A record bigger than the chunk: read just that one.
+                uint32_t klen, vlen;
+                std::memcpy(&klen, c.value->data() + 4, 4);
+                std::memcpy(&vlen, c.value->data() + 8, 4);
+                size_t record_len = k_header_size + size_t{klen} + vlen;
+                if (range.offset + record_len <= end) {
+                    c.value = read_exact(file->fd, range.offset, static_cast<uint32_t>(record_len));
+                    if (c.value) used = parse_records(*c.value, range, c.records);
+                }
+            }
+            c.ref.length = static_cast<uint32_t>(used);
+            shared->push(std::move(c));
+        });
+    }
+
+    // Appends the records wholly inside `bytes` (read at `range`) to `out`; returns the bytes they span.
+    // Ones failing their CRC are stepped over and left behind.
+    static size_t parse_records(std::string_view bytes, ColdRef range, std::vector<Record>& out) {
+        size_t pos = 0;
+        while (bytes.size() - pos >= k_header_size) {
+            uint32_t klen, vlen;
+            std::memcpy(&klen, bytes.data() + pos + 4, 4);
+            std::memcpy(&vlen, bytes.data() + pos + 8, 4);
+            size_t length = k_header_size + size_t{klen} + vlen;
+            if (bytes.size() - pos < length) break;
+            ColdRef ref{range.segment, static_cast<uint32_t>(range.offset + pos), static_cast<uint32_t>(length)};
+            auto value = decode(bytes.substr(pos, length), ref);
+            if (value) out.push_back(Record{std::string(bytes.substr(pos + k_header_size, klen)), std::move(*value), ref});
+            pos += length;
+        }
+        return pos;
+    }
+
+    template<typename OnRecord>
+    void compact_scanned(Completion& c, OnRecord& on_record) {
+        scanning_ = false;
+        if (!c.value) {
+            log_error("compaction read", c.value.error()); // leave the segment be
+            compacting_.reset();
+            return;
+        }
+        for (Record& rec : c.records) {
+            if (on_record(std::move(rec))) stats_.relocated++;
+        }
+        const Segment& segment = segments_.at(c.ref.segment);
+        // A record cut off by the chunk end is read again by the next step.
+        compact_pos_ = c.ref.offset + c.ref.length;
+        if (c.ref.length > 0 && compact_pos_ < segment.bytes) return;
+        stats_.compactions++;
+        stats_.file_bytes -= segment.bytes;
+        stats_.dead_bytes -= segment.dead;
+        ::unlink(path_of(c.ref.segment).c_str());
+        segments_.erase(c.ref.segment);
+        compacting_.reset();
+    }
+};
+
+#endif // COLD_TIER_HPP
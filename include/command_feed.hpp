@@ -0,0 +1,52 @@
+#ifndef COMMAND_FEED_HPP
+#define COMMAND_FEED_HPP
+
+#include <charconv>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include "command_table.hpp"
+#include "request_parser.hpp"
+#include "snapshot.hpp"
+
+// A shard's stream of executed writes, encoded once for everything that consumes it - the append-only log
+// and the replication backlog - in the framing RequestParser reads, so applying it is the connection path
+// minus the socket. Frames are replay-stable: PEXPIRE is rewritten to PEXPIREAT, and keys the shard
+// expires on its own are fed as DEL. The owning reactor hands pending() to the consumers once per batch
+// and clears it.
+class CommandFeed {
+public:
+    // A write the shard just executed.
+    void append(const CommandSpec& spec, const ArgList& args) {
+        if (spec.id == CommandId::PExpire) {
+            int64_t ttl_ms;
+            auto [ptr, ec] = std::from_chars(args[2].data(), args[2].data() + args[2].size(), ttl_ms);
+            if (ec == std::errc{} && ttl_ms >= 0) {
+                std::string at = std::to_string(snapshot_format::unix_ms_after(ttl_ms));
+                return RequestParser::encode(pending_, {"pexpireat", args[1], at});
+            }
+        }
+        RequestParser::encode(pending_, std::span<const std::string_view>(args.begin(), args.size()));
+    }
+
+    // A key the shard removed by itself (expiry), so whoever applies the feed removes it at the same point.
+    void append_del(std::string_view key) { RequestParser::encode(pending_, {"del", key}); }
+
+    [[nodiscard]] std::span<const uint8_t> pending() const noexcept { return pending_; }
+    [[nodiscard]] bool empty() const noexcept { return pending_.empty(); }
+    void clear() noexcept { pending_.clear(); }
+
+    // Set while a consumer can't keep its promise (the log failing to write or sync); CommandProcessor
+    // refuses writes with this reason meanwhile.
+    void set_refused(std::error_code why) noexcept { refused_ = why; }
+    [[nodiscard]] std::error_code refused() const noexcept { return refused_; }
+
+private:
+    std::vector<uint8_t> pending_;
+    std::error_code refused_;
+};
+
+#endif // COMMAND_FEED_HPP
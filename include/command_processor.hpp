@@ -1,32 +1,433 @@
 #ifndef COMMAND_PROCESSOR_HPP
 #define COMMAND_PROCESSOR_HPP
 
-#include <unordered_map>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <charconv>
+#include <cmath>
+#include <optional>
+#include <algorithm>
+#include <array>
+#include "request_parser.hpp"
+#include "command_table.hpp"
+#include "response_serializer.hpp"
+#include "keyspace.hpp"
 
 class CommandProcessor {
 public:
-    static void process_command(const std::vector<std::string>& args, std::vector<uint8_t>& response) {
+    using Out = std::vector<uint8_t>;
+
+    static void process_command(Keyspace& ks, const ArgList& args, Out& response) {
         if (args.empty()) {
-            response.push_back(0);
+            ResponseSerializer::serialize_error(response, ErrorCode::Unknown, "empty command");
             return;
         }
 
-        auto it = command_handlers.find(args[0]);
-        if (it == command_handlers.end()) {
-            response.push_back(1);
+        const CommandSpec* spec = find_command(args[0]);
+        if (!spec) {
+            ResponseSerializer::serialize_error(response, ErrorCode::Unknown, "unknown command");
+            return;
+        }
+        if (!spec->arity_ok(args.size())) {
+            ResponseSerializer::serialize_error(response, ErrorCode::Arity, "wrong number of arguments");
             return;
         }
 
-        it->second(args, response);
+        execute(ks, *spec, args, response);
+    }
+
+    // For callers that already resolved and validated the spec (e.g. for shard routing). Writes that
+    // succeed are appended to the shard's command feed, if it has one. Over maxmemory, writes that can grow
+    // the keyspace first evict a batch, and are refused if that doesn't get it under the limit.
+    static void execute(Keyspace& ks, const CommandSpec& spec, const ArgList& args, Out& response) {
+        CommandFeed* feed = spec.is_write() ? ks.command_feed() : nullptr;
+        if (feed && feed->refused()) {
+            return ResponseSerializer::serialize_error(response, ErrorCode::Busy, "append-only log is failing, writes refused");
+        }
+        if (spec.denies_oom() && !ks.make_room()) {
+            return ResponseSerializer::serialize_error(response, ErrorCode::OutOfMemory, "command not allowed when used memory > 'maxmemory'");
+        }
+        if (spec.is_write() && ks.snapshotting()) {
+            for_each_key(spec, args, [&ks](std::string_view key) { ks.before_write(key); });
+        }
+        size_t reply_at = response.size();
+        if (spec.is_write()) {
+            ks.begin_mutation();
+            run(ks, spec, args, response);
+            ks.end_mutation();
+        } else {
+            run(ks, spec, args, response);
+        }
+        // A command that failed changed nothing, so there is nothing to replay.
+        if (feed && response.size() > reply_at &&
+            response[reply_at] != static_cast<uint8_t>(ds::SerializationType::Error)) {
+            feed->append(spec, args);
+        }
+    }
+
+    // GET for a caller that can send the value by reference: for a string value of at least `min_bytes`
+    // only the reply header is written, and the value comes back shared for the caller to send after it.
+    // Anything else gets its whole reply written as usual.
+    static std::optional<ds::SharedString::Ref> get_shared(Keyspace& ks, const ArgList& args, Out& resp, size_t min_bytes) {
+        Entry* entry = ks.find(args[1]);
+        if (!entry || entry->type != EntryType::String || entry->value.size() < min_bytes || !entry->value.shareable()) {
+            get_reply(ks, entry, resp);
+            return std::nullopt;
+        }
+        ResponseSerializer::serialize_string_header(resp, entry->value.size());
+        return entry->value.share();
+    }
+
+    static std::optional<int64_t> parse_int(std::string_view s) {
+        int64_t value;
+        auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+        if (ec != std::errc{} || ptr != s.data() + s.size()) return std::nullopt;
+        return value;
+    }
+
+    static std::optional<double> parse_double(std::string_view s) {
+        double value;
+        auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+        if (ec != std::errc{} || ptr != s.data() + s.size() || std::isnan(value)) return std::nullopt;
+        return value;
+    }
+
+    // Score interval ends as ZCOUNT takes them: "1.5", "(1.5" (exclusive), "-inf", "+inf".
+    static std::optional<ds::ScoreBound> parse_score_bound(std::string_view s) {
+        ds::ScoreBound bound{0, false};
+        if (!s.empty() && s.front() == '(') {
+            bound.exclusive = true;
+            s.remove_prefix(1);
+        }
+        if (!s.empty() && s.front() == '+') s.remove_prefix(1); // from_chars rejects a leading '+'
+        auto value = parse_double(s);
+        if (!value) return std::nullopt;
+        bound.value = *value;
+        return bound;
     }
 
 private:
-    static inline const std::unordered_map<std::string, void(*)(const std::vector<std::string>&, std::vector<uint8_t>&)> command_handlers = {
-        {"ping", [](const auto&, auto& resp) { resp.push_back(2); }},
-        {"echo", [](const auto& args, auto& resp) { resp.insert(resp.end(), args[1].begin(), args[1].end()); }}
-    };
+    // Members gathered per batch before serializing; lets the response grow once per batch.
+    static constexpr size_t k_range_batch = 64;
+    // How many keys ahead of the lookup a batched command prefetches: enough misses in flight to cover
+    // one memory latency, few enough that the first ones are still in cache when their turn comes.
+    static constexpr size_t k_prefetch_distance = 8;
+
+    static void type_error(Out& resp) {
+        ResponseSerializer::serialize_error(resp, ErrorCode::Type, "operation against a key holding the wrong kind of value");
+    }
+
+    static void run(Keyspace& ks, const CommandSpec& spec, const ArgList& args, Out& response) {
+        switch (spec.id) {
+            case CommandId::Ping:    return ping(args, response);
+            case CommandId::Echo:    return echo(args, response);
+            case CommandId::Get:     return get(ks, args, response);
+            case CommandId::Set:     return set(ks, args, response);
+            case CommandId::Del:     return del(ks, args, response);
+            case CommandId::Unlink:  return del(ks, args, response); // large values are freed lazily either way
+            case CommandId::PExpire: return pexpire(ks, args, response);
+            case CommandId::PExpireAt: return pexpireat(ks, args, response);
+            case CommandId::PTtl:    return pttl(ks, args, response);
+            case CommandId::ZAdd:    return zadd(ks, args, response);
+            case CommandId::ZQuery:  return zquery(ks, args, response);
+            case CommandId::ZRank:   return zrank(ks, args, response, false);
+            case CommandId::ZRevRank: return zrank(ks, args, response, true);
+            case CommandId::ZRange:  return zrange(ks, args, response);
+            case CommandId::ZCount:  return zcount(ks, args, response);
+            case CommandId::ZRemRangeByScore: return zremrangebyscore(ks, args, response);
+            case CommandId::MGet:    return mget(ks, args, response);
+            case CommandId::MSet:    return mset(ks, args, response);
+            case CommandId::ZMScore: return zmscore(ks, args, response);
+            // The reactor runs these: it owns the snapshot targets and the I/O pool.
+            case CommandId::BgSave:
+            case CommandId::BgRewriteAof:
+            case CommandId::PSync:
+            case CommandId::Cluster:
+            case CommandId::Asking:
+            case CommandId::Info:
+            case CommandId::Latency:
+            // ... and these, since a transaction lives on the connection.
+            case CommandId::Multi:
+            case CommandId::Exec:
+            case CommandId::Discard: break;
+            case CommandId::Count:   break;
+        }
+        ResponseSerializer::serialize_error(response, ErrorCode::Unknown, "unknown command");
+    }
+
+    static void ping(const ArgList&, Out& resp) { ResponseSerializer::serialize_string(resp, "PONG"); }
+    static void echo(const ArgList& args, Out& resp) { ResponseSerializer::serialize_string(resp, args[1]); }
+
+    static void get(Keyspace& ks, const ArgList& args, Out& resp) { get_reply(ks, ks.find(args[1]), resp); }
+
+    static void get_reply(Keyspace& ks, Entry* entry, Out& resp) {
+        if (!entry) return ResponseSerializer::serialize_nil(resp);
+        if (entry->type == EntryType::Cold) {
+            // The reactor normally loads the value first (ColdTier::fetch); this is the blocking fallback.
+            auto value = ks.cold_value(*entry);
+            if (!value) return ResponseSerializer::serialize_error(resp, ErrorCode::Io, "cannot read value: " + value.error().message());
+            return ResponseSerializer::serialize_string(resp, *value);
+        }
+        if (entry->type != EntryType::String) return type_error(resp);
+        ResponseSerializer::serialize_string(resp, entry->value);
+    }
+
+    static void set(Keyspace& ks, const ArgList& args, Out& resp) {
+        bool inserted;
+        Entry& entry = ks.find_or_insert(args[1], inserted);
+        if (!inserted) ks.drop_cold(entry);
+        if (!inserted && entry.type != EntryType::String) return type_error(resp);
+        entry.value.assign(args[2]);
+        ResponseSerializer::serialize_nil(resp);
+    }
+
+    // Calls fn(i, key, hcode) for the keys at args[first], args[first + step], ... in order, hashing each
+    // k_prefetch_distance keys before its turn and prefetching its bucket, so the batch's cache misses
+    // overlap instead of each lookup stalling on its own.
+    template<typename Fn>
+    static void for_each_prefetched(Keyspace& ks, const ArgList& args, size_t first, size_t step, Fn&& fn) {
+        size_t n = args.size() > first ? (args.size() - first + step - 1) / step : 0;
+        auto key_at = [&](size_t i) { return args[first + i * step]; };
+        std::array<std::uint64_t, k_prefetch_distance> ahead;
+        for (size_t i = 0; i < std::min(n, k_prefetch_distance); ++i) {
+            ahead[i] = Keyspace::hash_key(key_at(i));
+            ks.prefetch(ahead[i]);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            std::uint64_t& slot = ahead[i % k_prefetch_distance];
+            std::uint64_t hcode = slot;
+            if (i + k_prefetch_distance < n) {
+                slot = Keyspace::hash_key(key_at(i + k_prefetch_distance));
+                ks.prefetch(slot);
+            }
+            fn(i, key_at(i), hcode);
+        }
+    }
+
+    // mget key [key ...] -> [value or nil, ...]; nil for a key holding anything but a string
+    static void mget(Keyspace& ks, const ArgList& args, Out& resp) {
+        ResponseSerializer::serialize_array_header(resp, static_cast<uint32_t>(args.size() - 1));
+        for_each_prefetched(ks, args, 1, 1, [&](size_t, std::string_view key, std::uint64_t hcode) {
+            Entry* entry = ks.find(key, hcode);
+            if (entry && (entry->type == EntryType::String || entry->type == EntryType::Cold)) {
+                get_reply(ks, entry, resp);
+            } else {
+                ResponseSerializer::serialize_nil(resp);
+            }
+        });
+    }
+
+    // mset key value [key value ...] -> nil, like set. All or nothing: if any key holds another type,
+    // none is written.
+    static void mset(Keyspace& ks, const ArgList& args, Out& resp) {
+        if (args.size() % 2 == 0) {
+            return ResponseSerializer::serialize_error(resp, ErrorCode::Arity, "wrong number of arguments");
+        }
+        bool clash = false;
+        for_each_prefetched(ks, args, 1, 2, [&](size_t, std::string_view key, std::uint64_t hcode) {
+            Entry* entry = ks.find(key, hcode);
+            clash |= entry && entry->type != EntryType::String && entry->type != EntryType::Cold;
+        });
+        if (clash) return type_error(resp);
+        for_each_prefetched(ks, args, 1, 2, [&](size_t i, std::string_view key, std::uint64_t hcode) {
+            bool inserted;
+            Entry& entry = ks.find_or_insert(key, hcode, inserted);
+            if (!inserted) ks.drop_cold(entry);
+            entry.value.assign(args[2 + 2 * i]);
+        });
+        ResponseSerializer::serialize_nil(resp);
+    }
+
+    static void del(Keyspace& ks, const ArgList& args, Out& resp) {
+        ResponseSerializer::serialize(resp, ks.erase(args[1]) ? 1 : 0);
+    }
+
+    static void pexpire(Keyspace& ks, const ArgList& args, Out& resp) {
+        auto ttl_ms = parse_int(args[2]);
+        if (!ttl_ms) {
+            return ResponseSerializer::serialize_error(resp, ErrorCode::Argument, "expect int64");
+        }
+        Entry* entry = ks.find(args[1]);
+        if (entry) ks.set_ttl(*entry, *ttl_ms);
+        ResponseSerializer::serialize(resp, entry ? 1 : 0);
+    }
+
+    // pexpireat key unix-time-ms -> like pexpire; a time already past expires the key right away
+    static void pexpireat(Keyspace& ks, const ArgList& args, Out& resp) {
+        auto at_ms = parse_int(args[2]);
+        if (!at_ms) {
+            return ResponseSerializer::serialize_error(resp, ErrorCode::Argument, "expect int64");
+        }
+        Entry* entry = ks.find(args[1]);
+        if (entry) ks.set_ttl(*entry, std::max<int64_t>(snapshot_format::ms_until_unix(*at_ms), 0));
+        ResponseSerializer::serialize(resp, entry ? 1 : 0);
+    }
+
+    static void pttl(Keyspace& ks, const ArgList& args, Out& resp) {
+        Entry* entry = ks.find(args[1]);
+        ResponseSerializer::serialize(resp, entry ? ks.pttl(*entry) : -2);
+    }
+
+    // zadd key score name [score name ...] -> how many members were added (updated scores don't count).
+    // Every score is checked before anything is added.
+    static void zadd(Keyspace& ks, const ArgList& args, Out& resp) {
+        if (args.size() % 2 != 0) {
+            return ResponseSerializer::serialize_error(resp, ErrorCode::Arity, "wrong number of arguments");
+        }
+        for (size_t i = 2; i < args.size(); i += 2) {
+            if (!parse_double(args[i])) {
+                return ResponseSerializer::serialize_error(resp, ErrorCode::Argument, "expect float");
+            }
+        }
+        bool inserted;
+        Entry& entry = ks.find_or_insert(args[1], inserted);
+        if (inserted) {
+            entry.type = EntryType::ZSet;
+            entry.zset = std::make_unique<ds::ZSet>();
+        } else if (entry.type != EntryType::ZSet) {
+            return type_error(resp);
+        }
+        int64_t added = 0;
+        for (size_t i = 2; i < args.size(); i += 2) {
+            added += entry.zset->add(args[i + 1], *parse_double(args[i])) ? 1 : 0;
+        }
+        ResponseSerializer::serialize(resp, added);
+    }
+
+    // zquery key score name offset limit -> [name, score, name, score, ...] starting at the first
+    // member >= (score, name), skipping `offset` members, returning at most `limit` of them.
+    static void zquery(Keyspace& ks, const ArgList& args, Out& resp) {
+        auto score = parse_double(args[2]);
+        auto offset = parse_int(args[4]);
+        auto limit = parse_int(args[5]);
+        if (!score || !offset || !limit) {
+            return ResponseSerializer::serialize_error(resp, ErrorCode::Argument, "expect number");
+        }
+
+        Entry* entry = ks.find(args[1]);
+        if (!entry) return ResponseSerializer::serialize_array_header(resp, 0);
+        if (entry->type != EntryType::ZSet) return type_error(resp);
+
+        if (*limit <= 0) return ResponseSerializer::serialize_array_header(resp, 0);
+        write_range(entry->zset->seek(*score, args[3], *offset).limit(static_cast<uint64_t>(*limit)), true, resp);
+    }
+
+    // Looks up args[1] as a sorted set. Returns nullptr and writes the reply for a missing key (`missing`
+    // is called) or a key of another type.
+    template<typename Missing>
+    static ds::ZSet* zset_or_reply(Keyspace& ks, const ArgList& args, Out& resp, Missing&& missing) {
+        Entry* entry = ks.find(args[1]);
+        if (!entry) {
+            missing();
+            return nullptr;
+        }
+        if (entry->type != EntryType::ZSet) {
+            type_error(resp);
+            return nullptr;
+        }
+        return entry->zset.get();
+    }
+
+    // Drains the cursor straight into the response: [name, (score,) name, (score,) ...].
+    static void write_range(ds::ZCursor cursor, bool with_scores, Out& resp) {
+        uint64_t items = cursor.remaining() * (with_scores ? 2 : 1);
+        ResponseSerializer::serialize_array_header(resp, static_cast<uint32_t>(items));
+        ds::ZMember batch[k_range_batch];
+        while (size_t n = cursor.next_batch(batch)) {
+            size_t bytes = 0;
+            for (size_t i = 0; i < n; ++i) {
+                bytes += 1 + sizeof(uint32_t) + batch[i].name.size() + (with_scores ? 1 + sizeof(double) : 0);
+            }
+            if (resp.capacity() < resp.size() + bytes) {
+                resp.reserve(std::max(resp.size() + bytes, resp.capacity() * 2)); // keep growth geometric
+            }
+            for (size_t i = 0; i < n; ++i) {
+                ResponseSerializer::serialize_string(resp, batch[i].name);
+                if (with_scores) ResponseSerializer::serialize_double(resp, batch[i].score);
+            }
+        }
+    }
+
+    // zrank / zrevrank key name -> 0-based rank, or nil if the member (or key) doesn't exist
+    static void zrank(Keyspace& ks, const ArgList& args, Out& resp, bool reverse) {
+        ds::ZSet* zset = zset_or_reply(ks, args, resp, [&] { ResponseSerializer::serialize_nil(resp); });
+        if (!zset) return;
+        auto rank = zset->rank(args[2]);
+        if (!rank) return ResponseSerializer::serialize_nil(resp);
+        int64_t r = static_cast<int64_t>(*rank);
+        ResponseSerializer::serialize(resp, reverse ? static_cast<int64_t>(zset->size()) - 1 - r : r);
+    }
+
+    // zrange key start stop [withscores] -> names at ranks start..stop (inclusive, negative counts from the end)
+    static void zrange(Keyspace& ks, const ArgList& args, Out& resp) {
+        auto start = parse_int(args[2]);
+        auto stop = parse_int(args[3]);
+        if (!start || !stop) {
+            return ResponseSerializer::serialize_error(resp, ErrorCode::Argument, "expect int64");
+        }
+        bool with_scores = false;
+        if (args.size() == 5 && command_table_detail::equals_folded(args[4], "withscores")) {
+            with_scores = true;
+        } else if (args.size() != 4) {
+            return ResponseSerializer::serialize_error(resp, ErrorCode::Argument, "syntax error");
+        }
+
+        ds::ZSet* zset = zset_or_reply(ks, args, resp, [&] { ResponseSerializer::serialize_array_header(resp, 0); });
+        if (!zset) return;
+        int64_t size = static_cast<int64_t>(zset->size());
+        int64_t lo = *start < 0 ? *start + size : *start;
+        int64_t hi = *stop < 0 ? *stop + size : *stop;
+        lo = std::max<int64_t>(lo, 0);
+        hi = std::min<int64_t>(hi, size - 1);
+        if (lo > hi) return ResponseSerializer::serialize_array_header(resp, 0);
+        write_range(zset->range_by_rank(static_cast<uint64_t>(lo), static_cast<uint64_t>(hi)), with_scores, resp);
+    }
+
+    // zmscore key name [name ...] -> [score or nil, ...], one per name
+    static void zmscore(Keyspace& ks, const ArgList& args, Out& resp) {
+        auto names = static_cast<uint32_t>(args.size() - 2);
+        ds::ZSet* zset = zset_or_reply(ks, args, resp, [&] {
+            ResponseSerializer::serialize_array_header(resp, names);
+            for (uint32_t i = 0; i < names; ++i) ResponseSerializer::serialize_nil(resp);
+        });
+        if (!zset) return;
+        ResponseSerializer::serialize_array_header(resp, names);
+        for (size_t i = 2; i < args.size(); ++i) {
+            auto score = zset->score(args[i]);
+            if (score) {
+                ResponseSerializer::serialize_double(resp, *score);
+            } else {
+                ResponseSerializer::serialize_nil(resp);
+            }
+        }
+    }
+
+    // zcount key min max -> members with min <= score <= max; "(" marks an exclusive end
+    static void zcount(Keyspace& ks, const ArgList& args, Out& resp) {
+        auto lo = parse_score_bound(args[2]);
+        auto hi = parse_score_bound(args[3]);
+        if (!lo || !hi) {
+            return ResponseSerializer::serialize_error(resp, ErrorCode::Argument, "min or max is not a float");
+        }
+        ds::ZSet* zset = zset_or_reply(ks, args, resp, [&] { ResponseSerializer::serialize(resp, int64_t{0}); });
+        if (!zset) return;
+        ResponseSerializer::serialize(resp, static_cast<int64_t>(zset->count(*lo, *hi)));
+    }
+
+    // zremrangebyscore key min max -> number removed; the key goes away with its last member
+    static void zremrangebyscore(Keyspace& ks, const ArgList& args, Out& resp) {
+        auto lo = parse_score_bound(args[2]);
+        auto hi = parse_score_bound(args[3]);
+        if (!lo || !hi) {
+            return ResponseSerializer::serialize_error(resp, ErrorCode::Argument, "min or max is not a float");
+        }
+        ds::ZSet* zset = zset_or_reply(ks, args, resp, [&] { ResponseSerializer::serialize(resp, int64_t{0}); });
+        if (!zset) return;
+        uint64_t removed = zset->remove_range_by_score(*lo, *hi);
+        if (zset->empty()) ks.erase(args[1]);
+        ResponseSerializer::serialize(resp, static_cast<int64_t>(removed));
+    }
 };
 
 #endif 
@@ -0,0 +1,193 @@
+#ifndef COMMAND_TABLE_HPP
+#define COMMAND_TABLE_HPP
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include "request_parser.hpp"
+
+// Every command the server understands, with the metadata other subsystems need without running it:
+// arity, whether it mutates the keyspace, and where its keys sit in the argument list.
+// Add a command by appending a CommandId and a row to k_command_specs - the perfect hash below is
+// regenerated at compile time and fails the build if it can't place the new name.
+
+enum class CommandId : uint8_t {
+    Ping,
+    Echo,
+    Get,
+    Set,
+    Del,
+    Unlink,
+    PExpire,
+    PExpireAt,
+    PTtl,
+    ZAdd,
+    ZQuery,
+    ZRank,
+    ZRevRank,
+    ZRange,
+    ZCount,
+    ZRemRangeByScore,
+    BgSave,
+    BgRewriteAof,
+    PSync,
+    Cluster,
+    Asking,
+    Info,
+    Latency,
+    MGet,
+    MSet,
+    ZMScore,
+    Multi,
+    Exec,
+    Discard,
+    Count
+};
+
+enum CommandFlags : uint8_t {
+    CMD_READ  = 1u << 0, // never mutates the keyspace - safe on replicas
+    CMD_WRITE = 1u << 1, // mutates the keyspace - logged and replicated
+    CMD_DENY_OOM = 1u << 2 // can grow the keyspace - refused over maxmemory when nothing can be evicted
+};
+
+struct CommandSpec {
+    std::string_view name; // lowercase; matching is ASCII case-insensitive
+    CommandId id;
+    int8_t arity;          // > 0: exactly `arity` args (incl. name); < 0: at least -arity
+    uint8_t flags;
+    int8_t first_key;      // index of the first key, 0 if the command takes no keys
+    int8_t last_key;       // index of the last key; -1 means the last argument
+    int8_t key_step;       // distance between consecutive keys (2 for key/value pairs)
+
+    [[nodiscard]] constexpr bool arity_ok(size_t argc) const noexcept {
+        return arity >= 0 ? argc == static_cast<size_t>(arity) : argc >= static_cast<size_t>(-arity);
+    }
+    [[nodiscard]] constexpr bool is_write() const noexcept { return flags & CMD_WRITE; }
+    [[nodiscard]] constexpr bool denies_oom() const noexcept { return flags & CMD_DENY_OOM; }
+    [[nodiscard]] constexpr bool has_keys() const noexcept { return first_key > 0; }
+};
+
+inline constexpr std::array<CommandSpec, static_cast<size_t>(CommandId::Count)> k_command_specs = {{
+    //  name     id                arity flags      first last step
+    {"ping",    CommandId::Ping,    1,   CMD_READ,  0,    0,   0},
+    {"echo",    CommandId::Echo,    2,   CMD_READ,  0,    0,   0},
+    {"get",     CommandId::Get,     2,   CMD_READ,  1,    1,   1},
+    {"set",     CommandId::Set,     3,   CMD_WRITE | CMD_DENY_OOM, 1, 1, 1},
+    {"del",     CommandId::Del,     2,   CMD_WRITE, 1,    1,   1},
+    {"unlink",  CommandId::Unlink,  2,   CMD_WRITE, 1,    1,   1},
+    {"pexpire", CommandId::PExpire, 3,   CMD_WRITE, 1,    1,   1},
+    {"pexpireat", CommandId::PExpireAt, 3, CMD_WRITE, 1,  1,   1},
+    {"pttl",    CommandId::PTtl,    2,   CMD_READ,  1,    1,   1},
+    {"zadd",    CommandId::ZAdd,    -4,   CMD_WRITE | CMD_DENY_OOM, 1, 1, 1},
+    {"zquery",  CommandId::ZQuery,  6,   CMD_READ,  1,    1,   1},
+    {"zrank",   CommandId::ZRank,   3,   CMD_READ,  1,    1,   1},
+    {"zrevrank", CommandId::ZRevRank, 3, CMD_READ,  1,    1,   1},
+    {"zrange",  CommandId::ZRange,  -4,  CMD_READ,  1,    1,   1},
+    {"zcount",  CommandId::ZCount,  4,   CMD_READ,  1,    1,   1},
+    {"zremrangebyscore", CommandId::ZRemRangeByScore, 4, CMD_WRITE, 1, 1, 1},
+    {"bgsave",  CommandId::BgSave,  1,   CMD_READ,  0,    0,   0},
+    {"bgrewriteaof", CommandId::BgRewriteAof, 1, CMD_READ, 0, 0, 0},
+    {"psync",   CommandId::PSync,   5,   CMD_READ,  0,    0,   0},
+    {"cluster", CommandId::Cluster, -2,  CMD_READ,  0,    0,   0},
+    {"asking",  CommandId::Asking,  1,   CMD_READ,  0,    0,   0},
+    {"info",    CommandId::Info,    -1,  CMD_READ,  0,    0,   0},
+    {"latency", CommandId::Latency, -2,  CMD_READ,  0,    0,   0},
+    {"mget",    CommandId::MGet,    -2,  CMD_READ,  1,   -1,   1},
+    {"mset",    CommandId::MSet,    -3,  CMD_WRITE | CMD_DENY_OOM, 1, -1, 2},
+    {"zmscore", CommandId::ZMScore, -3,  CMD_READ,  1,    1,   1},
+    {"multi",   CommandId::Multi,   1,   CMD_READ,  0,    0,   0},
+    {"exec",    CommandId::Exec,    1,   CMD_READ,  0,    0,   0},
+    {"discard", CommandId::Discard, 1,   CMD_READ,  0,    0,   0},
+}};
+
+namespace command_table_detail {
+
+[[nodiscard]] constexpr uint8_t fold(uint8_t c) noexcept {
+    return (c >= 'A' && c <= 'Z') ? static_cast<uint8_t>(c | 0x20) : c;
+}
+
+// Seeded FNV-style hash over the case-folded name. Command names are a handful of bytes, so this
+// is a few multiplies on bytes that are already in cache from parsing.
+[[nodiscard]] constexpr uint32_t hash(std::string_view name, uint32_t seed) noexcept {
+    uint32_t h = seed ^ static_cast<uint32_t>(name.size());
+    for (char c : name) {
+        h = (h ^ fold(static_cast<uint8_t>(c))) * 0x01000193u;
+    }
+    return h ^ (h >> 15);
+}
+
+inline constexpr size_t k_slots = std::bit_ceil(k_command_specs.size() * 4);
+inline constexpr uint8_t k_empty = 0xFF;
+
+// Search for a seed under which every name lands in its own slot.
+[[nodiscard]] constexpr uint32_t find_seed() {
+    for (uint32_t seed = 0x811C9DC5u; ; seed += 0x9E3779B9u) {
+        std::array<bool, k_slots> used{};
+        bool ok = true;
+        for (const auto& spec : k_command_specs) {
+            size_t slot = hash(spec.name, seed) & (k_slots - 1);
+            if (used[slot]) { ok = false; break; }
+            used[slot] = true;
+        }
+        if (ok) return seed;
+    }
+}
+
+inline constexpr uint32_t k_seed = find_seed();
+
+[[nodiscard]] constexpr std::array<uint8_t, k_slots> build_slots() {
+    std::array<uint8_t, k_slots> slots{};
+    slots.fill(k_empty);
+    for (size_t i = 0; i < k_command_specs.size(); ++i) {
+        slots[hash(k_command_specs[i].name, k_seed) & (k_slots - 1)] = static_cast<uint8_t>(i);
+    }
+    return slots;
+}
+
+inline constexpr std::array<uint8_t, k_slots> k_slot_table = build_slots();
+
+[[nodiscard]] constexpr bool equals_folded(std::string_view raw, std::string_view lower) noexcept {
+    if (raw.size() != lower.size()) return false;
+    for (size_t i = 0; i < raw.size(); ++i) {
+        if (fold(static_cast<uint8_t>(raw[i])) != static_cast<uint8_t>(lower[i])) return false;
+    }
+    return true;
+}
+
+} // namespace command_table_detail
+
+// One hash, one table load, one compare against the raw bytes in the request buffer.
+[[nodiscard]] constexpr const CommandSpec* find_command(std::string_view raw) noexcept {
+    using namespace command_table_detail;
+    uint8_t idx = k_slot_table[hash(raw, k_seed) & (k_slots - 1)];
+    if (idx == k_empty) return nullptr;
+    const CommandSpec& spec = k_command_specs[idx];
+    return equals_folded(raw, spec.name) ? &spec : nullptr;
+}
+
+static_assert(find_command("PING") == &k_command_specs[static_cast<size_t>(CommandId::Ping)]);
+static_assert(find_command("nope") == nullptr);
+
+[[nodiscard]] constexpr const CommandSpec& command_spec(CommandId id) noexcept {
+    return k_command_specs[static_cast<size_t>(id)];
+}
+
+// Calls fn(key) for every key position the spec declares. Assumes arity has been checked.
+template<typename Fn>
+constexpr void for_each_key(const CommandSpec& spec, const ArgList& args, Fn&& fn) {
+    if (!spec.has_keys()) return;
+    size_t last = spec.last_key < 0 ? args.size() - 1 : static_cast<size_t>(spec.last_key);
+    size_t step = spec.key_step > 0 ? static_cast<size_t>(spec.key_step) : 1;
+    for (size_t i = static_cast<size_t>(spec.first_key); i <= last && i < args.size(); i += step) {
+        fn(args[i]);
+    }
+}
+
+[[nodiscard]] constexpr std::optional<std::string_view> first_key(const CommandSpec& spec, const ArgList& args) noexcept {
+    if (!spec.has_keys() || args.size() <= static_cast<size_t>(spec.first_key)) return std::nullopt;
+    return args[static_cast<size_t>(spec.first_key)];
+}
+
+#endif // COMMAND_TABLE_HPP
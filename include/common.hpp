@@ -2,10 +2,18 @@
 #define COMMON_HPP
 
 #include <cstdint>
+#include <cstddef>
 #include <chrono>
+#include <expected>
+#include <system_error>
 
+// Default cap on one request frame; ClientLimits::max_request_bytes (Server::set_client_limits) overrides it.
 constexpr size_t MAX_MSG_SIZE = 4096;
+// Default for ClientLimits::idle_timeout: a client silent this long is disconnected.
 constexpr auto IDLE_TIMEOUT = std::chrono::milliseconds(5000);
 constexpr uint16_t SERVER_PORT = 1234;
 
+template<typename T>
+using Result = std::expected<T, std::error_code>;
+
 #endif 
@@ -2,37 +2,481 @@
 #define CONNECTION_HPP
 
 #include <vector>
+#include <string>
+#include <span>
 #include <chrono>
+#include <deque>
+#include <charconv>
+#include <cerrno>
+#include <cstring>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+#include <optional>
 #include "socket.hpp"
+#include "../buffer_pool.hpp"
+#include "../list.hpp"
+#include "../shared_string.hpp"
 #include "request_parser.hpp"
 #include "response_serializer.hpp"
 
 enum class ConnectionState : uint8_t { Request, Response, End };
 
-class Connection {
+// What one client may cost. Output that has not reached the socket yet - replies the client is slow to
+// read - is capped: past output_hard_bytes the client is disconnected at once, and past output_soft_bytes
+// once it has stayed there for output_soft_window. A client with no I/O for idle_timeout is disconnected
+// too. 0 turns a limit off.
+struct ClientLimits {
+    size_t max_request_bytes{MAX_MSG_SIZE}; // one command's frame, header excluded
+    size_t output_hard_bytes{256u << 20};
+    size_t output_soft_bytes{64u << 20};
+    std::chrono::seconds output_soft_window{60};
+    std::chrono::milliseconds idle_timeout{IDLE_TIMEOUT};
+};
+
+// Tag for the hook of the reactor's idle list (least recently active connection first): just the two links.
+struct IdleLink {};
+
+class Connection;
+
+// The commands between MULTI and EXEC, queued instead of run. They are copied out, since the parsed views
+// die with the read buffer, into one flat list - [argc, arg..., argc, arg...] - which is also the form
+// EXEC carries them in to the shard that runs them. A command refused while queuing fails the whole
+// transaction: EXEC then runs nothing.
+class Transaction {
+public:
+    void queue(const ArgList& args) {
+        commands_.push_back(std::to_string(args.size()));
+        commands_.insert(commands_.end(), args.begin(), args.end());
+        ++size_;
+    }
+    void fail() noexcept { failed_ = true; }
+
+    [[nodiscard]] bool failed() const noexcept { return failed_; }
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+    [[nodiscard]] std::span<const std::string> commands() const noexcept { return commands_; }
+    [[nodiscard]] std::vector<std::string> take_commands() noexcept { return std::move(commands_); }
+
+    // Calls fn(const ArgList&) per command of a flat list as queue() builds it - owned, or views of one such as
+    // a forwarded EXEC's arguments. False if the list is malformed, in which case fn may have seen a prefix of it.
+    template<typename Str, typename Fn>
+    static bool for_each(std::span<const Str> flat, Fn&& fn) {
+        while (!flat.empty()) {
+            size_t argc = 0;
+            auto [ptr, ec] = std::from_chars(flat[0].data(), flat[0].data() + flat[0].size(), argc);
+            if (ec != std::errc{} || argc == 0 || argc >= flat.size()) return false;
+            ArgList args;
+            for (const Str& arg : flat.subspan(1, argc)) args.push_back(arg);
+            fn(args);
+            flat = flat.subspan(1 + argc);
+        }
+        return true;
+    }
+
+private:
+    std::vector<std::string> commands_;
+    size_t size_{0};
+    bool failed_{false};
+};
+
+// Runs a parsed command on behalf of a connection. A reactor either executes it against its own
+// shard, appending the reply to the connection's output, or forwards it to the owning reactor and
+// suspends the connection until complete_remote() delivers the reply.
+class CommandDispatcher {
+public:
+    virtual ~CommandDispatcher() = default;
+    virtual void dispatch(Connection& conn, const ArgList& args) = 0;
+    // Called after a batch of frames has run and before its replies are written: where whatever the
+    // batch logged gets committed, once for the whole pipeline.
+    virtual void before_reply() {}
+};
+
+// Output is wbuf_ plus splices: values sent by reference (ds::SharedString::Ref) at recorded offsets of
+// it, so a large GET reply is never copied into user space. The pieces go out with one sendmsg() per
+// batch of up to k_max_iov of them; when the referenced bytes in a batch reach k_zerocopy_bytes and the
+// socket allows it, with MSG_ZEROCOPY, and the values it covers are held until the kernel reports the
+// send complete on the error queue.
+class Connection : public ds::ListNode<IdleLink> {
 public:
-    explicit Connection(Socket socket)
+    // Values at least this long are spliced rather than copied into wbuf_.
+    static constexpr size_t k_splice_bytes = 2 * 1024;
+    // Referenced bytes per sendmsg() worth pinning pages and a completion for, rather than a copy.
+    static constexpr size_t k_zerocopy_bytes = 32 * 1024;
+
+    // `pool` (the reactor's) lends the read and write buffers; `limits` must outlive the connection.
+    // Either may be null: plain vectors, no limits.
+    explicit Connection(Socket socket, uint64_t id = 0, ds::BufferPool* pool = nullptr, const ClientLimits* limits = nullptr)
         : socket_(std::move(socket)), state_(ConnectionState::Request),
-          idle_start_(std::chrono::steady_clock::now()) {}
+          idle_start_(std::chrono::steady_clock::now()), id_(id), pool_(pool), limits_(limits) {}
+
+    ~Connection() {
+        ds::ListNode<IdleLink>::unlink();
+        give_back(rbuf_);
+        give_back(wbuf_);
+    }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    // Arms MSG_ZEROCOPY for this socket; without it large values still go out by reference, copied by the kernel.
+    void enable_zerocopy() noexcept { zerocopy_ = socket_.enable_zerocopy().has_value(); }
 
     [[nodiscard]] int fd() const noexcept { return socket_.get(); }
-    
-    Result<void> process_io() {
+    [[nodiscard]] uint64_t id() const noexcept { return id_; }
+    [[nodiscard]] ConnectionState state() const noexcept { return state_; }
+    [[nodiscard]] std::chrono::steady_clock::time_point idle_since() const noexcept { return idle_start_; }
+    void update_idle_time() noexcept { idle_start_ = std::chrono::steady_clock::now(); }
+
+    // Called once per readiness event. With an edge-triggered backend this must keep reading or
+    // writing until the socket returns EAGAIN, since no further event arrives for buffered data.
+    Result<void> process_io(CommandDispatcher& dispatcher) {
         update_idle_time();
-        return (state_ == ConnectionState::Request) ? handle_request() : handle_response();
+        reap_zerocopy();
+        while (true) {
+            if (state_ == ConnectionState::Request) {
+                if (auto res = handle_request(dispatcher); !res) return res;
+                if (state_ != ConnectionState::Response) return {};
+            }
+            if (auto res = handle_response(); !res) return res;
+            // Fully flushed: go back and drain whatever arrived while we were writing, since an
+            // edge-triggered backend won't report that data again.
+            if (state_ != ConnectionState::Request) return {};
+        }
+    }
+
+    [[nodiscard]] std::vector<uint8_t>& output() noexcept { return wbuf_; }
+
+    // Sends `value` after everything output() holds so far, without copying it there.
+    void splice(ds::SharedString::Ref value) {
+        spliced_bytes_ += value.size();
+        splices_.push_back(Splice{wbuf_.size(), std::move(value)});
+    }
+
+    // Replies not yet handed to the socket.
+    [[nodiscard]] size_t pending_output() const noexcept { return wbuf_.size() - wpos_ + spliced_bytes_; }
+
+    // The client has been over its soft output limit for the whole window (or is over the hard one). Checked
+    // as replies are queued and, for clients that have stopped reading altogether, by the reactor's sweep.
+    [[nodiscard]] bool output_limit_exceeded() {
+        if (!limits_) return false;
+        size_t pending = pending_output();
+        if (limits_->output_hard_bytes && pending > limits_->output_hard_bytes) return true;
+        if (!limits_->output_soft_bytes || pending <= limits_->output_soft_bytes) {
+            soft_since_.reset();
+            return false;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (!soft_since_) soft_since_ = now;
+        return now - *soft_since_ >= limits_->output_soft_window;
+    }
+    [[nodiscard]] bool over_soft_limit() const noexcept { return soft_since_.has_value(); }
+
+    // For a connection that turns into something else (a replica link): the socket leaves, whatever is
+    // still buffered stays behind with the Connection.
+    [[nodiscard]] Socket release_socket() noexcept { return std::move(socket_); }
+
+    // Cluster ASKING: lets the next command (only) run against a slot this node is importing.
+    void set_asking() noexcept { asking_ = true; }
+    [[nodiscard]] bool take_asking() noexcept { return std::exchange(asking_, false); }
+
+    // MULTI opens a transaction, EXEC or DISCARD ends it; null outside one.
+    void begin_transaction() { transaction_.emplace(); }
+    [[nodiscard]] Transaction* transaction() noexcept { return transaction_ ? &*transaction_ : nullptr; }
+    [[nodiscard]] std::optional<Transaction> end_transaction() noexcept { return std::exchange(transaction_, std::nullopt); }
+
+    // While a forwarded command is in flight no further frames are executed, which keeps
+    // responses in request order without per-slot reordering buffers.
+    [[nodiscard]] bool awaiting_remote() const noexcept { return awaiting_remote_; }
+    void suspend_for_remote() noexcept { awaiting_remote_ = true; }
+    void complete_remote(std::span<const uint8_t> reply) {
+        ensure_output();
+        wbuf_.insert(wbuf_.end(), reply.begin(), reply.end());
+        awaiting_remote_ = false;
     }
 
 private:
+    // Read depth for a burst of pipelined frames per read(). A frame that doesn't fit gets the buffer
+    // grown to its size, and the grown buffer is dropped rather than pooled once it drains.
+    static constexpr size_t k_rbuf_size = ds::BufferPool::k_chunk_size;
+
     Socket socket_;
     ConnectionState state_;
     std::chrono::steady_clock::time_point idle_start_;
+    uint64_t id_;
+    ds::BufferPool* pool_;
+    const ClientLimits* limits_;
+    std::optional<std::chrono::steady_clock::time_point> soft_since_; // over the soft limit since
+    bool awaiting_remote_{false};
+    bool asking_{false};
+    bool eof_{false};
+    std::optional<Transaction> transaction_;
+    // rbuf_[rpos_, rend_) holds unparsed bytes. Consumed frames just advance rpos_; only the
+    // partial trailing frame is ever moved, and only when the tail runs out of room.
     std::vector<uint8_t> rbuf_;
+    size_t rpos_{0};
+    size_t rend_{0};
+    // A value to send once wbuf_ has gone out up to `at`.
+    struct Splice {
+        size_t at;
+        ds::SharedString::Ref value;
+    };
+
+    // One MSG_ZEROCOPY sendmsg() still in the kernel's hands: the bytes it may yet read. `seq` is the
+    // kernel's count of zerocopy sends on the socket, which its completions report ranges of.
+    struct ZeroCopySend {
+        uint32_t seq;
+        std::vector<uint8_t> copied; // the wbuf_ parts, which wbuf_ itself is about to reuse
+        std::vector<ds::SharedString::Ref> values;
+    };
+
+    static constexpr size_t k_max_iov = 64;
+
     std::vector<uint8_t> wbuf_;
+    size_t wpos_{0};
+    std::vector<Splice> splices_;
+    size_t next_splice_{0};  // first splice not fully sent
+    size_t splice_pos_{0};   // ... of which this much is
+    size_t spliced_bytes_{0}; // not sent yet, over all splices
+    bool zerocopy_{false};
+    uint32_t zerocopy_seq_{0};
+    std::deque<ZeroCopySend> zerocopy_pending_; // oldest first; dropped with the connection if it goes first
 
-    void update_idle_time() noexcept { idle_start_ = std::chrono::steady_clock::now(); }
-    
-    Result<void> handle_request() { return {}; }
-    Result<void> handle_response() { return {}; }
+    // Reads until EAGAIN, executing every complete frame as it lands, then leaves all of the
+    // responses in wbuf_ so the caller flushes them with a single write per loop iteration.
+    Result<void> handle_request(CommandDispatcher& dispatcher) {
+        if (auto res = execute_frames(dispatcher); !res) return res; // frames left behind by a remote hop
+
+        while (!awaiting_remote_ && !eof_) {
+            make_room();
+            ssize_t n = read(socket_.get(), rbuf_.data() + rend_, rbuf_.size() - rend_);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                return std::unexpected(std::error_code(errno, std::system_category()));
+            }
+            if (n == 0) {
+                eof_ = true;
+                break;
+            }
+            rend_ += static_cast<size_t>(n);
+            if (auto res = execute_frames(dispatcher); !res) return res;
+        }
+        if (rend_ == 0) give_back(rbuf_); // nothing partial left: the buffer can serve someone else
+
+        if (!wbuf_.empty()) {
+            dispatcher.before_reply();
+            state_ = ConnectionState::Response;
+        } else if (eof_ && !awaiting_remote_) {
+            state_ = ConnectionState::End;
+        }
+        return {};
+    }
+
+    Result<void> execute_frames(CommandDispatcher& dispatcher) {
+        while (!awaiting_remote_) {
+            auto frame = RequestParser::parse_next(
+                std::span<const uint8_t>(rbuf_.data() + rpos_, rend_ - rpos_), max_request());
+            if (!frame) {
+                return std::unexpected(frame.error()); // malformed or oversized: drop the client
+            }
+            if (frame->consumed == 0) {
+                break;
+            }
+            rpos_ += frame->consumed;
+            ensure_output();
+            dispatcher.dispatch(*this, frame->args); // views into rbuf_, consumed before the next read
+            if (output_limit_exceeded()) return std::unexpected(std::make_error_code(std::errc::no_buffer_space));
+        }
+        if (rpos_ == rend_) {
+            rpos_ = rend_ = 0; // fully drained - rewinding is free
+        }
+        return {};
+    }
+
+    [[nodiscard]] size_t max_request() const noexcept { return limits_ ? limits_->max_request_bytes : MAX_MSG_SIZE; }
+
+    void make_room() {
+        if (rbuf_.empty()) {
+            if (pool_) rbuf_ = pool_->acquire();
+            rbuf_.resize(k_rbuf_size);
+        }
+        if (rend_ == rbuf_.size() && rpos_ > 0) {
+            std::memmove(rbuf_.data(), rbuf_.data() + rpos_, rend_ - rpos_);
+            rend_ -= rpos_;
+            rpos_ = 0;
+        }
+        // The partial frame at rpos_ is bigger than the buffer: make it fit (parse_next() vetted the size).
+        if (rend_ - rpos_ >= RequestParser::k_header_size) {
+            uint32_t len;
+            std::memcpy(&len, rbuf_.data() + rpos_, sizeof(len));
+            size_t frame = RequestParser::k_header_size + len;
+            if (rpos_ + frame > rbuf_.size()) {
+                std::memmove(rbuf_.data(), rbuf_.data() + rpos_, rend_ - rpos_);
+                rend_ -= rpos_;
+                rpos_ = 0;
+                if (frame > rbuf_.size()) rbuf_.resize(frame);
+            }
+        }
+    }
+
+    void ensure_output() {
+        if (pool_ && wbuf_.capacity() == 0) {
+            wbuf_ = pool_->acquire();
+            wbuf_.clear();
+        }
+    }
+
+    void give_back(std::vector<uint8_t>& buf) {
+        if (pool_) pool_->release(std::move(buf));
+        buf = {};
+    }
+
+    Result<void> handle_response() {
+        while (splices_.empty() && wpos_ < wbuf_.size()) {
+            ssize_t n = write(socket_.get(), wbuf_.data() + wpos_, wbuf_.size() - wpos_);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return {};
+                return std::unexpected(std::error_code(errno, std::system_category()));
+            }
+            wpos_ += static_cast<size_t>(n);
+        }
+        while (next_splice_ < splices_.size() || wpos_ < wbuf_.size()) {
+            if (auto sent = send_vectored(); !sent) return std::unexpected(sent.error());
+            else if (!*sent) return {};
+        }
+        give_back(wbuf_);
+        wpos_ = 0;
+        splices_.clear();
+        next_splice_ = splice_pos_ = 0;
+        state_ = (eof_ && !awaiting_remote_ && rpos_ == rend_) ? ConnectionState::End : ConnectionState::Request;
+        return {};
+    }
+
+    // One sendmsg() over the unsent output, in order: wbuf_ up to the next splice, the spliced value,
+    // wbuf_ up to the one after, ... Returns false once the socket is full.
+    Result<bool> send_vectored() {
+        iovec iov[k_max_iov];
+        size_t count = 0, referenced = 0;
+        size_t w = wpos_, pos = splice_pos_;
+        for (size_t i = next_splice_; count < k_max_iov;) {
+            size_t until = i < splices_.size() ? splices_[i].at : wbuf_.size();
+            if (w < until) {
+                iov[count++] = {wbuf_.data() + w, until - w};
+                w = until;
+                continue;
+            }
+            if (i == splices_.size()) break;
+            const ds::SharedString::Ref& value = splices_[i++].value;
+            iov[count++] = {const_cast<char*>(value.data()) + pos, value.size() - pos};
+            referenced += value.size() - pos;
+            pos = 0;
+        }
+
+        bool zerocopy = zerocopy_ && referenced >= k_zerocopy_bytes;
+        ZeroCopySend held;
+        if (zerocopy) pin(iov, count, held);
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t n;
+        while (true) {
+#ifdef MSG_ZEROCOPY
+            n = sendmsg(socket_.get(), &msg, zerocopy ? MSG_ZEROCOPY : 0);
+            if (n < 0 && errno == ENOBUFS && zerocopy) { // out of pinnable memory: copy this one
+                zerocopy = false;
+                continue;
+            }
+#else
+            n = sendmsg(socket_.get(), &msg, 0);
+#endif
+            if (n < 0 && errno == EINTR) continue;
+            break;
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+            return std::unexpected(std::error_code(errno, std::system_category()));
+        }
+        if (zerocopy) {
+            held.seq = zerocopy_seq_++;
+            zerocopy_pending_.push_back(std::move(held));
+        }
+        advance(static_cast<size_t>(n));
+        return true;
+    }
+
+    // Points the wbuf_ parts of `iov` at a copy the kernel may keep reading, and holds the spliced values.
+    void pin(iovec* iov, size_t count, ZeroCopySend& held) {
+        size_t copied = 0;
+        for (size_t k = 0; k < count; ++k) {
+            if (is_wbuf(iov[k])) copied += iov[k].iov_len;
+        }
+        held.copied.reserve(copied);
+        size_t next = next_splice_;
+        for (size_t k = 0; k < count; ++k) {
+            if (is_wbuf(iov[k])) {
+                auto* base = static_cast<uint8_t*>(iov[k].iov_base);
+                size_t at = held.copied.size();
+                held.copied.insert(held.copied.end(), base, base + iov[k].iov_len);
+                iov[k].iov_base = held.copied.data() + at;
+            } else {
+                held.values.push_back(splices_[next++].value);
+            }
+        }
+    }
+
+    [[nodiscard]] bool is_wbuf(const iovec& v) const noexcept {
+        auto* p = static_cast<const uint8_t*>(v.iov_base);
+        return p >= wbuf_.data() && p < wbuf_.data() + wbuf_.size();
+    }
+
+    // Moves the send position `n` bytes on, across wbuf_ and the splices.
+    void advance(size_t n) {
+        while (n > 0) {
+            size_t until = next_splice_ < splices_.size() ? splices_[next_splice_].at : wbuf_.size();
+            if (wpos_ < until) {
+                size_t step = std::min(n, until - wpos_);
+                wpos_ += step;
+                n -= step;
+                continue;
+            }
+            size_t step = std::min(n, splices_[next_splice_].value.size() - splice_pos_);
+            splice_pos_ += step;
+            spliced_bytes_ -= step;
+            n -= step;
+            if (splice_pos_ == splices_[next_splice_].value.size()) {
+                next_splice_++;
+                splice_pos_ = 0;
+            }
+        }
+    }
+
+    // Releases what finished MSG_ZEROCOPY sends were holding. A socket whose sends the kernel ended up
+    // copying anyway (loopback, some NICs) stops asking: the pinning only costs there.
+    void reap_zerocopy() {
+#ifdef MSG_ZEROCOPY
+        while (!zerocopy_pending_.empty()) {
+            alignas(cmsghdr) char control[128];
+            msghdr msg{};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (recvmsg(socket_.get(), &msg, MSG_ERRQUEUE) < 0) return; // EAGAIN: nothing finished yet
+            for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+                bool recverr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                               (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+                if (!recverr) continue;
+                sock_extended_err err;
+                std::memcpy(&err, CMSG_DATA(cm), sizeof(err));
+                if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) continue;
+                if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) zerocopy_ = false;
+                // [ee_info, ee_data] finished; TCP completes in order, so that is a prefix of ours.
+                while (!zerocopy_pending_.empty() && static_cast<int32_t>(zerocopy_pending_.front().seq - err.ee_data) <= 0) {
+                    zerocopy_pending_.pop_front();
+                }
+            }
+        }
+#endif
+    }
 };
 
 #endif // CONNECTION_HPP
@@ -1,45 +1,216 @@
 #ifndef ENTRY_MANAGER_HPP
 #define ENTRY_MANAGER_HPP
 
+#include <algorithm>
 #include <vector>
 #include <cstdint>
+#include <chrono>
+#include <limits>
 #include <memory>
-#include <unordered_map>
+#include <optional>
+#include <utility>
+#include <string>
+#include <string_view>
 #include "response_serializer.hpp"
+#include "../hashtable.hpp"
+#include "../heap.hpp"
+#include "../timing_wheel.hpp"
+#include "../zset.hpp"
+#include "../slab_allocator.hpp"
+#include "../list.hpp"
+#include "../shared_string.hpp"
 
-struct Entry {
-    std::string value;
-    std::unique_ptr<class ZSet> zset;
-    int64_t heap_idx = -1;
+// Cold: a string whose value was moved to the cold tier; `value` holds its ColdRef (see cold_tier.hpp).
+enum class EntryType : uint8_t { String, ZSet, Cold };
+
+struct Entry;
+
+// What the TTL heap orders: the absolute expiry time, plus a back-pointer so the expiry path can find the key.
+struct TtlItem {
+    uint64_t expire_at_us{0};
+    Entry* entry{nullptr};
+
+    bool operator<(const TtlItem& other) const noexcept { return expire_at_us < other.expire_at_us; }
 };
 
+using TtlHeap = ds::BinaryHeap<TtlItem>;
+
+// Tag for the eviction lists' intrusive hook (see eviction.hpp): the node is just its two links.
+struct EvictLink {};
+
+// One key in the keyspace. Entry is its own hash node, so the key, the value and the chain link share a
+// single allocation and the keyspace HMap owns it outright. It is also its own timer-wheel node, for the
+// same reason, and its own eviction-list node: the links are the 16 bytes of per-key eviction state, the
+// rest (evict_bits, evict_clock) sits in what used to be padding.
+struct Entry : public HNode<Entry>, public ds::TimerNode, public ds::ListNode<EvictLink> {
+    static constexpr size_t k_no_ttl = std::numeric_limits<size_t>::max();
+
+    Entry(std::string_view k, std::uint64_t hcode) : HNode<Entry>(hcode), key(k) {}
+
+    // Entries come from the owning shard's slab pool rather than malloc.
+    static void* operator new(size_t bytes) { return ds::SlabPool::local().allocate(bytes); }
+    static void operator delete(void* ptr, size_t bytes) noexcept { ds::SlabPool::deallocate(ptr, bytes); }
+
+    std::string key;
+    EntryType type = EntryType::String;
+    uint8_t evict_bits = 0;  // TinyLFU: segment; sampled LRU: clock bits 16-23; sampled LFU: log counter
+    uint16_t evict_clock = 0; // sampled LRU: clock bits 0-15; sampled LFU: minutes at the last decay
+    uint32_t snapshot_epoch = 0; // last snapshot that wrote this entry out (see BasicKeyspace::begin_snapshot)
+    ds::SharedString value; // shareable, so a reply can send a large value without copying it
+    std::unique_ptr<ds::ZSet> zset;
+    size_t heap_idx = k_no_ttl; // kept current by the heap through HeapItem::position_ref_
+};
+
+static_assert(sizeof(ds::ListNode<EvictLink>) == 2 * sizeof(void*), "eviction hook must be just the links");
+
 class EntryManager {
 public:
-    static void destroy_entry(Entry* entry) {
+    // Frees the entry (already unlinked from the keyspace), dropping its TTL first so the index never holds
+    // a dangling back-pointer.
+    template<typename Ttl>
+    static void destroy_entry(std::unique_ptr<Entry> entry, Ttl& ttl) {
         if (!entry) return;
-        entry->value.clear();
-        if (entry->zset) entry->zset.reset();
-        delete entry;
+        ttl.cancel(*entry);
+        entry.reset();
     }
 
-    static void set_entry_ttl(Entry& entry, int64_t ttl_ms, std::vector<int64_t>& heap) {
-        if (ttl_ms < 0) return;
-
-        auto expire_at = get_monotonic_usec() + ttl_ms * 1000;
-        if (entry.heap_idx == -1) {
-            heap.push_back(expire_at);
-            entry.heap_idx = heap.size() - 1;
-        } else {
-            heap[entry.heap_idx] = expire_at;
+    // ttl_ms < 0 clears the TTL, matching PEXPIRE's "persist" semantics. The deadline is capped at
+    // INT64_MAX microseconds, so it neither wraps nor overflows pttl().
+    template<typename Ttl>
+    static void set_entry_ttl(Entry& entry, int64_t ttl_ms, Ttl& ttl) {
+        if (ttl_ms < 0) {
+            ttl.cancel(entry);
+            return;
         }
+        uint64_t now = get_monotonic_usec();
+        uint64_t max_ms = (static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) - now) / 1000;
+        ttl.arm(entry, now + std::min(static_cast<uint64_t>(ttl_ms), max_ms) * 1000);
+    }
+
+    // Roughly how many allocations freeing the entry's value takes; lazy freeing is gated on it.
+    static size_t free_effort(const Entry& entry) noexcept {
+        if (entry.type != EntryType::ZSet || !entry.zset) return 1;
+        return entry.zset->encoding() == ds::ZEncoding::Listpack ? 1 : entry.zset->size();
+    }
+
+    // What the entry costs in memory, as maxmemory counts it: the entry, the heap parts of its strings and
+    // the value. O(1), so writes can recharge it after every change.
+    static size_t memory_usage(const Entry& entry) noexcept {
+        size_t bytes = sizeof(Entry) + heap_bytes(entry.key) + entry.value.heap_bytes();
+        if (entry.type == EntryType::ZSet && entry.zset) bytes += entry.zset->approx_bytes();
+        return bytes;
+    }
+
+    template<typename Ttl>
+    static void remove_entry_ttl(Entry& entry, Ttl& ttl) {
+        ttl.cancel(entry);
     }
 
-private:
     static uint64_t get_monotonic_usec() {
         return std::chrono::duration_cast<std::chrono::microseconds>(
             std::chrono::steady_clock::now().time_since_epoch()
         ).count();
     }
+
+private:
+    // Short strings live inside std::string itself.
+    static size_t heap_bytes(const std::string& s) noexcept {
+        return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+    }
+};
+
+// TTL index backends. Both offer the same surface:
+//   arm(entry, expire_at_us)  set or move the entry's deadline
+//   cancel(entry)             drop it (no-op without one)
+//   expire_at(entry)          the deadline, if any
+//   expire(now_us, max, fn)   disarm up to `max` entries due by now_us and hand each to fn
+//   next_due_us()             no later than the earliest deadline (none when empty): when to expire next
+// HeapTtl keeps exact deadlines in a binary min-heap, O(log n) per change. WheelTtl files them into
+// k_tick_us buckets of a hierarchical timing wheel, O(1) per change; deadlines are rounded up to the next
+// tick, so a key can outlive its TTL by up to a tick but never expires early.
+class HeapTtl {
+public:
+    void arm(Entry& entry, uint64_t expire_at_us) {
+        if (entry.heap_idx == Entry::k_no_ttl) {
+            ds::HeapItem<TtlItem> item(TtlItem{expire_at_us, &entry});
+            item.set_position(&entry.heap_idx);
+            heap_.push(std::move(item));
+        } else {
+            heap_.value_at(entry.heap_idx).expire_at_us = expire_at_us;
+            heap_.update(entry.heap_idx);
+        }
+    }
+
+    void cancel(Entry& entry) {
+        if (entry.heap_idx == Entry::k_no_ttl) return;
+        heap_.erase(entry.heap_idx);
+        entry.heap_idx = Entry::k_no_ttl;
+    }
+
+    [[nodiscard]] std::optional<uint64_t> expire_at(const Entry& entry) const {
+        if (entry.heap_idx == Entry::k_no_ttl) return std::nullopt;
+        return heap_.at(entry.heap_idx).value().expire_at_us;
+    }
+
+    template<typename OnExpire>
+    size_t expire(uint64_t now_us, size_t max, OnExpire&& on_expire) {
+        size_t fired = 0;
+        while (fired < max && !heap_.empty() && heap_.top().value().expire_at_us <= now_us) {
+            Entry* entry = heap_.pop().value().entry;
+            entry->heap_idx = Entry::k_no_ttl;
+            fired++;
+            on_expire(*entry);
+        }
+        return fired;
+    }
+
+    [[nodiscard]] std::optional<uint64_t> next_due_us() const {
+        if (heap_.empty()) return std::nullopt;
+        return heap_.top().value().expire_at_us;
+    }
+
+    void clear() noexcept { heap_.clear(); }
+    [[nodiscard]] size_t size() const noexcept { return heap_.size(); }
+
+private:
+    TtlHeap heap_;
+};
+
+class WheelTtl {
+public:
+    static constexpr uint64_t k_tick_us = 1000;
+
+    WheelTtl() : wheel_(get_tick(EntryManager::get_monotonic_usec())) {}
+
+    void arm(Entry& entry, uint64_t expire_at_us) noexcept {
+        wheel_.arm(entry, (expire_at_us + k_tick_us - 1) / k_tick_us);
+    }
+
+    void cancel(Entry& entry) noexcept { wheel_.cancel(entry); }
+
+    [[nodiscard]] std::optional<uint64_t> expire_at(const Entry& entry) const noexcept {
+        if (!entry.armed()) return std::nullopt;
+        return entry.deadline * k_tick_us;
+    }
+
+    template<typename OnExpire>
+    size_t expire(uint64_t now_us, size_t max, OnExpire&& on_expire) {
+        return wheel_.advance(get_tick(now_us), max, std::forward<OnExpire>(on_expire));
+    }
+
+    // The wheel's next bucket or cascade boundary, which may come a little before any deadline in it.
+    [[nodiscard]] std::optional<uint64_t> next_due_us() const noexcept {
+        if (wheel_.empty()) return std::nullopt;
+        return wheel_.next_event() * k_tick_us;
+    }
+
+    void clear() noexcept { wheel_.clear(); }
+    [[nodiscard]] size_t size() const noexcept { return wheel_.size(); }
+
+private:
+    ds::TimingWheel<Entry> wheel_;
+
+    static uint64_t get_tick(uint64_t us) noexcept { return us / k_tick_us; }
 };
 
 #endif 
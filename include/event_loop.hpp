@@ -0,0 +1,471 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "logging.hpp"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+// Readiness bits handed back by every backend. EVENT_ACCEPT is only produced by backends that
+// accept on our behalf (io_uring multishot accept), in which case IoEvent::result holds the new fd.
+enum : uint32_t {
+    EVENT_READ   = 1u << 0,
+    EVENT_WRITE  = 1u << 1,
+    EVENT_ERROR  = 1u << 2,
+    EVENT_ACCEPT = 1u << 3
+};
+
+struct IoEvent {
+    int fd;
+    uint32_t events;
+    int result;
+};
+
+enum class EventBackendKind : uint8_t { Poll, Epoll, IoUring };
+
+inline std::error_code last_error() noexcept { return {errno, std::system_category()}; }
+
+// The monitored fd set lives inside the backend and persists across iterations - callers only
+// tell it about changes (add/modify/remove) instead of rebuilding the whole set every wakeup.
+class EventBackend {
+public:
+    virtual ~EventBackend() = default;
+
+    virtual Result<void> add(int fd, uint32_t interest) = 0;
+    virtual Result<void> modify(int fd, uint32_t interest) = 0;
+    virtual void remove(int fd) = 0;
+    virtual Result<void> add_acceptor(int listen_fd) { return add(listen_fd, EVENT_READ); }
+
+    // Clears `out` and fills it with ready events. Returns the number of events.
+    virtual Result<size_t> wait(std::vector<IoEvent>& out, int timeout_ms) = 0;
+
+    // Edge-triggered backends only report transitions, so callers must drain reads/accepts until
+    // EAGAIN and can keep READ|WRITE registered permanently instead of calling modify().
+    [[nodiscard]] virtual bool edge_triggered() const noexcept = 0;
+    [[nodiscard]] virtual std::string_view name() const noexcept = 0;
+};
+
+// Portability fallback. The pollfd array is persistent (swap-remove on delete) but poll() itself
+// still hands the kernel the whole array each call, so this stays O(connections) per wakeup.
+class PollBackend final : public EventBackend {
+public:
+    Result<void> add(int fd, uint32_t interest) override {
+        if (index_.contains(fd)) return modify(fd, interest);
+        index_[fd] = fds_.size();
+        fds_.push_back(pollfd{fd, to_poll(interest), 0});
+        return {};
+    }
+
+    Result<void> modify(int fd, uint32_t interest) override {
+        auto it = index_.find(fd);
+        if (it == index_.end()) return std::unexpected(std::make_error_code(std::errc::bad_file_descriptor));
+        fds_[it->second].events = to_poll(interest);
+        return {};
+    }
+
+    void remove(int fd) override {
+        auto it = index_.find(fd);
+        if (it == index_.end()) return;
+        size_t pos = it->second;
+        index_.erase(it);
+        if (pos != fds_.size() - 1) {
+            fds_[pos] = fds_.back();
+            index_[fds_[pos].fd] = pos;
+        }
+        fds_.pop_back();
+    }
+
+    Result<size_t> wait(std::vector<IoEvent>& out, int timeout_ms) override {
+        out.clear();
+        int rv = ::poll(fds_.data(), static_cast<nfds_t>(fds_.size()), timeout_ms);
+        if (rv < 0) return std::unexpected(last_error());
+
+        for (size_t i = 0; i < fds_.size() && out.size() < static_cast<size_t>(rv); ++i) {
+            short re = fds_[i].revents;
+            if (!re) continue;
+            uint32_t ev = 0;
+            if (re & POLLIN) ev |= EVENT_READ;
+            if (re & POLLOUT) ev |= EVENT_WRITE;
+            if (re & (POLLERR | POLLHUP | POLLNVAL)) ev |= EVENT_ERROR;
+            out.push_back(IoEvent{fds_[i].fd, ev, 0});
+        }
+        return out.size();
+    }
+
+    [[nodiscard]] bool edge_triggered() const noexcept override { return false; }
+    [[nodiscard]] std::string_view name() const noexcept override { return "poll"; }
+
+private:
+    std::vector<pollfd> fds_;
+    std::unordered_map<int, size_t> index_;
+
+    static short to_poll(uint32_t interest) noexcept {
+        short ev = 0;
+        if (interest & EVENT_READ) ev |= POLLIN;
+        if (interest & EVENT_WRITE) ev |= POLLOUT;
+        return ev;
+    }
+};
+
+#ifdef __linux__
+
+// Default on Linux. Edge-triggered so a connection is registered once for READ|WRITE and never
+// touched again until it closes - wakeups cost O(ready), not O(connections).
+class EpollBackend final : public EventBackend {
+public:
+    static Result<std::unique_ptr<EventBackend>> create() {
+        int fd = epoll_create1(EPOLL_CLOEXEC);
+        if (fd < 0) return std::unexpected(last_error());
+        return std::unique_ptr<EventBackend>(new EpollBackend(fd));
+    }
+
+    ~EpollBackend() override { if (epfd_ != -1) close(epfd_); }
+
+    EpollBackend(const EpollBackend&) = delete;
+    EpollBackend& operator=(const EpollBackend&) = delete;
+
+    Result<void> add(int fd, uint32_t interest) override { return ctl(EPOLL_CTL_ADD, fd, interest); }
+    Result<void> modify(int fd, uint32_t interest) override { return ctl(EPOLL_CTL_MOD, fd, interest); }
+    void remove(int fd) override { epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr); }
+
+    Result<size_t> wait(std::vector<IoEvent>& out, int timeout_ms) override {
+        out.clear();
+        int rv = epoll_wait(epfd_, buffer_.data(), static_cast<int>(buffer_.size()), timeout_ms);
+        if (rv < 0) return std::unexpected(last_error());
+
+        for (int i = 0; i < rv; ++i) {
+            uint32_t re = buffer_[i].events;
+            uint32_t ev = 0;
+            if (re & EPOLLIN) ev |= EVENT_READ;
+            if (re & EPOLLOUT) ev |= EVENT_WRITE;
+            if (re & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) ev |= EVENT_ERROR | EVENT_READ;
+            out.push_back(IoEvent{buffer_[i].data.fd, ev, 0});
+        }
+        // A full buffer means more events are probably queued - grow so the next wait drains them in one call.
+        if (static_cast<size_t>(rv) == buffer_.size() && buffer_.size() < k_max_events) {
+            buffer_.resize(buffer_.size() * 2);
+        }
+        return out.size();
+    }
+
+    [[nodiscard]] bool edge_triggered() const noexcept override { return true; }
+    [[nodiscard]] std::string_view name() const noexcept override { return "epoll"; }
+
+private:
+    static constexpr size_t k_initial_events = 256;
+    static constexpr size_t k_max_events = 16384;
+
+    int epfd_;
+    std::vector<epoll_event> buffer_;
+
+    explicit EpollBackend(int fd) : epfd_(fd), buffer_(k_initial_events) {}
+
+    Result<void> ctl(int op, int fd, uint32_t interest) {
+        epoll_event ev{};
+        ev.events = EPOLLET | EPOLLRDHUP;
+        if (interest & EVENT_READ) ev.events |= EPOLLIN;
+        if (interest & EVENT_WRITE) ev.events |= EPOLLOUT;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd_, op, fd, &ev) < 0) return std::unexpected(last_error());
+        return {};
+    }
+};
+
+// io_uring backend driven through the raw syscalls (no liburing dependency). Connections are armed
+// once with a multishot POLL_ADD and the listener with a multishot ACCEPT, so steady state costs a
+// single io_uring_enter per loop iteration and the kernel hands us accepted fds directly.
+// Stale completions after remove() are filtered by a per-fd generation stored in user_data.
+class IoUringBackend final : public EventBackend {
+public:
+    static Result<std::unique_ptr<EventBackend>> create(unsigned entries = k_default_entries) {
+        std::unique_ptr<IoUringBackend> ring(new IoUringBackend());
+        if (auto res = ring->setup(entries); !res) return std::unexpected(res.error());
+        return std::unique_ptr<EventBackend>(std::move(ring));
+    }
+
+    ~IoUringBackend() override {
+        if (sqes_) munmap(sqes_, sqes_size_);
+        if (cq_ptr_ && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+        if (sq_ptr_) munmap(sq_ptr_, sq_size_);
+        if (ring_fd_ != -1) close(ring_fd_);
+    }
+
+    IoUringBackend(const IoUringBackend&) = delete;
+    IoUringBackend& operator=(const IoUringBackend&) = delete;
+
+    Result<void> add(int fd, uint32_t interest) override {
+        auto& reg = registrations_[fd];
+        reg.generation = next_generation_++;
+        reg.kind = Kind::Poll;
+        reg.interest = interest;
+        return arm(fd, reg);
+    }
+
+    Result<void> modify(int fd, uint32_t interest) override {
+        auto it = registrations_.find(fd);
+        if (it == registrations_.end()) return add(fd, interest);
+        if (it->second.interest == interest) return {};
+        cancel(fd, it->second);
+        return add(fd, interest);
+    }
+
+    void remove(int fd) override {
+        auto it = registrations_.find(fd);
+        if (it == registrations_.end()) return;
+        cancel(fd, it->second);
+        registrations_.erase(it);
+    }
+
+    Result<void> add_acceptor(int listen_fd) override {
+        auto& reg = registrations_[listen_fd];
+        reg.generation = next_generation_++;
+        reg.kind = multishot_accept_ ? Kind::Accept : Kind::Poll;
+        reg.interest = EVENT_READ;
+        return arm(listen_fd, reg);
+    }
+
+    Result<size_t> wait(std::vector<IoEvent>& out, int timeout_ms) override {
+        out.clear();
+        if (cq_ready() == 0) {
+            if (timeout_ms >= 0 && !timeout_armed_) {
+                // off = 1: the timeout also completes as soon as any other CQE is posted, so it never lingers.
+                timeout_.tv_sec = timeout_ms / 1000;
+                timeout_.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1'000'000;
+                io_uring_sqe* sqe = get_sqe();
+                sqe->opcode = IORING_OP_TIMEOUT;
+                sqe->fd = -1;
+                sqe->addr = reinterpret_cast<uint64_t>(&timeout_);
+                sqe->len = 1;
+                sqe->off = 1;
+                sqe->user_data = encode(Kind::Timeout, 0, -1);
+                timeout_armed_ = true;
+            }
+            if (auto res = enter(1, IORING_ENTER_GETEVENTS); !res) return std::unexpected(res.error());
+        } else if (pending_) {
+            if (auto res = enter(0, 0); !res) return std::unexpected(res.error());
+        }
+        reap(out);
+        return out.size();
+    }
+
+    [[nodiscard]] bool edge_triggered() const noexcept override { return true; }
+    [[nodiscard]] std::string_view name() const noexcept override { return "io_uring"; }
+
+private:
+    static constexpr unsigned k_default_entries = 4096;
+
+    enum class Kind : uint8_t { Poll = 1, Accept = 2, Timeout = 3, Cancel = 4 };
+
+    struct Registration {
+        uint32_t generation{0};
+        Kind kind{Kind::Poll};
+        uint32_t interest{0};
+    };
+
+    int ring_fd_{-1};
+    void* sq_ptr_{nullptr};
+    void* cq_ptr_{nullptr};
+    size_t sq_size_{0};
+    size_t cq_size_{0};
+    size_t sqes_size_{0};
+    io_uring_sqe* sqes_{nullptr};
+    io_uring_cqe* cqes_{nullptr};
+    unsigned* sq_head_{nullptr};
+    unsigned* sq_tail_{nullptr};
+    unsigned* sq_array_{nullptr};
+    unsigned sq_mask_{0};
+    unsigned sq_entries_{0};
+    unsigned* cq_head_{nullptr};
+    unsigned* cq_tail_{nullptr};
+    unsigned cq_mask_{0};
+    unsigned pending_{0};
+
+    bool multishot_accept_{true};
+    bool timeout_armed_{false};
+    __kernel_timespec timeout_{};
+    uint32_t next_generation_{1};
+    std::unordered_map<int, Registration> registrations_;
+
+    IoUringBackend() = default;
+
+    // user_data layout: [kind:8][generation:24][fd:32]
+    static uint64_t encode(Kind kind, uint32_t generation, int fd) noexcept {
+        return (static_cast<uint64_t>(kind) << 56) |
+               (static_cast<uint64_t>(generation & 0xFFFFFF) << 32) |
+               static_cast<uint32_t>(fd);
+    }
+
+    Result<void> setup(unsigned entries) {
+        io_uring_params params{};
+        ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd_ < 0) return std::unexpected(last_error());
+
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+
+        sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) { sq_ptr_ = nullptr; return std::unexpected(last_error()); }
+        if (single_mmap) {
+            cq_ptr_ = sq_ptr_;
+        } else {
+            cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+            if (cq_ptr_ == MAP_FAILED) { cq_ptr_ = nullptr; return std::unexpected(last_error()); }
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return std::unexpected(last_error());
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        auto* sq = static_cast<char*>(sq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+
+        auto* cq = static_cast<char*>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return {};
+    }
+
+    io_uring_sqe* get_sqe() {
+        unsigned tail = *sq_tail_;
+        if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+            (void)enter(0, 0); // SQ full - flush what we have before queueing more
+        }
+        unsigned idx = tail & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array_[idx] = idx;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++pending_;
+        return sqe;
+    }
+
+    Result<void> enter(unsigned min_complete, unsigned flags) {
+        int rv = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, pending_, min_complete, flags, nullptr, 0));
+        if (rv < 0) return std::unexpected(last_error());
+        pending_ -= std::min<unsigned>(pending_, static_cast<unsigned>(rv));
+        return {};
+    }
+
+    unsigned cq_ready() const noexcept {
+        return __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) - *cq_head_;
+    }
+
+    Result<void> arm(int fd, const Registration& reg) {
+        io_uring_sqe* sqe = get_sqe();
+        sqe->fd = fd;
+        sqe->user_data = encode(reg.kind, reg.generation, fd);
+        if (reg.kind == Kind::Accept) {
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        } else {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->len = IORING_POLL_ADD_MULTI;
+            uint32_t mask = POLLERR | POLLHUP | POLLRDHUP;
+            if (reg.interest & EVENT_READ) mask |= POLLIN;
+            if (reg.interest & EVENT_WRITE) mask |= POLLOUT;
+            sqe->poll32_events = mask;
+        }
+        return {};
+    }
+
+    void cancel(int fd, const Registration& reg) {
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = reg.kind == Kind::Accept ? IORING_OP_ASYNC_CANCEL : IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = encode(reg.kind, reg.generation, fd);
+        sqe->user_data = encode(Kind::Cancel, 0, -1);
+    }
+
+    void reap(std::vector<IoEvent>& out) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            auto kind = static_cast<Kind>(cqe.user_data >> 56);
+            if (kind == Kind::Timeout) { timeout_armed_ = false; continue; }
+            if (kind == Kind::Cancel) continue;
+
+            int fd = static_cast<int>(static_cast<uint32_t>(cqe.user_data));
+            uint32_t generation = static_cast<uint32_t>(cqe.user_data >> 32) & 0xFFFFFF;
+            auto it = registrations_.find(fd);
+            if (it == registrations_.end() || (it->second.generation & 0xFFFFFF) != generation) continue;
+
+            bool more = cqe.flags & IORING_CQE_F_MORE;
+            if (kind == Kind::Accept) {
+                if (cqe.res >= 0) {
+                    out.push_back(IoEvent{fd, EVENT_ACCEPT, cqe.res});
+                } else if (cqe.res == -EINVAL && multishot_accept_) {
+                    // Kernel predates multishot accept: downgrade the listener to readiness polling.
+                    log_message("io_uring: multishot accept unsupported, falling back to poll");
+                    multishot_accept_ = false;
+                    it->second.kind = Kind::Poll;
+                    more = false;
+                }
+            } else if (cqe.res < 0) {
+                if (cqe.res != -ECANCELED) out.push_back(IoEvent{fd, EVENT_ERROR, cqe.res});
+            } else {
+                uint32_t ev = 0;
+                if (cqe.res & POLLIN) ev |= EVENT_READ;
+                if (cqe.res & POLLOUT) ev |= EVENT_WRITE;
+                if (cqe.res & (POLLERR | POLLHUP | POLLRDHUP)) ev |= EVENT_ERROR | EVENT_READ;
+                out.push_back(IoEvent{fd, ev, 0});
+            }
+            if (!more) (void)arm(fd, it->second); // multishot terminated (overflow, error, ...) - re-arm
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+};
+
+#endif // __linux__
+
+[[nodiscard]] constexpr EventBackendKind default_event_backend() noexcept {
+#ifdef __linux__
+    return EventBackendKind::Epoll;
+#else
+    return EventBackendKind::Poll;
+#endif
+}
+
+// Builds the requested backend, falling back io_uring -> epoll -> poll when the kernel refuses
+// (old kernel, seccomp profile blocking io_uring_setup, non-Linux build).
+inline std::unique_ptr<EventBackend> make_event_backend(EventBackendKind kind) {
+#ifdef __linux__
+    if (kind == EventBackendKind::IoUring) {
+        if (auto ring = IoUringBackend::create()) return std::move(*ring);
+        log_message("io_uring unavailable, falling back to epoll");
+        kind = EventBackendKind::Epoll;
+    }
+    if (kind == EventBackendKind::Epoll) {
+        if (auto ep = EpollBackend::create()) return std::move(*ep);
+        log_message("epoll unavailable, falling back to poll");
+    }
+#endif
+    return std::make_unique<PollBackend>();
+}
+
+#endif // EVENT_LOOP_HPP
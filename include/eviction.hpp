@@ -0,0 +1,232 @@
+#ifndef EVICTION_HPP
+#define EVICTION_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include "entry_manager.hpp"
+#include "../frequency_sketch.hpp"
+#include "../list.hpp"
+
+// What a shard drops once its keys use more memory than maxmemory allows.
+//  - TinyLfu (default): W-TinyLFU. New keys enter a small LRU window (1% of the keys); the window's LRU
+//    key then competes with the main area's LRU victim, and whichever the frequency sketch has seen less
+//    often is evicted. The main area is a segmented LRU - probation, and protected (80%) for keys hit
+//    again while on probation - so one scan of cold keys can't flush the hot ones.
+//  - SampledLru / SampledLfu: Redis' approximations. No lists are kept; each eviction samples a few keys
+//    and drops the one idle longest, or with the lowest decaying log-frequency counter. Cheaper per access,
+//    less accurate.
+//  - NoEviction: writes that would grow the keyspace are refused instead.
+enum class EvictionPolicy : uint8_t { NoEviction, TinyLfu, SampledLru, SampledLfu };
+
+[[nodiscard]] inline std::optional<EvictionPolicy> parse_eviction_policy(std::string_view name) noexcept {
+    if (name == "noeviction") return EvictionPolicy::NoEviction;
+    if (name == "tinylfu") return EvictionPolicy::TinyLfu;
+    if (name == "allkeys-lru") return EvictionPolicy::SampledLru;
+    if (name == "allkeys-lfu") return EvictionPolicy::SampledLfu;
+    return std::nullopt;
+}
+
+struct EvictionConfig {
+    size_t maxmemory{0}; // bytes for the whole server, split evenly over the shards; 0 = no limit
+    EvictionPolicy policy{EvictionPolicy::TinyLfu};
+    uint32_t samples{5}; // keys compared per eviction by the sampled policies
+};
+
+struct EvictionStats {
+    size_t used_bytes{0};      // what the keys cost, as EntryManager::memory_usage() counts it
+    size_t limit_bytes{0};     // this shard's share of maxmemory, 0 if none
+    uint64_t evicted_keys{0};
+    uint64_t admitted{0};      // TinyLfu: window keys that won against the main area's victim
+    uint64_t rejected{0};      // ... and ones that lost, and were evicted instead
+    uint64_t oom_refused{0};   // writes refused because nothing more could be evicted
+};
+
+// The per-key side of the policy, driven by the keyspace: every key added, hit or removed is reported, and
+// victim() / pick() name the next key to evict. Owned by one shard, like the keyspace itself.
+class Evictor {
+public:
+    // Before the first key is added: keys already present are not in the policy's lists.
+    void configure(EvictionPolicy policy, uint32_t samples) noexcept {
+        policy_ = policy;
+        samples_ = std::clamp<uint32_t>(samples, 1, k_max_samples);
+    }
+
+    [[nodiscard]] EvictionPolicy policy() const noexcept { return policy_; }
+    [[nodiscard]] bool sampled() const noexcept {
+        return policy_ == EvictionPolicy::SampledLru || policy_ == EvictionPolicy::SampledLfu;
+    }
+    [[nodiscard]] uint32_t samples() const noexcept { return samples_; }
+
+    // The sampled policies stamp accesses with a clock refreshed here once per loop tick, not per access.
+    void tick() noexcept {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        seconds_ = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(now).count());
+    }
+
+    void on_insert(Entry& entry) {
+        switch (policy_) {
+            case EvictionPolicy::NoEviction: return;
+            case EvictionPolicy::TinyLfu: {
+                if (count() + 1 > sketch_.capacity()) sketch_.ensure_capacity(2 * (count() + 1));
+                sketch_.increment(entry.hcode());
+                link(entry, Segment::Window);
+                // An overfull window spills its LRU key onto probation, where it meets eviction on merit.
+                if (window_count_ > window_target()) move(lru(window_), Segment::Probation);
+                return;
+            }
+            case EvictionPolicy::SampledLru: return stamp_lru(entry);
+            case EvictionPolicy::SampledLfu:
+                entry.evict_bits = k_lfu_initial;
+                entry.evict_clock = minutes();
+                return;
+        }
+    }
+
+    void on_access(Entry& entry) noexcept {
+        switch (policy_) {
+            case EvictionPolicy::NoEviction: return;
+            case EvictionPolicy::TinyLfu:
+                sketch_.increment(entry.hcode());
+                if (segment(entry) == Segment::Probation) {
+                    move(entry, Segment::Protected);
+                    if (protected_count_ > protected_target()) move(lru(protected_), Segment::Probation);
+                } else if (segment(entry) != Segment::None) {
+                    move(entry, segment(entry)); // to the front of its own list
+                }
+                return;
+            case EvictionPolicy::SampledLru: return stamp_lru(entry);
+            case EvictionPolicy::SampledLfu: {
+                uint8_t counter = lfu_decayed(entry);
+                if (counter < 255) {
+                    double p = 1.0 / (static_cast<double>(std::max<int>(counter - k_lfu_initial, 0)) * k_lfu_log_factor + 1.0);
+                    if (static_cast<double>(random() >> 11) * 0x1.0p-53 < p) counter++;
+                }
+                entry.evict_bits = counter;
+                entry.evict_clock = minutes();
+                return;
+            }
+        }
+    }
+
+    // Before the entry is freed, whatever the reason.
+    void on_remove(Entry& entry) noexcept {
+        if (policy_ == EvictionPolicy::TinyLfu && segment(entry) != Segment::None) unlink(entry);
+    }
+
+    // TinyLfu: the key to evict next. The window's LRU key is admitted to probation, and the main area's victim
+    // evicted instead, only if the sketch has seen it more often. Null when no keys are tracked.
+    [[nodiscard]] Entry* victim() noexcept {
+        Entry* victim = !probation_.empty() ? &lru(probation_) : !protected_.empty() ? &lru(protected_) : nullptr;
+        Entry* candidate = window_.empty() ? nullptr : &lru(window_);
+        if (!victim || !candidate) return victim ? victim : candidate;
+        if (sketch_.estimate(candidate->hcode()) > sketch_.estimate(victim->hcode())) {
+            move(*candidate, Segment::Probation);
+            stats_.admitted++;
+            return victim;
+        }
+        stats_.rejected++;
+        return candidate;
+    }
+
+    // Sampled policies: the best one to evict among `candidates` (not empty).
+    [[nodiscard]] Entry* pick(std::span<Entry* const> candidates) const noexcept {
+        auto score = [this](const Entry& e) -> uint32_t {
+            return policy_ == EvictionPolicy::SampledLru ? idle_seconds(e) : 255u - lfu_decayed(e);
+        };
+        return *std::max_element(candidates.begin(), candidates.end(),
+                                 [&](const Entry* a, const Entry* b) { return score(*a) < score(*b); });
+    }
+
+    // xorshift64*, for sampling and the LFU increments.
+    uint64_t random() noexcept {
+        rng_ ^= rng_ >> 12;
+        rng_ ^= rng_ << 25;
+        rng_ ^= rng_ >> 27;
+        return rng_ * 0x2545f4914f6cdd1dull;
+    }
+
+    // The keys are being freed wholesale.
+    void clear() noexcept {
+        window_.clear();
+        probation_.clear();
+        protected_.clear();
+        window_count_ = probation_count_ = protected_count_ = 0;
+        sketch_.clear();
+    }
+
+    [[nodiscard]] EvictionStats& stats() noexcept { return stats_; }
+    [[nodiscard]] const EvictionStats& stats() const noexcept { return stats_; }
+
+private:
+    enum class Segment : uint8_t { None, Window, Probation, Protected };
+
+    static constexpr uint32_t k_max_samples = 64;
+    static constexpr uint32_t k_lru_clock_mask = (1u << 24) - 1; // 24-bit seconds: wraps after ~194 days
+    static constexpr uint8_t k_lfu_initial = 5;                   // new keys don't lose to one-hit keys at once
+    static constexpr double k_lfu_log_factor = 10.0;              // ~1M hits to saturate the counter
+    static constexpr uint32_t k_lfu_decay_minutes = 1;            // counter drops by one per idle minute
+
+    using List = ds::DoublyLinkedList<EvictLink>;
+
+    EvictionPolicy policy_{EvictionPolicy::NoEviction};
+    uint32_t samples_{5};
+    ds::FrequencySketch sketch_;
+    List window_, probation_, protected_;
+    size_t window_count_{0}, probation_count_{0}, protected_count_{0};
+    uint32_t seconds_{0};
+    uint64_t rng_{0x9e3779b97f4a7c15ull};
+    EvictionStats stats_;
+
+    [[nodiscard]] size_t count() const noexcept { return window_count_ + probation_count_ + protected_count_; }
+    [[nodiscard]] size_t window_target() const noexcept { return std::max<size_t>(1, count() / 100); }
+    [[nodiscard]] size_t protected_target() const noexcept { return (count() - window_count_) * 8 / 10; }
+
+    [[nodiscard]] static Segment segment(const Entry& entry) noexcept { return static_cast<Segment>(entry.evict_bits); }
+    [[nodiscard]] static Entry& lru(List& list) noexcept { return static_cast<Entry&>(list.back()); }
+
+    size_t& counter_of(Segment segment) noexcept {
+        return segment == Segment::Window ? window_count_ : segment == Segment::Probation ? probation_count_ : protected_count_;
+    }
+    List& list_of(Segment segment) noexcept {
+        return segment == Segment::Window ? window_ : segment == Segment::Probation ? probation_ : protected_;
+    }
+
+    void link(Entry& entry, Segment segment) noexcept {
+        list_of(segment).push_front(entry);
+        counter_of(segment)++;
+        entry.evict_bits = static_cast<uint8_t>(segment);
+    }
+    void unlink(Entry& entry) noexcept {
+        entry.ds::ListNode<EvictLink>::unlink();
+        counter_of(segment(entry))--;
+        entry.evict_bits = static_cast<uint8_t>(Segment::None);
+    }
+    // To the front (MRU end) of `to`.
+    void move(Entry& entry, Segment to) noexcept {
+        unlink(entry);
+        link(entry, to);
+    }
+
+    void stamp_lru(Entry& entry) const noexcept {
+        uint32_t clock = seconds_ & k_lru_clock_mask;
+        entry.evict_bits = static_cast<uint8_t>(clock >> 16);
+        entry.evict_clock = static_cast<uint16_t>(clock);
+    }
+    [[nodiscard]] uint32_t idle_seconds(const Entry& entry) const noexcept {
+        uint32_t stamp = (static_cast<uint32_t>(entry.evict_bits) << 16) | entry.evict_clock;
+        return ((seconds_ & k_lru_clock_mask) - stamp) & k_lru_clock_mask;
+    }
+
+    [[nodiscard]] uint16_t minutes() const noexcept { return static_cast<uint16_t>(seconds_ / 60); }
+    [[nodiscard]] uint8_t lfu_decayed(const Entry& entry) const noexcept {
+        uint32_t idle = static_cast<uint16_t>(minutes() - entry.evict_clock);
+        uint32_t decay = idle / k_lfu_decay_minutes;
+        return decay >= entry.evict_bits ? 0 : static_cast<uint8_t>(entry.evict_bits - decay);
+    }
+};
+
+#endif // EVICTION_HPP
@@ -0,0 +1,618 @@
+#ifndef KEYSPACE_HPP
+#define KEYSPACE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include "cold_tier.hpp"
+#include "command_feed.hpp"
+#include "entry_manager.hpp"
+#include "eviction.hpp"
+#include "snapshot.hpp"
+#include "../hashtable.hpp"
+#include "../flat_hashtable.hpp"
+#include "../thread_pool.hpp"
+
+// Values handed to the background pool instead of being freed on the reactor thread.
+struct LazyFreeStats {
+    uint64_t lazy_freed{0}; // values handed off so far
+    size_t pending{0};      // ... of which the background pool hasn't finished freeing
+};
+
+// Counters for the two expiry paths, for INFO-style reporting.
+struct ExpiryStats {
+    uint64_t expired_keys{0};     // total, both paths
+    uint64_t lazy_expired{0};     // found expired on access
+    uint64_t active_expired{0};   // reclaimed by active_expire()
+    uint64_t cycles{0};           // active_expire() calls that had anything to do
+    uint64_t cycles_capped{0};    // ... of which stopped on the time budget with keys still due
+    uint64_t cycle_ns{0};         // total time spent inside those cycles
+    uint64_t budget_ns{0};        // current per-cycle budget
+    double expired_per_sec{0.0};  // active expiry rate over the last full second
+};
+
+static_assert(ColdRef::k_encoded_size <= ds::SharedString::k_inline, "a cold entry's ref must not allocate");
+
+// The data a shard serves: every key as an Entry in an incrementally-resized hash map, plus the index of
+// expiry deadlines. Owned by one reactor thread, so no locking.
+// Map picks the hash backend - chained HMap or open-addressing FlatHMap; Ttl the expiry index - WheelTtl
+// (timing wheel) or HeapTtl (binary heap). Keyspace is what the server uses.
+template<template<typename> class Map = HMap, typename Ttl = WheelTtl>
+class BasicKeyspace {
+public:
+    BasicKeyspace() = default;
+    ~BasicKeyspace() { clear(); }
+
+    BasicKeyspace(const BasicKeyspace&) = delete;
+    BasicKeyspace& operator=(const BasicKeyspace&) = delete;
+
+    static std::uint64_t hash_key(std::string_view key) noexcept {
+        return hash_string(reinterpret_cast<const uint8_t*>(key.data()), key.size());
+    }
+
+    // Batched commands (MGET, MSET, ...) hash a few keys ahead and prefetch their buckets, then look each one
+    // up by the hash they already have: see CommandProcessor::for_each_prefetched.
+    void prefetch(std::uint64_t hcode) const noexcept { map_.prefetch(hcode); }
+
+    // Keys whose TTL has passed are reclaimed here on the spot, whether or not the active cycle got to them.
+    Entry* find(std::string_view key) { return find(key, hash_key(key)); }
+
+    // `hcode` is hash_key(key).
+    Entry* find(std::string_view key, std::uint64_t hcode) {
+        Entry* e = map_.find(hcode, [key](const Entry& ent) { return ent.key == key; });
+        if (e && expired(*e)) {
+            expire_lazily(*e);
+            return nullptr;
+        }
+        if (e) touch(*e);
+        return e;
+    }
+
+    // Returns the existing entry or inserts an empty string entry for `key`.
+    Entry& find_or_insert(std::string_view key, bool& inserted) { return find_or_insert(key, hash_key(key), inserted); }
+
+    Entry& find_or_insert(std::string_view key, std::uint64_t hcode, bool& inserted) {
+        if (Entry* e = map_.find(hcode, [key](const Entry& ent) { return ent.key == key; })) {
+            if (!expired(*e)) {
+                inserted = false;
+                touch(*e);
+                return *e;
+            }
+            expire_lazily(*e);
+        }
+        auto entry = std::make_unique<Entry>(key, hcode);
+        entry->snapshot_epoch = snapshot_epoch_; // born after any running snapshot's point in time
+        Entry& ref = *entry;
+        map_.insert(std::move(entry));
+        added(ref);
+        inserted = true;
+        return ref;
+    }
+
+    // Incremental walk over every entry for callers moving keys elsewhere (slot migration), with the map's
+    // scan() contract: start at 0, feed the cursor back until it returns 0. fn must not insert or remove.
+    template<typename Fn>
+    size_t scan(size_t cursor, Fn&& fn) { return map_.scan(cursor, fn); }
+
+    // Bulk loading: sizes an empty keyspace for `n` keys, then insert_new() adds each one without the lookup.
+    void reserve(size_t n) { map_.reserve(n); }
+
+    // `key` must not be present; `hcode` is hash_key(key), which the caller may have computed on another thread.
+    // Like a command's keys, it is charged at the end of the enclosing begin_mutation() / end_mutation().
+    Entry& insert_new(std::string_view key, std::uint64_t hcode) {
+        auto entry = std::make_unique<Entry>(key, hcode);
+        entry->snapshot_epoch = snapshot_epoch_;
+        Entry& ref = *entry;
+        map_.insert(std::move(entry));
+        added(ref);
+        return ref;
+    }
+
+    // Memory accounting. Entries change size in place (SET overwrites, ZADD grows a set), so whoever changes
+    // them brackets the change: every entry found or added in between is charged afresh at end_mutation(),
+    // and used_bytes() stays the sum of EntryManager::memory_usage() over all keys.
+    void begin_mutation() noexcept { mutating_ = true; }
+    void end_mutation() {
+        for (const Charge& c : charges_) used_bytes_ += EntryManager::memory_usage(*c.entry) - c.bytes;
+        charges_.clear();
+        mutating_ = false;
+    }
+    [[nodiscard]] size_t used_bytes() const noexcept { return used_bytes_; }
+
+    // maxmemory for this shard (see eviction.hpp); 0 means no limit. Before the first key is added.
+    void set_eviction(EvictionPolicy policy, size_t limit_bytes, uint32_t samples) {
+        limit_bytes_ = limit_bytes;
+        evictor_.configure(limit_bytes > 0 ? policy : EvictionPolicy::NoEviction, samples);
+        evict_refuses_ = limit_bytes > 0 && policy == EvictionPolicy::NoEviction;
+        evictor_.tick();
+    }
+
+    // Over the limit, and free to do something about it (not while expiry is paused: a replica follows
+    // its primary's evictions).
+    [[nodiscard]] bool over_limit() const noexcept { return limit_bytes_ > 0 && used_bytes_ > limit_bytes_ && !expiry_paused_; }
+
+    // Evicts up to `max` keys, stopping once under the limit. Evicted keys are fed as DEL, like expired ones.
+    // With a cold tier, a string victim big enough is spilled to it instead and the key stays; keys already
+    // cold are only evicted for real once there is nothing else left to pick. Returns whether the keyspace
+    // is still over the limit.
+    bool evict(size_t max) {
+        Entry* sample[64];
+        for (size_t n = 0; n < max && over_limit(); ++n) {
+            Entry* victim = nullptr;
+            if (evictor_.sampled()) {
+                std::span<Entry*> out(sample, evictor_.samples());
+                size_t found = 0;
+                for (size_t tries = 0; found < out.size() && tries < 4 * out.size() && map_.size() > 0; ++tries) {
+                    map_.scan(static_cast<size_t>(evictor_.random()), [&](Entry& e) {
+                        if (found < out.size() && e.type != EntryType::Cold) out[found++] = &e;
+                    });
+                }
+                if (found > 0) victim = evictor_.pick(out.first(found));
+            } else if (evictor_.policy() != EvictionPolicy::NoEviction) {
+                victim = evictor_.victim();
+            }
+            if (victim && spillable(*victim)) {
+                spill(*victim);
+                continue;
+            }
+            if (!victim && cold_) victim = cold_victim();
+            if (!victim) break;
+            if (feed_) feed_->append_del(victim->key);
+            reclaim(*victim);
+            evictor_.stats().evicted_keys++;
+        }
+        return over_limit();
+    }
+
+    // Tiered storage (see cold_tier.hpp): evicted string values of at least `min_value_bytes` go to `tier`.
+    // Null detaches it; keys already cold then read as errors until overwritten or deleted.
+    void attach_cold_tier(ColdTier* tier, size_t min_value_bytes) noexcept {
+        cold_ = tier;
+        cold_min_bytes_ = min_value_bytes;
+    }
+    [[nodiscard]] ColdTier* cold_tier() const noexcept { return cold_; }
+
+    // The value of a Cold entry, read from disk on the spot. For the paths that can't wait for
+    // ColdTier::fetch(): snapshots, slot migration, a GET that found no loaded value.
+    [[nodiscard]] Result<std::string> cold_value(const Entry& entry) const {
+        if (!cold_) return std::unexpected(std::make_error_code(std::errc::no_such_file_or_directory));
+        return cold_->read(ColdRef::decode(entry.value));
+    }
+
+    // A value ColdTier::fetch() read back: the key is a plain string again, unless it changed meanwhile.
+    bool promote(std::string_view key, ColdRef ref, std::string value) {
+        Entry* e = map_.find(hash_key(key), [key](const Entry& ent) { return ent.key == key; });
+        if (!e || e->type != EntryType::Cold || ColdRef::decode(e->value) != ref) return false;
+        if (scanning()) preserve(*e); // before it moves back; save() reads cold values directly
+        size_t before = EntryManager::memory_usage(*e);
+        e->type = EntryType::String;
+        e->value.assign(value);
+        used_bytes_ += EntryManager::memory_usage(*e) - before;
+        cold_->release(ref);
+        evictor_.on_insert(*e);
+        return true;
+    }
+
+    // An overwrite of a Cold entry: its record is dead, and the entry an empty string for the caller to fill.
+    void drop_cold(Entry& entry) noexcept {
+        if (entry.type != EntryType::Cold) return;
+        if (cold_) cold_->release(ColdRef::decode(entry.value));
+        entry.type = EntryType::String;
+        entry.value.clear();
+        evictor_.on_insert(entry);
+    }
+
+    // A record out of a segment being compacted: appended afresh if it still is the key's value.
+    bool relocate_cold(ColdTier::Record&& record) {
+        std::string_view key = record.key;
+        Entry* e = map_.find(hash_key(key), [key](const Entry& ent) { return ent.key == key; });
+        if (!e || e->type != EntryType::Cold || ColdRef::decode(e->value) != record.ref) return false;
+        e->value = cold_->append(record.key, record.value).encode();
+        cold_->release(record.ref);
+        return true;
+    }
+
+    // The event loop's share: evicts in batches of k_evict_batch until under the limit or k_evict_budget
+    // is spent, so a large overshoot (a big SET, a lowered limit) is worked off over several ticks.
+    // Returns whether keys still have to go.
+    bool evict_step() {
+        evictor_.tick();
+        if (!over_limit()) return false;
+        auto deadline = std::chrono::steady_clock::now() + k_evict_budget;
+        while (evict(k_evict_batch)) {
+            if (evict_refuses_ || std::chrono::steady_clock::now() >= deadline) break;
+        }
+        return over_limit() && !evict_refuses_;
+    }
+
+    // Before a write that can grow the keyspace: whether there is room for it after evicting a batch.
+    bool make_room() {
+        if (!over_limit()) return true;
+        if (!evict(k_evict_batch)) return true;
+        evictor_.stats().oom_refused++;
+        return false;
+    }
+
+    [[nodiscard]] EvictionStats eviction_stats() const noexcept {
+        EvictionStats s = evictor_.stats();
+        s.used_bytes = used_bytes_;
+        s.limit_bytes = limit_bytes_;
+        return s;
+    }
+
+    bool erase(std::string_view key) {
+        auto entry = map_.remove(hash_key(key), [key](const Entry& e) { return e.key == key; });
+        if (!entry) return false;
+        bool live = !expired(*entry);
+        if (!live) count_expired(stats_.lazy_expired, 1);
+        destroy(std::move(entry));
+        return live;
+    }
+
+    // With a background pool set, values whose free_effort() reaches k_lazy_free_threshold are detached
+    // and freed there (UNLINK-style) on every removal path - DEL/UNLINK, lazy and active expiry -
+    // instead of stalling the reactor. Without one everything is freed inline. The pool must drain before
+    // the shard's slab pool goes away; the members it frees come back through SlabPool::collect_remote().
+    void set_background(threading::ThreadPool* pool) noexcept { background_ = pool; }
+
+    // Where CommandProcessor feeds executed writes, and where keys this shard expires are fed as DEL.
+    void set_command_feed(CommandFeed* feed) noexcept { feed_ = feed; }
+    [[nodiscard]] CommandFeed* command_feed() const noexcept { return feed_; }
+
+    // While paused nothing expires or is evicted. For replaying a log or following a primary: the stream already
+    // carries every expiry as a DEL at the point it happened. Keys whose TTL passed meanwhile are
+    // reclaimed once expiry resumes.
+    void pause_expiry(bool paused) noexcept { expiry_paused_ = paused; }
+
+    [[nodiscard]] LazyFreeStats lazy_free_stats() const noexcept {
+        return {lazy_freed_, lazy_pending_->load(std::memory_order_relaxed)};
+    }
+
+    void set_ttl(Entry& entry, int64_t ttl_ms) { EntryManager::set_entry_ttl(entry, ttl_ms, ttl_); }
+
+    // Remaining TTL in ms, or -1 if the key has none.
+    [[nodiscard]] int64_t pttl(const Entry& entry) const {
+        auto expire_at = ttl_.expire_at(entry);
+        if (!expire_at) return -1;
+        uint64_t now = EntryManager::get_monotonic_usec();
+        return *expire_at > now ? static_cast<int64_t>((*expire_at - now) / 1000) : 0;
+    }
+
+    void clear() {
+        abort_snapshot();
+        // for_each, not scan(): each entry exactly once, even mid-resize, so no cold ref is released twice.
+        if (cold_) map_.for_each([this](Entry& e) { release_cold(e); });
+        ttl_.clear();
+        map_.clear();
+        evictor_.clear();
+        charges_.clear();
+        used_bytes_ = 0;
+    }
+
+    // One active expiry cycle: reclaims due keys in batches of k_expire_batch until none are left or the
+    // adaptive budget is spent, so a mass expiry is spread over many loop ticks instead of stalling one.
+    // The budget doubles (up to k_expire_max_budget) while cycles keep ending with keys still due, and
+    // halves back towards k_expire_min_budget once they drain. Returns whether keys are still due.
+    bool active_expire() {
+        if (ttl_.size() == 0 || expiry_paused_) return false;
+        auto start = std::chrono::steady_clock::now();
+        uint64_t now_us = EntryManager::get_monotonic_usec();
+        auto deadline = start + expire_budget_;
+        size_t reclaimed = 0;
+        bool backlog = false;
+        while (true) {
+            size_t n = ttl_.expire(now_us, k_expire_batch, [this, now_us](Entry& e) {
+                if (scanning()) preserve(e, now_us); // already disarmed, so pass on that it was due by now
+                if (feed_) feed_->append_del(e.key);
+                reclaim(e);
+            });
+            reclaimed += n;
+            if (n < k_expire_batch) break;
+            if (std::chrono::steady_clock::now() >= deadline) {
+                backlog = true;
+                break;
+            }
+        }
+
+        if (reclaimed > 0 || backlog) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            stats_.cycles++;
+            stats_.cycle_ns += static_cast<uint64_t>(elapsed.count());
+            count_expired(stats_.active_expired, reclaimed);
+            window_expired_ += reclaimed;
+        }
+        if (backlog) {
+            stats_.cycles_capped++;
+            expire_budget_ = std::min(expire_budget_ * 2, k_expire_max_budget);
+        } else {
+            expire_budget_ = std::max(expire_budget_ / 2, k_expire_min_budget);
+        }
+        if (now_us - window_start_us_ >= 1'000'000) {
+            stats_.expired_per_sec = static_cast<double>(window_expired_) * 1e6 / static_cast<double>(now_us - window_start_us_);
+            window_start_us_ = now_us;
+            window_expired_ = 0;
+        }
+        return backlog;
+    }
+
+    [[nodiscard]] bool has_ttls() const noexcept { return ttl_.size() > 0; }
+    [[nodiscard]] size_t ttl_count() const noexcept { return ttl_.size(); }
+    // When active_expire() may next find a key due (monotonic usec), or none while nothing can expire.
+    [[nodiscard]] std::optional<uint64_t> next_expiry_us() const {
+        if (expiry_paused_) return std::nullopt;
+        return ttl_.next_due_us();
+    }
+    [[nodiscard]] ExpiryStats expiry_stats() const noexcept {
+        ExpiryStats s = stats_;
+        s.budget_ns = static_cast<uint64_t>(expire_budget_.count());
+        return s;
+    }
+
+    // Fork-free point-in-time snapshot, written while the shard keeps serving. The map is walked a slice at a
+    // time with scan(); each entry is stamped with the snapshot epoch when written, and anything about to be
+    // modified (before_write) or removed (destroy) before the walk reaches it is written out first. Entries
+    // created after the start carry the new epoch already and are skipped. So the file holds the keyspace
+    // exactly as of this call, at the cost of one early serialization per key touched during the walk -
+    // copy-on-write at entry granularity instead of fork's page granularity.
+    Result<void> begin_snapshot(std::unique_ptr<SnapshotWriter> writer) {
+        if (writer_) return std::unexpected(std::make_error_code(std::errc::operation_in_progress));
+        writer_ = std::move(writer);
+        snapshot_epoch_++;
+        scan_cursor_ = 0;
+        scan_done_ = false;
+        snapshot_start_us_ = EntryManager::get_monotonic_usec();
+        snapshot_start_unix_ms_ = snapshot_format::unix_ms_now();
+        snapshot_stats_.in_progress = true;
+        snapshot_stats_.keys = 0;
+        snapshot_stats_.preserved = 0;
+        return {};
+    }
+
+    // Walks the map for up to `budget`, pausing while the disk falls behind. Returns whether the snapshot is
+    // still running; once it isn't, snapshot_stats() says how it went.
+    bool snapshot_step(std::chrono::nanoseconds budget) {
+        if (!writer_) return false;
+        if (scan_done_) {
+            if (writer_->done()) finish_snapshot();
+            return writer_ != nullptr;
+        }
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        while (!writer_->congested()) {
+            for (size_t i = 0; i < k_snapshot_batch; ++i) {
+                scan_cursor_ = map_.scan(scan_cursor_, [this](Entry& e) { save(e); });
+                if (scan_cursor_ == 0) break;
+            }
+            if (scan_cursor_ == 0) {
+                scan_done_ = true;
+                writer_->finish();
+                break;
+            }
+            if (std::chrono::steady_clock::now() >= deadline) break;
+        }
+        snapshot_stats_.keys = writer_->records();
+        snapshot_stats_.bytes = writer_->bytes();
+        return true;
+    }
+
+    // Write commands call this for each key before touching it.
+    void before_write(std::string_view key) {
+        if (!scanning()) return;
+        if (Entry* e = map_.find(hash_key(key), [key](const Entry& ent) { return ent.key == key; })) preserve(*e);
+    }
+
+    // Drops a running snapshot; its partial file is removed.
+    void abort_snapshot() {
+        if (!writer_) return;
+        writer_.reset();
+        snapshot_stats_.in_progress = false;
+        snapshot_stats_.last_ok = false;
+    }
+
+    [[nodiscard]] bool snapshotting() const noexcept { return writer_ != nullptr; }
+    // Whether snapshot_step() would get anywhere right now, rather than wait for the disk.
+    [[nodiscard]] bool snapshot_runnable() const noexcept { return scanning() && !writer_->congested(); }
+    [[nodiscard]] const SnapshotStats& snapshot_stats() const noexcept { return snapshot_stats_; }
+
+    // Background share of the incremental rehash, run by the reactor when it has nothing else to do.
+    bool rehash_step(std::chrono::nanoseconds budget) { return map_.rehash_step(budget); }
+    [[nodiscard]] bool rehashing() const noexcept { return map_.resizing(); }
+    [[nodiscard]] ResizeProgress resize_progress() const noexcept { return map_.resize_progress(); }
+
+    [[nodiscard]] size_t size() const noexcept { return map_.size(); }
+    [[nodiscard]] Ttl& ttl() noexcept { return ttl_; }
+    [[nodiscard]] Map<Entry>& map() noexcept { return map_; }
+
+private:
+    static constexpr size_t k_lazy_free_threshold = 64;
+    static constexpr size_t k_snapshot_batch = 16; // buckets scanned between clock reads
+    static constexpr size_t k_expire_batch = 32; // keys reclaimed between clock reads
+    static constexpr std::chrono::nanoseconds k_expire_min_budget{std::chrono::microseconds(25)};
+    static constexpr std::chrono::nanoseconds k_expire_max_budget{std::chrono::milliseconds(1)};
+    static constexpr size_t k_evict_batch = 32; // keys evicted between clock reads
+    static constexpr std::chrono::nanoseconds k_evict_budget{std::chrono::microseconds(500)};
+
+    // An entry found or added inside begin_mutation(), with what it was charged at that point.
+    struct Charge {
+        Entry* entry;
+        size_t bytes;
+    };
+
+    Map<Entry> map_;
+    Ttl ttl_;
+    ExpiryStats stats_;
+    std::chrono::nanoseconds expire_budget_{k_expire_min_budget};
+    uint64_t window_start_us_{EntryManager::get_monotonic_usec()};
+    uint64_t window_expired_{0};
+    threading::ThreadPool* background_{nullptr};
+    CommandFeed* feed_{nullptr};
+    bool expiry_paused_{false};
+    uint64_t lazy_freed_{0};
+    std::shared_ptr<std::atomic<size_t>> lazy_pending_{std::make_shared<std::atomic<size_t>>(0)};
+    std::unique_ptr<SnapshotWriter> writer_;
+    uint32_t snapshot_epoch_{0};
+    ColdTier* cold_{nullptr};
+    size_t cold_min_bytes_{0};
+    size_t scan_cursor_{0};
+    bool scan_done_{false};
+    uint64_t snapshot_start_us_{0};
+    int64_t snapshot_start_unix_ms_{0};
+    SnapshotStats snapshot_stats_;
+    Evictor evictor_;
+    size_t limit_bytes_{0};
+    bool evict_refuses_{false}; // limit with NoEviction: make_room() only refuses
+    size_t used_bytes_{0};
+    bool mutating_{false};
+    std::vector<Charge> charges_;
+
+    [[nodiscard]] bool scanning() const noexcept { return writer_ && !scan_done_; }
+
+    // A live key was looked up: a hit for the eviction policy, and inside a mutation, charged again at its end.
+    void touch(Entry& entry) {
+        evictor_.on_access(entry);
+        if (!mutating_) return;
+        auto it = std::find_if(charges_.begin(), charges_.end(), [&entry](const Charge& c) { return c.entry == &entry; });
+        if (it == charges_.end()) charges_.push_back({&entry, EntryManager::memory_usage(entry)});
+    }
+
+    // Inside a mutation a new entry is charged at its end, once it holds its value.
+    void added(Entry& entry) {
+        evictor_.on_insert(entry);
+        if (mutating_) {
+            charges_.push_back({&entry, 0});
+        } else {
+            used_bytes_ += EntryManager::memory_usage(entry);
+        }
+    }
+
+    // The entry is going away: it takes back what it is charged at right now.
+    void uncharge(Entry& entry) noexcept {
+        evictor_.on_remove(entry);
+        auto it = std::find_if(charges_.begin(), charges_.end(), [&entry](const Charge& c) { return c.entry == &entry; });
+        if (it == charges_.end()) {
+            used_bytes_ -= EntryManager::memory_usage(entry);
+        } else {
+            used_bytes_ -= it->bytes;
+            *it = charges_.back();
+            charges_.pop_back();
+        }
+    }
+
+    // Writes `entry` into the running snapshot unless it already is in it. TTLs go out as wall-clock times,
+    // as of the snapshot's start; a key already expired by then is not part of the image.
+    void save(Entry& entry) { save(entry, ttl_.expire_at(entry)); }
+
+    void save(Entry& entry, std::optional<uint64_t> expire_at) {
+        if (entry.snapshot_epoch == snapshot_epoch_) return;
+        entry.snapshot_epoch = snapshot_epoch_;
+        if (expire_at && *expire_at <= snapshot_start_us_) return;
+        std::optional<int64_t> expire_ms;
+        if (expire_at) expire_ms = snapshot_start_unix_ms_ + static_cast<int64_t>((*expire_at - snapshot_start_us_ + 999) / 1000);
+        if (entry.type != EntryType::Cold) return writer_->add(entry, expire_ms);
+        // A value that can't be read back is left out, as if the key had been evicted.
+        if (auto value = cold_value(entry)) writer_->add(entry, expire_ms, *value);
+    }
+
+    void preserve(Entry& entry) { preserve(entry, ttl_.expire_at(entry)); }
+
+    void preserve(Entry& entry, std::optional<uint64_t> expire_at) {
+        if (entry.snapshot_epoch == snapshot_epoch_) return;
+        save(entry, expire_at);
+        snapshot_stats_.preserved++;
+    }
+
+    void finish_snapshot() {
+        auto res = writer_->result();
+        snapshot_stats_.in_progress = false;
+        snapshot_stats_.last_ok = res.has_value();
+        snapshot_stats_.keys = writer_->records();
+        snapshot_stats_.bytes = writer_->bytes();
+        snapshot_stats_.duration_ms = (EntryManager::get_monotonic_usec() - snapshot_start_us_) / 1000;
+        if (res) snapshot_stats_.last_save_unix_ms = snapshot_start_unix_ms_;
+        writer_.reset();
+    }
+
+    [[nodiscard]] bool expired(const Entry& entry) const {
+        if (expiry_paused_) return false;
+        auto expire_at = ttl_.expire_at(entry);
+        return expire_at && *expire_at <= EntryManager::get_monotonic_usec();
+    }
+
+    void count_expired(uint64_t& path, uint64_t n) noexcept {
+        path += n;
+        stats_.expired_keys += n;
+    }
+
+    void expire_lazily(Entry& entry) {
+        if (feed_) feed_->append_del(entry.key);
+        reclaim(entry);
+        count_expired(stats_.lazy_expired, 1);
+    }
+
+    // Unlinks `entry` from the map and frees it; it is matched by address, it's the one we hold.
+    void reclaim(Entry& entry) {
+        auto owned = map_.remove(entry.hcode(), [&entry](const Entry& e) { return &e == &entry; });
+        destroy(std::move(owned));
+    }
+
+    [[nodiscard]] bool spillable(const Entry& entry) const noexcept {
+        return cold_ && entry.type == EntryType::String && entry.value.size() >= cold_min_bytes_;
+    }
+
+    // Moves the value to the cold tier. The key leaves the eviction lists, and stays charged for the entry.
+    void spill(Entry& entry) {
+        size_t before = EntryManager::memory_usage(entry);
+        evictor_.on_remove(entry);
+        ColdRef ref = cold_->append(entry.key, entry.value);
+        entry.value = ref.encode();
+        entry.type = EntryType::Cold;
+        used_bytes_ -= before - EntryManager::memory_usage(entry);
+    }
+
+    // A few random Cold entries, the first one found being evicted: with only cold keys left there is no
+    // ordering worth keeping among them.
+    [[nodiscard]] Entry* cold_victim() {
+        Entry* found = nullptr;
+        for (size_t tries = 0; !found && tries < 4 * evictor_.samples() && map_.size() > 0; ++tries) {
+            map_.scan(static_cast<size_t>(evictor_.random()), [&found](Entry& e) {
+                if (!found && e.type == EntryType::Cold) found = &e;
+            });
+        }
+        return found;
+    }
+
+    void release_cold(const Entry& entry) noexcept {
+        if (cold_ && entry.type == EntryType::Cold) cold_->release(ColdRef::decode(entry.value));
+    }
+
+    // The entry itself is one small slab object and always goes inline; only a large value is shipped off.
+    void destroy(std::unique_ptr<Entry> entry) {
+        if (scanning()) preserve(*entry);
+        uncharge(*entry);
+        release_cold(*entry);
+        if (background_ && EntryManager::free_effort(*entry) >= k_lazy_free_threshold) {
+            ds::ZSet* zset = entry->zset.release();
+            lazy_pending_->fetch_add(1, std::memory_order_relaxed);
+            try {
+                background_->submit([zset, pending = lazy_pending_] {
+                    delete zset;
+                    pending->fetch_sub(1, std::memory_order_relaxed);
+                });
+                lazy_freed_++;
+            } catch (const std::runtime_error&) {
+                lazy_pending_->fetch_sub(1, std::memory_order_relaxed); // pool shutting down
+                delete zset;
+            }
+        }
+        EntryManager::destroy_entry(std::move(entry), ttl_);
+    }
+};
+
+using Keyspace = BasicKeyspace<HMap>;
+using FlatKeyspace = BasicKeyspace<FlatHMap>;
+
+#endif
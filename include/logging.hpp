@@ -1,14 +1,129 @@
 #ifndef LOGGING_HPP
 #define LOGGING_HPP
 
-#include <iostream>
-#include <source_location>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
 #include <format>
+#include <memory>
+#include <source_location>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <unistd.h>
+
+// Log lines go through a bounded multi-producer ring to one writer thread, so a reactor that logs never
+// waits on stderr: a slow terminal or a full pipe stalls only the writer. A line that finds the ring full
+// is dropped and counted, and the writer reports the gap after the lines it writes next. What is still
+// queued at exit is written out before the writer stops.
+class AsyncLogger {
+public:
+    static constexpr size_t k_capacity = 4096; // lines in flight
+
+    static AsyncLogger& instance() {
+        static AsyncLogger logger;
+        return logger;
+    }
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    ~AsyncLogger() {
+        stopping_.store(true, std::memory_order_release);
+        pending_.fetch_add(1, std::memory_order_release);
+        pending_.notify_one();
+        writer_.join();
+    }
+
+    // Never blocks: a CAS on the ring's tail and a move, then a wakeup only if the writer is asleep.
+    void write(std::string line) {
+        uint64_t pos = tail_.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots_[pos & k_mask];
+            uint64_t seq = slot->seq.load(std::memory_order_acquire);
+            auto diff = static_cast<int64_t>(seq - pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        slot->line = std::move(line);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        pending_.fetch_add(1, std::memory_order_release);
+        pending_.notify_one();
+    }
+
+    [[nodiscard]] uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint64_t k_mask = k_capacity - 1;
+    static_assert((k_capacity & k_mask) == 0, "capacity must be a power of two");
+
+    // Vyukov's bounded queue: seq == pos means free for the producer claiming pos, pos + 1 means filled.
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        std::string line;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<uint64_t> tail_{0};
+    alignas(64) std::atomic<uint64_t> pending_{0}; // bumped after every line: what the writer waits on
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> stopping_{false};
+    uint64_t head_{0}; // writer thread only
+    std::thread writer_;
+
+    AsyncLogger() : slots_(std::make_unique<Slot[]>(k_capacity)) {
+        for (uint64_t i = 0; i < k_capacity; ++i) slots_[i].seq.store(i, std::memory_order_relaxed);
+        writer_ = std::thread([this] { run(); });
+    }
+
+    void run() {
+        std::string batch;
+        uint64_t reported = 0;
+        while (true) {
+            uint64_t seen = pending_.load(std::memory_order_acquire);
+            batch.clear();
+            while (true) {
+                Slot& slot = slots_[head_ & k_mask];
+                if (slot.seq.load(std::memory_order_acquire) != head_ + 1) break;
+                batch += slot.line;
+                slot.line.clear();
+                slot.seq.store(head_ + k_capacity, std::memory_order_release);
+                head_++;
+            }
+            uint64_t lost = dropped();
+            if (lost != reported) {
+                batch += "[logging] - " + std::to_string(lost - reported) + " lines dropped, the log ring was full\n";
+                reported = lost;
+            }
+            write_all(batch);
+            if (stopping_.load(std::memory_order_acquire) &&
+                slots_[head_ & k_mask].seq.load(std::memory_order_acquire) != head_ + 1) {
+                return;
+            }
+            pending_.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    static void write_all(std::string_view data) noexcept {
+        while (!data.empty()) {
+            ssize_t n = ::write(STDERR_FILENO, data.data(), data.size());
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return; // nowhere to complain to
+            data.remove_prefix(static_cast<size_t>(n));
+        }
+    }
+};
 
 inline void log_message(std::string_view format,
                         const std::source_location& location = std::source_location::current()) {
-    std::cerr << std::format("[{}:{}] - {}\n", location.file_name(), location.line(), format);
+    AsyncLogger::instance().write(std::format("[{}:{}] - {}\n", location.file_name(), location.line(), format));
 }
 
 #endif
@@ -0,0 +1,202 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include "command_table.hpp"
+
+// Counters and histograms that one thread writes and any thread may read. Each reactor records into its
+// own ReactorMetrics, so the hot path is plain loads and stores - relaxed atomics only so that INFO on another
+// reactor, or the Prometheus endpoint's thread, can read them without a data race. No RMW, no lock, and
+// every reactor's slots sit on their own cache lines.
+class RelaxedCounter {
+public:
+    void add(uint64_t n = 1) noexcept { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void set(uint64_t value) noexcept { value_.store(value, std::memory_order_relaxed); }
+    void raise_to(uint64_t value) noexcept {
+        if (value > value_.load(std::memory_order_relaxed)) value_.store(value, std::memory_order_relaxed);
+    }
+    [[nodiscard]] uint64_t load() const noexcept { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+// HDR-style log-linear histogram of nanosecond latencies. Values below k_sub_count get a bucket each; above
+// that every power of two is split into k_sub_count / 2 linear buckets, so any recorded value is known to
+// within 1/32 (~3%) of itself, from 1ns up to 2^k_max_bits ns (~18 minutes) - in 9KB.
+class LatencyHistogram {
+public:
+    static constexpr unsigned k_sub_bits = 6;
+    static constexpr uint64_t k_sub_count = uint64_t{1} << k_sub_bits;
+    static constexpr uint64_t k_half = k_sub_count / 2;
+    static constexpr unsigned k_max_bits = 40;
+    static constexpr uint64_t k_max_value = (uint64_t{1} << k_max_bits) - 1;
+    static constexpr size_t k_buckets = (k_max_bits - k_sub_bits) * k_half + k_sub_count;
+
+    void record(uint64_t ns, uint64_t times = 1) noexcept {
+        counts_[index(std::min(ns, k_max_value))].add(times);
+        max_.raise_to(ns);
+    }
+
+    // Owning thread only.
+    void reset() noexcept {
+        for (auto& count : counts_) count.set(0);
+        max_.set(0);
+    }
+
+    [[nodiscard]] uint64_t count_at(size_t bucket) const noexcept { return counts_[bucket].load(); }
+    [[nodiscard]] uint64_t max() const noexcept { return max_.load(); }
+
+    [[nodiscard]] static constexpr size_t index(uint64_t value) noexcept {
+        if (value < k_sub_count) return static_cast<size_t>(value);
+        auto shift = static_cast<unsigned>(std::bit_width(value)) - k_sub_bits;
+        return static_cast<size_t>(shift * k_half + (value >> shift));
+    }
+    // The largest value that lands in `bucket`: what a percentile in it is reported as.
+    [[nodiscard]] static constexpr uint64_t highest_in(size_t bucket) noexcept {
+        if (bucket < k_sub_count) return bucket;
+        uint64_t shift = bucket / k_half - 1;
+        uint64_t sub = bucket - shift * k_half;
+        return ((sub + 1) << shift) - 1;
+    }
+
+private:
+    std::array<RelaxedCounter, k_buckets> counts_{};
+    RelaxedCounter max_;
+};
+
+static_assert(LatencyHistogram::index(LatencyHistogram::k_max_value) == LatencyHistogram::k_buckets - 1);
+static_assert(LatencyHistogram::highest_in(LatencyHistogram::index(1000)) >= 1000);
+
+// Several histograms (one per reactor) added up at read time, for percentiles over the whole server.
+class LatencySummary {
+public:
+    void add(const LatencyHistogram& histogram) noexcept {
+        for (size_t i = 0; i < LatencyHistogram::k_buckets; ++i) {
+            uint64_t n = histogram.count_at(i);
+            counts_[i] += n;
+            total_ += n;
+        }
+        max_ = std::max(max_, histogram.max());
+    }
+
+    [[nodiscard]] uint64_t count() const noexcept { return total_; }
+    [[nodiscard]] uint64_t max() const noexcept { return max_; }
+
+    // Smallest recorded value that `q` (0..1) of the samples are at or below, 0 without samples.
+    [[nodiscard]] uint64_t percentile(double q) const noexcept {
+        if (total_ == 0) return 0;
+        auto rank = static_cast<uint64_t>(q * static_cast<double>(total_) + 0.5);
+        rank = std::clamp<uint64_t>(rank, 1, total_);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < LatencyHistogram::k_buckets; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) return std::min(LatencyHistogram::highest_in(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    std::array<uint64_t, LatencyHistogram::k_buckets> counts_{};
+    uint64_t total_{0};
+    uint64_t max_{0};
+};
+
+struct alignas(64) CommandMetrics {
+    RelaxedCounter calls;
+    RelaxedCounter errors;   // ... whose reply was an error
+    RelaxedCounter total_ns; // time spent running them
+    LatencyHistogram latency;
+};
+
+// What a shard holds and how its structures are doing: copied out by the owning reactor as its loop turns,
+// at most every k_publish_interval, and before each INFO it answers itself.
+struct alignas(64) ShardGauges {
+    RelaxedCounter keys;
+    RelaxedCounter expires;          // keys with a TTL: the expiry index's depth
+    RelaxedCounter expired_keys;
+    RelaxedCounter evicted_keys;
+    RelaxedCounter used_bytes;       // as maxmemory counts it
+    RelaxedCounter limit_bytes;      // this shard's share of maxmemory, 0 if none
+    RelaxedCounter rehashing;        // 1 while the table is being resized incrementally
+    RelaxedCounter rehash_remaining; // ... and the entries still in the old table
+    RelaxedCounter slab_bytes;       // mapped by the shard's slab pool
+    RelaxedCounter slab_live_objects;
+    RelaxedCounter slab_requested_bytes;
+    RelaxedCounter lazy_free_pending; // values handed to the background pool, not freed yet
+    RelaxedCounter cold_segments;
+    RelaxedCounter cold_bytes;
+    RelaxedCounter connections;
+    RelaxedCounter buffer_idle_bytes; // held by the reactor's I/O buffer pool
+};
+
+// The longest recent event loop iterations, kept per reactor. An iteration that runs past k_stall_threshold
+// - a big DEL done inline, a blocking disk call, a pathological command - is a stall: it held up every other
+// client of the reactor for that long.
+struct alignas(64) LoopMetrics {
+    static constexpr std::chrono::milliseconds k_stall_threshold{10};
+
+    RelaxedCounter iterations;
+    RelaxedCounter stalls;
+    RelaxedCounter last_stall_ns;
+    RelaxedCounter last_stall_unix_ms;
+    RelaxedCounter max_stall_ns;
+    LatencyHistogram busy; // per iteration, from the wakeup to the next wait
+};
+
+// One reactor's instrumentation. Written by that reactor only; read from anywhere.
+class ReactorMetrics {
+public:
+    static constexpr std::chrono::milliseconds k_publish_interval{100};
+
+    void record(CommandId id, uint64_t ns, bool error) noexcept {
+        CommandMetrics& m = commands_[static_cast<size_t>(id)];
+        m.calls.add();
+        if (error) m.errors.add();
+        m.total_ns.add(ns);
+        m.latency.record(ns);
+    }
+    // Unknown commands and wrong argument counts: never ran, so no command to charge them to.
+    void reject() noexcept { rejected_.add(); }
+
+    void loop_iteration(uint64_t busy_ns) noexcept {
+        loop_.iterations.add();
+        loop_.busy.record(busy_ns);
+        if (busy_ns < static_cast<uint64_t>(std::chrono::nanoseconds(LoopMetrics::k_stall_threshold).count())) return;
+        loop_.stalls.add();
+        loop_.last_stall_ns.set(busy_ns);
+        loop_.last_stall_unix_ms.set(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count()));
+        loop_.max_stall_ns.raise_to(busy_ns);
+    }
+
+    // LATENCY RESET: the histograms and stall records start over; call counts are kept. Owning thread only.
+    void reset_latency() noexcept {
+        for (auto& m : commands_) m.latency.reset();
+        loop_.busy.reset();
+        loop_.stalls.set(0);
+        loop_.last_stall_ns.set(0);
+        loop_.last_stall_unix_ms.set(0);
+        loop_.max_stall_ns.set(0);
+    }
+
+    [[nodiscard]] const CommandMetrics& command(CommandId id) const noexcept { return commands_[static_cast<size_t>(id)]; }
+    [[nodiscard]] uint64_t rejected() const noexcept { return rejected_.load(); }
+    [[nodiscard]] const LoopMetrics& loop() const noexcept { return loop_; }
+    [[nodiscard]] ShardGauges& gauges() noexcept { return gauges_; }
+    [[nodiscard]] const ShardGauges& gauges() const noexcept { return gauges_; }
+
+private:
+    std::array<CommandMetrics, static_cast<size_t>(CommandId::Count)> commands_{};
+    alignas(64) RelaxedCounter rejected_;
+    LoopMetrics loop_;
+    ShardGauges gauges_;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef METRICS_ENDPOINT_HPP
+#define METRICS_ENDPOINT_HPP
+
+#include <cerrno>
+#include <format>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include "event_loop.hpp"
+#include "logging.hpp"
+#include "socket.hpp"
+
+// Serves GET /metrics in the Prometheus text format on a port of its own, from a thread of its own: a
+// scrape never runs on a reactor, it only reads their relaxed counters (see MetricsReport::prometheus). One
+// request per connection, answered and closed - all a scraper needs, so no keep-alive and no reactor
+// machinery. Slow or silent clients get k_io_timeout_ms, then the next one is served.
+class MetricsEndpoint {
+public:
+    using Render = std::function<std::string()>;
+
+    static constexpr int k_io_timeout_ms = 1000;
+    static constexpr int k_stop_check_ms = 200; // how long stop() may wait for the accept loop to notice
+    static constexpr size_t k_max_request = 8 * 1024;
+
+    MetricsEndpoint(uint16_t port, Render render) : port_(port), render_(std::move(render)) {}
+
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+    ~MetricsEndpoint() { stop(); }
+
+    Result<void> start() {
+        listen_socket_ = Socket(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        if (listen_socket_.get() < 0) return std::unexpected(last_error());
+        int val = 1;
+        setsockopt(listen_socket_.get(), SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port_);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(listen_socket_.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            listen(listen_socket_.get(), 16) < 0) {
+            return std::unexpected(last_error());
+        }
+        thread_ = std::jthread([this](std::stop_token stop) { run(stop); });
+        return {};
+    }
+
+    void stop() {
+        if (!thread_.joinable()) return;
+        thread_.request_stop();
+        thread_.join();
+    }
+
+private:
+    uint16_t port_;
+    Render render_;
+    Socket listen_socket_{-1};
+    std::jthread thread_;
+
+    void run(std::stop_token stop) {
+        while (!stop.stop_requested()) {
+            pollfd pfd{listen_socket_.get(), POLLIN, 0};
+            int ready = ::poll(&pfd, 1, k_stop_check_ms);
+            if (ready <= 0) continue;
+            Socket client(::accept4(listen_socket_.get(), nullptr, nullptr, SOCK_CLOEXEC));
+            if (client.get() < 0) continue;
+            timeval tv{k_io_timeout_ms / 1000, (k_io_timeout_ms % 1000) * 1000};
+            setsockopt(client.get(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            setsockopt(client.get(), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+            serve(client);
+        }
+    }
+
+    void serve(const Socket& client) {
+        std::string request;
+        char buf[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < k_max_request) {
+            ssize_t n = ::recv(client.get(), buf, sizeof(buf), 0);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) continue;
+                return;
+            }
+            request.append(buf, static_cast<size_t>(n));
+        }
+        std::string_view line(request);
+        line = line.substr(0, line.find("\r\n"));
+        if (line.starts_with("GET /metrics ") || line.starts_with("GET /metrics?")) {
+            respond(client, "200 OK", "text/plain; version=0.0.4; charset=utf-8", render_());
+        } else if (line.starts_with("GET ")) {
+            respond(client, "404 Not Found", "text/plain", "metrics are at /metrics\n");
+        } else {
+            respond(client, "405 Method Not Allowed", "text/plain", "only GET /metrics\n");
+        }
+    }
+
+    static void respond(const Socket& client, std::string_view status, std::string_view type, const std::string& body) {
+        std::string out = "HTTP/1.1 ";
+        out.append(status).append("\r\nContent-Type: ").append(type);
+        out.append("\r\nContent-Length: ").append(std::to_string(body.size()));
+        out.append("\r\nConnection: close\r\n\r\n").append(body);
+        std::string_view rest(out);
+        while (!rest.empty()) {
+            ssize_t n = ::send(client.get(), rest.data(), rest.size(), MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                log_message(std::format("metrics: reply to a scrape failed: {}", last_error().message()));
+                return;
+            }
+            rest.remove_prefix(static_cast<size_t>(n));
+        }
+    }
+};
+
+#endif
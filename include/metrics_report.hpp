@@ -0,0 +1,314 @@
+#ifndef METRICS_REPORT_HPP
+#define METRICS_REPORT_HPP
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include "command_table.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+
+// The server-wide facts a report starts with; the rest comes from the reactors' ReactorMetrics.
+struct ServerInfo {
+    uint16_t port{0};
+    std::string_view role{"primary"};
+    std::chrono::steady_clock::time_point started{};
+};
+
+// Renders every reactor's metrics for the two ways out: INFO's "field:value" sections and the Prometheus
+// text exposition format. Reads only the relaxed counters, so it runs on any thread.
+class MetricsReport {
+public:
+    using Reactors = std::span<const ReactorMetrics* const>;
+
+    // `section` as INFO takes it: server, clients, memory, stats, keyspace, commandstats, latencystats,
+    // or empty / "all" / "everything" for all of them. Unknown sections come back empty, as in Redis.
+    [[nodiscard]] static std::string info(std::string_view section, const ServerInfo& server, Reactors reactors) {
+        std::string out;
+        auto wants = [section](std::string_view name) {
+            return section.empty() || equals_folded(section, "all") || equals_folded(section, "everything") ||
+                   equals_folded(section, name);
+        };
+        if (wants("server")) server_section(out, server, reactors);
+        if (wants("clients")) clients_section(out, reactors);
+        if (wants("memory")) memory_section(out, reactors);
+        if (wants("stats")) stats_section(out, reactors);
+        if (wants("keyspace")) keyspace_section(out, reactors);
+        if (wants("commandstats")) commandstats_section(out, reactors);
+        if (wants("latencystats")) latencystats_section(out, reactors);
+        return out;
+    }
+
+    [[nodiscard]] static std::string prometheus(const ServerInfo& server, Reactors reactors) {
+        std::string out;
+        header(out, "kv_uptime_seconds", "gauge", "Seconds since the server started.");
+        sample(out, "kv_uptime_seconds", "", uptime_seconds(server));
+
+        header(out, "kv_commands_total", "counter", "Commands executed, by command.");
+        for_each_used(reactors, [&](const CommandSpec& spec, uint64_t calls, uint64_t, uint64_t) {
+            sample(out, "kv_commands_total", label("cmd", spec.name), calls);
+        });
+        header(out, "kv_command_errors_total", "counter", "Commands whose reply was an error, by command.");
+        for_each_used(reactors, [&](const CommandSpec& spec, uint64_t, uint64_t errors, uint64_t) {
+            sample(out, "kv_command_errors_total", label("cmd", spec.name), errors);
+        });
+        header(out, "kv_commands_rejected_total", "counter", "Unknown commands and wrong argument counts.");
+        sample(out, "kv_commands_rejected_total", "", sum(reactors, [](const ReactorMetrics& m) { return m.rejected(); }));
+
+        header(out, "kv_command_duration_seconds", "summary", "Time to run a command, by command.");
+        for_each_used(reactors, [&](const CommandSpec& spec, uint64_t calls, uint64_t, uint64_t total_ns) {
+            LatencySummary summary = summarize(spec.id, reactors);
+            std::string cmd = label("cmd", spec.name);
+            for (double q : k_quantiles) {
+                std::string labels = cmd;
+                labels.append(",quantile=\"").append(fixed(q, 3)).append("\"");
+                sample(out, "kv_command_duration_seconds", labels, seconds(summary.percentile(q)));
+            }
+            sample(out, "kv_command_duration_seconds_sum", cmd, seconds(total_ns));
+            sample(out, "kv_command_duration_seconds_count", cmd, calls);
+        });
+
+        header(out, "kv_event_loop_stalls_total", "counter", "Event loop iterations longer than the stall threshold.");
+        per_reactor(out, "kv_event_loop_stalls_total", reactors, [](const ReactorMetrics& m) { return m.loop().stalls.load(); });
+        header(out, "kv_event_loop_max_stall_seconds", "gauge", "Longest event loop iteration since the last LATENCY RESET.");
+        for (size_t i = 0; i < reactors.size(); ++i) {
+            sample(out, "kv_event_loop_max_stall_seconds", label("reactor", i), seconds(reactors[i]->loop().max_stall_ns.load()));
+        }
+
+        gauge(out, "kv_keys", "Keys, by shard.", reactors, [](const ShardGauges& g) { return g.keys.load(); });
+        gauge(out, "kv_expires", "Keys with a TTL (the expiry index's depth), by shard.", reactors,
+              [](const ShardGauges& g) { return g.expires.load(); });
+        gauge(out, "kv_used_memory_bytes", "Memory the keys use, as maxmemory counts it, by shard.", reactors,
+              [](const ShardGauges& g) { return g.used_bytes.load(); });
+        gauge(out, "kv_maxmemory_bytes", "The shard's share of maxmemory, 0 if unlimited.", reactors,
+              [](const ShardGauges& g) { return g.limit_bytes.load(); });
+        gauge(out, "kv_rehashing", "1 while the shard's table is being resized.", reactors,
+              [](const ShardGauges& g) { return g.rehashing.load(); });
+        gauge(out, "kv_rehash_remaining", "Entries still in the old table of a resize.", reactors,
+              [](const ShardGauges& g) { return g.rehash_remaining.load(); });
+        gauge(out, "kv_slab_bytes", "Memory mapped by the shard's slab allocator.", reactors,
+              [](const ShardGauges& g) { return g.slab_bytes.load(); });
+        gauge(out, "kv_slab_live_objects", "Objects allocated from the shard's slabs.", reactors,
+              [](const ShardGauges& g) { return g.slab_live_objects.load(); });
+        gauge(out, "kv_connected_clients", "Client connections of each shard's reactor.", reactors,
+              [](const ShardGauges& g) { return g.connections.load(); });
+        counter(out, "kv_expired_keys_total", "Keys expired, by shard.", reactors,
+                [](const ShardGauges& g) { return g.expired_keys.load(); });
+        counter(out, "kv_evicted_keys_total", "Keys evicted for maxmemory, by shard.", reactors,
+                [](const ShardGauges& g) { return g.evicted_keys.load(); });
+
+        header(out, "kv_log_dropped_lines_total", "counter", "Log lines lost to a full log ring.");
+        sample(out, "kv_log_dropped_lines_total", "", AsyncLogger::instance().dropped());
+        return out;
+    }
+
+    // One command's latency over every reactor.
+    [[nodiscard]] static LatencySummary summarize(CommandId id, Reactors reactors) {
+        LatencySummary summary;
+        for (const ReactorMetrics* m : reactors) summary.add(m->command(id).latency);
+        return summary;
+    }
+
+    [[nodiscard]] static LatencySummary summarize_loop(Reactors reactors) {
+        LatencySummary summary;
+        for (const ReactorMetrics* m : reactors) summary.add(m->loop().busy);
+        return summary;
+    }
+
+    // A duration as INFO shows it: microseconds with three decimals.
+    [[nodiscard]] static std::string micros(uint64_t ns) { return fixed(static_cast<double>(ns) / 1e3, 3); }
+
+private:
+    static constexpr double k_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+    [[nodiscard]] static bool equals_folded(std::string_view raw, std::string_view lower) noexcept {
+        return command_table_detail::equals_folded(raw, lower);
+    }
+
+    [[nodiscard]] static std::string fixed(double value, int precision) {
+        char buf[64];
+        auto res = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::fixed, precision);
+        return std::string(buf, res.ptr);
+    }
+    [[nodiscard]] static std::string seconds(uint64_t ns) { return fixed(static_cast<double>(ns) / 1e9, 9); }
+
+    [[nodiscard]] static uint64_t uptime_seconds(const ServerInfo& server) {
+        auto up = std::chrono::steady_clock::now() - server.started;
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(up).count());
+    }
+
+    template<typename Fn>
+    [[nodiscard]] static uint64_t sum(Reactors reactors, Fn&& fn) {
+        uint64_t total = 0;
+        for (const ReactorMetrics* m : reactors) total += fn(*m);
+        return total;
+    }
+    template<typename Fn>
+    [[nodiscard]] static uint64_t sum_gauge(Reactors reactors, Fn&& fn) {
+        return sum(reactors, [&fn](const ReactorMetrics& m) { return fn(m.gauges()); });
+    }
+
+    // Commands that have run at least once anywhere, with their calls, errors and total time over all reactors.
+    template<typename Fn>
+    static void for_each_used(Reactors reactors, Fn&& fn) {
+        for (const CommandSpec& spec : k_command_specs) {
+            uint64_t calls = 0, errors = 0, total_ns = 0;
+            for (const ReactorMetrics* m : reactors) {
+                const CommandMetrics& c = m->command(spec.id);
+                calls += c.calls.load();
+                errors += c.errors.load();
+                total_ns += c.total_ns.load();
+            }
+            if (calls > 0) fn(spec, calls, errors, total_ns);
+        }
+    }
+
+    template<typename T>
+    static void field(std::string& out, std::string_view name, const T& value) {
+        out.append(name).append(":");
+        if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            out.append(std::string_view(value));
+        } else {
+            out.append(std::to_string(value));
+        }
+        out.append("\r\n");
+    }
+    static void title(std::string& out, std::string_view name) {
+        if (!out.empty()) out.append("\r\n");
+        out.append("# ").append(name).append("\r\n");
+    }
+
+    static void server_section(std::string& out, const ServerInfo& server, Reactors reactors) {
+        title(out, "Server");
+        field(out, "tcp_port", server.port);
+        field(out, "role", server.role);
+        field(out, "reactors", reactors.size());
+        field(out, "uptime_in_seconds", uptime_seconds(server));
+    }
+
+    static void clients_section(std::string& out, Reactors reactors) {
+        title(out, "Clients");
+        field(out, "connected_clients", sum_gauge(reactors, [](const ShardGauges& g) { return g.connections.load(); }));
+    }
+
+    static void memory_section(std::string& out, Reactors reactors) {
+        title(out, "Memory");
+        field(out, "used_memory", sum_gauge(reactors, [](const ShardGauges& g) { return g.used_bytes.load(); }));
+        field(out, "maxmemory", sum_gauge(reactors, [](const ShardGauges& g) { return g.limit_bytes.load(); }));
+        uint64_t slab_bytes = sum_gauge(reactors, [](const ShardGauges& g) { return g.slab_bytes.load(); });
+        uint64_t requested = sum_gauge(reactors, [](const ShardGauges& g) { return g.slab_requested_bytes.load(); });
+        field(out, "slab_bytes", slab_bytes);
+        field(out, "slab_live_objects", sum_gauge(reactors, [](const ShardGauges& g) { return g.slab_live_objects.load(); }));
+        field(out, "slab_fragmentation_ratio",
+              fixed(slab_bytes ? 1.0 - static_cast<double>(requested) / static_cast<double>(slab_bytes) : 0.0, 3));
+        field(out, "io_buffer_idle_bytes", sum_gauge(reactors, [](const ShardGauges& g) { return g.buffer_idle_bytes.load(); }));
+        field(out, "lazyfree_pending_objects", sum_gauge(reactors, [](const ShardGauges& g) { return g.lazy_free_pending.load(); }));
+        field(out, "cold_tier_segments", sum_gauge(reactors, [](const ShardGauges& g) { return g.cold_segments.load(); }));
+        field(out, "cold_tier_bytes", sum_gauge(reactors, [](const ShardGauges& g) { return g.cold_bytes.load(); }));
+    }
+
+    static void stats_section(std::string& out, Reactors reactors) {
+        title(out, "Stats");
+        uint64_t processed = 0, failed = 0;
+        for_each_used(reactors, [&](const CommandSpec&, uint64_t calls, uint64_t errors, uint64_t) {
+            processed += calls;
+            failed += errors;
+        });
+        field(out, "total_commands_processed", processed);
+        field(out, "total_error_replies", failed);
+        field(out, "rejected_calls", sum(reactors, [](const ReactorMetrics& m) { return m.rejected(); }));
+        field(out, "expired_keys", sum_gauge(reactors, [](const ShardGauges& g) { return g.expired_keys.load(); }));
+        field(out, "evicted_keys", sum_gauge(reactors, [](const ShardGauges& g) { return g.evicted_keys.load(); }));
+        LatencySummary loop = summarize_loop(reactors);
+        field(out, "event_loop_iterations", sum(reactors, [](const ReactorMetrics& m) { return m.loop().iterations.load(); }));
+        field(out, "event_loop_busy_p99_usec", micros(loop.percentile(0.99)));
+        field(out, "event_loop_busy_max_usec", micros(loop.max()));
+        field(out, "event_loop_stalls", sum(reactors, [](const ReactorMetrics& m) { return m.loop().stalls.load(); }));
+        field(out, "log_dropped_lines", AsyncLogger::instance().dropped());
+    }
+
+    static void keyspace_section(std::string& out, Reactors reactors) {
+        title(out, "Keyspace");
+        for (size_t i = 0; i < reactors.size(); ++i) {
+            const ShardGauges& g = reactors[i]->gauges();
+            std::string value = "keys=" + std::to_string(g.keys.load());
+            value.append(",expires=").append(std::to_string(g.expires.load()));
+            value.append(",rehashing=").append(std::to_string(g.rehashing.load()));
+            value.append(",rehash_remaining=").append(std::to_string(g.rehash_remaining.load()));
+            field(out, "shard" + std::to_string(i), value);
+        }
+    }
+
+    static void commandstats_section(std::string& out, Reactors reactors) {
+        title(out, "Commandstats");
+        for_each_used(reactors, [&](const CommandSpec& spec, uint64_t calls, uint64_t errors, uint64_t total_ns) {
+            std::string value = "calls=" + std::to_string(calls);
+            value.append(",usec=").append(std::to_string(total_ns / 1000));
+            value.append(",usec_per_call=").append(micros(total_ns / calls));
+            value.append(",failed_calls=").append(std::to_string(errors));
+            field(out, "cmdstat_" + std::string(spec.name), value);
+        });
+    }
+
+    static void latencystats_section(std::string& out, Reactors reactors) {
+        title(out, "Latencystats");
+        for_each_used(reactors, [&](const CommandSpec& spec, uint64_t, uint64_t, uint64_t) {
+            LatencySummary summary = summarize(spec.id, reactors);
+            if (summary.count() == 0) return; // nothing since LATENCY RESET
+            std::string value = "p50=" + micros(summary.percentile(0.5));
+            value.append(",p99=").append(micros(summary.percentile(0.99)));
+            value.append(",p99.9=").append(micros(summary.percentile(0.999)));
+            field(out, "latency_percentiles_usec_" + std::string(spec.name), value);
+        });
+    }
+
+    static void header(std::string& out, std::string_view name, std::string_view type, std::string_view help) {
+        out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+        out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+    }
+    [[nodiscard]] static std::string label(std::string_view name, std::string_view value) {
+        std::string out(name);
+        out.append("=\"").append(value).append("\"");
+        return out;
+    }
+    [[nodiscard]] static std::string label(std::string_view name, size_t value) { return label(name, std::to_string(value)); }
+
+    template<typename T>
+    static void sample(std::string& out, std::string_view name, std::string_view labels, const T& value) {
+        out.append(name);
+        if (!labels.empty()) out.append("{").append(labels).append("}");
+        out.append(" ");
+        if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            out.append(std::string_view(value));
+        } else {
+            out.append(std::to_string(value));
+        }
+        out.append("\n");
+    }
+
+    template<typename Fn>
+    static void per_reactor(std::string& out, std::string_view name, Reactors reactors, Fn&& fn) {
+        for (size_t i = 0; i < reactors.size(); ++i) sample(out, name, label("reactor", i), fn(*reactors[i]));
+    }
+    template<typename Fn>
+    static void by_shard(std::string& out, std::string_view name, std::string_view type, std::string_view help,
+                         Reactors reactors, Fn&& fn) {
+        header(out, name, type, help);
+        for (size_t i = 0; i < reactors.size(); ++i) sample(out, name, label("shard", i), fn(reactors[i]->gauges()));
+    }
+    template<typename Fn>
+    static void gauge(std::string& out, std::string_view name, std::string_view help, Reactors reactors, Fn&& fn) {
+        by_shard(out, name, "gauge", help, reactors, std::forward<Fn>(fn));
+    }
+    template<typename Fn>
+    static void counter(std::string& out, std::string_view name, std::string_view help, Reactors reactors, Fn&& fn) {
+        by_shard(out, name, "counter", help, reactors, std::forward<Fn>(fn));
+    }
+};
+
+#endif
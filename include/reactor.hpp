@@ -0,0 +1,1796 @@
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include "socket.hpp"
+#include "connection.hpp"
+#include "command_processor.hpp"
+#include "event_loop.hpp"
+#include "append_log.hpp"
+#include "cluster.hpp"
+#include "cold_tier.hpp"
+#include "command_feed.hpp"
+#include "replication.hpp"
+#include "shard.hpp"
+#include "snapshot.hpp"
+#include "logging.hpp"
+#include "metrics.hpp"
+#include "metrics_report.hpp"
+#include "topology.hpp"
+#include "../spsc_queue.hpp"
+#include "../thread_pool.hpp"
+
+// A command hopping between reactors. The request travels origin -> owner carrying the arguments,
+// the owner fills `reply` in place and sends the same message back, so nothing is copied twice.
+// A Handoff gives the owner a replica's socket (conn_fd) together with its PSYNC arguments.
+struct ShardMessage {
+    enum class Kind : uint8_t { Request, Reply, Handoff };
+
+    Kind kind;
+    uint32_t origin;
+    uint64_t conn_id;
+    int conn_fd;
+    std::vector<std::string> args;
+    std::vector<uint8_t> reply;
+};
+
+// One event loop pinned to one thread: its own SO_REUSEPORT listener, its own connection table and
+// its own keyspace shard. Nothing here is shared with other reactors except the SPSC inboxes, one
+// per peer, which only that peer pushes into and only we pop from.
+class Reactor final : public CommandDispatcher {
+public:
+    // Where this reactor runs, from the server's AffinityConfig. cpu -1 leaves the thread unpinned.
+    struct Placement {
+        int cpu{-1};
+        int numa_node{-1};          // prefer this node for the shard's slabs; -1 = first touch
+        bool steer_incoming_cpu{false};
+    };
+
+    // `background`, if given, takes over freeing large values so DEL and expiry never stall the loop.
+    Reactor(uint32_t id, uint32_t count, uint16_t port, EventBackendKind backend,
+            threading::ThreadPool* background = nullptr)
+        : id_(id), port_(port), backend_kind_(backend), background_(background), shard_(id, count),
+          next_conn_id_(static_cast<uint64_t>(id) << 48) {
+        shard_.keyspace().set_background(background);
+    }
+
+    ~Reactor() override { if (wake_fd_ != -1) close(wake_fd_); }
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    // Before initialize(): the listener's SO_INCOMING_CPU is set there.
+    void set_placement(const Placement& placement) noexcept {
+        placement_ = placement;
+        shard_.pool().set_preferred_node(placement.numa_node);
+    }
+
+    // Where this shard's snapshot file lives; it is loaded from there when run() starts, if present.
+    void set_data_dir(std::string dir) { data_dir_ = std::move(dir); }
+
+    // Before run(). With the log enabled, startup loads the log chain in data_dir instead of the snapshot.
+    void set_append_only(const AofConfig& config) { aof_config_ = config; }
+
+    // Before run(). `replid` names this server's run for replicas' partial resyncs. With a primary set this
+    // shard follows the same shard there instead of loading anything locally, and refuses client writes.
+    void set_replication(const ReplicationConfig& config, std::string replid) {
+        repl_config_ = config;
+        replid_ = std::move(replid);
+    }
+
+    // Before run(): this shard's share of maxmemory, and what to evict past it (see eviction.hpp).
+    void set_eviction(const EvictionConfig& config) {
+        shard_.keyspace().set_eviction(config.policy, config.maxmemory / shard_.count(), config.samples);
+    }
+
+    // Before run(): spill evicted values to disk instead of dropping them (see cold_tier.hpp). Needs the
+    // background pool for the reads and writes; ignored on a replica, which does not evict.
+    void set_cold_tier(const ColdTierConfig& config) { cold_config_ = config; }
+
+    // Before initialize(): request size and output buffer limits for this reactor's clients.
+    void set_client_limits(const ClientLimits& limits) noexcept { client_limits_ = limits; }
+
+    // Before run(): turns cluster mode on, `self` being how this node appears in the slot map. The map
+    // starts empty - CLUSTER ADDSLOTSRANGE gives it slots.
+    void set_cluster(ClusterNode self) { cluster_ = std::make_unique<SlotMap>(std::move(self)); }
+
+    // Must be called for every reactor before any of them starts running.
+    void connect_peers(std::span<Reactor* const> peers) {
+        peers_.assign(peers.begin(), peers.end());
+        inboxes_.clear();
+        for (size_t i = 0; i < peers_.size(); ++i) {
+            inboxes_.push_back(std::make_unique<ds::SpscQueue<ShardMessage>>(k_inbox_capacity));
+        }
+        outboxes_.resize(peers_.size());
+    }
+
+    Result<void> initialize() {
+        listen_socket_ = Socket(socket(AF_INET, SOCK_STREAM, 0));
+        if (listen_socket_.get() < 0) {
+            return std::unexpected(std::make_error_code(std::errc::bad_file_descriptor));
+        }
+
+        // SO_REUSEPORT lets every reactor bind the same port; the kernel spreads incoming
+        // connections across the listeners so no accept lock or hand-off queue is needed.
+        int val = 1;
+        setsockopt(listen_socket_.get(), SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+        setsockopt(listen_socket_.get(), SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val));
+        // Among the reuseport listeners, prefer ours for connections whose packets arrive on our CPU.
+        if (placement_.steer_incoming_cpu && placement_.cpu >= 0) {
+            setsockopt(listen_socket_.get(), SOL_SOCKET, SO_INCOMING_CPU, &placement_.cpu, sizeof(placement_.cpu));
+        }
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port_);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(listen_socket_.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+            return std::unexpected(last_error());
+        }
+        if (listen(listen_socket_.get(), SOMAXCONN) < 0) {
+            return std::unexpected(last_error());
+        }
+        if (auto res = listen_socket_.set_nonblocking(); !res) return res;
+
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd_ < 0) return std::unexpected(last_error());
+
+        backend_ = make_event_backend(backend_kind_);
+        log_message(std::format("reactor {}: event backend {}", id_, backend_->name()));
+        if (auto res = backend_->add(wake_fd_, EVENT_READ); !res) return res;
+        return backend_->add_acceptor(listen_socket_.get());
+    }
+
+    void run(const std::atomic<bool>& should_stop) {
+        // Pinned before the first slab is touched, so first-touch placement already lands on our node.
+        if (placement_.cpu >= 0) {
+            if (auto res = pin_current_thread(placement_.cpu); !res) {
+                log_message(std::format("reactor {}: cannot pin to cpu {}: {}", id_, placement_.cpu, res.error().message()));
+            }
+        }
+        ds::SlabPool::Scope pool_scope(shard_.pool());
+        open_cold_tier();
+        if (!repl_config_.primary_host.empty()) {
+            // The primary's DELs do the expiring; the data comes from it, not from the local files.
+            shard_.keyspace().pause_expiry(true);
+            primary_ = std::make_unique<ReplicaClient>(repl_config_.primary_host, repl_config_.primary_port, id_,
+                                                       shard_.count(), replica_snapshot_path(data_dir_, id_));
+        } else if (aof_config_.enabled) {
+            load_append_only();
+        } else {
+            (void)load_snapshot_file();
+        }
+        std::vector<IoEvent> events;
+        bool expire_backlog = false;
+        bool evict_backlog = false;
+        while (!should_stop.load(std::memory_order_relaxed)) {
+            // Messages we couldn't hand off yet must not wait for an unrelated wakeup, and a pending
+            // rehash or expiry backlog only polls so idle time goes to finishing it. Otherwise the sleep
+            // ends at the next TTL deadline or idle-client deadline, whichever comes first, so keys are
+            // reclaimed and silent clients closed even when nothing else happens.
+            int timeout = has_backlog() ? 1 : static_cast<int>(k_max_sleep.count());
+            timeout = std::min(timeout, next_deadline_ms());
+            if (shard_.keyspace().snapshotting()) timeout = std::min(timeout, 1); // waiting on the disk
+            if (aof_ && aof_->unsynced()) timeout = std::min(timeout, static_cast<int>(AppendLog::k_sync_interval.count()));
+            if (primary_ && primary_->state() == ReplicaClient::State::Idle) timeout = std::min(timeout, 100);
+            if (soft_limited_) timeout = std::min(timeout, static_cast<int>(k_output_sweep_interval.count()));
+            if (shard_.keyspace().rehashing() || expire_backlog || evict_backlog || shard_.keyspace().snapshot_runnable() ||
+                migrating()) {
+                timeout = 0;
+            }
+            auto ready = backend_->wait(events, timeout);
+            if (!ready) {
+                if (ready.error() == std::errc::interrupted) continue;
+                log_message(std::format("reactor {}: event wait failed: {}", id_, ready.error().message()));
+                break;
+            }
+            auto woke = std::chrono::steady_clock::now();
+            for (const IoEvent& ev : events) {
+                if (ev.fd == listen_socket_.get()) {
+                    if (ev.events & EVENT_ACCEPT) {
+                        adopt_connection(ev.result);
+                    } else {
+                        accept_new_connections();
+                    }
+                } else if (ev.fd == wake_fd_) {
+                    uint64_t count;
+                    (void)!read(wake_fd_, &count, sizeof(count));
+                } else {
+                    handle_connection_event(ev.fd);
+                }
+            }
+            flush_outboxes();
+            drain_inboxes();
+            step_cold_tier();
+            expire_backlog = shard_.keyspace().active_expire();
+            evict_backlog = shard_.keyspace().evict_step();
+            shard_.pool().collect_remote(k_remote_free_batch);
+            step_snapshot();
+            step_migrations();
+            step_log();
+            step_replication();
+            sweep_output_limits();
+            close_idle_connections();
+            if (events.empty()) {
+                shard_.keyspace().rehash_step(k_idle_rehash_budget);
+                shard_.pool().release_empty();
+            }
+            end_iteration(woke);
+        }
+        // While the I/O pool is still there to clean up after the snapshot and sync the log.
+        shard_.keyspace().abort_snapshot();
+        if (sync_snapshot_) ::unlink(repl_sync_path(data_dir_, id_).c_str());
+        commit_writes();
+        replicas_.clear();
+        migrations_.clear();
+        aof_.reset();
+        update_feed();
+        shard_.keyspace().attach_cold_tier(nullptr, 0);
+        cold_fetches_.clear();
+        cold_waits_.clear();
+        cold_.reset();
+    }
+
+    // Safe to call from any thread. Coalesces wakeups so a burst of posts costs one eventfd write.
+    void notify() noexcept {
+        if (!wake_pending_.exchange(true, std::memory_order_acq_rel)) {
+            uint64_t one = 1;
+            (void)!write(wake_fd_, &one, sizeof(one));
+        }
+    }
+
+    // Times what runs here; a command handed to the shard owning its key is timed there, by the reactor
+    // that runs it, so nothing is counted twice.
+    void dispatch(Connection& conn, const ArgList& args) override {
+        const CommandSpec* spec = args.empty() ? nullptr : find_command(args[0]);
+        if (!spec || !spec->arity_ok(args.size())) {
+            metrics_.reject();
+            if (Transaction* tx = conn.transaction()) tx->fail();
+            CommandProcessor::process_command(shard_.keyspace(), args, conn.output()); // emits the error reply
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        size_t mark = conn.output().size();
+        // Queued commands are timed when EXEC runs them.
+        bool queuing = conn.transaction() && spec->id != CommandId::Exec && spec->id != CommandId::Discard;
+        route(conn, *spec, args);
+        if (!conn.awaiting_remote() && !queuing) record(spec->id, start, conn.output(), mark);
+    }
+
+    // Group commit for a connection's batch: its writes reach the log (and the disk, under Always) before
+    // any of its replies do.
+    void before_reply() override { commit_writes(); }
+
+    [[nodiscard]] uint32_t id() const noexcept { return id_; }
+    [[nodiscard]] Shard& shard() noexcept { return shard_; }
+    // Readable from any thread (see metrics.hpp).
+    [[nodiscard]] const ReactorMetrics& metrics() const noexcept { return metrics_; }
+
+private:
+    static constexpr size_t k_inbox_capacity = 4096;
+    // One idle slice of rehashing; short enough that a request arriving meanwhile barely notices.
+    static constexpr std::chrono::microseconds k_idle_rehash_budget{200};
+    // Members the background pool freed, returned to our slabs per loop tick.
+    static constexpr size_t k_remote_free_batch = 4096;
+    // Longest the loop sleeps with no deadline due: background frees and failed log rewrites are picked
+    // up at least this often.
+    static constexpr std::chrono::milliseconds k_max_sleep{5000};
+    // Snapshot serialization per loop tick - the most a snapshot adds to any one request's latency.
+    static constexpr std::chrono::microseconds k_snapshot_budget{250};
+    // Wait before an automatic log rewrite is tried again after one failed.
+    static constexpr std::chrono::seconds k_rewrite_retry{10};
+    // Buckets a slot migration walks per loop tick while no batch is on the wire.
+    static constexpr size_t k_migrate_scan_buckets = 256;
+    // How often clients over their soft output limit are checked when nothing else drives them.
+    static constexpr std::chrono::milliseconds k_output_sweep_interval{1000};
+    // Times a parked read is loaded again after eviction sent one of its values back to disk before the
+    // last one came in; past that it reads what is still cold synchronously rather than wait on a churn.
+    static constexpr unsigned k_cold_rounds = 3;
+
+    // An MGET whose keys live on several shards, run as one part per owning shard: ours right away, the
+    // others as messages, all at once. The client's reply is put together when the last part is back.
+    struct SplitCommand {
+        uint64_t conn_id;
+        int conn_fd;
+        std::vector<uint32_t> shard_of;            // per key, in request order
+        std::vector<std::vector<uint8_t>> replies; // per shard, its part's reply
+        uint32_t outstanding;                      // parts not back yet
+    };
+
+    // A PSYNC connection leaving the connection table once the current drive() is done with it.
+    struct Detach {
+        int fd;
+        uint32_t shard;
+        std::vector<std::string> args;
+    };
+
+    uint32_t id_;
+    uint16_t port_;
+    EventBackendKind backend_kind_;
+    Placement placement_;
+    threading::ThreadPool* background_;
+    std::string data_dir_{"."};
+    AofConfig aof_config_;
+    std::unique_ptr<AppendLog> aof_;       // open incr file, null while the log is off
+    AofManifest aof_manifest_;
+    std::optional<uint64_t> rewrite_seq_;  // base the running snapshot writes, during a rewrite
+    bool rewrite_scheduled_{false};        // asked for while a BGSAVE was running
+    uint64_t aof_base_bytes_{0};           // size of the current base, for the automatic rewrite
+    std::chrono::steady_clock::time_point rewrite_retry_at_{};
+    bool aof_error_reported_{false};
+    std::vector<ShardMessage> deferred_replies_; // replies held back until the log is flushed
+    CommandFeed feed_;                     // attached to the keyspace while the log or the backlog is on
+    ReplicationConfig repl_config_;
+    std::string replid_;
+    std::unique_ptr<ReplicationBacklog> backlog_; // from the first replica on
+    std::unordered_map<int, std::unique_ptr<ReplicaLink>> replicas_;
+    bool full_sync_pending_{false};        // replicas waiting for a snapshot none is being written for yet
+    bool sync_snapshot_{false};            // the running snapshot is for replicas
+    uint64_t sync_offset_{0};              // stream position that snapshot was taken at
+    std::optional<Detach> detach_;
+    std::unique_ptr<ReplicaClient> primary_; // on a replica: the link to this shard on the primary
+    std::unique_ptr<SlotMap> cluster_;       // null unless cluster mode is on
+    ColdTierConfig cold_config_;
+    std::unique_ptr<ColdTier> cold_;         // null unless the cold tier is on
+    // Reads (GET, MGET, EXEC) parked until the tier has read back every cold value they need, by an id drawn
+    // from next_conn_id_. Waiters from our own connections have origin == id_; the others came from peers and
+    // go back to them as replies.
+    struct ColdWait {
+        ShardMessage request;
+        size_t loads_left;
+        unsigned round;
+    };
+    std::unordered_map<uint64_t, ColdWait> cold_waits_;
+    std::unordered_map<std::string, std::vector<uint64_t>> cold_fetches_; // the waits on each key being loaded
+    std::vector<std::unique_ptr<SlotMigration>> migrations_; // of slots this shard owns, one per target node
+    // MGETs split across shards, waiting for their parts; by an id drawn from next_conn_id_, which
+    // the parts carry as their conn_id, so no connection has it.
+    std::unordered_map<uint64_t, SplitCommand> splits_;
+    Socket listen_socket_{-1};
+    int wake_fd_{-1};
+    std::atomic<bool> wake_pending_{false};
+    std::unique_ptr<EventBackend> backend_;
+    Shard shard_;
+    uint64_t next_conn_id_;
+    ClientLimits client_limits_;
+    ds::BufferPool buffers_;                 // before connections_: they hand their buffers back on the way out
+    ds::DoublyLinkedList<IdleLink> idle_;    // connections_, least recently active first; also before them
+    std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+    bool soft_limited_{false};               // some client was over its soft output limit at the last sweep
+    std::chrono::steady_clock::time_point next_output_sweep_{};
+    ReactorMetrics metrics_;
+    std::chrono::steady_clock::time_point started_{std::chrono::steady_clock::now()};
+    std::chrono::steady_clock::time_point next_publish_{};
+    bool publish_pending_{false}; // something ran since the gauges were last published
+
+    std::vector<Reactor*> peers_;
+    std::vector<std::unique_ptr<ds::SpscQueue<ShardMessage>>> inboxes_; // inboxes_[i]: pushed only by peer i
+    std::vector<std::deque<ShardMessage>> outboxes_;                   // overflow when a peer's inbox is full
+
+    static uint32_t interest_for(const Connection& conn) noexcept {
+        return conn.state() == ConnectionState::Response ? EVENT_WRITE : EVENT_READ;
+    }
+
+    uint32_t initial_interest() const noexcept {
+        return backend_->edge_triggered() ? (EVENT_READ | EVENT_WRITE) : EVENT_READ;
+    }
+
+    void accept_new_connections() {
+        while (true) {
+            int fd = accept4(listen_socket_.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    log_message(std::format("accept failed: {}", last_error().message()));
+                }
+                if (errno != EINTR) return;
+                continue;
+            }
+            adopt_connection(fd);
+        }
+    }
+
+    void adopt_connection(int fd) {
+        Socket socket(fd);
+        if (!socket.set_nonblocking()) return;
+        if (auto res = backend_->add(fd, initial_interest()); !res) {
+            log_message(std::format("failed to register fd {}: {}", fd, res.error().message()));
+            return;
+        }
+        auto conn = std::make_unique<Connection>(std::move(socket), next_conn_id_++, &buffers_, &client_limits_);
+        conn->enable_zerocopy();
+        idle_.push_back(*conn);
+        connections_[fd] = std::move(conn);
+    }
+
+    void handle_connection_event(int fd) {
+        if (auto it = connections_.find(fd); it != connections_.end()) return drive(it);
+        if (auto it = replicas_.find(fd); it != replicas_.end()) {
+            if (auto res = it->second->drain_input(); !res) return drop_replica(it, res.error());
+            return pump_replica(it);
+        }
+        if (primary_ && fd == primary_->fd()) return step_primary_link();
+        for (size_t i = 0; i < migrations_.size(); ++i) {
+            if (migrations_[i]->fd() == fd) return pump_migration(i);
+        }
+    }
+
+    void drive(std::unordered_map<int, std::unique_ptr<Connection>>::iterator it) {
+        Connection& conn = *it->second;
+        ConnectionState before = conn.state();
+        auto res = conn.process_io(*this);
+        if (detach_ && detach_->fd == it->first) return hand_off(it);
+        if (!res && res.error() == std::errc::no_buffer_space) {
+            log_message(std::format("reactor {}: closing client {}: {} bytes of output over the limit", id_, conn.id(), conn.pending_output()));
+        }
+        if (!res || conn.state() == ConnectionState::End) {
+            backend_->remove(it->first);
+            connections_.erase(it);
+            return;
+        }
+        soft_limited_ |= conn.over_soft_limit();
+        touch(conn);
+        if (!backend_->edge_triggered() && conn.state() != before) {
+            (void)backend_->modify(it->first, interest_for(conn));
+        }
+    }
+
+    // process_io() has just stamped the connection active: to the back of the idle list, which so stays
+    // ordered by idle_since().
+    void touch(Connection& conn) noexcept {
+        conn.ds::ListNode<IdleLink>::unlink();
+        idle_.push_back(conn);
+    }
+
+    // Closes the clients idle past the timeout - all at the front of the list, so this costs one look plus
+    // one per client closed. One waiting on another shard or the cold tier is not idle, just slow to answer:
+    // it goes round again.
+    void close_idle_connections() {
+        auto timeout = client_limits_.idle_timeout;
+        if (timeout.count() == 0) return;
+        auto now = std::chrono::steady_clock::now();
+        while (!idle_.empty()) {
+            auto& conn = static_cast<Connection&>(idle_.front());
+            if (now - conn.idle_since() < timeout) break;
+            if (conn.awaiting_remote()) {
+                conn.update_idle_time();
+                touch(conn);
+                continue;
+            }
+            int fd = conn.fd();
+            backend_->remove(fd);
+            connections_.erase(fd);
+        }
+    }
+
+    // Milliseconds until the earliest TTL, idle-client or held-back gauge deadline, rounded up so the
+    // wakeup is never early; k_max_sleep when there is none.
+    [[nodiscard]] int next_deadline_ms() {
+        using namespace std::chrono;
+        auto now = steady_clock::now();
+        auto due = now + k_max_sleep;
+        if (auto at = shard_.keyspace().next_expiry_us()) {
+            due = std::min(due, steady_clock::time_point(duration_cast<steady_clock::duration>(microseconds(*at))));
+        }
+        if (client_limits_.idle_timeout.count() != 0 && !idle_.empty()) {
+            due = std::min(due, static_cast<Connection&>(idle_.front()).idle_since() + client_limits_.idle_timeout);
+        }
+        if (publish_pending_) due = std::min(due, next_publish_);
+        if (due <= now) return 0;
+        return static_cast<int>(ceil<milliseconds>(due - now).count());
+    }
+
+    // A client that stopped reading never gets driven again, so its soft output limit is enforced from here.
+    // The full walk only runs while some client is over the soft limit, and at most once per interval.
+    void sweep_output_limits() {
+        if (!soft_limited_) return;
+        auto now = std::chrono::steady_clock::now();
+        if (now < next_output_sweep_) return;
+        next_output_sweep_ = now + k_output_sweep_interval;
+        soft_limited_ = false;
+        for (auto it = connections_.begin(); it != connections_.end();) {
+            Connection& conn = *it->second;
+            if (!conn.over_soft_limit()) {
+                ++it;
+            } else if (conn.output_limit_exceeded()) {
+                log_message(std::format("reactor {}: closing client {}: {} bytes of output over the limit", id_, conn.id(), conn.pending_output()));
+                backend_->remove(it->first);
+                it = connections_.erase(it);
+            } else {
+                soft_limited_ |= conn.over_soft_limit();
+                ++it;
+            }
+        }
+    }
+
+    void record(CommandId id, std::chrono::steady_clock::time_point start, std::span<const uint8_t> out, size_t mark) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        bool error = out.size() > mark && out[mark] == static_cast<uint8_t>(ds::SerializationType::Error);
+        metrics_.record(id, static_cast<uint64_t>(ns), error);
+    }
+
+    // How long the loop was busy since `woke`, for stall detection, and the shard's gauges when they are due.
+    // Gauges held back by the interval still go out once it ends (next_deadline_ms() wakes us for that),
+    // so a reactor that goes quiet does not leave stale figures behind.
+    void end_iteration(std::chrono::steady_clock::time_point woke) {
+        auto now = std::chrono::steady_clock::now();
+        metrics_.loop_iteration(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - woke).count()));
+        publish_pending_ = now < next_publish_;
+        if (publish_pending_) return;
+        next_publish_ = now + ReactorMetrics::k_publish_interval;
+        publish_gauges();
+    }
+
+    void publish_gauges() {
+        Keyspace& ks = shard_.keyspace();
+        ShardGauges& g = metrics_.gauges();
+        g.keys.set(ks.size());
+        g.expires.set(ks.ttl_count());
+        g.expired_keys.set(ks.expiry_stats().expired_keys);
+        EvictionStats eviction = ks.eviction_stats();
+        g.evicted_keys.set(eviction.evicted_keys);
+        g.used_bytes.set(eviction.used_bytes);
+        g.limit_bytes.set(eviction.limit_bytes);
+        ResizeProgress resize = ks.resize_progress();
+        g.rehashing.set(resize.active ? 1 : 0);
+        g.rehash_remaining.set(resize.remaining);
+        ds::SlabStats slab = shard_.pool().stats();
+        g.slab_bytes.set(slab.slab_bytes);
+        g.slab_live_objects.set(slab.live_objects);
+        g.slab_requested_bytes.set(slab.requested_bytes);
+        g.lazy_free_pending.set(ks.lazy_free_stats().pending);
+        ColdTierStats cold = cold_ ? cold_->stats() : ColdTierStats{};
+        g.cold_segments.set(cold.segments);
+        g.cold_bytes.set(cold.file_bytes);
+        g.connections.set(connections_.size());
+        g.buffer_idle_bytes.set(buffers_.stats().idle_bytes);
+    }
+
+    // Every reactor's metrics, ours included, for a report.
+    [[nodiscard]] std::vector<const ReactorMetrics*> all_metrics() const {
+        std::vector<const ReactorMetrics*> all;
+        for (const Reactor* peer : peers_) all.push_back(&peer->metrics_);
+        if (all.empty()) all.push_back(&metrics_);
+        return all;
+    }
+
+    [[nodiscard]] ServerInfo server_info() const noexcept {
+        return ServerInfo{port_, primary_ ? "replica" : "primary", started_};
+    }
+
+    // INFO [section ...]: peers' figures are what they last published; ours are fresh.
+    void info_command(const ArgList& args, std::vector<uint8_t>& out) {
+        publish_gauges();
+        auto all = all_metrics();
+        std::string text;
+        if (args.size() == 1) text = MetricsReport::info("", server_info(), all);
+        for (size_t i = 1; i < args.size(); ++i) text += MetricsReport::info(args[i], server_info(), all);
+        ResponseSerializer::serialize_string(out, text);
+    }
+
+    // LATENCY LATEST              per reactor that has stalled: [event, unix time (s), last (ms), max (ms)]
+    // LATENCY HISTOGRAM [cmd ...] per command that has run: [name, calls, p50, p99, p99.9, max] (usec)
+    // LATENCY RESET               histograms and stall records start over on every reactor; replies their count
+    void latency_command(const ArgList& args, std::vector<uint8_t>& out) {
+        auto all = all_metrics();
+        if (command_table_detail::equals_folded(args[1], "latest")) {
+            size_t pos = ResponseSerializer::begin_array(out);
+            uint32_t n = 0;
+            for (size_t i = 0; i < all.size(); ++i) {
+                const LoopMetrics& loop = all[i]->loop();
+                if (loop.stalls.load() == 0) continue;
+                ResponseSerializer::serialize_array_header(out, 4);
+                ResponseSerializer::serialize_string(out, "event-loop:" + std::to_string(i));
+                ResponseSerializer::serialize(out, loop.last_stall_unix_ms.load() / 1000);
+                ResponseSerializer::serialize(out, loop.last_stall_ns.load() / 1'000'000);
+                ResponseSerializer::serialize(out, loop.max_stall_ns.load() / 1'000'000);
+                n++;
+            }
+            return ResponseSerializer::end_array(out, pos, n);
+        }
+        if (command_table_detail::equals_folded(args[1], "histogram")) {
+            size_t pos = ResponseSerializer::begin_array(out);
+            uint32_t n = 0;
+            for (const CommandSpec& spec : k_command_specs) {
+                bool wanted = args.size() == 2;
+                for (size_t i = 2; i < args.size() && !wanted; ++i) wanted = find_command(args[i]) == &spec;
+                LatencySummary summary = wanted ? MetricsReport::summarize(spec.id, all) : LatencySummary{};
+                if (summary.count() == 0) continue;
+                ResponseSerializer::serialize_array_header(out, 6);
+                ResponseSerializer::serialize_string(out, spec.name);
+                ResponseSerializer::serialize(out, summary.count());
+                for (double q : {0.5, 0.99, 0.999}) {
+                    ResponseSerializer::serialize_double(out, static_cast<double>(summary.percentile(q)) / 1e3);
+                }
+                ResponseSerializer::serialize_double(out, static_cast<double>(summary.max()) / 1e3);
+                n++;
+            }
+            return ResponseSerializer::end_array(out, pos, n);
+        }
+        if (command_table_detail::equals_folded(args[1], "reset") && args.size() == 2) {
+            // Each reactor clears its own: the counters have one writer.
+            metrics_.reset_latency();
+            for (uint32_t peer = 0; peer < peers_.size(); ++peer) {
+                if (peer != id_) post(peer, ShardMessage{ShardMessage::Kind::Request, id_, 0, -1, args.to_owned(), {}});
+            }
+            return ResponseSerializer::serialize(out, all.size());
+        }
+        ResponseSerializer::serialize_error(out, ErrorCode::Argument, "LATENCY LATEST | HISTOGRAM [command ...] | RESET");
+    }
+
+    // Where a validated command runs: here, on the reactor owning its key, or (some keyless ones) everywhere.
+    void route(Connection& conn, const CommandSpec& spec, const ArgList& args) {
+        if (Transaction* tx = conn.transaction(); tx && spec.id != CommandId::Exec && spec.id != CommandId::Discard) {
+            return queue_command(*tx, spec, args, conn.output());
+        }
+        if (primary_ && spec.is_write()) {
+            return ResponseSerializer::serialize_error(conn.output(), ErrorCode::ReadOnly, "read-only replica");
+        }
+        if (spec.id == CommandId::PSync) return accept_psync(conn, args);
+        if (spec.id == CommandId::Asking) {
+            conn.set_asking();
+            return ResponseSerializer::serialize_string(conn.output(), "OK");
+        }
+        bool asking = conn.take_asking();
+        if (spec.id == CommandId::Multi) {
+            conn.begin_transaction();
+            return ResponseSerializer::serialize_string(conn.output(), "OK");
+        }
+        if (spec.id == CommandId::Discard) {
+            if (!conn.end_transaction()) {
+                return ResponseSerializer::serialize_error(conn.output(), ErrorCode::Argument, "DISCARD without MULTI");
+            }
+            return ResponseSerializer::serialize_string(conn.output(), "OK");
+        }
+        if (spec.id == CommandId::Exec) return exec_transaction(conn, asking);
+        if (spec.id == CommandId::Cluster) {
+            // Every reactor keeps its own copy of the map; peers apply changes the way they run BGSAVE.
+            if (cluster_ && cluster_changes_map(args)) {
+                for (uint32_t peer = 0; peer < peers_.size(); ++peer) {
+                    if (peer != id_) post(peer, ShardMessage{ShardMessage::Kind::Request, id_, 0, -1, args.to_owned(), {}});
+                }
+            }
+            return cluster_command(args, conn.output());
+        }
+        if (spec.id == CommandId::Info) return info_command(args, conn.output());
+        if (spec.id == CommandId::Latency) return latency_command(args, conn.output());
+
+        // Keyless commands run wherever they land; keyed ones run on the shard owning their first key.
+        if (spec.id == CommandId::BgSave || spec.id == CommandId::BgRewriteAof) {
+            // Every shard does its own; peers get a copy of the command and their replies are dropped.
+            for (uint32_t peer = 0; peer < peers_.size(); ++peer) {
+                if (peer != id_) post(peer, ShardMessage{ShardMessage::Kind::Request, id_, 0, -1, args.to_owned(), {}});
+            }
+            return run_background_command(spec.id, conn.output());
+        }
+
+        auto key = first_key(spec, args);
+        std::optional<uint32_t> slot;
+        if (cluster_ && key) {
+            slot = route_to_slot(spec, args, asking, conn.output());
+            if (!slot) return;
+        }
+        if (spec.id == CommandId::MGet && split_across_shards(conn, args)) return;
+        // A write is never split: one part could apply and another fail. (Cluster mode checked the slot above.)
+        if (!cluster_ && spec.is_write() && spec.last_key != spec.first_key && !on_one_shard(spec, args)) {
+            return ResponseSerializer::serialize_error(conn.output(), ErrorCode::CrossSlot,
+                                                       "keys in request live on different shards, put them under one {hash tag}");
+        }
+        uint32_t owner = key ? shard_.owner_of(*key) : id_;
+        if (owner == id_) {
+            if (slot && redirect_migrating(spec, args, *slot, conn.output())) return;
+            if (auto cold = cold_keys(spec, args); !cold.empty()) {
+                conn.suspend_for_remote();
+                return park_on_cold(ShardMessage{ShardMessage::Kind::Request, id_, conn.id(), conn.fd(), args.to_owned(), {}}, cold);
+            }
+            if (spec.id == CommandId::Get) {
+                // Local GETs of large values go out by reference; replies from peers arrive as bytes anyway.
+                auto value = CommandProcessor::get_shared(shard_.keyspace(), args, conn.output(), Connection::k_splice_bytes);
+                if (value) conn.splice(std::move(*value));
+                return;
+            }
+            CommandProcessor::execute(shard_.keyspace(), spec, args, conn.output());
+            return;
+        }
+        // The views point into the connection's rbuf_, which may be gone by the time the owner
+        // runs the command, so this hop is the one place the arguments get copied.
+        conn.suspend_for_remote();
+        post(owner, ShardMessage{ShardMessage::Kind::Request, id_, conn.id(), conn.fd(), args.to_owned(), {}});
+    }
+
+    // Between MULTI and EXEC: what can be refused now is, and fails the transaction; the rest is queued.
+    // Commands the reactor runs itself rather than the keyspace have no place in a transaction.
+    void queue_command(Transaction& tx, const CommandSpec& spec, const ArgList& args, std::vector<uint8_t>& out) {
+        if (spec.id == CommandId::Multi) {
+            return ResponseSerializer::serialize_error(out, ErrorCode::Argument, "MULTI calls can not be nested");
+        }
+        switch (spec.id) {
+            case CommandId::BgSave:
+            case CommandId::BgRewriteAof:
+            case CommandId::PSync:
+            case CommandId::Cluster:
+            case CommandId::Asking:
+            case CommandId::Info:
+            case CommandId::Latency:
+                tx.fail();
+                return ResponseSerializer::serialize_error(out, ErrorCode::Argument, "command not allowed inside MULTI");
+            default: break;
+        }
+        if (primary_ && spec.is_write()) {
+            tx.fail();
+            return ResponseSerializer::serialize_error(out, ErrorCode::ReadOnly, "read-only replica");
+        }
+        tx.queue(args);
+        ResponseSerializer::serialize_string(out, "QUEUED");
+    }
+
+    // A reactor runs one command at a time, so a transaction is atomic as long as all of it runs on one
+    // shard: every key in one slot in cluster mode, otherwise keys that share an owner - put them under
+    // one {hash tag}. It runs here or is carried to that shard whole, as "exec" followed by the queue.
+    void exec_transaction(Connection& conn, bool asking) {
+        auto& out = conn.output();
+        auto tx = conn.end_transaction();
+        if (!tx) return ResponseSerializer::serialize_error(out, ErrorCode::Argument, "EXEC without MULTI");
+        if (tx->failed()) {
+            return ResponseSerializer::serialize_error(out, ErrorCode::ExecAbort, "transaction discarded because of previous errors");
+        }
+        std::optional<uint32_t> owner;
+        std::optional<uint32_t> slot;
+        bool spread = false;
+        bool refused = false;
+        Transaction::for_each(tx->commands(), [&](const ArgList& args) {
+            const CommandSpec& spec = *find_command(args[0]); // validated when queued
+            if (refused || spread || !spec.has_keys()) return;
+            if (cluster_) {
+                auto at = route_to_slot(spec, args, asking, out);
+                if (!at) {
+                    refused = true; // the reply says why
+                    return;
+                }
+                spread = slot && *slot != *at;
+                slot = at;
+            }
+            for_each_key(spec, args, [&](std::string_view key) {
+                uint32_t shard = shard_.owner_of(key);
+                spread = spread || (owner && *owner != shard);
+                owner = shard;
+            });
+        });
+        if (refused) return;
+        if (spread) {
+            return ResponseSerializer::serialize_error(out, ErrorCode::CrossSlot,
+                                                       "keys in transaction live on different shards, put them under one {hash tag}");
+        }
+        std::vector<std::string> cold;
+        if (!owner || *owner == id_) {
+            cold = queued_cold_keys(tx->commands());
+            if (cold.empty()) return run_transaction(tx->commands(), out);
+        }
+        std::vector<std::string> carried{"exec"};
+        std::vector<std::string> commands = tx->take_commands();
+        carried.insert(carried.end(), std::make_move_iterator(commands.begin()), std::make_move_iterator(commands.end()));
+        conn.suspend_for_remote();
+        ShardMessage request{ShardMessage::Kind::Request, id_, conn.id(), conn.fd(), std::move(carried), {}};
+        if (!cold.empty()) return park_on_cold(std::move(request), cold);
+        post(*owner, std::move(request));
+    }
+
+    // The shard's half of EXEC: the queued commands back to back, their replies as one array. Each is timed
+    // as if it had come on its own. In cluster mode the slot is checked once more first, as for any command
+    // a peer forwarded; a redirect then stands for the whole transaction.
+    void run_transaction(std::span<const std::string> commands, std::vector<uint8_t>& out) {
+        bool runnable = true;
+        Transaction::for_each(commands, [&](const ArgList& args) {
+            const CommandSpec* spec = find_command(args[0]);
+            if (!runnable) return;
+            if (!spec) {
+                runnable = false;
+                ResponseSerializer::serialize_error(out, ErrorCode::Unknown, "unknown command");
+            } else if (cluster_ && spec->has_keys() && !serves_here(*spec, args, out)) {
+                runnable = false;
+            }
+        });
+        if (!runnable) return;
+        size_t at = ResponseSerializer::begin_array(out);
+        uint32_t replies = 0;
+        Transaction::for_each(commands, [&](const ArgList& args) {
+            const CommandSpec& spec = *find_command(args[0]);
+            auto start = std::chrono::steady_clock::now();
+            size_t mark = out.size();
+            CommandProcessor::execute(shard_.keyspace(), spec, args, out);
+            record(spec.id, start, out, mark);
+            replies++;
+        });
+        ResponseSerializer::end_array(out, at, replies);
+    }
+
+    [[nodiscard]] bool on_one_shard(const CommandSpec& spec, const ArgList& args) const {
+        uint32_t owner = shard_.owner_of(*first_key(spec, args));
+        bool same = true;
+        for_each_key(spec, args, [&](std::string_view key) { same = same && shard_.owner_of(key) == owner; });
+        return same;
+    }
+
+    // True if the MGET's keys span shards and it went out in parts (see SplitCommand); false leaves it to the
+    // usual single-owner path.
+    bool split_across_shards(Connection& conn, const ArgList& args) {
+        const CommandSpec& spec = k_command_specs[static_cast<size_t>(CommandId::MGet)];
+        std::vector<uint32_t> shard_of;
+        shard_of.reserve(args.size() - 1);
+        bool spread = false;
+        for (size_t i = 1; i < args.size(); ++i) {
+            shard_of.push_back(shard_.owner_of(args[i]));
+            spread = spread || shard_of.back() != shard_of.front();
+        }
+        if (!spread) return false;
+
+        ArgList local;
+        local.push_back(args[0]);
+        std::vector<std::vector<std::string>> parts(peers_.size());
+        for (size_t k = 0; k < shard_of.size(); ++k) {
+            if (shard_of[k] == id_) {
+                local.push_back(args[1 + k]);
+                continue;
+            }
+            auto& part = parts[shard_of[k]];
+            if (part.empty()) part.emplace_back(args[0]);
+            part.emplace_back(args[1 + k]);
+        }
+        uint64_t split_id = next_conn_id_++;
+        SplitCommand split{conn.id(), conn.fd(), std::move(shard_of), std::vector<std::vector<uint8_t>>(peers_.size()), 0};
+        if (local.size() > 1) {
+            if (auto cold = cold_keys(spec, local); !cold.empty()) {
+                // Comes back through complete() like the peers' parts.
+                park_on_cold(ShardMessage{ShardMessage::Kind::Request, id_, split_id, conn.fd(), local.to_owned(), {}}, cold);
+                split.outstanding++;
+            } else {
+                auto start = std::chrono::steady_clock::now();
+                CommandProcessor::execute(shard_.keyspace(), spec, local, split.replies[id_]);
+                record(spec.id, start, split.replies[id_], 0);
+            }
+        }
+        for (uint32_t peer = 0; peer < parts.size(); ++peer) {
+            if (parts[peer].empty()) continue;
+            post(peer, ShardMessage{ShardMessage::Kind::Request, id_, split_id, conn.fd(), std::move(parts[peer]), {}});
+            split.outstanding++;
+        }
+        splits_.emplace(split_id, std::move(split));
+        conn.suspend_for_remote();
+        return true;
+    }
+
+    // Takes the reply of the part `shard` ran. Once the last is in, `part` becomes the reply to the client - the
+    // values in request order, or the first error if a part failed - and false is returned.
+    bool awaiting_parts(std::unordered_map<uint64_t, SplitCommand>::iterator it, uint32_t shard, ShardMessage& part) {
+        SplitCommand& split = it->second;
+        split.replies[shard] = std::move(part.reply);
+        if (--split.outstanding > 0) return true;
+        part.conn_id = split.conn_id;
+        part.conn_fd = split.conn_fd;
+        part.reply.clear();
+        auto failed = std::find_if(split.replies.begin(), split.replies.end(), [](const auto& reply) {
+            return !reply.empty() && reply[0] == static_cast<uint8_t>(ds::SerializationType::Error);
+        });
+        if (failed != split.replies.end()) {
+            part.reply = std::move(*failed);
+        } else {
+            size_t bytes = 0;
+            for (const auto& reply : split.replies) bytes += reply.size();
+            part.reply.reserve(bytes);
+            ResponseSerializer::serialize_array_header(part.reply, static_cast<uint32_t>(split.shard_of.size()));
+            // Past each part's array header, then one value at a time.
+            std::vector<size_t> cursor(split.replies.size(), 1 + sizeof(uint32_t));
+            for (uint32_t owner : split.shard_of) {
+                auto rest = std::span<const uint8_t>(split.replies[owner]).subspan(cursor[owner]);
+                size_t n = ResponseSerializer::reply_length(rest);
+                part.reply.insert(part.reply.end(), rest.begin(), rest.begin() + static_cast<std::ptrdiff_t>(n));
+                cursor[owner] += n;
+            }
+        }
+        splits_.erase(it);
+        return false;
+    }
+
+    void post(uint32_t target, ShardMessage&& msg) {
+        auto& outbox = outboxes_[target];
+        if (outbox.empty() && peers_[target]->inboxes_[id_]->try_push(msg)) {
+            peers_[target]->notify();
+            return;
+        }
+        outbox.push_back(std::move(msg)); // preserve FIFO order behind anything already queued
+    }
+
+    [[nodiscard]] bool has_backlog() const noexcept {
+        for (const auto& outbox : outboxes_) {
+            if (!outbox.empty()) return true;
+        }
+        return false;
+    }
+
+    void flush_outboxes() {
+        for (uint32_t target = 0; target < outboxes_.size(); ++target) {
+            auto& outbox = outboxes_[target];
+            bool pushed = false;
+            while (!outbox.empty() && peers_[target]->inboxes_[id_]->try_push(outbox.front())) {
+                outbox.pop_front();
+                pushed = true;
+            }
+            if (pushed) peers_[target]->notify();
+        }
+    }
+
+    void drain_inboxes() {
+        // Clear the flag before draining: a producer that pushes after this point will see false
+        // and write the eventfd, so no message can be stranded until the idle timeout.
+        wake_pending_.store(false, std::memory_order_release);
+        for (uint32_t peer = 0; peer < inboxes_.size(); ++peer) {
+            while (auto msg = inboxes_[peer]->try_pop()) {
+                handle_message(std::move(*msg), peer);
+            }
+        }
+        if (!deferred_replies_.empty()) {
+            commit_writes(); // one commit for everything the peers sent this round
+            for (ShardMessage& reply : deferred_replies_) post(reply.origin, std::move(reply));
+            deferred_replies_.clear();
+        }
+    }
+
+    void run_background_command(CommandId id, std::vector<uint8_t>& out) {
+        if (id == CommandId::BgSave) return start_snapshot(out);
+        request_rewrite(out);
+    }
+
+    void start_snapshot(std::vector<uint8_t>& out) {
+        Keyspace& ks = shard_.keyspace();
+        if (ks.snapshotting()) {
+            return ResponseSerializer::serialize_error(out, ErrorCode::Busy, "snapshot already in progress");
+        }
+        auto writer = SnapshotWriter::open(snapshot_path(data_dir_, id_), id_, shard_.count(), background_);
+        if (!writer) {
+            log_message(std::format("reactor {}: cannot start snapshot: {}", id_, writer.error().message()));
+            return ResponseSerializer::serialize_error(out, ErrorCode::Busy, writer.error().message());
+        }
+        (void)ks.begin_snapshot(std::move(*writer));
+        ResponseSerializer::serialize_string(out, "Background saving started");
+    }
+
+    void step_snapshot() {
+        Keyspace& ks = shard_.keyspace();
+        if (!ks.snapshotting() || ks.snapshot_step(k_snapshot_budget)) return;
+        const SnapshotStats& stats = ks.snapshot_stats();
+        if (rewrite_seq_) return finish_rewrite(stats);
+        if (sync_snapshot_) return finish_full_sync(stats);
+        if (stats.last_ok) {
+            log_message(std::format("reactor {}: snapshot saved, {} keys, {} bytes in {} ms", id_, stats.keys, stats.bytes,
+                                    stats.duration_ms));
+        } else {
+            log_message(std::format("reactor {}: snapshot failed", id_));
+        }
+    }
+
+    // Returns whether a snapshot was loaded.
+    bool load_snapshot_file() {
+        std::string path = snapshot_path(data_dir_, id_);
+        auto start = std::chrono::steady_clock::now();
+        auto loaded = load_snapshot(path, shard_.keyspace(), id_, shard_.count(), background_);
+        if (!loaded) {
+            if (loaded.error() != std::errc::no_such_file_or_directory) {
+                log_message(std::format("reactor {}: not loading {}: {}", id_, path, loaded.error().message()));
+                shard_.keyspace().clear(); // all or nothing
+            }
+            return false;
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        log_message(std::format("reactor {}: loaded {} keys ({} expired) from {} in {} ms", id_, loaded->keys, loaded->expired,
+                                path, ms));
+        return true;
+    }
+
+    // Startup with the log on: loads the base and replays the incr files the manifest lists, then keeps
+    // appending to the last one. Without a manifest the log starts here, from the snapshot file if any.
+    // A chain that fails to load is left untouched on disk and the log stays off for this shard.
+    void load_append_only() {
+        Keyspace& ks = shard_.keyspace();
+        auto manifest = AofManifest::load(aof_manifest_path(data_dir_, id_));
+        if (!manifest) {
+            if (manifest.error() != std::errc::no_such_file_or_directory) {
+                log_message(std::format("reactor {}: append-only log off, bad manifest: {}", id_, manifest.error().message()));
+                return;
+            }
+            return create_log();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        ks.pause_expiry(true);
+        auto replayed = replay_chain(*manifest);
+        ks.pause_expiry(false);
+        if (!replayed) {
+            log_message(std::format("reactor {}: append-only log off, cannot load it: {}", id_, replayed.error().message()));
+            ks.clear();
+            return;
+        }
+        if (!attach_log(manifest->incrs.back())) return;
+        aof_manifest_ = std::move(*manifest);
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        log_message(std::format("reactor {}: loaded {} keys from the append-only log ({} commands replayed) in {} ms", id_,
+                                ks.size(), *replayed, ms));
+    }
+
+    // Returns the number of commands replayed. Runs with the keyspace in loading mode.
+    Result<uint64_t> replay_chain(const AofManifest& manifest) {
+        Keyspace& ks = shard_.keyspace();
+        if (manifest.base) {
+            std::string path = aof_base_path(data_dir_, id_, *manifest.base);
+            auto loaded = load_snapshot(path, ks, id_, shard_.count(), background_, true);
+            if (!loaded) return std::unexpected(loaded.error());
+            struct stat st{};
+            aof_base_bytes_ = ::stat(path.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+        }
+        uint64_t commands = 0;
+        std::vector<uint8_t> reply; // replies are thrown away, one buffer reused for all of them
+        for (size_t i = 0; i < manifest.incrs.size(); ++i) {
+            std::string path = aof_incr_path(data_dir_, id_, manifest.incrs[i]);
+            auto stats = replay_append_log(path, [&](const ArgList& args) {
+                reply.clear();
+                CommandProcessor::process_command(ks, args, reply);
+            });
+            if (!stats) return std::unexpected(stats.error());
+            if (stats->truncated_bytes > 0) {
+                // A write cut short by a crash can only be at the end of the file still being appended to.
+                if (i + 1 != manifest.incrs.size()) return std::unexpected(snapshot_format::corrupt());
+                log_message(std::format("reactor {}: dropping {} bytes of a partial command at the end of {}", id_,
+                                        stats->truncated_bytes, path));
+                if (::truncate(path.c_str(), static_cast<off_t>(stats->valid_bytes)) < 0) return std::unexpected(last_error());
+            }
+            commands += stats->commands;
+        }
+        return commands;
+    }
+
+    // First start with the log on. A snapshot that loaded becomes the base - hard-linked, so a later BGSAVE
+    // replacing the snapshot file leaves it alone; otherwise (or if linking fails) a rewrite writes one.
+    void create_log() {
+        bool loaded = load_snapshot_file();
+        AofManifest manifest;
+        manifest.incrs.push_back(1);
+        std::string base = aof_base_path(data_dir_, id_, 1);
+        std::string incr = aof_incr_path(data_dir_, id_, 1);
+        ::unlink(base.c_str()); // leftovers of an earlier start that never wrote its manifest
+        ::unlink(incr.c_str());
+        if (loaded && ::link(snapshot_path(data_dir_, id_).c_str(), base.c_str()) == 0) {
+            manifest.base = 1;
+            struct stat st{};
+            aof_base_bytes_ = ::stat(base.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+        } else if (shard_.keyspace().size() > 0) {
+            rewrite_scheduled_ = true;
+        }
+        if (!attach_log(1)) return;
+        if (auto res = manifest.store(data_dir_, id_); !res) {
+            log_message(std::format("reactor {}: append-only log off, cannot write its manifest: {}", id_, res.error().message()));
+            aof_.reset();
+            update_feed();
+            return;
+        }
+        aof_manifest_ = std::move(manifest);
+    }
+
+    bool attach_log(uint64_t seq) {
+        std::string path = aof_incr_path(data_dir_, id_, seq);
+        auto log = AppendLog::open(path, aof_config_.fsync, background_);
+        if (!log) {
+            log_message(std::format("reactor {}: append-only log off, cannot open {}: {}", id_, path, log.error().message()));
+            return false;
+        }
+        aof_ = std::move(*log);
+        update_feed();
+        return true;
+    }
+
+    void request_rewrite(std::vector<uint8_t>& out) {
+        if (!aof_) return ResponseSerializer::serialize_error(out, ErrorCode::Busy, "append-only log is off");
+        if (rewrite_seq_) return ResponseSerializer::serialize_error(out, ErrorCode::Busy, "rewrite already in progress");
+        if (shard_.keyspace().snapshotting()) {
+            rewrite_scheduled_ = true; // starts once the running snapshot is done
+            return ResponseSerializer::serialize_string(out, "Background append only file rewriting scheduled");
+        }
+        if (auto res = start_rewrite(); !res) {
+            return ResponseSerializer::serialize_error(out, ErrorCode::Busy, res.error().message());
+        }
+        ResponseSerializer::serialize_string(out, "Background append only file rewriting started");
+    }
+
+    // Switches appends to a new incr file and starts a snapshot of this moment as its base, in the same
+    // loop tick: the old base and logs hold everything up to here, the new file everything after. Writes
+    // keep going throughout. The manifest lists the new file before anything is written to it.
+    Result<void> start_rewrite() {
+        rewrite_scheduled_ = false;
+        uint64_t seq = aof_manifest_.incrs.back() + 1;
+        std::string incr = aof_incr_path(data_dir_, id_, seq);
+        ::unlink(incr.c_str()); // from a rewrite that failed before its manifest was written
+        auto log = AppendLog::open(incr, aof_config_.fsync, background_);
+        if (!log) return std::unexpected(log.error());
+        auto writer = SnapshotWriter::open(aof_base_path(data_dir_, id_, seq), id_, shard_.count(), background_);
+        if (!writer) {
+            ::unlink(incr.c_str());
+            return std::unexpected(writer.error());
+        }
+        AofManifest next = aof_manifest_;
+        next.incrs.push_back(seq);
+        if (auto res = next.store(data_dir_, id_); !res) {
+            ::unlink(incr.c_str());
+            return res;
+        }
+        commit_writes();
+        aof_ = std::move(*log); // the old file is synced and closed on the pool
+        aof_manifest_ = std::move(next);
+        (void)shard_.keyspace().begin_snapshot(std::move(*writer));
+        rewrite_seq_ = seq;
+        return {};
+    }
+
+    void finish_rewrite(const SnapshotStats& stats) {
+        uint64_t seq = *std::exchange(rewrite_seq_, std::nullopt);
+        if (!stats.last_ok) {
+            log_message(std::format("reactor {}: append-only log rewrite failed, keeping the old base", id_));
+            rewrite_retry_at_ = std::chrono::steady_clock::now() + k_rewrite_retry;
+            return;
+        }
+        AofManifest next;
+        next.base = seq;
+        next.incrs.push_back(seq);
+        if (auto res = next.store(data_dir_, id_); !res) {
+            log_message(std::format("reactor {}: append-only log rewrite not installed: {}", id_, res.error().message()));
+            ::unlink(aof_base_path(data_dir_, id_, seq).c_str());
+            rewrite_retry_at_ = std::chrono::steady_clock::now() + k_rewrite_retry;
+            return;
+        }
+        if (aof_manifest_.base) ::unlink(aof_base_path(data_dir_, id_, *aof_manifest_.base).c_str());
+        for (uint64_t old : aof_manifest_.incrs) {
+            if (old != seq) ::unlink(aof_incr_path(data_dir_, id_, old).c_str());
+        }
+        aof_manifest_ = std::move(next);
+        aof_base_bytes_ = stats.bytes;
+        log_message(std::format("reactor {}: append-only log rewritten, base of {} keys, {} bytes in {} ms", id_, stats.keys,
+                                stats.bytes, stats.duration_ms));
+    }
+
+    // Once per loop tick: starts a due rewrite, writes out what expiry logged, and syncs under EverySec.
+    void step_log() {
+        if (!aof_) return;
+        if (!rewrite_seq_ && !shard_.keyspace().snapshotting() && (rewrite_scheduled_ || rewrite_due())) {
+            if (auto res = start_rewrite(); !res) {
+                log_message(std::format("reactor {}: cannot start append-only log rewrite: {}", id_, res.error().message()));
+                rewrite_retry_at_ = std::chrono::steady_clock::now() + k_rewrite_retry;
+            }
+        }
+        commit_writes();
+        aof_->tick();
+        bool failed = aof_->failed();
+        if (failed && !aof_error_reported_) {
+            log_message(std::format("reactor {}: append-only log failing, refusing writes: {}", id_, aof_->error().message()));
+        }
+        aof_error_reported_ = failed;
+    }
+
+    [[nodiscard]] bool rewrite_due() const {
+        if (aof_config_.rewrite_percent == 0 || std::chrono::steady_clock::now() < rewrite_retry_at_) return false;
+        uint64_t size = aof_->size();
+        return size >= aof_config_.rewrite_min_bytes && size * 100 >= aof_base_bytes_ * aof_config_.rewrite_percent;
+    }
+
+    // Attached while anything consumes it, so a shard with neither log nor replicas encodes nothing.
+    void update_feed() { shard_.keyspace().set_command_feed(aof_ || backlog_ ? &feed_ : nullptr); }
+
+    // Hands the feed's batch to the log and the backlog - the one copy replicas get - and refuses writes
+    // while the log can't take them.
+    void commit_writes() {
+        if (feed_.empty() && !(aof_ && aof_->has_pending())) return;
+        if (aof_) (void)aof_->write(feed_.pending());
+        if (backlog_) backlog_->append(feed_.pending());
+        feed_.clear();
+        feed_.set_refused(aof_ && aof_->failed() ? aof_->error() : std::error_code{});
+    }
+
+    // The connection becomes a replica link once this drive() returns; see hand_off().
+    void accept_psync(Connection& conn, const ArgList& args) {
+        auto shard = repl_detail::parse_number<uint32_t>(args[1]);
+        auto count = repl_detail::parse_number<uint32_t>(args[2]);
+        if (primary_) {
+            return ResponseSerializer::serialize_error(conn.output(), ErrorCode::Busy, "a replica has no replicas");
+        }
+        if (!shard || !count || *count != shard_.count() || *shard >= *count) {
+            return ResponseSerializer::serialize_error(conn.output(), ErrorCode::Argument, "shard layout differs from the primary's");
+        }
+        conn.suspend_for_remote(); // nothing after PSYNC runs as a command
+        detach_ = Detach{conn.fd(), *shard, args.to_owned()};
+    }
+
+    void hand_off(std::unordered_map<int, std::unique_ptr<Connection>>::iterator it) {
+        Detach detach = std::move(*detach_);
+        detach_.reset();
+        backend_->remove(it->first);
+        Socket socket = it->second->release_socket();
+        connections_.erase(it);
+        if (detach.shard == id_) return accept_replica(std::move(socket), detach.args);
+        post(detach.shard, ShardMessage{ShardMessage::Kind::Handoff, id_, 0, socket.release(), std::move(detach.args), {}});
+    }
+
+    // On the owning shard: continues from the replica's offset if the backlog still has it, otherwise
+    // queues it for a full resync.
+    void accept_replica(Socket socket, const std::vector<std::string>& args) {
+        int fd = socket.get();
+        if (auto res = backend_->add(fd, initial_interest()); !res) {
+            log_message(std::format("reactor {}: failed to register replica fd {}: {}", id_, fd, res.error().message()));
+            return;
+        }
+        if (!backlog_) {
+            backlog_ = std::make_unique<ReplicationBacklog>(repl_config_.backlog_bytes);
+            update_feed();
+        }
+        commit_writes(); // the backlog's end is "now"
+        auto offset = repl_detail::parse_number<uint64_t>(args[4]);
+        std::unique_ptr<ReplicaLink> link;
+        if (args[3] == replid_ && offset && backlog_->covers(*offset)) {
+            link = std::make_unique<ReplicaLink>(std::move(socket), replid_, *offset);
+            log_message(std::format("reactor {}: replica on fd {} continues from offset {}", id_, fd, *offset));
+        } else {
+            link = std::make_unique<ReplicaLink>(std::move(socket));
+            // One snapshot serves every replica that asks while it is written: each streams from its offset.
+            if (!sync_snapshot_) full_sync_pending_ = true;
+            log_message(std::format("reactor {}: replica on fd {} needs a full resync", id_, fd));
+        }
+        auto [it, inserted] = replicas_.insert_or_assign(fd, std::move(link));
+        pump_replica(it);
+    }
+
+    void drop_replica(std::unordered_map<int, std::unique_ptr<ReplicaLink>>::iterator it, std::error_code why) {
+        log_message(std::format("reactor {}: replica on fd {} dropped: {}", id_, it->first, why.message()));
+        backend_->remove(it->first);
+        replicas_.erase(it);
+    }
+
+    void pump_replica(std::unordered_map<int, std::unique_ptr<ReplicaLink>>::iterator it) {
+        ReplicaLink& link = *it->second;
+        auto blocked = link.pump(*backlog_);
+        if (!blocked) return drop_replica(it, blocked.error());
+        if (!backend_->edge_triggered() && *blocked != link.write_armed()) {
+            (void)backend_->modify(it->first, *blocked ? (EVENT_READ | EVENT_WRITE) : EVENT_READ);
+            link.set_write_armed(*blocked);
+        }
+    }
+
+    // Snapshots this moment for the replicas waiting on one; every write from here on is in the backlog.
+    void start_full_sync() {
+        full_sync_pending_ = false;
+        auto writer = SnapshotWriter::open(repl_sync_path(data_dir_, id_), id_, shard_.count(), background_);
+        if (!writer) {
+            log_message(std::format("reactor {}: cannot snapshot for replicas: {}", id_, writer.error().message()));
+            return drop_waiting_replicas(writer.error());
+        }
+        commit_writes();
+        sync_offset_ = backlog_->end();
+        (void)shard_.keyspace().begin_snapshot(std::move(*writer));
+        sync_snapshot_ = true;
+    }
+
+    void finish_full_sync(const SnapshotStats& stats) {
+        sync_snapshot_ = false;
+        std::string path = repl_sync_path(data_dir_, id_);
+        if (!stats.last_ok) {
+            log_message(std::format("reactor {}: snapshot for replicas failed", id_));
+            ::unlink(path.c_str());
+            return drop_waiting_replicas(std::make_error_code(std::errc::io_error));
+        }
+        for (auto& [fd, link] : replicas_) {
+            if (link->state() != ReplicaLink::State::WaitingSnapshot) continue;
+            int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (file < 0 || !link->send_snapshot(file, replid_, sync_offset_)) link = nullptr; // dropped below
+        }
+        ::unlink(path.c_str()); // the open descriptors keep it readable
+        for (auto it = replicas_.begin(); it != replicas_.end();) {
+            auto next = std::next(it);
+            if (!it->second) {
+                backend_->remove(it->first);
+                replicas_.erase(it);
+            } else {
+                pump_replica(it);
+            }
+            it = next;
+        }
+    }
+
+    void drop_waiting_replicas(std::error_code why) {
+        for (auto it = replicas_.begin(); it != replicas_.end();) {
+            auto next = std::next(it);
+            if (it->second->state() == ReplicaLink::State::WaitingSnapshot) drop_replica(it, why);
+            it = next;
+        }
+    }
+
+    // Once per loop tick. On a primary: starts a full resync that is due and sends what the backlog got;
+    // on a replica: reconnects to the primary when due.
+    void step_replication() {
+        if (primary_) {
+            if (!primary_->due()) return;
+            if (auto res = primary_->connect(); !res) {
+                log_message(std::format("reactor {}: cannot reach the primary: {}", id_, res.error().message()));
+                return;
+            }
+            if (auto res = backend_->add(primary_->fd(), EVENT_READ | EVENT_WRITE); !res) {
+                log_message(std::format("reactor {}: failed to register the primary link: {}", id_, res.error().message()));
+                primary_->reset();
+            }
+            return;
+        }
+        if (!backlog_) return;
+        commit_writes();
+        if (full_sync_pending_ && !shard_.keyspace().snapshotting()) start_full_sync();
+        for (auto it = replicas_.begin(); it != replicas_.end();) {
+            auto next = std::next(it);
+            pump_replica(it);
+            it = next;
+        }
+    }
+
+    void step_primary_link() {
+        Keyspace& ks = shard_.keyspace();
+        bool was_connecting = primary_->wants_write();
+        std::vector<uint8_t> reply; // scratch: replies to the stream are dropped
+        auto res = primary_->on_event(
+            [&](const ArgList& args) {
+                reply.clear();
+                CommandProcessor::process_command(ks, args, reply);
+            },
+            [&](const std::string& path) { return load_full_sync(path); });
+        if (!res) {
+            log_message(std::format("reactor {}: lost the primary, retrying: {}", id_, res.error().message()));
+            backend_->remove(primary_->fd());
+            primary_->reset();
+            return;
+        }
+        if (was_connecting && !primary_->wants_write() && !backend_->edge_triggered()) {
+            (void)backend_->modify(primary_->fd(), EVENT_READ);
+        }
+    }
+
+    bool load_full_sync(const std::string& path) {
+        Keyspace& ks = shard_.keyspace();
+        auto start = std::chrono::steady_clock::now();
+        ks.clear();
+        // Expired keys stay: the primary's stream deletes them.
+        auto loaded = load_snapshot(path, ks, id_, shard_.count(), background_, true);
+        if (!loaded) {
+            log_message(std::format("reactor {}: cannot load the primary's snapshot: {}", id_, loaded.error().message()));
+            ks.clear();
+            return false;
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        log_message(std::format("reactor {}: full resync, {} keys from the primary in {} ms", id_, loaded->keys, ms));
+        return true;
+    }
+
+    // CLUSTER subcommands that change the slot map, which every reactor of the node must apply.
+    [[nodiscard]] static bool cluster_changes_map(const ArgList& args) noexcept {
+        using command_table_detail::equals_folded;
+        return equals_folded(args[1], "addslotsrange") || equals_folded(args[1], "setslot");
+    }
+
+    [[nodiscard]] static std::optional<uint32_t> parse_slot(std::string_view text) {
+        auto slot = repl_detail::parse_number<uint32_t>(text);
+        if (!slot || *slot >= k_cluster_slots) return std::nullopt;
+        return slot;
+    }
+
+    // CLUSTER KEYSLOT key | SLOTS | ADDSLOTSRANGE first last [host:port] |
+    //         SETSLOT slot NODE host:port | MIGRATING host:port | IMPORTING host:port | STABLE
+    // The map is set by the operator (or a tool) on every node; nodes don't gossip.
+    void cluster_command(const ArgList& args, std::vector<uint8_t>& out) {
+        using command_table_detail::equals_folded;
+        if (!cluster_) return ResponseSerializer::serialize_error(out, ErrorCode::ClusterDown, "cluster mode is off");
+        std::string_view sub = args[1];
+        if (equals_folded(sub, "keyslot") && args.size() == 3) return ResponseSerializer::serialize(out, key_slot(args[2]));
+        if (equals_folded(sub, "slots") && args.size() == 2) {
+            auto ranges = cluster_->ranges();
+            ResponseSerializer::serialize_array_header(out, static_cast<uint32_t>(ranges.size()));
+            for (const SlotMap::Range& range : ranges) {
+                ResponseSerializer::serialize_array_header(out, 3);
+                ResponseSerializer::serialize(out, range.first);
+                ResponseSerializer::serialize(out, range.last);
+                ResponseSerializer::serialize_string(out, cluster_->node(range.node).address());
+            }
+            return;
+        }
+        if (equals_folded(sub, "addslotsrange") && (args.size() == 4 || args.size() == 5)) {
+            auto first = parse_slot(args[2]);
+            auto last = parse_slot(args[3]);
+            if (!first || !last || *first > *last) {
+                return ResponseSerializer::serialize_error(out, ErrorCode::Argument, "invalid slot range");
+            }
+            uint16_t node = 0;
+            if (args.size() == 5) {
+                auto parsed = ClusterNode::parse(args[4]);
+                if (!parsed) return ResponseSerializer::serialize_error(out, ErrorCode::Argument, "invalid node address");
+                node = cluster_->intern(*parsed);
+            }
+            for (uint32_t slot = *first; slot <= *last; ++slot) stop_migration(slot);
+            cluster_->assign(*first, *last, node);
+            return ResponseSerializer::serialize_string(out, "OK");
+        }
+        if (equals_folded(sub, "setslot") && (args.size() == 4 || args.size() == 5)) {
+            auto slot = parse_slot(args[2]);
+            if (!slot) return ResponseSerializer::serialize_error(out, ErrorCode::Argument, "invalid slot");
+            std::string_view how = args[3];
+            if (args.size() == 4) {
+                if (!equals_folded(how, "stable")) return ResponseSerializer::serialize_error(out, ErrorCode::Arity, "SETSLOT needs a node");
+                stop_migration(*slot);
+                cluster_->set_stable(*slot);
+                return ResponseSerializer::serialize_string(out, "OK");
+            }
+            auto parsed = ClusterNode::parse(args[4]);
+            if (!parsed) return ResponseSerializer::serialize_error(out, ErrorCode::Argument, "invalid node address");
+            uint16_t node = cluster_->intern(*parsed);
+            bool owned = SlotMap::is_self(cluster_->owner(*slot));
+            if (equals_folded(how, "node")) {
+                stop_migration(*slot);
+                cluster_->assign(*slot, *slot, node);
+                return ResponseSerializer::serialize_string(out, "OK");
+            }
+            if (equals_folded(how, "migrating")) {
+                if (!owned || SlotMap::is_self(node)) {
+                    return ResponseSerializer::serialize_error(out, ErrorCode::Argument, "can only migrate an owned slot to another node");
+                }
+                cluster_->set_migrating(*slot, node);
+                if (shard_.owner_of_slot(*slot) == id_) start_migration(*slot, node);
+                return ResponseSerializer::serialize_string(out, "OK");
+            }
+            if (equals_folded(how, "importing")) {
+                if (owned || SlotMap::is_self(node)) {
+                    return ResponseSerializer::serialize_error(out, ErrorCode::Argument, "can only import a slot another node owns");
+                }
+                cluster_->set_importing(*slot, node);
+                return ResponseSerializer::serialize_string(out, "OK");
+            }
+        }
+        ResponseSerializer::serialize_error(out, ErrorCode::Argument, "unknown CLUSTER subcommand or wrong arguments");
+    }
+
+    // Cluster mode, wherever the command arrived: the slot of its keys if this node serves it, otherwise
+    // nullopt with the reply (MOVED, CROSSSLOT, CLUSTERDOWN) written. After ASKING an importing slot counts.
+    // Only commands whose key positions span more than one argument pay for the cross-slot check.
+    std::optional<uint32_t> route_to_slot(const CommandSpec& spec, const ArgList& args, bool asking, std::vector<uint8_t>& out) {
+        uint32_t slot = key_slot(args[static_cast<size_t>(spec.first_key)]);
+        if (spec.last_key != spec.first_key) {
+            bool same = true;
+            for_each_key(spec, args, [&](std::string_view key) { same = same && key_slot(key) == slot; });
+            if (!same) {
+                ResponseSerializer::serialize_error(out, ErrorCode::CrossSlot, "keys in request don't hash to the same slot");
+                return std::nullopt;
+            }
+        }
+        uint16_t owner = cluster_->owner(slot);
+        if (SlotMap::is_self(owner) || (asking && cluster_->importing_from(slot) != SlotMap::k_none)) return slot;
+        if (owner == SlotMap::k_none) {
+            ResponseSerializer::serialize_error(out, ErrorCode::ClusterDown, std::format("hash slot {} is not served", slot));
+        } else {
+            ResponseSerializer::serialize_redirect(out, ErrorCode::Moved, slot, cluster_->node(owner).address());
+        }
+        return std::nullopt;
+    }
+
+    // On the shard owning a slot this node is migrating: true with the reply written unless the keys are all
+    // still here. Keys already gone get ASK; keys on the wire, or a mix of both, get TRYAGAIN.
+    bool redirect_migrating(const CommandSpec& spec, const ArgList& args, uint32_t slot, std::vector<uint8_t>& out) {
+        uint16_t target = cluster_->migrating_to(slot);
+        if (target == SlotMap::k_none) return false;
+        const SlotMigration* migration = migration_to(target);
+        size_t keys = 0, present = 0;
+        bool moving = false;
+        for_each_key(spec, args, [&](std::string_view key) {
+            keys++;
+            if (migration && migration->in_flight(key)) {
+                moving = true;
+            } else if (shard_.keyspace().find(key)) {
+                present++;
+            }
+        });
+        if (!moving && present == keys) return false;
+        if (moving || present > 0) {
+            ResponseSerializer::serialize_error(out, ErrorCode::TryAgain, "keys are being migrated, try again");
+        } else {
+            ResponseSerializer::serialize_redirect(out, ErrorCode::Ask, slot, cluster_->node(target).address());
+        }
+        return true;
+    }
+
+    // For a command a peer forwarded: the map may have changed since the peer routed it.
+    bool serves_here(const CommandSpec& spec, const ArgList& args, std::vector<uint8_t>& out) {
+        auto slot = route_to_slot(spec, args, true, out); // the origin already applied ASKING
+        return slot && !redirect_migrating(spec, args, *slot, out);
+    }
+
+    [[nodiscard]] SlotMigration* migration_to(uint16_t node) const noexcept {
+        for (const auto& migration : migrations_) {
+            if (migration->target() == node) return migration.get();
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]] bool migrating() const noexcept {
+        return std::any_of(migrations_.begin(), migrations_.end(), [](const auto& m) { return m->walking(); });
+    }
+
+    // A failed connect leaves the slot MIGRATING with nothing moving; SETSLOT MIGRATING again retries.
+    void start_migration(uint32_t slot, uint16_t node) {
+        SlotMigration* migration = migration_to(node);
+        if (!migration) {
+            const ClusterNode& target = cluster_->node(node);
+            auto socket = connect_nonblocking(target.host, target.port);
+            if (!socket) {
+                log_message(std::format("reactor {}: cannot reach {} to migrate slots: {}", id_, target.address(),
+                                        socket.error().message()));
+                return;
+            }
+            int fd = socket->get();
+            if (auto res = backend_->add(fd, EVENT_READ | EVENT_WRITE); !res) {
+                log_message(std::format("reactor {}: failed to register migration fd {}: {}", id_, fd, res.error().message()));
+                return;
+            }
+            migrations_.push_back(std::make_unique<SlotMigration>(node, std::move(*socket)));
+            migration = migrations_.back().get();
+            migration->set_write_armed(true);
+            log_message(std::format("reactor {}: migrating slots to {}", id_, target.address()));
+        }
+        migration->add_slot(slot);
+    }
+
+    void stop_migration(uint32_t slot) {
+        for (auto& migration : migrations_) migration->remove_slot(slot);
+    }
+
+    void drop_migration(size_t index, std::error_code why) {
+        SlotMigration& migration = *migrations_[index];
+        log_message(std::format("reactor {}: migration to {} failed, its slots stay MIGRATING: {}", id_,
+                                cluster_->node(migration.target()).address(), why.message()));
+        backend_->remove(migration.fd());
+        migrations_.erase(migrations_.begin() + static_cast<ptrdiff_t>(index));
+    }
+
+    // Once per loop tick: walks the next slice for migrations waiting on nothing, and closes finished ones.
+    void step_migrations() {
+        for (size_t i = migrations_.size(); i-- > 0;) {
+            SlotMigration& migration = *migrations_[i];
+            if (migration.walking()) {
+                pump_migration(i);
+            } else if (migration.state() == SlotMigration::State::Moving && migration.empty() && migration.idle()) {
+                backend_->remove(migration.fd());
+                migrations_.erase(migrations_.begin() + static_cast<ptrdiff_t>(i));
+            }
+        }
+    }
+
+    // Moves the migration along as far as the socket allows: acknowledged keys are deleted here, the next
+    // batch queued, and once the walk is done the slots handed over.
+    void pump_migration(size_t index) {
+        SlotMigration& migration = *migrations_[index];
+        if (migration.state() == SlotMigration::State::Connecting) {
+            if (auto res = migration.connected(); !res) return drop_migration(index, res.error());
+        }
+        while (true) {
+            auto answered = migration.on_io();
+            if (!answered) return drop_migration(index, answered.error());
+            if (!*answered) break;
+            if (migration.state() == SlotMigration::State::Handover) {
+                finish_handover(migration);
+            } else if (!migration.batch().empty()) {
+                delete_moved(migration);
+            }
+            if (auto res = migration.fill(shard_.keyspace(), k_migrate_scan_buckets); !res) {
+                return drop_migration(index, res.error());
+            }
+            if (migration.walked()) migration.hand_over(cluster_->node(migration.target()).address());
+            if (migration.idle()) break;
+        }
+        if (!backend_->edge_triggered() && migration.wants_write() != migration.write_armed()) {
+            (void)backend_->modify(migration.fd(), migration.wants_write() ? (EVENT_READ | EVENT_WRITE) : EVENT_READ);
+            migration.set_write_armed(migration.wants_write());
+        }
+    }
+
+    // Through the command path, so the deletes reach the log and the replicas like any other.
+    void delete_moved(SlotMigration& migration) {
+        std::vector<uint8_t> reply;
+        for (const std::string& key : migration.batch()) {
+            ArgList del;
+            del.push_back("del");
+            del.push_back(key);
+            reply.clear();
+            CommandProcessor::process_command(shard_.keyspace(), del, reply);
+        }
+        migration.batch_done();
+    }
+
+    // The target owns the slots now: switch our map and the peers'.
+    void finish_handover(SlotMigration& migration) {
+        std::string address = cluster_->node(migration.target()).address();
+        for (uint32_t slot : migration.handed_over()) {
+            cluster_->assign(slot, slot, migration.target());
+            std::vector<std::string> args{"cluster", "setslot", std::to_string(slot), "node", address};
+            for (uint32_t peer = 0; peer < peers_.size(); ++peer) {
+                if (peer != id_) post(peer, ShardMessage{ShardMessage::Kind::Request, id_, 0, -1, args, {}});
+            }
+        }
+        log_message(std::format("reactor {}: handed {} slots over to {}", id_, migration.handed_over().size(), address));
+        migration.handover_done();
+    }
+
+    void open_cold_tier() {
+        if (!cold_config_.enabled || !background_ || !repl_config_.primary_host.empty()) return;
+        auto tier = std::make_unique<ColdTier>(data_dir_, id_, background_, [this] { notify(); });
+        if (auto res = tier->open(); !res) {
+            log_message(std::format("reactor {}: cold tier disabled: {}", id_, res.error().message()));
+            return;
+        }
+        cold_ = std::move(tier);
+        shard_.keyspace().attach_cold_tier(cold_.get(), cold_config_.min_value_bytes);
+    }
+
+    // The keys a GET or MGET - or the GETs and MGETs of a forwarded EXEC ("exec" and the queue) - would read
+    // from the cold tier, each once. Such a command is not run until they are all loaded (see park_on_cold()):
+    // reading them on the spot would block the loop on the disk. Nothing else reads a cold value; writes just
+    // drop it.
+    [[nodiscard]] std::vector<std::string> cold_keys(const CommandSpec& spec, const ArgList& args) {
+        if (spec.id == CommandId::Exec) return queued_cold_keys(std::span<const std::string_view>(args.begin() + 1, args.end()));
+        std::vector<std::string> keys;
+        collect_cold_keys(spec, args, keys);
+        return dedupe(std::move(keys));
+    }
+
+    template<typename Str>
+    [[nodiscard]] std::vector<std::string> queued_cold_keys(std::span<const Str> commands) {
+        std::vector<std::string> keys;
+        if (!cold_) return keys;
+        Transaction::for_each(commands, [&](const ArgList& args) {
+            if (const CommandSpec* spec = find_command(args[0])) collect_cold_keys(*spec, args, keys);
+        });
+        return dedupe(std::move(keys));
+    }
+
+    void collect_cold_keys(const CommandSpec& spec, const ArgList& args, std::vector<std::string>& keys) {
+        if (!cold_ || (spec.id != CommandId::Get && spec.id != CommandId::MGet)) return;
+        for (size_t i = 1; i < args.size(); ++i) {
+            Entry* entry = shard_.keyspace().find(args[i]);
+            if (entry && entry->type == EntryType::Cold) keys.emplace_back(args[i]);
+        }
+    }
+
+    static std::vector<std::string> dedupe(std::vector<std::string> keys) {
+        if (keys.size() > 1) {
+            std::sort(keys.begin(), keys.end());
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        }
+        return keys;
+    }
+
+    // One fetch per key, however many waiters queue up behind it; a waiter runs once its last key is in.
+    void park_on_cold(ShardMessage&& waiter, std::span<const std::string> keys, unsigned round = 0) {
+        uint64_t wait_id = next_conn_id_++;
+        for (const std::string& key : keys) {
+            auto [it, fresh] = cold_fetches_.try_emplace(key);
+            if (fresh) {
+                Entry* entry = shard_.keyspace().find(key);
+                cold_->fetch(key, ColdRef::decode(entry->value));
+            }
+            it->second.push_back(wait_id);
+        }
+        cold_waits_.emplace(wait_id, ColdWait{std::move(waiter), keys.size(), round});
+    }
+
+    void step_cold_tier() {
+        if (!cold_) return;
+        cold_->poll(
+            [this](ColdTier::Loaded&& loaded) {
+                if (loaded.value) shard_.keyspace().promote(loaded.key, loaded.ref, std::move(*loaded.value));
+                auto it = cold_fetches_.find(loaded.key);
+                if (it == cold_fetches_.end()) return;
+                std::vector<uint64_t> waits = std::move(it->second);
+                cold_fetches_.erase(it);
+                for (uint64_t wait_id : waits) {
+                    auto wait = cold_waits_.find(wait_id);
+                    if (wait == cold_waits_.end() || --wait->second.loads_left > 0) continue;
+                    ShardMessage waiter = std::move(wait->second.request);
+                    unsigned round = wait->second.round;
+                    cold_waits_.erase(wait);
+                    finish_cold_wait(std::move(waiter), round);
+                }
+            },
+            [this](ColdTier::Record&& record) { return shard_.keyspace().relocate_cold(std::move(record)); });
+    }
+
+    // Runs the parked command now that its values are loaded and delivers the reply. Values evicted again
+    // while the others loaded are fetched once more, up to k_cold_rounds; after that, or if a read failed,
+    // the command reads them synchronously. A transaction's writes are committed first, as they would have
+    // been before its reply left a peer.
+    void finish_cold_wait(ShardMessage&& waiter, unsigned round) {
+        const CommandSpec& spec = *find_command(waiter.args[0]);
+        if (round < k_cold_rounds) {
+            if (auto cold = cold_keys(spec, ArgList::of(waiter.args)); !cold.empty()) {
+                return park_on_cold(std::move(waiter), cold, round + 1);
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
+        if (spec.id == CommandId::Exec) {
+            run_transaction(std::span<const std::string>(waiter.args).subspan(1), waiter.reply);
+            commit_writes();
+        } else {
+            CommandProcessor::process_command(shard_.keyspace(), ArgList::of(waiter.args), waiter.reply);
+        }
+        record(spec.id, start, waiter.reply, 0);
+        if (waiter.origin != id_) {
+            waiter.kind = ShardMessage::Kind::Reply;
+            uint32_t origin = waiter.origin;
+            return post(origin, std::move(waiter));
+        }
+        complete(std::move(waiter), id_);
+    }
+
+    // `from` is the peer whose inbox held the message; a reply keeps the origin of its request.
+    void handle_message(ShardMessage&& msg, uint32_t from) {
+        if (msg.kind == ShardMessage::Kind::Handoff) return accept_replica(Socket(msg.conn_fd), msg.args);
+        if (msg.kind == ShardMessage::Kind::Request) {
+            const CommandSpec* spec = msg.args.empty() ? nullptr : find_command(msg.args[0]);
+            ArgList args = ArgList::of(msg.args);
+            auto start = std::chrono::steady_clock::now();
+            if (spec && (spec->id == CommandId::BgSave || spec->id == CommandId::BgRewriteAof)) {
+                run_background_command(spec->id, msg.reply);
+            } else if (spec && spec->id == CommandId::Cluster) {
+                cluster_command(args, msg.reply);
+            } else if (spec && spec->id == CommandId::Latency) {
+                metrics_.reset_latency(); // the only LATENCY that is passed on
+            } else if (cluster_ && spec && spec->has_keys() && !serves_here(*spec, args, msg.reply)) {
+                // redirected: the reply says where to go
+            } else if (auto cold = spec ? cold_keys(*spec, args) : std::vector<std::string>{}; !cold.empty()) {
+                return park_on_cold(std::move(msg), cold);
+            } else if (spec && spec->id == CommandId::Exec) {
+                run_transaction(std::span<const std::string>(msg.args).subspan(1), msg.reply);
+            } else {
+                CommandProcessor::process_command(shard_.keyspace(), args, msg.reply);
+            }
+            // Copies of a command every shard runs (conn_fd -1) were counted where the client sent it.
+            if (spec && msg.conn_fd >= 0) record(spec->id, start, msg.reply, 0);
+            msg.kind = ShardMessage::Kind::Reply;
+            if (aof_) {
+                deferred_replies_.push_back(std::move(msg)); // sent once the log is flushed, in order
+                return;
+            }
+            uint32_t origin = msg.origin;
+            post(origin, std::move(msg));
+            return;
+        }
+        complete(std::move(msg), from);
+    }
+
+    // A reply for one of our connections, or for a part of a split MGET, that `from` ran.
+    void complete(ShardMessage&& msg, uint32_t from) {
+        if (auto split = splits_.find(msg.conn_id); split != splits_.end() && awaiting_parts(split, from, msg)) return;
+        auto it = connections_.find(msg.conn_fd);
+        if (it == connections_.end() || it->second->id() != msg.conn_id) {
+            return; // client went away while the command was in flight
+        }
+        it->second->complete_remote(msg.reply);
+        drive(it); // resume parsing the rest of the pipeline and flush - no readiness edge will do it for us
+    }
+};
+
+#endif // REACTOR_HPP
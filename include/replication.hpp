@@ -0,0 +1,448 @@
+#ifndef REPLICATION_HPP
+#define REPLICATION_HPP
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "request_parser.hpp"
+#include "response_serializer.hpp"
+#include "socket.hpp"
+
+// Asynchronous primary -> replica replication, one stream per shard. The primary's CommandFeed (see
+// command_feed.hpp) is copied once into each shard's ReplicationBacklog, and every replica of that shard
+// is written straight out of the ring, so adding replicas adds syscalls, not copies. A replica's shard
+// connects, sends
+//   PSYNC <shard> <shard_count> <replid | ?> <offset>
+// and gets one String reply followed by raw bytes:
+//   "CONTINUE <replid>"                        then the stream from <offset>
+//   "FULLRESYNC <replid> <offset> <size>"      then a <size>-byte snapshot (snapshot.hpp), then the stream
+// The replication id names the primary's run and the offset counts stream bytes per shard, so a replica
+// that comes back to the same run picks up where it left off for as long as the backlog still holds it.
+// Replication is fire-and-forget: there are no acknowledgements, and a replica that falls further behind
+// than the backlog is dropped and resyncs.
+
+struct ReplicationConfig {
+    std::string primary_host;                  // empty: this server is a primary
+    uint16_t primary_port{0};
+    size_t backlog_bytes{size_t{16} << 20};    // per shard, allocated when its first replica connects
+};
+
+// The primary's full-resync snapshot, deleted once every replica waiting for it has it open.
+inline std::string repl_sync_path(std::string_view dir, uint32_t shard) {
+    return std::string(dir) + "/repl-" + std::to_string(shard) + ".kvs";
+}
+
+// Where a replica receives that snapshot before loading it.
+inline std::string replica_snapshot_path(std::string_view dir, uint32_t shard) {
+    return std::string(dir) + "/replica-" + std::to_string(shard) + ".kvs.tmp";
+}
+
+// Random id for one run of a primary: 40 hex digits.
+inline std::string make_replication_id() {
+    static constexpr char k_hex[] = "0123456789abcdef";
+    std::random_device rd;
+    std::string id(40, '0');
+    for (size_t i = 0; i < id.size(); i += 8) {
+        uint32_t bits = rd();
+        for (size_t j = 0; j < 8; ++j, bits >>= 4) id[i + j] = k_hex[bits & 0xf];
+    }
+    return id;
+}
+
+namespace repl_detail {
+
+inline std::error_code last_errno() noexcept { return {errno, std::system_category()}; }
+
+inline bool would_block() noexcept { return errno == EAGAIN || errno == EWOULDBLOCK; }
+
+inline std::vector<uint8_t> string_reply(std::string_view text) {
+    std::vector<uint8_t> out;
+    ResponseSerializer::serialize_string(out, text);
+    return out;
+}
+
+template<typename T>
+std::optional<T> parse_number(std::string_view s) {
+    T value;
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    if (ec != std::errc{} || ptr != s.data() + s.size()) return std::nullopt;
+    return value;
+}
+
+} // namespace repl_detail
+
+// The last capacity() bytes of a shard's stream. Offsets are absolute stream positions; [start, end)
+// is what is still held.
+class ReplicationBacklog {
+public:
+    explicit ReplicationBacklog(size_t capacity) : buf_(std::max<size_t>(capacity, 1)) {}
+
+    void append(std::span<const uint8_t> data) {
+        uint64_t total = data.size();
+        if (data.size() > buf_.size()) data = data.last(buf_.size()); // only the tail survives anyway
+        size_t pos = static_cast<size_t>((end_ + total - data.size()) % buf_.size());
+        size_t first = std::min(data.size(), buf_.size() - pos);
+        std::memcpy(buf_.data() + pos, data.data(), first);
+        std::memcpy(buf_.data(), data.data() + first, data.size() - first);
+        end_ += total;
+    }
+
+    [[nodiscard]] uint64_t start() const noexcept { return end_ > buf_.size() ? end_ - buf_.size() : 0; }
+    [[nodiscard]] uint64_t end() const noexcept { return end_; }
+    [[nodiscard]] size_t capacity() const noexcept { return buf_.size(); }
+    [[nodiscard]] bool covers(uint64_t offset) const noexcept { return offset >= start() && offset <= end_; }
+
+    // [from, end) as at most two pieces of the ring, oldest first. `from` must be covered.
+    [[nodiscard]] std::array<std::span<const uint8_t>, 2> since(uint64_t from) const noexcept {
+        size_t len = static_cast<size_t>(end_ - from);
+        size_t pos = static_cast<size_t>(from % buf_.size());
+        size_t first = std::min(len, buf_.size() - pos);
+        return {std::span<const uint8_t>(buf_.data() + pos, first), std::span<const uint8_t>(buf_.data(), len - first)};
+    }
+
+private:
+    std::vector<uint8_t> buf_;
+    uint64_t end_{0};
+};
+
+// The primary's end of one replica connection: the handshake reply, then the snapshot for a full resync
+// (sendfile from the page cache), then the stream out of the backlog. Never blocks; pump() reports when
+// the socket is full and the owner should wait for it to become writable.
+class ReplicaLink {
+public:
+    enum class State : uint8_t {
+        WaitingSnapshot, // full resync: the snapshot it will get is still being written
+        SendingSnapshot,
+        Streaming
+    };
+
+    // A partial resync, streaming from `offset` right after the CONTINUE reply.
+    ReplicaLink(Socket socket, std::string_view replid, uint64_t offset)
+        : socket_(std::move(socket)), state_(State::Streaming),
+          head_(repl_detail::string_reply(std::string("CONTINUE ").append(replid))), offset_(offset) {}
+
+    // A full resync; send_snapshot() follows once the snapshot is on disk.
+    explicit ReplicaLink(Socket socket) : socket_(std::move(socket)), state_(State::WaitingSnapshot) {}
+
+    ~ReplicaLink() { if (file_fd_ != -1) ::close(file_fd_); }
+    ReplicaLink(const ReplicaLink&) = delete;
+    ReplicaLink& operator=(const ReplicaLink&) = delete;
+
+    [[nodiscard]] int fd() const noexcept { return socket_.get(); }
+    [[nodiscard]] State state() const noexcept { return state_; }
+    [[nodiscard]] uint64_t offset() const noexcept { return offset_; }
+
+    // Takes `file_fd` (even on failure), the snapshot of the moment the stream stood at `offset`.
+    Result<void> send_snapshot(int file_fd, std::string_view replid, uint64_t offset) {
+        file_fd_ = file_fd;
+        struct stat st{};
+        if (::fstat(file_fd_, &st) < 0) return std::unexpected(repl_detail::last_errno());
+        file_size_ = st.st_size;
+        offset_ = offset;
+        head_ = repl_detail::string_reply(std::format("FULLRESYNC {} {} {}", replid, offset, file_size_));
+        state_ = State::SendingSnapshot;
+        return {};
+    }
+
+    // Sends whatever is due until done or the socket is full; returns true in the latter case. Fails when
+    // the replica went away or the backlog no longer holds its position.
+    Result<bool> pump(const ReplicationBacklog& backlog) {
+        while (head_pos_ < head_.size()) {
+            ssize_t n = ::send(fd(), head_.data() + head_pos_, head_.size() - head_pos_, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (repl_detail::would_block()) return true;
+                return std::unexpected(repl_detail::last_errno());
+            }
+            head_pos_ += static_cast<size_t>(n);
+        }
+        if (state_ == State::WaitingSnapshot) return false;
+        if (state_ == State::SendingSnapshot) {
+            while (file_pos_ < file_size_) {
+                ssize_t n = ::sendfile(fd(), file_fd_, &file_pos_, static_cast<size_t>(file_size_ - file_pos_));
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    if (repl_detail::would_block()) return true;
+                    return std::unexpected(repl_detail::last_errno());
+                }
+                if (n == 0) return std::unexpected(std::make_error_code(std::errc::io_error)); // file shrank
+            }
+            ::close(std::exchange(file_fd_, -1));
+            state_ = State::Streaming;
+        }
+        while (offset_ < backlog.end()) {
+            if (!backlog.covers(offset_)) return std::unexpected(std::make_error_code(std::errc::no_buffer_space));
+            auto parts = backlog.since(offset_);
+            std::array<iovec, 2> iov{{{const_cast<uint8_t*>(parts[0].data()), parts[0].size()},
+                                      {const_cast<uint8_t*>(parts[1].data()), parts[1].size()}}};
+            msghdr msg{};
+            msg.msg_iov = iov.data();
+            msg.msg_iovlen = parts[1].empty() ? 1 : 2;
+            ssize_t n = ::sendmsg(fd(), &msg, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (repl_detail::would_block()) return true;
+                return std::unexpected(repl_detail::last_errno());
+            }
+            offset_ += static_cast<uint64_t>(n);
+        }
+        return false;
+    }
+
+    // Replicas don't talk after the handshake; reading only notices the disconnect.
+    Result<void> drain_input() {
+        std::array<uint8_t, 512> scratch;
+        while (true) {
+            ssize_t n = ::recv(fd(), scratch.data(), scratch.size(), 0);
+            if (n > 0) continue;
+            if (n == 0) return std::unexpected(std::make_error_code(std::errc::connection_reset));
+            if (errno == EINTR) continue;
+            if (repl_detail::would_block()) return {};
+            return std::unexpected(repl_detail::last_errno());
+        }
+    }
+
+    // Level-triggered backends only: whether EVENT_WRITE is currently registered for the socket.
+    [[nodiscard]] bool write_armed() const noexcept { return write_armed_; }
+    void set_write_armed(bool armed) noexcept { write_armed_ = armed; }
+
+private:
+    Socket socket_;
+    State state_;
+    std::vector<uint8_t> head_; // handshake reply
+    size_t head_pos_{0};
+    int file_fd_{-1};
+    off_t file_pos_{0};
+    off_t file_size_{0};
+    uint64_t offset_{0};        // next stream byte to send
+    bool write_armed_{false};
+};
+
+// A replica shard's connection to the primary. The owner calls connect() when due(), then on_event() for
+// every readiness event; the client drives the handshake and hands the owner what arrives through
+//   apply(const ArgList&)                      one stream command
+//   load(const std::string& path) -> bool      replace the keyspace with the snapshot at `path`
+// Any failure closes the connection and schedules a reconnect; the replication id and offset survive it,
+// so the next handshake asks for a partial resync.
+class ReplicaClient {
+public:
+    enum class State : uint8_t { Idle, Connecting, Handshake, Loading, Streaming };
+
+    static constexpr std::chrono::milliseconds k_retry_interval{1000};
+
+    ReplicaClient(std::string host, uint16_t port, uint32_t shard, uint32_t shard_count, std::string snapshot_path)
+        : host_(std::move(host)), port_(port), shard_(shard), shard_count_(shard_count),
+          snapshot_path_(std::move(snapshot_path)) {}
+
+    ~ReplicaClient() { close_file(); }
+    ReplicaClient(const ReplicaClient&) = delete;
+    ReplicaClient& operator=(const ReplicaClient&) = delete;
+
+    [[nodiscard]] int fd() const noexcept { return socket_.get(); }
+    [[nodiscard]] State state() const noexcept { return state_; }
+    [[nodiscard]] uint64_t offset() const noexcept { return offset_; }
+    [[nodiscard]] bool due() const noexcept {
+        return state_ == State::Idle && std::chrono::steady_clock::now() >= retry_at_;
+    }
+    // Only while connecting is there anything to write.
+    [[nodiscard]] bool wants_write() const noexcept { return state_ == State::Connecting; }
+
+    // Starts a non-blocking connect; the socket is fd() until the next failure.
+    Result<void> connect() {
+        retry_at_ = std::chrono::steady_clock::now() + k_retry_interval;
+        auto sock = connect_nonblocking(host_, port_);
+        if (!sock) return std::unexpected(sock.error());
+        socket_ = std::move(*sock);
+        state_ = State::Connecting;
+        return {};
+    }
+
+    template<typename Apply, typename Load>
+    Result<void> on_event(Apply&& apply, Load&& load) {
+        if (state_ == State::Connecting) {
+            if (auto res = connect_result(socket_); !res) return fail(res.error());
+            if (auto res = send_psync(); !res) return fail(res.error());
+            state_ = State::Handshake;
+        }
+        while (true) {
+            if (rbuf_.size() - rend_ < k_read_chunk) rbuf_.resize(rend_ + k_read_chunk);
+            ssize_t n = ::recv(fd(), rbuf_.data() + rend_, rbuf_.size() - rend_, 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (repl_detail::would_block()) return {};
+                return fail(repl_detail::last_errno());
+            }
+            if (n == 0) return fail(std::make_error_code(std::errc::connection_reset));
+            rend_ += static_cast<size_t>(n);
+            if (auto res = consume(apply, load); !res) return fail(res.error());
+        }
+    }
+
+    // Drops the connection (the owner has already unregistered it) and schedules the reconnect.
+    void reset() {
+        socket_ = Socket(-1);
+        close_file();
+        state_ = State::Idle;
+        rpos_ = rend_ = 0;
+        retry_at_ = std::chrono::steady_clock::now() + k_retry_interval;
+    }
+
+    [[nodiscard]] std::error_code last_error() const noexcept { return error_; }
+
+private:
+    static constexpr size_t k_read_chunk = 64 * 1024;
+    static constexpr size_t k_max_reply = 256; // the handshake reply is one short line
+
+    std::string host_;
+    uint16_t port_;
+    uint32_t shard_;
+    uint32_t shard_count_;
+    std::string snapshot_path_;
+    Socket socket_{-1};
+    State state_{State::Idle};
+    std::chrono::steady_clock::time_point retry_at_{};
+    std::error_code error_;
+    std::string replid_{"?"};
+    uint64_t offset_{0};
+    // Full resync in progress: where the stream starts once the snapshot is loaded.
+    std::string pending_replid_;
+    uint64_t pending_offset_{0};
+    uint64_t snapshot_left_{0};
+    int file_fd_{-1};
+    std::vector<uint8_t> rbuf_;
+    size_t rpos_{0};
+    size_t rend_{0};
+
+    Result<void> fail(std::error_code ec) {
+        error_ = ec;
+        return std::unexpected(ec);
+    }
+
+    void close_file() {
+        if (file_fd_ != -1) ::close(std::exchange(file_fd_, -1));
+    }
+
+    Result<void> send_psync() {
+        std::vector<uint8_t> frame;
+        std::string shard = std::to_string(shard_), count = std::to_string(shard_count_), offset = std::to_string(offset_);
+        RequestParser::encode(frame, {"psync", shard, count, replid_, offset});
+        // A fresh socket's send buffer takes a few dozen bytes whole.
+        ssize_t n = ::send(fd(), frame.data(), frame.size(), MSG_NOSIGNAL);
+        if (n < 0) return std::unexpected(repl_detail::last_errno());
+        if (static_cast<size_t>(n) != frame.size()) return std::unexpected(std::make_error_code(std::errc::io_error));
+        return {};
+    }
+
+    template<typename Apply, typename Load>
+    Result<void> consume(Apply& apply, Load& load) {
+        while (rpos_ < rend_) {
+            std::span<const uint8_t> data(rbuf_.data() + rpos_, rend_ - rpos_);
+            if (state_ == State::Handshake) {
+                auto used = handshake(data);
+                if (!used) return std::unexpected(used.error());
+                if (*used == 0) break;
+                rpos_ += *used;
+            } else if (state_ == State::Loading) {
+                size_t n = static_cast<size_t>(std::min<uint64_t>(snapshot_left_, data.size()));
+                if (n > 0) {
+                    if (auto ec = write_file(data.first(n)); ec) return std::unexpected(ec);
+                    rpos_ += n;
+                    snapshot_left_ -= n;
+                }
+                if (snapshot_left_ == 0) {
+                    close_file();
+                    bool ok = load(snapshot_path_);
+                    ::unlink(snapshot_path_.c_str());
+                    if (!ok) return std::unexpected(std::make_error_code(std::errc::invalid_argument));
+                    replid_ = std::move(pending_replid_);
+                    offset_ = pending_offset_;
+                    state_ = State::Streaming;
+                }
+            } else {
+                auto frame = RequestParser::parse_next(data, RequestParser::k_trusted);
+                if (!frame) return std::unexpected(frame.error());
+                if (frame->consumed == 0) break;
+                apply(frame->args);
+                rpos_ += frame->consumed;
+                offset_ += frame->consumed;
+            }
+        }
+        // Keep only the unconsumed tail, at the front.
+        std::memmove(rbuf_.data(), rbuf_.data() + rpos_, rend_ - rpos_);
+        rend_ -= rpos_;
+        rpos_ = 0;
+        return {};
+    }
+
+    // Parses the one-line reply; returns the bytes it took, 0 while incomplete.
+    Result<size_t> handshake(std::span<const uint8_t> data) {
+        auto bad = [] { return std::unexpected(std::make_error_code(std::errc::protocol_error)); };
+        const size_t prefix = 1 + sizeof(uint32_t); // [tag][u32 len] for a String
+        auto tag = static_cast<ds::SerializationType>(data[0]);
+        if (tag == ds::SerializationType::Error) return std::unexpected(std::make_error_code(std::errc::connection_refused));
+        if (tag != ds::SerializationType::String) return bad();
+        if (data.size() < prefix) return 0;
+        uint32_t len;
+        std::memcpy(&len, data.data() + 1, sizeof(len));
+        if (len > k_max_reply) return bad();
+        if (data.size() < prefix + len) return 0;
+        std::string_view text(reinterpret_cast<const char*>(data.data() + prefix), len);
+
+        std::vector<std::string_view> words;
+        for (size_t pos = 0; pos <= text.size();) {
+            size_t space = std::min(text.find(' ', pos), text.size());
+            words.push_back(text.substr(pos, space - pos));
+            pos = space + 1;
+        }
+        if (words.size() == 2 && words[0] == "CONTINUE" && words[1] == replid_) {
+            state_ = State::Streaming;
+        } else if (words.size() == 4 && words[0] == "FULLRESYNC") {
+            auto offset = repl_detail::parse_number<uint64_t>(words[2]);
+            auto size = repl_detail::parse_number<uint64_t>(words[3]);
+            if (!offset || !size) return bad();
+            file_fd_ = ::open(snapshot_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (file_fd_ < 0) return std::unexpected(repl_detail::last_errno());
+            pending_replid_ = words[1];
+            pending_offset_ = *offset;
+            snapshot_left_ = *size;
+            state_ = State::Loading;
+        } else {
+            return bad();
+        }
+        return prefix + len;
+    }
+
+    std::error_code write_file(std::span<const uint8_t> data) {
+        while (!data.empty()) {
+            ssize_t n = ::write(file_fd_, data.data(), data.size());
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return repl_detail::last_errno();
+            }
+            data = data.subspan(static_cast<size_t>(n));
+        }
+        return {};
+    }
+};
+
+#endif // REPLICATION_HPP
@@ -1,35 +1,137 @@
 #ifndef REQUEST_PARSER_HPP
 #define REQUEST_PARSER_HPP
 
+#include <array>
 #include <expected>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <span>
 #include <cstring>
+#include <initializer_list>
 #include <system_error>
+#include "common.hpp"
+
+// Arguments of one command as views into the connection's read buffer. The first
+// k_inline_capacity views live inline, so typical commands parse without touching the allocator;
+// only unusually wide commands spill to the heap. The views stay valid until the connection
+// reads again, which is after the command's response has been written into wbuf_ - anything that
+// must outlive that (a cross-shard hop, a log record) has to copy.
+class ArgList {
+public:
+    static constexpr size_t k_inline_capacity = 8;
+
+    ArgList() = default;
+
+    void push_back(std::string_view arg) {
+        if (size_ < k_inline_capacity) {
+            inline_[size_++] = arg;
+            return;
+        }
+        if (overflow_.empty()) {
+            overflow_.reserve(k_inline_capacity * 2);
+            overflow_.assign(inline_.begin(), inline_.end());
+        }
+        overflow_.push_back(arg);
+        ++size_;
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+
+    [[nodiscard]] const std::string_view* data() const noexcept {
+        return overflow_.empty() ? inline_.data() : overflow_.data();
+    }
+    [[nodiscard]] std::string_view operator[](size_t i) const noexcept { return data()[i]; }
+    [[nodiscard]] const std::string_view* begin() const noexcept { return data(); }
+    [[nodiscard]] const std::string_view* end() const noexcept { return data() + size_; }
+
+    // Views over strings someone else owns, e.g. a forwarded ShardMessage or one command of a queued transaction.
+    static ArgList of(std::span<const std::string> owned) {
+        ArgList args;
+        for (const auto& s : owned) args.push_back(s);
+        return args;
+    }
+
+    [[nodiscard]] std::vector<std::string> to_owned() const {
+        return std::vector<std::string>(begin(), end());
+    }
+
+private:
+    std::array<std::string_view, k_inline_capacity> inline_{};
+    std::vector<std::string_view> overflow_;
+    size_t size_{0};
+};
+
+// One frame pulled off the front of a buffer. consumed == 0 means the buffer only holds a partial
+// frame and the caller should wait for more bytes; nothing has been parsed in that case.
+struct ParsedFrame {
+    ArgList args;
+    size_t consumed{0};
+};
 
 class RequestParser {
 public:
+    static constexpr size_t k_header_size = sizeof(uint32_t);
+
+    // Owning mode: copies every argument out, for callers that keep the command around.
     static std::expected<std::vector<std::string>, std::error_code> parse(std::span<const uint8_t> data) {
-        if (data.size() < sizeof(uint32_t)) {
+        auto frame = parse_next(data);
+        if (!frame) {
+            return std::unexpected(frame.error());
+        }
+        if (frame->consumed == 0) {
             return std::unexpected(std::make_error_code(std::errc::message_size));
         }
+        return frame->args.to_owned();
+    }
+
+    // The inverse, for commands the server sends itself (the command log, replication, slot migration):
+    // appends `args` to `out` as one frame.
+    static void encode(std::vector<uint8_t>& out, std::span<const std::string_view> args) {
+        size_t len = 0;
+        for (std::string_view arg : args) len += sizeof(uint32_t) + arg.size();
+        put_u32(out, static_cast<uint32_t>(len));
+        for (std::string_view arg : args) {
+            put_u32(out, static_cast<uint32_t>(arg.size()));
+            out.insert(out.end(), arg.begin(), arg.end());
+        }
+    }
+
+    static void encode(std::vector<uint8_t>& out, std::initializer_list<std::string_view> args) {
+        encode(out, std::span(args.begin(), args.size()));
+    }
+
+    // No size limit beyond the u32 length: for streams the server wrote itself (the command log, a
+    // primary's feed), whose frames were vetted when the commands arrived.
+    static constexpr size_t k_trusted = UINT32_MAX;
+
+    // Zero-copy mode: parses the first complete frame in `data` into views over `data` itself.
+    // Errors are reserved for frames that can never become valid (longer than `max_len`, or malformed),
+    // so a pipelining caller can simply loop until consumed == 0 and keep the partial tail.
+    static std::expected<ParsedFrame, std::error_code> parse_next(std::span<const uint8_t> data, size_t max_len = MAX_MSG_SIZE) {
+        if (data.size() < k_header_size) {
+            return ParsedFrame{};
+        }
 
         uint32_t len;
         std::memcpy(&len, data.data(), sizeof(uint32_t));
-        if (len > 4096) {
+        if (len > max_len) {
             return std::unexpected(std::make_error_code(std::errc::message_size));
         }
 
-        if (sizeof(uint32_t) + len > data.size()) {
-            return std::unexpected(std::make_error_code(std::errc::message_size));
+        if (k_header_size + len > data.size()) {
+            return ParsedFrame{};
         }
 
-        std::vector<std::string> cmd;
-        const uint8_t* pos = data.data() + sizeof(uint32_t);
+        ParsedFrame frame;
+        const uint8_t* pos = data.data() + k_header_size;
         const uint8_t* end = pos + len;
 
         while (pos < end) {
+            if (static_cast<size_t>(end - pos) < sizeof(uint32_t)) {
+                return std::unexpected(std::make_error_code(std::errc::bad_message));
+            }
             uint32_t str_len;
             std::memcpy(&str_len, pos, sizeof(uint32_t));
             pos += sizeof(uint32_t);
@@ -38,11 +140,18 @@ public:
                 return std::unexpected(std::make_error_code(std::errc::bad_message));
             }
 
-            cmd.emplace_back(reinterpret_cast<const char*>(pos), str_len);
+            frame.args.push_back(std::string_view(reinterpret_cast<const char*>(pos), str_len));
             pos += str_len;
         }
 
-        return cmd;
+        frame.consumed = k_header_size + len;
+        return frame;
+    }
+
+private:
+    static void put_u32(std::vector<uint8_t>& out, uint32_t v) {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(&v);
+        out.insert(out.end(), bytes, bytes + sizeof(v));
     }
 };
 
@@ -2,26 +2,139 @@
 #define RESPONSE_SERIALIZER_HPP
 
 #include <vector>
+#include <string>
 #include <string_view>
 #include <cstdint>
+#include <cstring>
+#include <span>
+#include "../common.hpp"
 
+enum class ErrorCode : uint32_t {
+    Unknown  = 1, // unknown command
+    Arity    = 2, // wrong number of arguments
+    Type     = 3, // operation against a key holding the wrong kind of value
+    Argument = 4, // malformed argument (not a number, ...)
+    Busy     = 5, // can't run now (e.g. a snapshot is already in progress)
+    ReadOnly = 6, // a write sent to a replica
+    // Cluster mode (see cluster.hpp)
+    Moved       = 7,  // the slot is served by another node, named in the message
+    Ask         = 8,  // this one command goes to the node in the message, after ASKING
+    TryAgain    = 9,  // the key is being migrated right now
+    CrossSlot   = 10, // keys of one command in different slots
+    ClusterDown = 11, // no node serves the slot
+    OutOfMemory = 12, // over maxmemory and nothing (more) can be evicted
+    Io          = 13, // a value in the cold tier could not be read back
+    ExecAbort   = 14  // EXEC of a transaction that had a command refused while it was queued
+};
+
+// Every reply is one tagged value, written straight into the connection's wbuf_:
+//   Nil     [tag]
+//   Error   [tag][u32 code][u32 len][msg]
+//   String  [tag][u32 len][bytes]
+//   Integer [tag][i64]
+//   Double  [tag][f64]
+//   Array   [tag][u32 n][n values]
+// Values are self-delimiting, so pipelined replies can be concatenated with no extra framing.
 class ResponseSerializer {
 public:
+    using SerializationType = ds::SerializationType;
+
     template<typename T>
     static void serialize(std::vector<uint8_t>& buffer, const T& data) {
         buffer.push_back(static_cast<uint8_t>(SerializationType::Integer));
         append_data(buffer, static_cast<int64_t>(data));
     }
 
+    static void serialize_nil(std::vector<uint8_t>& buffer) {
+        buffer.push_back(static_cast<uint8_t>(SerializationType::Nil));
+    }
+
     static void serialize_string(std::vector<uint8_t>& buffer, std::string_view str) {
         buffer.push_back(static_cast<uint8_t>(SerializationType::String));
         append_data(buffer, static_cast<uint32_t>(str.size()));
         buffer.insert(buffer.end(), str.begin(), str.end());
     }
 
-private:
-    enum class SerializationType : uint8_t { Nil, Integer, String };
+    // Just [tag][u32 len]: the caller sends the `size` bytes themselves some other way (Connection::splice).
+    static void serialize_string_header(std::vector<uint8_t>& buffer, size_t size) {
+        buffer.push_back(static_cast<uint8_t>(SerializationType::String));
+        append_data(buffer, static_cast<uint32_t>(size));
+    }
+
+    static void serialize_double(std::vector<uint8_t>& buffer, double value) {
+        buffer.push_back(static_cast<uint8_t>(SerializationType::Double));
+        append_data(buffer, value);
+    }
+
+    static void serialize_error(std::vector<uint8_t>& buffer, ErrorCode code, std::string_view msg) {
+        buffer.push_back(static_cast<uint8_t>(SerializationType::Error));
+        append_data(buffer, static_cast<uint32_t>(code));
+        append_data(buffer, static_cast<uint32_t>(msg.size()));
+        buffer.insert(buffer.end(), msg.begin(), msg.end());
+    }
 
+    // Cluster redirection, an error whose message the client acts on: "MOVED <slot> <host>:<port>" or
+    // "ASK <slot> <host>:<port>".
+    static void serialize_redirect(std::vector<uint8_t>& buffer, ErrorCode code, uint32_t slot, std::string_view address) {
+        std::string msg = code == ErrorCode::Moved ? "MOVED " : "ASK ";
+        msg.append(std::to_string(slot)).append(" ").append(address);
+        serialize_error(buffer, code, msg);
+    }
+
+    static void serialize_array_header(std::vector<uint8_t>& buffer, uint32_t count) {
+        buffer.push_back(static_cast<uint8_t>(SerializationType::Array));
+        append_data(buffer, count);
+    }
+
+    // For arrays whose length is only known after walking the data: reserve the count, patch it later.
+    [[nodiscard]] static size_t begin_array(std::vector<uint8_t>& buffer) {
+        serialize_array_header(buffer, 0);
+        return buffer.size() - sizeof(uint32_t);
+    }
+
+    static void end_array(std::vector<uint8_t>& buffer, size_t pos, uint32_t count) {
+        std::memcpy(buffer.data() + pos, &count, sizeof(count));
+    }
+
+    // The other direction, for the server's own client connections (slot migration), for reassembling an
+    // MGET split across shards and for kvbench:
+    // length of the complete reply value at the front of `data`, 0 if it isn't all there yet.
+    [[nodiscard]] static size_t reply_length(std::span<const uint8_t> data) {
+        if (data.empty()) return 0;
+        auto u32_at = [&data](size_t pos) {
+            uint32_t v;
+            std::memcpy(&v, data.data() + pos, sizeof(v));
+            return v;
+        };
+        switch (static_cast<SerializationType>(data[0])) {
+            case SerializationType::Nil: return 1;
+            case SerializationType::Integer:
+            case SerializationType::Double: return data.size() >= 9 ? 9 : 0;
+            case SerializationType::String: {
+                if (data.size() < 5) return 0;
+                size_t n = 5 + u32_at(1);
+                return data.size() >= n ? n : 0;
+            }
+            case SerializationType::Error: {
+                if (data.size() < 9) return 0;
+                size_t n = 9 + u32_at(5);
+                return data.size() >= n ? n : 0;
+            }
+            case SerializationType::Array: {
+                if (data.size() < 5) return 0;
+                size_t pos = 5;
+                for (uint32_t i = 0, count = u32_at(1); i < count; ++i) {
+                    size_t n = reply_length(data.subspan(pos));
+                    if (n == 0) return 0;
+                    pos += n;
+                }
+                return pos;
+            }
+        }
+        return 0;
+    }
+
+private:
     template<typename T>
     static void append_data(std::vector<uint8_t>& buffer, const T& data) {
         const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&data);
@@ -1,45 +1,146 @@
 #ifndef SERVER_HPP
 #define SERVER_HPP
 
-#include <unordered_map>
+#include <csignal>
 #include <memory>
+#include <string>
 #include <thread>
-#include <shared_mutex>
-#include <poll.h>
+#include <atomic>
+#include <vector>
 #include "socket.hpp"
-#include "connection.hpp"
-#include "server_state.hpp"
-#include "command_processor.hpp"
+#include "reactor.hpp"
+#include "event_loop.hpp"
+#include "logging.hpp"
+#include "metrics_endpoint.hpp"
+#include "metrics_report.hpp"
+#include "topology.hpp"
+#include "../thread_pool.hpp"
 
+// Owns the reactors. With reactor_count == 1 this is the classic single event loop running on the
+// caller's thread; with N > 1 it is shared-nothing: N loops, each with its own listener on the same
+// port (SO_REUSEPORT), connection table and keyspace shard, talking only through SPSC inboxes.
+// `affinity` optionally pins each reactor and the background workers to cores (see AffinityConfig).
 class Server {
 public:
-    Server(uint16_t port, size_t thread_pool_size) 
-        : port_(port), thread_pool_(thread_pool_size) {}
+    Server(uint16_t port, size_t thread_pool_size, EventBackendKind backend = default_event_backend(),
+           size_t reactor_count = 1, AffinityConfig affinity = {})
+        : port_(port), backend_kind_(backend), reactor_count_(std::max<size_t>(reactor_count, 1)),
+          topology_(affinity.pin_threads ? CpuTopology::detect() : CpuTopology{}),
+          affinity_(plan_placement(std::move(affinity), topology_, reactor_count_)),
+          thread_pool_(std::make_unique<threading::ThreadPool>(thread_pool_size,
+              affinity_.pin_threads ? affinity_.worker_cpus : std::vector<int>{})) {}
+
+    // The background pool frees into the reactors' slab pools, so it has to finish first.
+    ~Server() { thread_pool_.reset(); }
 
     Result<void> initialize() {
-        listen_socket_ = Socket(socket(AF_INET, SOCK_STREAM, 0));
-        if (listen_socket_.get() < 0) {
-            return std::unexpected(std::make_error_code(std::errc::bad_file_descriptor));
+        // A peer that went away must show up as EPIPE on the socket, not kill the process: replies use
+        // plain write() and snapshots for replicas go out with sendfile(), neither of which takes MSG_NOSIGNAL.
+        std::signal(SIGPIPE, SIG_IGN);
+        metrics_endpoint_.reset();
+        reactors_.clear();
+        for (size_t i = 0; i < reactor_count_; ++i) {
+            reactors_.push_back(std::make_unique<Reactor>(static_cast<uint32_t>(i),
+                static_cast<uint32_t>(reactor_count_), port_, backend_kind_, thread_pool_.get()));
+            if (affinity_.pin_threads && i < affinity_.reactor_cpus.size()) {
+                reactors_.back()->set_placement(placement_for(i));
+            }
+            reactors_.back()->set_data_dir(data_dir_);
+            reactors_.back()->set_append_only(aof_config_);
+            reactors_.back()->set_replication(repl_config_, replid_);
+            reactors_.back()->set_eviction(eviction_config_);
+            reactors_.back()->set_cold_tier(cold_config_);
+            reactors_.back()->set_client_limits(client_limits_);
+            if (cluster_config_.enabled) reactors_.back()->set_cluster(ClusterNode{cluster_config_.announce_host, port_});
+        }
+
+        std::vector<Reactor*> peers;
+        for (auto& reactor : reactors_) peers.push_back(reactor.get());
+        for (auto& reactor : reactors_) {
+            reactor->connect_peers(peers);
+            if (auto res = reactor->initialize(); !res) return res;
+        }
+        if (metrics_port_ != 0) {
+            metrics_endpoint_ = std::make_unique<MetricsEndpoint>(metrics_port_, [this] { return prometheus_text(); });
+            if (auto res = metrics_endpoint_->start(); !res) return res;
         }
         return {};
     }
 
+    // Blocks until stop(). Reactor 0 runs on the calling thread, the rest get one thread each.
     void run() {
-        std::vector<pollfd> poll_args;
-        while (!should_stop_) {
-            prepare_poll_args(poll_args);
-            poll(poll_args.data(), poll_args.size(), 5000);
-            process_active_connections(poll_args);
+        std::vector<std::jthread> threads;
+        for (size_t i = 1; i < reactors_.size(); ++i) {
+            threads.emplace_back([this, i] { reactors_[i]->run(should_stop_); });
         }
+        reactors_[0]->run(should_stop_);
+    }
+
+    void stop() {
+        should_stop_ = true;
+        for (auto& reactor : reactors_) reactor->notify();
     }
 
-    void stop() { should_stop_ = true; }
+    // Directory for the per-shard snapshot files (BGSAVE writes them, startup loads them). Before initialize().
+    void set_data_dir(std::string dir) { data_dir_ = std::move(dir); }
+    // Append-only command log per shard, in the data dir (see append_log.hpp). Before initialize().
+    void set_append_only(const AofConfig& config) { aof_config_ = config; }
+    // Follow a primary (see replication.hpp): same shard count on both sides. Before initialize().
+    void set_replication(const ReplicationConfig& config) { repl_config_ = config; }
+    // Memory limit and eviction policy (see eviction.hpp), split evenly over the shards. Before initialize().
+    void set_eviction(const EvictionConfig& config) { eviction_config_ = config; }
+    // Spill evicted string values to segment files in the data dir instead of dropping them (see
+    // cold_tier.hpp). Only matters with a memory limit. Before initialize().
+    void set_cold_tier(const ColdTierConfig& config) { cold_config_ = config; }
+    // Request size and output buffer limits per client (see ClientLimits). Before initialize().
+    void set_client_limits(const ClientLimits& limits) { client_limits_ = limits; }
+    // Serve only the hash slots the cluster map gives this node (see cluster.hpp). Before initialize().
+    void set_cluster(const ClusterConfig& config) { cluster_config_ = config; }
+    // Prometheus scrapes at http://<host>:<port>/metrics (see metrics_endpoint.hpp); 0, the default, for
+    // none. Before initialize().
+    void set_metrics_port(uint16_t port) noexcept { metrics_port_ = port; }
+
+    // What the metrics endpoint serves, from any thread.
+    [[nodiscard]] std::string prometheus_text() const {
+        std::vector<const ReactorMetrics*> all;
+        for (const auto& reactor : reactors_) all.push_back(&reactor->metrics());
+        ServerInfo info{port_, repl_config_.primary_host.empty() ? "primary" : "replica", started_};
+        return MetricsReport::prometheus(info, all);
+    }
+
+    [[nodiscard]] size_t reactor_count() const noexcept { return reactor_count_; }
+    [[nodiscard]] const AffinityConfig& affinity() const noexcept { return affinity_; }
 
 private:
     uint16_t port_;
-    Socket listen_socket_{-1};
+    EventBackendKind backend_kind_;
+    size_t reactor_count_;
+    CpuTopology topology_;
+    AffinityConfig affinity_; // after plan_placement(): every list filled in when pinning
+    std::string data_dir_{"."};
+    AofConfig aof_config_;
+    ReplicationConfig repl_config_;
+    ClusterConfig cluster_config_;
+    EvictionConfig eviction_config_;
+    ColdTierConfig cold_config_;
+    ClientLimits client_limits_;
+    std::string replid_{make_replication_id()}; // this run, as replicas know it
+    std::unique_ptr<threading::ThreadPool> thread_pool_; // background work: lazy freeing
     std::atomic<bool> should_stop_{false};
-    std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+    std::vector<std::unique_ptr<Reactor>> reactors_;
+    uint16_t metrics_port_{0};
+    std::chrono::steady_clock::time_point started_{std::chrono::steady_clock::now()};
+    std::unique_ptr<MetricsEndpoint> metrics_endpoint_; // after reactors_: stops reading them before they go
+
+    [[nodiscard]] Reactor::Placement placement_for(size_t i) const {
+        Reactor::Placement placement;
+        placement.cpu = affinity_.reactor_cpus[i];
+        if (affinity_.numa_local_memory && topology_.nodes().size() > 1) {
+            placement.numa_node = topology_.node_of(placement.cpu).value_or(-1);
+        }
+        placement.steer_incoming_cpu = affinity_.steer_incoming_cpu;
+        return placement;
+    }
 };
 
-#endif 
+#endif
@@ -5,6 +5,8 @@
 #include "connection.hpp"
 #include <unordered_map>
 #include <shared_mutex>
+#include <mutex>
+#include <memory>
 
 class ServerState {
 public:
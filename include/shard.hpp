@@ -0,0 +1,40 @@
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include <cstdint>
+#include <string_view>
+#include "cluster.hpp"
+#include "keyspace.hpp"
+#include "../slab_allocator.hpp"
+
+// One partition of the keyspace. Each shard is owned by exactly one reactor thread, so nothing in
+// here is locked - other reactors reach it only by posting a message to the owner.
+class Shard {
+public:
+    Shard(uint32_t id, uint32_t count) noexcept : id_(id), count_(count) {}
+
+    Shard(const Shard&) = delete;
+    Shard& operator=(const Shard&) = delete;
+
+    [[nodiscard]] uint32_t id() const noexcept { return id_; }
+    [[nodiscard]] uint32_t count() const noexcept { return count_; }
+    [[nodiscard]] Keyspace& keyspace() noexcept { return keyspace_; }
+    // Entries and zset members of this shard are carved from here; the reactor installs it on its thread.
+    [[nodiscard]] ds::SlabPool& pool() noexcept { return pool_; }
+
+    // By hash slot, so each slot - and so each set of keys sharing a {tag} - lives on one shard. The slot
+    // comes from the high half of the hash: the tables index by the low bits, and routing on those would
+    // leave every shard using only 1/count of its buckets.
+    [[nodiscard]] uint32_t owner_of(std::string_view key) const noexcept {
+        return count_ == 1 ? 0 : owner_of_slot(key_slot(key));
+    }
+    [[nodiscard]] uint32_t owner_of_slot(uint32_t slot) const noexcept { return slot % count_; }
+
+private:
+    uint32_t id_;
+    uint32_t count_;
+    ds::SlabPool pool_; // declared before keyspace_ so it outlives every entry
+    Keyspace keyspace_;
+};
+
+#endif
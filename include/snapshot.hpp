@@ -0,0 +1,651 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "entry_manager.hpp"
+#include "../crc32c.hpp"
+#include "../thread_pool.hpp"
+
+// Point-in-time snapshot file, one per shard. All integers little-endian.
+//   header  "KVSNAP" u16 version, u32 shard, u32 shard_count, i64 created_unix_ms, u32 crc32c(header so far)
+//   frame   [u32 payload_len][u32 crc32c(payload)][payload], the payload being a run of whole records
+//   record  [u8 op][i64 expire_unix_ms if op & k_has_expiry][varint key_len][key][value]
+//           op & 0x7F is the value's wire tag: String  -> [varint len][bytes]
+//                                              Array   -> [varint n] n x ([varint len][name][f64 score])
+//                                              Nil     -> end of data: [u64 record count], last in its frame
+//   footer  u64 record count, u32 frame count, u32 crc32c(footer so far) - unframed, after the last frame
+// Records reuse the reply tags (ds::SerializationType), so a sorted set is the Array it would be sent as,
+// members in rank order. A file without its end record or footer, or with any frame failing its CRC, is
+// rejected as a whole. The footer lets a loader size the keyspace and split the frames up before parsing.
+namespace snapshot_format {
+
+inline constexpr char k_magic[6] = {'K', 'V', 'S', 'N', 'A', 'P'};
+inline constexpr uint16_t k_version = 3; // 3: keys placed on shards by hash slot
+inline constexpr size_t k_header_size = sizeof(k_magic) + 2 + 4 + 4 + 8 + 4;
+inline constexpr size_t k_frame_header = 8;
+inline constexpr size_t k_footer_size = 8 + 4 + 4;
+inline constexpr uint8_t k_has_expiry = 0x80;
+
+template<typename T>
+inline void put(std::vector<uint8_t>& out, T value) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+inline void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+inline void put_string(std::vector<uint8_t>& out, std::string_view s) {
+    put_varint(out, s.size());
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+// Bounds-checked reads over one frame's payload; any short read leaves ok() false for good.
+class Reader {
+public:
+    explicit Reader(std::span<const uint8_t> data) noexcept : data_(data) {}
+
+    template<typename T>
+    T get() noexcept {
+        T value{};
+        if (!take(sizeof(T))) return value;
+        std::memcpy(&value, data_.data() + pos_ - sizeof(T), sizeof(T));
+        return value;
+    }
+
+    uint64_t get_varint() noexcept {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (!take(1)) return 0;
+            uint8_t byte = data_[pos_ - 1];
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok_ = false;
+        return 0;
+    }
+
+    std::string_view get_string() noexcept {
+        uint64_t len = get_varint();
+        if (!ok_ || len > data_.size() - pos_) {
+            ok_ = false;
+            return {};
+        }
+        std::string_view s(reinterpret_cast<const char*>(data_.data() + pos_), static_cast<size_t>(len));
+        pos_ += static_cast<size_t>(len);
+        return s;
+    }
+
+    [[nodiscard]] bool ok() const noexcept { return ok_; }
+    [[nodiscard]] bool at_end() const noexcept { return pos_ == data_.size(); }
+
+private:
+    std::span<const uint8_t> data_;
+    size_t pos_{0};
+    bool ok_{true};
+
+    bool take(size_t n) noexcept {
+        if (!ok_ || n > data_.size() - pos_) {
+            ok_ = false;
+            return false;
+        }
+        pos_ += n;
+        return true;
+    }
+};
+
+inline std::error_code corrupt() { return std::make_error_code(std::errc::bad_message); }
+
+inline int64_t unix_ms_now() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// The unix time `ms` (>= 0) from now, and the ms from now until unix time `at_ms`, saturating: PEXPIRE
+// and PEXPIREAT take any int64, and a wrapped result would expire a key that should live.
+inline int64_t unix_ms_after(int64_t ms) {
+    int64_t now = unix_ms_now();
+    return ms > std::numeric_limits<int64_t>::max() - now ? std::numeric_limits<int64_t>::max() : now + ms;
+}
+
+inline int64_t ms_until_unix(int64_t at_ms) {
+    int64_t now = unix_ms_now();
+    return at_ms < std::numeric_limits<int64_t>::min() + now ? std::numeric_limits<int64_t>::min() : at_ms - now;
+}
+
+} // namespace snapshot_format
+
+inline std::string snapshot_path(std::string_view dir, uint32_t shard) {
+    return std::string(dir) + "/dump-" + std::to_string(shard) + ".kvs";
+}
+
+// Numbers for the snapshot in progress, or the last one once it has finished.
+struct SnapshotStats {
+    bool in_progress{false};
+    bool last_ok{true};
+    uint64_t keys{0};            // records written
+    uint64_t preserved{0};       // ... of which were written early, just before a write or delete reached them
+    uint64_t bytes{0};           // file size so far
+    uint64_t duration_ms{0};     // of the last completed snapshot
+    int64_t last_save_unix_ms{0};
+};
+
+// Encodes records into k_chunk_size frames and hands each full frame to the background pool, which writes
+// them to "<path>.tmp" strictly in order - the reactor never waits on the disk. finish() queues the end
+// record; the pool then fsyncs and renames the file into place, so `path` only ever holds a whole snapshot.
+// Without a pool (or once it is shutting down) frames are written inline.
+class SnapshotWriter {
+public:
+    static constexpr size_t k_chunk_size = size_t{1} << 20;
+    // Frames queued for the disk beyond which congested() asks the producer to pause.
+    static constexpr size_t k_max_queued = 64 * k_chunk_size;
+
+    static Result<std::unique_ptr<SnapshotWriter>> open(std::string path, uint32_t shard, uint32_t shard_count,
+                                                        threading::ThreadPool* io) {
+        auto sink = std::make_shared<Sink>();
+        sink->path = std::move(path);
+        sink->tmp_path = sink->path + ".tmp";
+        sink->fd = ::open(sink->tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (sink->fd < 0) return std::unexpected(std::error_code(errno, std::system_category()));
+        sink->io = io;
+
+        std::unique_ptr<SnapshotWriter> writer(new SnapshotWriter(std::move(sink)));
+        std::vector<uint8_t> header(std::begin(snapshot_format::k_magic), std::end(snapshot_format::k_magic));
+        header.reserve(snapshot_format::k_header_size);
+        snapshot_format::put(header, snapshot_format::k_version);
+        snapshot_format::put(header, shard);
+        snapshot_format::put(header, shard_count);
+        snapshot_format::put(header, snapshot_format::unix_ms_now());
+        snapshot_format::put(header, crc32c(header.data(), header.size()));
+        writer->bytes_ = header.size();
+        writer->sink_->push(std::move(header));
+        writer->start_frame();
+        return writer;
+    }
+
+    // Abandons an unfinished snapshot: whatever was written is unlinked once the pool gets to it.
+    ~SnapshotWriter() {
+        if (!finished_) sink_->close(true);
+    }
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    void add(const Entry& entry, std::optional<int64_t> expire_unix_ms) {
+        using ds::SerializationType;
+        size_t before = chunk_.size();
+        uint8_t op = static_cast<uint8_t>(entry.type == EntryType::ZSet ? SerializationType::Array : SerializationType::String);
+        chunk_.push_back(expire_unix_ms ? (op | snapshot_format::k_has_expiry) : op);
+        if (expire_unix_ms) snapshot_format::put(chunk_, *expire_unix_ms);
+        snapshot_format::put_string(chunk_, entry.key);
+        if (entry.type == EntryType::ZSet) {
+            const ds::ZSet& zset = *entry.zset;
+            snapshot_format::put_varint(chunk_, zset.size());
+            if (!zset.empty()) {
+                ds::ZCursor cursor = zset.range_by_rank(0, zset.size() - 1);
+                ds::ZMember batch[64];
+                while (size_t n = cursor.next_batch(batch)) {
+                    for (size_t i = 0; i < n; ++i) {
+                        snapshot_format::put_string(chunk_, batch[i].name);
+                        snapshot_format::put(chunk_, batch[i].score);
+                    }
+                }
+            }
+        } else {
+            snapshot_format::put_string(chunk_, entry.value);
+        }
+        records_++;
+        bytes_ += chunk_.size() - before;
+        if (chunk_.size() >= k_chunk_size) seal_frame();
+    }
+
+    // A string entry whose value is kept elsewhere (the cold tier) and was read back for this.
+    void add(const Entry& entry, std::optional<int64_t> expire_unix_ms, std::string_view value) {
+        size_t before = chunk_.size();
+        uint8_t op = static_cast<uint8_t>(ds::SerializationType::String);
+        chunk_.push_back(expire_unix_ms ? (op | snapshot_format::k_has_expiry) : op);
+        if (expire_unix_ms) snapshot_format::put(chunk_, *expire_unix_ms);
+        snapshot_format::put_string(chunk_, entry.key);
+        snapshot_format::put_string(chunk_, value);
+        records_++;
+        bytes_ += chunk_.size() - before;
+        if (chunk_.size() >= k_chunk_size) seal_frame();
+    }
+
+    // Queues the end record and the final frame; done() turns true once the file is in place (or failed).
+    void finish() {
+        if (finished_) return;
+        chunk_.push_back(static_cast<uint8_t>(ds::SerializationType::Nil));
+        snapshot_format::put(chunk_, records_);
+        bytes_ += 1 + sizeof(records_);
+        finished_ = true;
+        seal_frame();
+        std::vector<uint8_t> footer;
+        footer.reserve(snapshot_format::k_footer_size);
+        snapshot_format::put(footer, records_);
+        snapshot_format::put(footer, frames_);
+        snapshot_format::put(footer, crc32c(footer.data(), footer.size()));
+        bytes_ += footer.size();
+        sink_->push(std::move(footer));
+        sink_->close(false);
+    }
+
+    [[nodiscard]] bool congested() const noexcept {
+        return sink_->queued.load(std::memory_order_relaxed) > k_max_queued;
+    }
+    [[nodiscard]] bool done() const noexcept { return sink_->done.load(std::memory_order_acquire); }
+    // Only meaningful once done().
+    [[nodiscard]] Result<void> result() const {
+        if (sink_->error) return std::unexpected(sink_->error);
+        return {};
+    }
+
+    [[nodiscard]] uint64_t records() const noexcept { return records_; }
+    [[nodiscard]] uint64_t bytes() const noexcept { return bytes_; }
+
+private:
+    // Shared with the pool tasks, so a writer dropped mid-flight doesn't pull the file out from under them.
+    struct Sink : std::enable_shared_from_this<Sink> {
+        int fd{-1};
+        std::string path;
+        std::string tmp_path;
+        threading::ThreadPool* io{nullptr};
+        std::mutex mutex;
+        std::deque<std::vector<uint8_t>> frames; // guarded by mutex
+        bool draining{false};                    // a drain is scheduled or running; guarded by mutex
+        bool closing{false};
+        bool discard{false};
+        std::error_code error;                   // written by the drain, read after `done`
+        std::atomic<size_t> queued{0};
+        std::atomic<bool> done{false};
+
+        void push(std::vector<uint8_t> frame) {
+            std::unique_lock lock(mutex);
+            queued.fetch_add(frame.size(), std::memory_order_relaxed);
+            frames.push_back(std::move(frame));
+            schedule(lock);
+        }
+
+        void close(bool drop) {
+            std::unique_lock lock(mutex);
+            closing = true;
+            discard = drop;
+            schedule(lock);
+        }
+
+        // At most one drain at a time, which is what keeps the frames in order.
+        void schedule(std::unique_lock<std::mutex>& lock) {
+            if (draining) return;
+            draining = true;
+            lock.unlock();
+            if (io) {
+                try {
+                    io->submit([self = shared_from_this()] { self->drain(); });
+                    return;
+                } catch (const std::runtime_error&) {
+                    // pool shutting down: fall through and write here
+                }
+            }
+            drain();
+        }
+
+        void drain() {
+            std::unique_lock lock(mutex);
+            while (!frames.empty()) {
+                std::vector<uint8_t> frame = std::move(frames.front());
+                frames.pop_front();
+                lock.unlock();
+                if (!error && !discard) error = write_all(frame);
+                queued.fetch_sub(frame.size(), std::memory_order_relaxed);
+                lock.lock();
+            }
+            draining = false;
+            if (!closing) return;
+            lock.unlock();
+            finalize();
+        }
+
+        void finalize() {
+            if (!error && !discard && ::fsync(fd) < 0) error = std::error_code(errno, std::system_category());
+            ::close(fd);
+            fd = -1;
+            if (!error && !discard && ::rename(tmp_path.c_str(), path.c_str()) < 0) {
+                error = std::error_code(errno, std::system_category());
+            }
+            if (error || discard) ::unlink(tmp_path.c_str());
+            done.store(true, std::memory_order_release);
+        }
+
+        std::error_code write_all(std::span<const uint8_t> data) const {
+            while (!data.empty()) {
+                ssize_t n = ::write(fd, data.data(), data.size());
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    return std::error_code(errno, std::system_category());
+                }
+                data = data.subspan(static_cast<size_t>(n));
+            }
+            return {};
+        }
+    };
+
+    std::shared_ptr<Sink> sink_;
+    std::vector<uint8_t> chunk_;
+    uint64_t records_{0};
+    uint64_t bytes_{0};
+    uint32_t frames_{0};
+    bool finished_{false};
+
+    explicit SnapshotWriter(std::shared_ptr<Sink> sink) : sink_(std::move(sink)) {}
+
+    void start_frame() {
+        chunk_.clear();
+        chunk_.reserve(k_chunk_size + k_chunk_size / 8);
+        chunk_.resize(snapshot_format::k_frame_header);
+        bytes_ += snapshot_format::k_frame_header;
+    }
+
+    void seal_frame() {
+        auto len = static_cast<uint32_t>(chunk_.size() - snapshot_format::k_frame_header);
+        uint32_t crc = crc32c(chunk_.data() + snapshot_format::k_frame_header, len);
+        std::memcpy(chunk_.data(), &len, sizeof(len));
+        std::memcpy(chunk_.data() + sizeof(len), &crc, sizeof(crc));
+        sink_->push(std::move(chunk_));
+        frames_++;
+        chunk_ = {};
+        if (!finished_) start_frame();
+    }
+};
+
+struct SnapshotLoadStats {
+    uint64_t keys{0};    // loaded
+    uint64_t expired{0}; // in the file but past their TTL by now, skipped
+};
+
+namespace snapshot_format {
+
+// Read-only private mapping of a whole file, unmapped on destruction.
+class MappedFile {
+public:
+    static Result<MappedFile> open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return std::unexpected(std::error_code(errno, std::system_category()));
+        struct stat st{};
+        if (::fstat(fd, &st) < 0) {
+            auto ec = std::error_code(errno, std::system_category());
+            ::close(fd);
+            return std::unexpected(ec);
+        }
+        MappedFile file;
+        file.size_ = static_cast<size_t>(st.st_size);
+        if (file.size_ > 0) {
+            void* addr = ::mmap(nullptr, file.size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                auto ec = std::error_code(errno, std::system_category());
+                ::close(fd);
+                return std::unexpected(ec);
+            }
+            file.data_ = static_cast<const uint8_t*>(addr);
+            // Hints only: read ahead now, and drop pages behind the parse.
+            ::madvise(addr, file.size_, MADV_WILLNEED);
+            ::madvise(addr, file.size_, MADV_SEQUENTIAL);
+        }
+        ::close(fd); // the mapping keeps the file
+        return file;
+    }
+
+    MappedFile() = default;
+    ~MappedFile() {
+        if (data_) ::munmap(const_cast<uint8_t*>(data_), size_);
+    }
+    MappedFile(MappedFile&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    [[nodiscard]] std::span<const uint8_t> bytes() const noexcept { return {data_, size_}; }
+
+private:
+    const uint8_t* data_{nullptr};
+    size_t size_{0};
+};
+
+// Frames parsed together as one unit of work.
+inline constexpr size_t k_section_frames = 8;
+
+struct ParsedRecord {
+    std::string_view key;  // views into the mapping, like everything below
+    uint64_t hcode;
+    std::string_view value;
+    uint32_t first_member; // zsets: [first_member, first_member + members) of ParsedSection::members
+    uint32_t members;
+    bool zset;
+    bool sorted;           // members strictly ascending, so assign_sorted() can take them as they are
+    std::optional<int64_t> expire_ms;
+};
+
+// Everything a section decodes to, ready for the keyspace owner to insert without touching the bytes again.
+struct ParsedSection {
+    std::vector<ParsedRecord> records;
+    std::vector<ds::ZMember> members;
+    std::optional<uint64_t> end_count; // set by the section holding the end record
+    uint64_t expired{0};
+    bool ok{true};
+};
+
+// Checks and decodes `frames` (payload spans, CRCs verified here). Pure function of its input, so sections
+// run on any thread; `hash` is the keyspace's key hash, computed here to keep it off the owner thread.
+template<typename Hash>
+ParsedSection parse_section(std::span<const std::span<const uint8_t>> frames, std::span<const uint32_t> crcs,
+                            int64_t now_ms, bool keep_expired, Hash hash) {
+    ParsedSection out;
+    for (size_t f = 0; f < frames.size() && out.ok; ++f) {
+        if (out.end_count || crc32c(frames[f].data(), frames[f].size()) != crcs[f]) {
+            out.ok = false; // data after the end record, or a bad checksum
+            break;
+        }
+        Reader in(frames[f]);
+        while (!in.at_end()) {
+            auto op = in.get<uint8_t>();
+            auto tag = static_cast<ds::SerializationType>(op & ~k_has_expiry);
+            if (tag == ds::SerializationType::Nil) {
+                out.end_count = in.get<uint64_t>();
+                out.ok = in.ok() && in.at_end();
+                break;
+            }
+            ParsedRecord rec{};
+            if (op & k_has_expiry) rec.expire_ms = in.get<int64_t>();
+            rec.key = in.get_string();
+            if (tag == ds::SerializationType::String) {
+                rec.value = in.get_string();
+            } else if (tag == ds::SerializationType::Array) {
+                uint64_t n = in.get_varint();
+                rec.zset = true;
+                rec.sorted = true;
+                rec.first_member = static_cast<uint32_t>(out.members.size());
+                for (uint64_t i = 0; i < n && in.ok(); ++i) {
+                    ds::ZMember m{in.get_string(), in.get<double>()};
+                    if (i > 0) {
+                        const ds::ZMember& prev = out.members.back();
+                        rec.sorted = rec.sorted && (prev.score < m.score || (prev.score == m.score && prev.name < m.name));
+                    }
+                    out.members.push_back(m);
+                }
+                rec.members = static_cast<uint32_t>(out.members.size() - rec.first_member);
+            } else {
+                out.ok = false;
+            }
+            if (!in.ok() || !out.ok) {
+                out.ok = false;
+                break;
+            }
+            if (!keep_expired && rec.expire_ms && *rec.expire_ms <= now_ms) {
+                if (rec.zset) out.members.resize(rec.first_member);
+                out.expired++;
+                continue;
+            }
+            rec.hcode = hash(rec.key);
+            out.records.push_back(rec);
+        }
+    }
+    return out;
+}
+
+} // namespace snapshot_format
+
+// Reads a file written by SnapshotWriter into `ks`, which must be empty and belong to shard `shard` of
+// `shard_count` (the routing hash decides which shard a key lives on, so files only load into the layout
+// they came from). Runs on the thread owning the keyspace, with its slab pool installed.
+//
+// The file is mapped, split into sections of k_section_frames frames, and the sections are checked and
+// decoded on `pool` a bounded window at a time while this thread inserts the finished ones in file order.
+// The keyspace is sized from the footer first, so no incremental resize runs during the load, and sorted
+// sets come back in rank order and are bulk-built. Without a pool every section is parsed here.
+// `keep_expired` loads keys whose TTL has passed too, due at once, for a caller that replays a command
+// log on top and must see the keyspace as it was when the file was written.
+template<typename Keyspace>
+Result<SnapshotLoadStats> load_snapshot(const std::string& path, Keyspace& ks, uint32_t shard, uint32_t shard_count,
+                                        threading::ThreadPool* pool = nullptr, bool keep_expired = false) {
+    using namespace snapshot_format;
+    if (ks.size() != 0) return std::unexpected(std::make_error_code(std::errc::invalid_argument));
+    auto mapped = MappedFile::open(path);
+    if (!mapped) return std::unexpected(mapped.error());
+    std::span<const uint8_t> file = mapped->bytes();
+    if (file.size() < k_header_size + k_footer_size) return std::unexpected(corrupt());
+
+    Reader head(file.subspan(sizeof(k_magic), k_header_size - sizeof(k_magic)));
+    auto version = head.get<uint16_t>();
+    auto file_shard = head.get<uint32_t>();
+    auto file_count = head.get<uint32_t>();
+    head.get<int64_t>();
+    auto crc = head.get<uint32_t>();
+    if (std::memcmp(file.data(), k_magic, sizeof(k_magic)) != 0 || crc != crc32c(file.data(), k_header_size - 4)) {
+        return std::unexpected(corrupt());
+    }
+    if (version != k_version || file_shard != shard || file_count != shard_count) {
+        return std::unexpected(std::make_error_code(std::errc::invalid_argument));
+    }
+
+    Reader foot(file.last(k_footer_size));
+    auto total_records = foot.get<uint64_t>();
+    auto total_frames = foot.get<uint32_t>();
+    if (foot.get<uint32_t>() != crc32c(file.data() + file.size() - k_footer_size, k_footer_size - 4)) {
+        return std::unexpected(corrupt());
+    }
+
+    // Walk the frame headers only; the payloads are checked by whichever thread parses them.
+    std::vector<std::span<const uint8_t>> frames;
+    std::vector<uint32_t> crcs;
+    frames.reserve(total_frames);
+    crcs.reserve(total_frames);
+    std::span<const uint8_t> rest = file.subspan(k_header_size, file.size() - k_header_size - k_footer_size);
+    while (!rest.empty()) {
+        Reader frame(rest);
+        auto len = frame.get<uint32_t>();
+        auto frame_crc = frame.get<uint32_t>();
+        if (!frame.ok() || len > rest.size() - k_frame_header) return std::unexpected(corrupt());
+        frames.push_back(rest.subspan(k_frame_header, len));
+        crcs.push_back(frame_crc);
+        rest = rest.subspan(k_frame_header + len);
+    }
+    if (frames.size() != total_frames || frames.empty()) return std::unexpected(corrupt());
+
+    int64_t now_ms = unix_ms_now();
+    auto parse = [&frames, &crcs, now_ms, keep_expired](size_t section) {
+        size_t first = section * k_section_frames;
+        size_t n = std::min(k_section_frames, frames.size() - first);
+        return parse_section(std::span(frames).subspan(first, n), std::span(crcs).subspan(first, n), now_ms, keep_expired,
+                             [](std::string_view key) { return Keyspace::hash_key(key); });
+    };
+    size_t sections = (frames.size() + k_section_frames - 1) / k_section_frames;
+    size_t window = pool ? 2 * std::max<size_t>(1, pool->thread_count()) : 0;
+
+    // In-flight parses read `frames` and the mapping, so every one is waited for before either goes away.
+    std::deque<std::future<ParsedSection>> inflight;
+    struct Drain {
+        std::deque<std::future<ParsedSection>>& futures;
+        ~Drain() {
+            for (auto& f : futures) if (f.valid()) f.wait();
+        }
+    } drain{inflight};
+    size_t next = 0;
+    auto refill = [&] {
+        while (next < sections && inflight.size() < window) {
+            try {
+                inflight.push_back(pool->enqueue(parse, next));
+            } catch (const std::runtime_error&) {
+                window = 0; // pool shutting down: parse the rest here
+                return;
+            }
+            next++;
+        }
+    };
+
+    ks.reserve(total_records);
+    SnapshotLoadStats stats;
+    for (size_t section = 0; section < sections; ++section) {
+        refill();
+        ParsedSection parsed;
+        if (!inflight.empty()) {
+            parsed = inflight.front().get();
+            inflight.pop_front();
+        } else {
+            parsed = parse(next++);
+        }
+        if (!parsed.ok || (parsed.end_count && section + 1 != sections)) return std::unexpected(corrupt());
+        ks.begin_mutation(); // charges the section's keys once they hold their values
+        for (const ParsedRecord& rec : parsed.records) {
+            Entry& entry = ks.insert_new(rec.key, rec.hcode);
+            if (rec.zset) {
+                entry.type = EntryType::ZSet;
+                entry.zset = std::make_unique<ds::ZSet>();
+                std::span<const ds::ZMember> members(parsed.members.data() + rec.first_member, rec.members);
+                if (rec.sorted) {
+                    entry.zset->assign_sorted(members);
+                } else {
+                    for (const ds::ZMember& m : members) entry.zset->add(m.name, m.score);
+                }
+            } else {
+                entry.value.assign(rec.value);
+            }
+            if (rec.expire_ms) ks.set_ttl(entry, std::max<int64_t>(*rec.expire_ms - now_ms, 0));
+        }
+        ks.end_mutation();
+        stats.keys += parsed.records.size();
+        stats.expired += parsed.expired;
+        if (parsed.end_count) {
+            uint64_t seen = stats.keys + stats.expired;
+            if (*parsed.end_count != seen || total_records != seen) return std::unexpected(corrupt());
+            return stats;
+        }
+    }
+    return std::unexpected(corrupt()); // no end record
+}
+
+#endif // SNAPSHOT_HPP
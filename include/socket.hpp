@@ -3,8 +3,14 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <cerrno>
 #include <expected>
+#include <string>
 #include <system_error>
+#include <utility>
+#include "common.hpp"
 
 class Socket {
 public:
@@ -21,10 +27,26 @@ public:
     }
 
     [[nodiscard]] int get() const noexcept { return fd_; }
+    // Gives up ownership: the descriptor stays open and becomes the caller's.
+    [[nodiscard]] int release() noexcept { return std::exchange(fd_, -1); }
+
+    // MSG_ZEROCOPY sends (Linux 4.14+, TCP); completions then arrive on the socket's error queue.
+    [[nodiscard]] Result<void> enable_zerocopy() const {
+#ifdef SO_ZEROCOPY
+        int one = 1;
+        if (setsockopt(fd_, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0) return {};
+        return std::unexpected(std::error_code(errno, std::system_category()));
+#else
+        return std::unexpected(std::make_error_code(std::errc::operation_not_supported));
+#endif
+    }
 
     [[nodiscard]] Result<void> set_nonblocking() const {
         int flags = fcntl(fd_, F_GETFL, 0);
         if (flags == -1) return std::unexpected(std::make_error_code(std::errc::io_error));
+        if (fcntl(fd_, F_SETFL, flags | O_NONBLOCK) == -1) {
+            return std::unexpected(std::make_error_code(std::errc::io_error));
+        }
         return {};
     }
 
@@ -32,4 +54,35 @@ private:
     int fd_;
 };
 
+// Starts a non-blocking IPv4 connect; completion (or failure, via SO_ERROR) shows up as writability.
+// Name resolution itself blocks, so callers keep `host` to a numeric address or a name the resolver has
+// at hand.
+inline Result<Socket> connect_nonblocking(const std::string& host, uint16_t port) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    std::string service = std::to_string(port);
+    if (::getaddrinfo(host.c_str(), service.c_str(), &hints, &found) != 0 || !found) {
+        return std::unexpected(std::make_error_code(std::errc::host_unreachable));
+    }
+    Socket sock(::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    int rc = sock.get() < 0 ? -1 : ::connect(sock.get(), found->ai_addr, found->ai_addrlen);
+    std::error_code ec(errno, std::system_category());
+    ::freeaddrinfo(found);
+    if (sock.get() < 0 || (rc < 0 && ec.value() != EINPROGRESS)) return std::unexpected(ec);
+    return sock;
+}
+
+// For a socket from connect_nonblocking() that became writable: whether the connect went through.
+inline Result<void> connect_result(const Socket& sock) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (::getsockopt(sock.get(), SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+        return std::unexpected(std::error_code(errno, std::system_category()));
+    }
+    if (err != 0) return std::unexpected(std::error_code(err, std::system_category()));
+    return {};
+}
+
 #endif
@@ -0,0 +1,156 @@
+#ifndef TOPOLOGY_HPP
+#define TOPOLOGY_HPP
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include "common.hpp"
+
+// Where the server's threads and memory go. Off by default: an unpinned server behaves as before.
+// With pin_threads set, reactor i runs on reactor_cpus[i] and the background workers on worker_cpus;
+// either list left empty is filled from the detected topology (plan_placement below).
+struct AffinityConfig {
+    bool pin_threads{false};
+    std::vector<int> reactor_cpus;
+    std::vector<int> worker_cpus;
+    // Prefer the reactor's NUMA node for its shard's slabs (first touch already lands there once the
+    // thread is pinned; this keeps it there under memory pressure too).
+    bool numa_local_memory{true};
+    // SO_INCOMING_CPU on each reactor's listener, so the kernel hands a connection to the reactor on
+    // the CPU that services its RX queue - packets, reactor and shard data then share a socket.
+    bool steer_incoming_cpu{true};
+};
+
+// CPUs and NUMA nodes this process may use, from /sys and the affinity mask. A machine without NUMA
+// information shows up as a single node holding every allowed CPU.
+class CpuTopology {
+public:
+    static CpuTopology detect() {
+        CpuTopology topo;
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+        auto usable = [&](int cpu) { return !have_mask || CPU_ISSET(cpu, &allowed); };
+
+        for (int node = 0;; ++node) {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!in) break;
+            std::string list;
+            std::getline(in, list);
+            std::vector<int> cpus;
+            for (int cpu : parse_cpu_list(list)) {
+                if (usable(cpu)) cpus.push_back(cpu);
+            }
+            if (!cpus.empty()) topo.nodes_.push_back({node, std::move(cpus)});
+        }
+        if (topo.nodes_.empty()) {
+            std::vector<int> cpus;
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (have_mask ? CPU_ISSET(cpu, &allowed) : cpu < static_cast<int>(std::thread::hardware_concurrency())) {
+                    cpus.push_back(cpu);
+                }
+            }
+            topo.nodes_.push_back({0, std::move(cpus)});
+        }
+        return topo;
+    }
+
+    // "0-3,8,10-11" -> {0,1,2,3,8,10,11}. Malformed pieces are skipped.
+    static std::vector<int> parse_cpu_list(std::string_view list) {
+        std::vector<int> cpus;
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            std::string_view part = list.substr(0, comma);
+            list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+            while (!part.empty() && (part.back() == '\n' || part.back() == ' ')) part.remove_suffix(1);
+            size_t dash = part.find('-');
+            int lo = 0;
+            int hi = 0;
+            auto first = part.substr(0, dash);
+            if (std::from_chars(first.data(), first.data() + first.size(), lo).ec != std::errc{}) continue;
+            hi = lo;
+            if (dash != std::string_view::npos) {
+                auto second = part.substr(dash + 1);
+                if (std::from_chars(second.data(), second.data() + second.size(), hi).ec != std::errc{}) continue;
+            }
+            for (int cpu = lo; cpu <= hi; ++cpu) cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    struct Node {
+        int id;
+        std::vector<int> cpus;
+    };
+
+    [[nodiscard]] const std::vector<Node>& nodes() const noexcept { return nodes_; }
+
+    [[nodiscard]] std::optional<int> node_of(int cpu) const noexcept {
+        for (const Node& node : nodes_) {
+            if (std::find(node.cpus.begin(), node.cpus.end(), cpu) != node.cpus.end()) return node.id;
+        }
+        return std::nullopt;
+    }
+
+    [[nodiscard]] size_t cpu_count() const noexcept {
+        size_t n = 0;
+        for (const Node& node : nodes_) n += node.cpus.size();
+        return n;
+    }
+
+private:
+    std::vector<Node> nodes_;
+};
+
+// Fills in whichever CPU lists the config left empty. Reactors are dealt round-robin across nodes so
+// shards (and their memory) spread over every socket; workers get the CPUs no reactor took, or all
+// of them if the reactors used everything.
+inline AffinityConfig plan_placement(AffinityConfig config, const CpuTopology& topo, size_t reactors) {
+    if (!config.pin_threads) return config;
+    std::vector<int> order; // node-interleaved: n0c0, n1c0, n0c1, n1c1, ...
+    for (size_t i = 0;; ++i) {
+        bool any = false;
+        for (const auto& node : topo.nodes()) {
+            if (i < node.cpus.size()) {
+                order.push_back(node.cpus[i]);
+                any = true;
+            }
+        }
+        if (!any) break;
+    }
+    if (order.empty()) return config;
+
+    if (config.reactor_cpus.empty()) {
+        for (size_t i = 0; i < reactors; ++i) config.reactor_cpus.push_back(order[i % order.size()]);
+    }
+    if (config.worker_cpus.empty()) {
+        for (int cpu : order) {
+            if (std::find(config.reactor_cpus.begin(), config.reactor_cpus.end(), cpu) == config.reactor_cpus.end()) {
+                config.worker_cpus.push_back(cpu);
+            }
+        }
+        if (config.worker_cpus.empty()) config.worker_cpus = order;
+    }
+    return config;
+}
+
+inline Result<void> pin_current_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); err != 0) {
+        return std::unexpected(std::error_code(err, std::system_category()));
+    }
+    return {};
+}
+
+#endif
@@ -1,6 +1,10 @@
 #ifndef LIST_HPP //
 #define LIST_HPP
 
+#include <cstddef>
+#include <iterator>
+#include <utility>
+
 namespace ds {
 
 // Forward declaration of DoubleLinkedList for ListNode to friend it
@@ -16,41 +20,42 @@ public:
     [[nodiscard]] const T& data() const noexcept { return data_; } // should not be discarded as a non-modifiable (const) getter, throw an error if so. 
     T& data() noexcept { return data_; } // modifiable getter, may be discarded if mutated in some way.
     
-    [[nodiscard]] bool is_linked() const noexcept { return next_ != this; } // return the boolean state of ListNode's next_, [[nodiscard]] to flag unused bool.
+    [[nodiscard]] bool is_linked() const noexcept { return next_node_ != this; } // return the boolean state of ListNode's next_node_, [[nodiscard]] to flag unused bool.
     
     void unlink() noexcept { // remove node from list
-        prev_->next_ = next_; // if node is linked, take previous node's next and link to present node's next 
-        next_->prev_ = prev_; // if node is linked, take next node's prev and link it to node before our node. 
+        prev_node_->next_node_ = next_node_; // if node is linked, take previous node's next and link to present node's next 
+        next_node_->prev_node_ = prev_node_; // if node is linked, take next node's prev and link it to node before our node. 
         link_self(); // now, let's take our current node and sever its connections to its sorrounding via calling circular reference helper link_self.
     }
     
     void insert_before(ListNode& node) noexcept { // our current listNode has this method to insert "node" before it.
-        node.prev_ = prev_; // here, we assign 'node.prev_' to point to our prev_. 
-        node.next_ = this; // then we take node's next to point to this listNode itself
-        prev_->next_ = &node; // now our prev ListNode should point to our Node
-        prev_ = &node; //and our prev pointer should point to the node passed in.
+        node.prev_node_ = prev_node_; // here, we assign 'node.prev_node_' to point to our prev_node_. 
+        node.next_node_ = this; // then we take node's next to point to this listNode itself
+        prev_node_->next_node_ = &node; // now our prev ListNode should point to our Node
+        prev_node_ = &node; //and our prev pointer should point to the node passed in.
     }
     
     void insert_after(ListNode& node) noexcept { // our current listNode has this method to insert "node" after it. Same logic as above but reversed.
-        node.prev_ = this; // ""
-        node.next_ = next_; // ""
-        next_->prev = &node; // ""
-        next_ = &node; // ""
+        node.prev_node_ = this; // ""
+        node.next_node_ = next_node_; // ""
+        next_node_->prev_node_ = &node; // ""
+        next_node_ = &node; // ""
     }
 
 private:
-    T data_{}; // this is our template data_! We can hold a lot of things here with our helpful generic
-    ListNode* prev_{nullptr}; // default init as nullptr. Definitely a doubleLinkedList already btw - probably should rename the class.
-    ListNode* next_{nullptr}; // default init as nullptr.
+    [[no_unique_address]] T data_{}; // this is our template data_! We can hold a lot of things here with our helpful generic. An empty T takes no space, so a ListNode<Empty> base is just the two links (intrusive use).
+    // (Not plain prev_/next_: a type deriving from ListNode and HNode, like Entry, would see two next_.)
+    ListNode* prev_node_{nullptr}; // default init as nullptr. Definitely a doubleLinkedList already btw - probably should rename the class.
+    ListNode* next_node_{nullptr}; // default init as nullptr.
     /*
-    Reasons why we prefer circular referencing over default nullptr initialization for prev_ and next_:
+    Reasons why we prefer circular referencing over default nullptr initialization for prev_node_ and next_node_:
     1. Main Reason: Minimize nullptr checks - every operation would require null checks which would clutter our code. (Consider unlink for example)
-    2. Operations such as node->next_->prev_ = node->prev_; will always work without risk of dereferencing nulls.
+    2. Operations such as node->next_node_->prev_node_ = node->prev_node_; will always work without risk of dereferencing nulls.
     3. We use a sentinel node that must have a circular reference, but this is barely an issue.
     */
     void link_self() noexcept {
-        prev_ = this;
-        next_ = this;
+        prev_node_ = this;
+        next_node_ = this;
     }
     
     friend class DoublyLinkedList<T>; //  allow DoublyLinkedList<T> to modify objects and call methods constructed from our interface
@@ -73,7 +78,7 @@ public:
         pointer operator->() noexcept { return &current_->data(); }
         
         Iterator& operator++() noexcept { // This actually represents the "++object" operator
-            current_ = current_->next_;
+            current_ = current_->next_node_;
             return *this;
         }
         
@@ -84,7 +89,7 @@ public:
         }
         
         Iterator& operator--() noexcept { // This actually represents the "--object" operator
-            current_ = current_->prev_;
+            current_ = current_->prev_node_;
             return *this;
         }
         
@@ -116,7 +121,7 @@ public:
     DoublyLinkedList(DoublyLinkedList&&) noexcept = default; // but we set the move constructors as default
     DoublyLinkedList& operator=(DoublyLinkedList&&) noexcept = default; // and the operator is overloaded to only accept std::move rather than lvalue object instances
     
-    [[nodiscard]] Iterator begin() noexcept { return Iterator(head_.next_); } // beginning of list
+    [[nodiscard]] Iterator begin() noexcept { return Iterator(head_.next_node_); } // beginning of list
     [[nodiscard]] Iterator end() noexcept { return Iterator(&head_); } // end of list 
     
     [[nodiscard]] bool empty() const noexcept { return !head_.is_linked(); } // if circular reference, our sentinel node is alone and thus the list is empty.
@@ -129,6 +134,12 @@ public:
         head_.insert_before(node);
     }
 
+    // The nodes themselves, for intrusive lists whose element type derives from ListNode<T>. List must not be empty.
+    [[nodiscard]] ListNode<T>& front() noexcept { return *head_.next_node_; }
+    [[nodiscard]] ListNode<T>& back() noexcept { return *head_.prev_node_; }
+
+    void clear() noexcept { head_.link_self(); } // forget every node at once; only for when the nodes are being freed anyway.
+
 private:
     ListNode<T> head_; // sentinel node
 };
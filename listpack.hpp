@@ -0,0 +1,140 @@
+#ifndef LISTPACK_HPP
+#define LISTPACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace ds {
+
+// Compact encoding for small sorted sets: every member back to back in one buffer, sorted by (score, name).
+//   entry := [f64 score][u8 name_len][name bytes]
+// That's 9 bytes + the name per member, with no pointers at all. Every operation is a linear scan, which for
+// the handful of members this is used for (see k_max_entries) runs over a few cache lines and beats
+// chasing tree nodes. BasicZSet converts to the tree encoding once a set outgrows it.
+class ZListpack {
+public:
+    static constexpr size_t k_max_entries = 128;
+    static constexpr size_t k_max_name = 64; // must fit the u8 length
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    struct Member {
+        std::string_view name;
+        double score;
+    };
+
+    [[nodiscard]] size_t size() const noexcept { return count_; }
+    [[nodiscard]] bool empty() const noexcept { return count_ == 0; }
+    [[nodiscard]] size_t bytes() const noexcept { return buf_.size(); }
+
+    // Byte offset of the member called `name`, or npos.
+    [[nodiscard]] size_t find(std::string_view name) const noexcept {
+        for (size_t off = 0; off < buf_.size(); off = next(off)) {
+            if (name_len_at(off) == name.size() && std::memcmp(name_at(off), name.data(), name.size()) == 0) {
+                return off;
+            }
+        }
+        return npos;
+    }
+
+    // `name` must not be present and must be at most k_max_name bytes.
+    void insert(std::string_view name, double score) {
+        size_t off = 0;
+        while (off < buf_.size() && before(read(off), score, name)) {
+            off = next(off);
+        }
+        uint8_t header[k_header];
+        std::memcpy(header, &score, sizeof(score));
+        header[sizeof(score)] = static_cast<uint8_t>(name.size());
+        buf_.insert(buf_.begin() + static_cast<std::ptrdiff_t>(off), header, header + k_header);
+        buf_.insert(buf_.begin() + static_cast<std::ptrdiff_t>(off + k_header), name.begin(), name.end());
+        count_++;
+    }
+
+    // Bulk loading in order: `name` must sort after every member already present (and fit k_max_name).
+    void append(std::string_view name, double score) {
+        uint8_t header[k_header];
+        std::memcpy(header, &score, sizeof(score));
+        header[sizeof(score)] = static_cast<uint8_t>(name.size());
+        buf_.insert(buf_.end(), header, header + k_header);
+        buf_.insert(buf_.end(), name.begin(), name.end());
+        count_++;
+    }
+
+    void reserve(size_t bytes) { buf_.reserve(bytes); }
+
+    void erase_at(size_t off) noexcept {
+        buf_.erase(buf_.begin() + static_cast<std::ptrdiff_t>(off), buf_.begin() + static_cast<std::ptrdiff_t>(next(off)));
+        count_--;
+    }
+
+    // Erase `n` consecutive members starting at `off`.
+    void erase_run(size_t off, size_t n) noexcept {
+        size_t end = off;
+        for (size_t i = 0; i < n; ++i) end = next(end);
+        buf_.erase(buf_.begin() + static_cast<std::ptrdiff_t>(off), buf_.begin() + static_cast<std::ptrdiff_t>(end));
+        count_ -= n;
+    }
+
+    [[nodiscard]] uint64_t rank_of(size_t target) const noexcept {
+        uint64_t rank = 0;
+        for (size_t off = 0; off < target; off = next(off)) rank++;
+        return rank;
+    }
+
+    // Offset of the member at `rank`, or npos past the end.
+    [[nodiscard]] size_t at(uint64_t rank) const noexcept {
+        size_t off = 0;
+        for (; off < buf_.size() && rank > 0; --rank) off = next(off);
+        return off < buf_.size() ? off : npos;
+    }
+
+    // Members for which before(member) holds; they form a prefix of the sorted order.
+    template<typename Before>
+    [[nodiscard]] uint64_t count_before(Before&& before) const {
+        uint64_t n = 0;
+        for (size_t off = 0; off < buf_.size() && before(read(off)); off = next(off)) n++;
+        return n;
+    }
+
+    [[nodiscard]] Member read(size_t off) const noexcept { return read(buf_.data() + off); }
+    [[nodiscard]] size_t next(size_t off) const noexcept { return off + k_header + name_len_at(off); }
+
+    [[nodiscard]] const uint8_t* data() const noexcept { return buf_.data(); }
+
+    // Raw-pointer walking for cursors, which outlive the call that created them.
+    static Member read(const uint8_t* p) noexcept {
+        double score;
+        std::memcpy(&score, p, sizeof(score));
+        return {std::string_view(reinterpret_cast<const char*>(p + k_header), p[sizeof(double)]), score};
+    }
+    static const uint8_t* next(const uint8_t* p) noexcept { return p + k_header + p[sizeof(double)]; }
+
+    void clear() noexcept {
+        buf_.clear();
+        buf_.shrink_to_fit();
+        count_ = 0;
+    }
+
+private:
+    static constexpr size_t k_header = sizeof(double) + 1;
+
+    std::vector<uint8_t> buf_;
+    size_t count_{0};
+
+    [[nodiscard]] size_t name_len_at(size_t off) const noexcept { return buf_[off + sizeof(double)]; }
+    [[nodiscard]] const uint8_t* name_at(size_t off) const noexcept { return buf_.data() + off + k_header; }
+
+    static bool before(const Member& m, double score, std::string_view name) noexcept {
+        if (m.score != score) return m.score < score;
+        return m.name < name;
+    }
+};
+
+} // namespace ds
+
+#endif // LISTPACK_HPP
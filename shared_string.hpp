@@ -0,0 +1,157 @@
+#ifndef SHARED_STRING_HPP
+#define SHARED_STRING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string_view>
+#include <utility>
+
+namespace ds {
+
+// Byte string for keyspace values that a reply can send by reference instead of copying. Up to k_inline
+// bytes live inside the object, like std::string's SSO; longer ones in a heap block with a reference
+// count. share() hands out a Ref to that block, and the Ref keeps the bytes alive after the string is
+// overwritten or destroyed - as long as a socket send may still be reading them. A block is never written
+// once shared: assign() on a shared string leaves the old block to its refs and starts a new one.
+// The count is atomic so a Ref may be dropped on any thread; the string itself belongs to one.
+class SharedString {
+    struct Block {
+        std::atomic<uint32_t> refs;
+        uint32_t capacity;
+
+        [[nodiscard]] char* data() noexcept { return reinterpret_cast<char*>(this + 1); }
+    };
+
+public:
+    static constexpr size_t k_inline = 24;
+
+    // Shared, read-only view of a heap value's bytes.
+    class Ref {
+    public:
+        Ref() noexcept = default;
+        Ref(const Ref& other) noexcept : block_(other.block_), size_(other.size_) {
+            if (block_) block_->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        Ref(Ref&& other) noexcept : block_(std::exchange(other.block_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+        Ref& operator=(Ref other) noexcept {
+            std::swap(block_, other.block_);
+            std::swap(size_, other.size_);
+            return *this;
+        }
+        ~Ref() { unref(block_); }
+
+        [[nodiscard]] const char* data() const noexcept { return block_ ? block_->data() : nullptr; }
+        [[nodiscard]] size_t size() const noexcept { return size_; }
+        [[nodiscard]] std::string_view view() const noexcept { return {data(), size_}; }
+
+    private:
+        friend class SharedString;
+        Ref(Block* block, uint32_t size) noexcept : block_(block), size_(size) {
+            block_->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        Block* block_{nullptr};
+        uint32_t size_{0};
+    };
+
+    SharedString() noexcept = default;
+    explicit SharedString(std::string_view s) { assign(s); }
+    SharedString(const SharedString& other) { assign(other.view()); }
+    SharedString(SharedString&& other) noexcept : size_(std::exchange(other.size_, 0)) {
+        std::memcpy(&storage_, &other.storage_, sizeof(storage_));
+    }
+    SharedString& operator=(const SharedString& other) {
+        if (this != &other) assign(other.view());
+        return *this;
+    }
+    SharedString& operator=(SharedString&& other) noexcept {
+        if (this != &other) {
+            release();
+            size_ = std::exchange(other.size_, 0);
+            std::memcpy(&storage_, &other.storage_, sizeof(storage_));
+        }
+        return *this;
+    }
+    SharedString& operator=(std::string_view s) {
+        assign(s);
+        return *this;
+    }
+    ~SharedString() { release(); }
+
+    void assign(std::string_view s) {
+        if (s.size() <= k_inline) {
+            char tmp[k_inline];
+            std::memcpy(tmp, s.data(), s.size()); // s may point into our own block
+            release();
+            std::memcpy(storage_.inline_bytes, tmp, s.size());
+            size_ = static_cast<uint32_t>(s.size());
+            return;
+        }
+        // An unshared block of about the right size is reused; values are mostly rewritten in place.
+        if (on_heap() && storage_.block->refs.load(std::memory_order_acquire) == 1 &&
+            storage_.block->capacity >= s.size() && storage_.block->capacity / 2 <= s.size()) {
+            std::memmove(storage_.block->data(), s.data(), s.size());
+            size_ = static_cast<uint32_t>(s.size());
+            return;
+        }
+        Block* block = allocate(s.size());
+        std::memcpy(block->data(), s.data(), s.size());
+        release();
+        storage_.block = block;
+        size_ = static_cast<uint32_t>(s.size());
+    }
+
+    void clear() noexcept { release(); }
+
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+    [[nodiscard]] const char* data() const noexcept { return on_heap() ? storage_.block->data() : storage_.inline_bytes; }
+    [[nodiscard]] std::string_view view() const noexcept { return {data(), size_}; }
+    operator std::string_view() const noexcept { return view(); } // NOLINT: reads like the std::string it replaced
+
+    // Whether share() can be used: only heap values have a block to share.
+    [[nodiscard]] bool shareable() const noexcept { return on_heap(); }
+    [[nodiscard]] Ref share() const noexcept { return Ref(storage_.block, size_); }
+
+    // What the value costs outside the object itself.
+    [[nodiscard]] size_t heap_bytes() const noexcept { return on_heap() ? sizeof(Block) + storage_.block->capacity : 0; }
+
+    bool operator==(std::string_view other) const noexcept { return view() == other; }
+
+private:
+    union Storage {
+        Block* block;
+        char inline_bytes[k_inline];
+    };
+
+    Storage storage_{};
+    uint32_t size_{0};
+
+    [[nodiscard]] bool on_heap() const noexcept { return size_ > k_inline; }
+
+    static Block* allocate(size_t bytes) {
+        void* mem = ::operator new(sizeof(Block) + bytes);
+        return ::new (mem) Block{{1}, static_cast<uint32_t>(bytes)};
+    }
+
+    static void unref(Block* block) noexcept {
+        if (block && block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            block->~Block();
+            ::operator delete(block);
+        }
+    }
+
+    void release() noexcept {
+        if (on_heap()) unref(storage_.block);
+        size_ = 0;
+    }
+};
+
+static_assert(sizeof(SharedString) == 32, "same footprint as the std::string it stands in for");
+
+} // namespace ds
+
+#endif // SHARED_STRING_HPP
@@ -0,0 +1,360 @@
+#ifndef SLAB_ALLOCATOR_HPP
+#define SLAB_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ds {
+
+// Size-class slab pool for the small, numerous objects of the keyspace (Entry, ZNode).
+// Every allocation of up to k_max_object bytes is rounded to a 16-byte class and carved out of a
+// k_slab_size slab dedicated to that class; a per-slab free list recycles slots. Compared with malloc
+// there is no per-object header and no cross-size fragmentation inside a slab.
+//
+// Slabs are mmap'd at k_slab_size alignment, so deallocate() finds the owning slab (and through it the
+// owning pool) by masking the pointer - callers only need to pass back the size they asked for.
+// A pool is meant to be owned by one shard and used by that shard's thread only: no locking. Threads
+// that have no shard (setup code, tools) fall back to shared(), which does lock. Memory may still be
+// freed from another thread (a background worker tearing down a large value): those frees are pushed
+// onto a lock-free remote list and only reach the free lists when the owner calls collect_remote().
+//
+// set_preferred_node() asks the kernel (mbind, MPOL_PREFERRED) to back every slab mapped from then on
+// with memory from that NUMA node - a shard's data stays next to the reactor that owns it.
+//
+// Objects above k_max_object go straight to ::operator new and don't show up in the stats.
+// Empty slabs: each class keeps at most one empty slab as a spare; any further slab that empties is
+// munmap'd straight away, and release_empty() drops the spares too.
+
+struct SlabStats {
+    size_t slabs{0};            // slabs currently mapped
+    size_t slab_bytes{0};       // slabs * k_slab_size
+    size_t live_objects{0};     // objects currently handed out from slabs
+    size_t slot_bytes{0};       // bytes of slots handed out (rounded to the class size)
+    size_t requested_bytes{0};  // bytes callers actually asked for
+    size_t released_slabs{0};   // slabs given back to the OS so far
+    size_t remote_frees{0};     // frees that arrived from other threads and have been collected
+
+    // Fraction of mapped slab memory holding live objects.
+    [[nodiscard]] double occupancy() const noexcept {
+        return slab_bytes ? static_cast<double>(slot_bytes) / static_cast<double>(slab_bytes) : 0.0;
+    }
+    // Fraction of mapped slab memory not backing requested bytes (free slots + rounding + headers).
+    [[nodiscard]] double fragmentation() const noexcept {
+        return slab_bytes ? 1.0 - static_cast<double>(requested_bytes) / static_cast<double>(slab_bytes) : 0.0;
+    }
+};
+
+class SlabPool {
+public:
+    static constexpr size_t k_slab_size = 256 * 1024;
+    static constexpr size_t k_granularity = 16;
+    static constexpr size_t k_max_object = 512;
+    static constexpr size_t k_class_count = k_max_object / k_granularity;
+
+    explicit SlabPool(bool shared = false) noexcept : shared_(shared) {}
+    // Objects must all have been returned by now; any slab still mapped is unmapped regardless.
+    ~SlabPool() {
+        for (auto& cls : classes_) {
+            while (Slab* slab = cls.partial) {
+                unlink(cls, slab);
+                unmap(slab);
+            }
+        }
+        for (Slab* slab = full_; slab;) {
+            Slab* next = slab->next;
+            unmap(slab);
+            slab = next;
+        }
+    }
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    void* allocate(size_t bytes) {
+        if (bytes > k_max_object) {
+            return ::operator new(bytes); // rare (long zset member names); not worth a class
+        }
+        auto guard = lock();
+        size_t idx = class_of(bytes);
+        SizeClass& cls = classes_[idx];
+        Slab* slab = cls.partial;
+        if (!slab) {
+            slab = map_slab(idx);
+            link(cls, slab);
+        }
+        if (slab->used == 0) cls.empty--;
+
+        void* p;
+        if (slab->free_list) {
+            p = slab->free_list;
+            slab->free_list = slab->free_list->next;
+        } else {
+            p = slab->data() + static_cast<size_t>(slab->bumped++) * slot_size(idx);
+        }
+        slab->used++;
+        if (slab->used == slab->capacity) {
+            unlink(cls, slab);
+            push_full(slab);
+        }
+        stats_.live_objects++;
+        stats_.slot_bytes += slot_size(idx);
+        stats_.requested_bytes += bytes;
+        return p;
+    }
+
+    // `bytes` must be what was passed to allocate(). Routes to whichever pool owns the memory.
+    static void deallocate(void* p, size_t bytes) noexcept {
+        if (!p) return;
+        if (bytes > k_max_object) {
+            ::operator delete(p);
+            return;
+        }
+        Slab* slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(p) & ~(k_slab_size - 1));
+        SlabPool* owner = slab->owner;
+        if (owner->shared_ || owner == current_) {
+            owner->free_slot(slab, p, bytes);
+        } else {
+            owner->push_remote(p, bytes);
+        }
+    }
+
+    // Owner side of remote frees: returns up to `max` of them to their slabs. Returns how many it took.
+    size_t collect_remote(size_t max = static_cast<size_t>(-1)) noexcept {
+        if (!collected_ && !remote_.load(std::memory_order_relaxed)) return 0;
+        size_t taken = 0;
+        while (taken < max) {
+            if (!collected_) {
+                collected_ = remote_.exchange(nullptr, std::memory_order_acquire);
+                if (!collected_) break;
+            }
+            RemoteSlot* slot = collected_;
+            collected_ = slot->next;
+            Slab* slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(slot) & ~(k_slab_size - 1));
+            free_slot(slab, slot, slot->bytes);
+            taken++;
+        }
+        stats_.remote_frees += taken;
+        return taken;
+    }
+
+    // Unmap every empty slab, spares included. Returns how many were released.
+    size_t release_empty() noexcept {
+        auto guard = lock();
+        size_t released = 0;
+        for (auto& cls : classes_) {
+            for (Slab* slab = cls.partial; slab && cls.empty > 0;) {
+                Slab* next = slab->next;
+                if (slab->used == 0) {
+                    unlink(cls, slab);
+                    cls.empty--;
+                    unmap(slab);
+                    released++;
+                }
+                slab = next;
+            }
+        }
+        return released;
+    }
+
+    // -1 (the default) leaves placement to the kernel, i.e. first touch.
+    void set_preferred_node(int node) noexcept { preferred_node_ = node; }
+
+    [[nodiscard]] SlabStats stats() const noexcept {
+        auto guard = lock();
+        return stats_;
+    }
+
+    // The pool allocations on this thread go to: the installed shard pool, else shared().
+    [[nodiscard]] static SlabPool& local() noexcept { return current_ ? *current_ : shared(); }
+
+    // Lock-protected pool for threads without a shard. Deliberately leaked so objects freed during
+    // static destruction still have somewhere to go.
+    [[nodiscard]] static SlabPool& shared() noexcept {
+        static SlabPool* pool = new SlabPool(true);
+        return *pool;
+    }
+
+    // Installs `pool` as this thread's local() for the lifetime of the scope.
+    class Scope {
+    public:
+        explicit Scope(SlabPool& pool) noexcept : previous_(current_) { current_ = &pool; }
+        ~Scope() { current_ = previous_; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        SlabPool* previous_;
+    };
+
+private:
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    // A remotely freed slot waiting for collect_remote(); every class is at least this big.
+    struct RemoteSlot {
+        RemoteSlot* next;
+        size_t bytes;
+    };
+    static_assert(sizeof(RemoteSlot) <= k_granularity);
+
+    // Lives at the start of each slab; objects follow.
+    struct alignas(64) Slab {
+        SlabPool* owner;
+        Slab* next;
+        Slab* prev;
+        FreeSlot* free_list;
+        uint32_t class_idx;
+        uint32_t used;
+        uint32_t capacity;
+        uint32_t bumped; // slots handed out at least once; everything past it is untouched memory
+
+        std::byte* data() noexcept { return reinterpret_cast<std::byte*>(this) + sizeof(Slab); }
+    };
+
+    struct SizeClass {
+        Slab* partial{nullptr}; // slabs with at least one free slot
+        size_t empty{0};        // how many of those are completely empty
+    };
+
+    inline static thread_local SlabPool* current_{nullptr};
+
+    std::array<SizeClass, k_class_count> classes_{};
+    Slab* full_{nullptr};
+    SlabStats stats_{};
+    bool shared_;
+    int preferred_node_{-1};
+    mutable std::mutex mutex_;
+    std::atomic<RemoteSlot*> remote_{nullptr}; // pushed by any thread, taken whole by the owner
+    RemoteSlot* collected_{nullptr};           // taken but not yet returned to a slab
+
+    static constexpr size_t class_of(size_t bytes) noexcept {
+        return bytes == 0 ? 0 : (bytes + k_granularity - 1) / k_granularity - 1;
+    }
+    static constexpr size_t slot_size(size_t idx) noexcept { return (idx + 1) * k_granularity; }
+
+    [[nodiscard]] std::unique_lock<std::mutex> lock() const noexcept {
+        return shared_ ? std::unique_lock<std::mutex>(mutex_) : std::unique_lock<std::mutex>();
+    }
+
+    void free_slot(Slab* slab, void* p, size_t bytes) noexcept {
+        auto guard = lock();
+        size_t idx = slab->class_idx;
+        SizeClass& cls = classes_[idx];
+        auto* slot = static_cast<FreeSlot*>(p);
+        slot->next = slab->free_list;
+        slab->free_list = slot;
+        if (slab->used == slab->capacity) {
+            unlink_full(slab);
+            link(cls, slab);
+        }
+        slab->used--;
+        stats_.live_objects--;
+        stats_.slot_bytes -= slot_size(idx);
+        stats_.requested_bytes -= bytes;
+
+        if (slab->used == 0) {
+            if (cls.empty > 0) {
+                unlink(cls, slab);
+                unmap(slab);
+            } else {
+                cls.empty++;
+            }
+        }
+    }
+
+    void push_remote(void* p, size_t bytes) noexcept {
+        auto* slot = static_cast<RemoteSlot*>(p);
+        slot->bytes = bytes;
+        slot->next = remote_.load(std::memory_order_relaxed);
+        while (!remote_.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    Slab* map_slab(size_t idx) {
+        // Over-map by one slab and trim, which leaves an aligned k_slab_size region.
+        size_t span = 2 * k_slab_size;
+        void* raw = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw std::bad_alloc();
+        auto base = reinterpret_cast<uintptr_t>(raw);
+        uintptr_t aligned = (base + k_slab_size - 1) & ~(k_slab_size - 1);
+        if (aligned > base) munmap(raw, aligned - base);
+        if (size_t tail = base + span - (aligned + k_slab_size)) {
+            munmap(reinterpret_cast<void*>(aligned + k_slab_size), tail);
+        }
+
+        if (preferred_node_ >= 0) prefer_node(reinterpret_cast<void*>(aligned));
+
+        auto* slab = new (reinterpret_cast<void*>(aligned)) Slab{};
+        slab->owner = this;
+        slab->class_idx = static_cast<uint32_t>(idx);
+        slab->capacity = static_cast<uint32_t>((k_slab_size - sizeof(Slab)) / slot_size(idx));
+        stats_.slabs++;
+        stats_.slab_bytes += k_slab_size;
+        classes_[idx].empty++;
+        return slab;
+    }
+
+    // Before the first touch, so the pages are faulted in on the right node. Best effort: without NUMA
+    // support in the kernel the call fails and the slab is simply placed by first touch.
+    void prefer_node(void* addr) const noexcept {
+#ifdef SYS_mbind
+        constexpr int k_mpol_preferred = 1;
+        constexpr unsigned long k_mask_bits = 8 * sizeof(unsigned long) * 16;
+        unsigned long mask[16] = {};
+        if (static_cast<unsigned long>(preferred_node_) >= k_mask_bits) return;
+        mask[preferred_node_ / (8 * sizeof(unsigned long))] |= 1UL << (preferred_node_ % (8 * sizeof(unsigned long)));
+        (void)syscall(SYS_mbind, addr, k_slab_size, k_mpol_preferred, mask, k_mask_bits, 0);
+#else
+        (void)addr;
+#endif
+    }
+
+    void unmap(Slab* slab) noexcept {
+        stats_.slabs--;
+        stats_.slab_bytes -= k_slab_size;
+        stats_.released_slabs++;
+        munmap(slab, k_slab_size);
+    }
+
+    static void link(SizeClass& cls, Slab* slab) noexcept {
+        slab->prev = nullptr;
+        slab->next = cls.partial;
+        if (cls.partial) cls.partial->prev = slab;
+        cls.partial = slab;
+    }
+
+    static void unlink(SizeClass& cls, Slab* slab) noexcept {
+        if (slab->prev) slab->prev->next = slab->next;
+        else cls.partial = slab->next;
+        if (slab->next) slab->next->prev = slab->prev;
+        slab->next = slab->prev = nullptr;
+    }
+
+    // Full slabs are only tracked so the destructor can unmap them.
+    void push_full(Slab* slab) noexcept {
+        slab->prev = nullptr;
+        slab->next = full_;
+        if (full_) full_->prev = slab;
+        full_ = slab;
+    }
+
+    void unlink_full(Slab* slab) noexcept {
+        if (slab->prev) slab->prev->next = slab->next;
+        else full_ = slab->next;
+        if (slab->next) slab->next->prev = slab->prev;
+        slab->next = slab->prev = nullptr;
+    }
+};
+
+} // namespace ds
+
+#endif // SLAB_ALLOCATOR_HPP
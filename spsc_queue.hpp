@@ -0,0 +1,81 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <optional>
+#include <bit>
+#include <cassert>
+
+namespace ds {
+
+// Bounded single-producer / single-consumer ring. Exactly one thread may push and exactly one thread may pop.
+// No locks, no CAS - just a release store on our own index and an acquire load of the other side's index.
+// head_ and tail_ live on separate cache lines so producer and consumer don't false-share, and each side
+// caches the other's index so the common case touches no shared line at all.
+
+inline constexpr std::size_t k_cache_line = 64;
+
+template<typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(std::size_t capacity)
+        : capacity_(std::bit_ceil(std::max<std::size_t>(capacity, 2))),
+          mask_(capacity_ - 1),
+          slots_(std::make_unique<std::optional<T>[]>(capacity_)) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side. Returns false (leaving value untouched) if the ring is full.
+    bool try_push(T& value) {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ == capacity_) {
+            head_cache_ = head_.load(std::memory_order_acquire); // refresh our stale view of the consumer
+            if (tail - head_cache_ == capacity_) {
+                return false;
+            }
+        }
+        slots_[tail & mask_].emplace(std::move(value));
+        tail_.store(tail + 1, std::memory_order_release); // publish the slot to the consumer
+        return true;
+    }
+
+    // Consumer side. Returns std::nullopt if the ring is empty.
+    std::optional<T> try_pop() {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) {
+                return std::nullopt;
+            }
+        }
+        auto& slot = slots_[head & mask_];
+        std::optional<T> result(std::move(*slot));
+        slot.reset();
+        head_.store(head + 1, std::memory_order_release); // hand the slot back to the producer
+        return result;
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+    [[nodiscard]] std::size_t capacity() const noexcept { return capacity_; }
+
+private:
+    const std::size_t capacity_;
+    const std::size_t mask_;
+    std::unique_ptr<std::optional<T>[]> slots_;
+
+    alignas(k_cache_line) std::atomic<std::size_t> head_{0}; // written by consumer
+    std::size_t tail_cache_{0};                              // consumer's cached copy of tail_
+    alignas(k_cache_line) std::atomic<std::size_t> tail_{0}; // written by producer
+    std::size_t head_cache_{0};                              // producer's cached copy of head_
+};
+
+} // namespace ds
+
+#endif // SPSC_QUEUE_HPP
@@ -1,142 +1,495 @@
 #ifndef THREAD_POOL_HPP
 #define THREAD_POOL_HPP
 
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <future>
-#include <queue>
-#include <thread>
-#include <vector>
+#include <limits>
 #include <memory>
-#include <type_traits>
+#include <new>
+#include <span>
 #include <stdexcept>
-#include <mutex>
-#include <condition_variable>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 namespace threading {
 
-class ThreadPool {
+// Move-only, type-erased void() callable that keeps anything up to k_inline bytes in place, so handing
+// a task to the pool costs no allocation. Bigger callables (rare - a lambda capturing a few pointers
+// fits) are boxed on the heap. Tasks must not throw; use ThreadPool::enqueue for a result or exception.
+class Task {
 public:
-    explicit ThreadPool(size_t num_threads) { // explicit to prevent accidental conversion
-        if (num_threads == 0) {
-            throw std::invalid_argument("Thread pool size must be positive");
+    static constexpr size_t k_inline = 40;
+
+    Task() noexcept = default;
+
+    template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+    Task(F&& f) { // NOLINT: implicit, so a lambda can be passed wherever a Task is expected
+        using Fn = std::decay_t<F>;
+        if constexpr (sizeof(Fn) <= k_inline && alignof(Fn) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible_v<Fn>) {
+            ::new (static_cast<void*>(buf_)) Fn(std::forward<F>(f));
+            ops_ = &inline_ops<Fn>;
+        } else {
+            ::new (static_cast<void*>(buf_)) Fn*(new Fn(std::forward<F>(f)));
+            ops_ = &boxed_ops<Fn>;
+        }
+    }
+
+    Task(Task&& other) noexcept : ops_(other.ops_) {
+        if (ops_) {
+            ops_->move(other.buf_, buf_);
+            other.ops_ = nullptr;
         }
+    }
 
-        try {
-            threads_.reserve(num_threads); // Makes space in the threads_ vector so we don't need to keep resizing it - important property for any container.
-            for (size_t i = 0; i < num_threads; ++i) {  // for each thread...
-                threads_.emplace_back(&ThreadPool::worker, this); // Constructs the thread in-place, each thread runs the worker function.
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            if ((ops_ = other.ops_)) {
+                ops_->move(other.buf_, buf_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() { reset(); }
+
+    void operator()() { ops_->call(buf_); }
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+    void reset() noexcept {
+        if (ops_) {
+            ops_->destroy(buf_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*call)(void*);
+        void (*move)(void* from, void* to) noexcept;
+        void (*destroy)(void*) noexcept;
+    };
+
+    template<typename Fn>
+    static constexpr Ops inline_ops{
+        [](void* p) { (*static_cast<Fn*>(p))(); },
+        [](void* from, void* to) noexcept {
+            ::new (to) Fn(std::move(*static_cast<Fn*>(from)));
+            static_cast<Fn*>(from)->~Fn();
+        },
+        [](void* p) noexcept { static_cast<Fn*>(p)->~Fn(); },
+    };
+
+    template<typename Fn>
+    static constexpr Ops boxed_ops{
+        [](void* p) { (**static_cast<Fn**>(p))(); },
+        [](void* from, void* to) noexcept { ::new (to) Fn*(*static_cast<Fn**>(from)); },
+        [](void* p) noexcept { delete *static_cast<Fn**>(p); },
+    };
+
+    alignas(std::max_align_t) std::byte buf_[k_inline];
+    const Ops* ops_{nullptr};
+};
+
+namespace pool_detail {
+
+inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// A queued task. Nodes come from the pool's arena and are recycled, so they are never freed while
+// the pool is alive - which is what makes the lock-free free list below ABA-safe with a tag.
+struct alignas(64) TaskNode {
+    Task task;
+    std::atomic<uint32_t> next_free{0};
+    bool boxed{false}; // arena was exhausted; this one came from the heap
+};
+
+// Fixed arena of nodes plus a Treiber free list. The head packs {tag, index + 1}; the tag bumps on
+// every pop so a node that was popped and pushed back in between can't fool a stale CAS.
+class NodeArena {
+public:
+    explicit NodeArena(size_t capacity) : nodes_(std::make_unique<TaskNode[]>(capacity)) {
+        for (size_t i = 0; i < capacity; ++i) {
+            nodes_[i].next_free.store(i + 1 < capacity ? static_cast<uint32_t>(i + 2) : 0, std::memory_order_relaxed);
+        }
+        head_.store(capacity ? 1 : 0, std::memory_order_relaxed);
+    }
+
+    TaskNode* acquire() {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        while (true) {
+            auto idx = static_cast<uint32_t>(head);
+            if (idx == 0) {
+                auto* node = new TaskNode;
+                node->boxed = true;
+                return node;
+            }
+            uint32_t next = nodes_[idx - 1].next_free.load(std::memory_order_relaxed);
+            uint64_t desired = ((head >> 32) + 1) << 32 | next;
+            if (head_.compare_exchange_weak(head, desired, std::memory_order_acquire, std::memory_order_acquire)) {
+                return &nodes_[idx - 1];
+            }
+        }
+    }
+
+    void release(TaskNode* node) noexcept {
+        if (node->boxed) {
+            delete node;
+            return;
+        }
+        auto idx = static_cast<uint32_t>(node - nodes_.get()) + 1;
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        do {
+            node->next_free.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        } while (!head_.compare_exchange_weak(head, (head & ~uint64_t{0xFFFFFFFF}) | idx,
+                                              std::memory_order_release, std::memory_order_relaxed));
+    }
+
+private:
+    std::unique_ptr<TaskNode[]> nodes_;
+    std::atomic<uint64_t> head_{0};
+};
+
+// Chase-Lev work-stealing deque (the C11 formulation of Le et al.): the owning worker pushes and pops
+// at the bottom, LIFO, for locality; thieves take from the top, FIFO. Fixed capacity - push() fails
+// when full and the caller sends the task elsewhere.
+class WorkDeque {
+public:
+    explicit WorkDeque(size_t capacity)
+        : mask_(std::bit_ceil(capacity) - 1), slots_(std::make_unique<std::atomic<TaskNode*>[]>(mask_ + 1)) {}
+
+    bool push(TaskNode* node) noexcept {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        if (b - t > static_cast<int64_t>(mask_)) return false;
+        slots_[static_cast<size_t>(b) & mask_].store(node, std::memory_order_relaxed);
+        bottom_.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    TaskNode* pop() noexcept {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_seq_cst);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        TaskNode* node = slots_[static_cast<size_t>(b) & mask_].load(std::memory_order_relaxed);
+        if (t == b) {
+            // Last one: race the thieves for it.
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                node = nullptr;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return node;
+    }
+
+    TaskNode* steal() noexcept {
+        int64_t t = top_.load(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_seq_cst);
+        if (t >= b) return nullptr;
+        TaskNode* node = slots_[static_cast<size_t>(t) & mask_].load(std::memory_order_relaxed);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr; // lost to the owner or another thief
+        }
+        return node;
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return top_.load(std::memory_order_acquire) >= bottom_.load(std::memory_order_acquire);
+    }
+
+private:
+    size_t mask_;
+    std::unique_ptr<std::atomic<TaskNode*>[]> slots_;
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+};
+
+// Bounded MPMC queue (Vyukov): each cell carries a sequence number saying whose turn it is, so
+// producers and consumers only contend on their own end's counter. Used for tasks submitted from
+// outside the pool, which have no deque of their own.
+class InjectQueue {
+public:
+    explicit InjectQueue(size_t capacity)
+        : mask_(std::bit_ceil(capacity) - 1), cells_(std::make_unique<Cell[]>(mask_ + 1)) {
+        for (size_t i = 0; i <= mask_; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(TaskNode* node) noexcept {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.node = node;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
             }
-        } catch (...) { // if anything fails, we'll catch all possible exceptions using ... and do the following:
-            stop = true; // stop flag to let all workers know to leave the premises
-            condition_.notify_all(); // tell all workers condition has been changed.
-            for (auto& thread : threads_) {  // for each thread in threads_ vector...
-                if (thread.joinable()) { // join all running threeads
-                    thread.join(); 
+        }
+    }
+
+    TaskNode* pop() noexcept {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    TaskNode* node = cell.node;
+                    cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+                    return node;
                 }
+            } else if (diff < 0) {
+                return nullptr; // empty
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
             }
-            throw; // rethrow an exception
         }
     }
 
-    ~ThreadPool() {
-        {
-            std::lock_guard<std::mutex> lock(mutex_); // destructor secures a lock
-            stop = true; // set stop condition to true to let workers know to leave
+    [[nodiscard]] bool empty() const noexcept {
+        size_t pos = head_.load(std::memory_order_acquire);
+        return cells_[pos & mask_].seq.load(std::memory_order_acquire) != pos + 1;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        TaskNode* node{nullptr};
+    };
+
+    size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+} // namespace pool_detail
+
+// Work-stealing pool. Each worker owns a Chase-Lev deque: tasks submitted from a worker (fan-out from
+// inside a task) go on its own deque, everything else through one lock-free injection queue. An idle
+// worker takes from its deque, then the injection queue, then steals from the others, and only after
+// k_spin_rounds empty rounds parks on a futex (std::atomic::wait) until a submit bumps the epoch.
+// No lock anywhere on the submit/run path, and the queues hold pointers to arena nodes, so a submit
+// allocates nothing unless the arena runs dry.
+//
+// Destruction runs everything already submitted before joining, so work queued against an object
+// still finishes while that object is alive - the server relies on it for background freeing.
+class ThreadPool {
+public:
+    static constexpr size_t k_deque_capacity = 1024;
+    static constexpr size_t k_inject_capacity = 8192;
+    static constexpr size_t k_arena_nodes = 8192;
+    static constexpr int k_spin_rounds = 64;
+
+    // With `cpus` given, worker i pins itself to cpus[i % cpus.size()].
+    explicit ThreadPool(size_t num_threads, std::vector<int> cpus = {})
+        : arena_(k_arena_nodes), inject_(k_inject_capacity), cpus_(std::move(cpus)) {
+        if (num_threads == 0) {
+            throw std::invalid_argument("Thread pool size must be positive");
         }
-        condition_.notify_all(); // ^^ 
-        /*
-        Joining before ending reasons:
-        If ThreadPool is destroyed without joining threads, the threads:
-        Might try to access memory that no longer exists.
-        Could cause undefined behavior or crashes.
-        */
-        for (auto& thread : threads_) { // ^^
-            if (thread.joinable()) { // ^^ Is it joinable?
-                thread.join(); // ^^ Then we join.  Must check joinable before join to prevent crashes.
+        workers_.reserve(num_threads);
+        for (size_t i = 0; i < num_threads; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        try {
+            threads_.reserve(num_threads);
+            for (size_t i = 0; i < num_threads; ++i) {
+                threads_.emplace_back(&ThreadPool::worker_loop, this, i);
             }
+        } catch (...) {
+            shutdown();
+            throw;
         }
     }
-    // delete copy constructor 3 reasons - we're dealing with shared states, threads cant be copied and concurrency makes copying unsafe
-    ThreadPool(const ThreadPool&) = delete; . 
+
+    ~ThreadPool() { shutdown(); }
+
+    ThreadPool(const ThreadPool&) = delete;
     ThreadPool& operator=(const ThreadPool&) = delete;
-    // default move constructor - if necessary to transfer ownership we default this behavior! 
-    ThreadPool(ThreadPool&&) noexcept = default;
-    ThreadPool& operator=(ThreadPool&&) noexcept = default;
-
-    template<typename F, typename... Args>  // Template for function
-    auto enqueue(F&& f, Args&&... args) // Templated function signature - we accept a function and its arguments respetively. notice they're all RValues.
-        -> std::future<typename std::result_of<F, Args...>::type>  // the return type is wrapped in future && result_of to retrieve the result / return type asynchonously
-    {
-        using return_type = typename std::result_of<F, Args...>::type; // extracts the return type of our templated argument and assigns to return_type with using directive
-
-        auto task = std::make_shared<std::packaged_task<return_type()> >( // make_shared pointer for our packaged_task with expected return_type. 
-            std::bind(std::forward<F>(f), std::forward<Args>(args)...) // we create a callable object that stores F and its arguments to ensure asynchronous execution by a worker thread.
-        ); // using shared to easily move the task queue and execute later without ownnership issues. 
-
-        /*
-        Retrieves a std::future<return_type> from the packaged_task.
-        The future allows the caller to retrieve the result later.
-        */
-        std::future<return_type> res = task->get_future();
-        {
-            std::lock_guard<std::mutex> lock(mutex_); // lock task queue to prevent race conditions
-            if (stop) { // if stopped (error or manual), throw runtime_error
-                throw std::runtime_error("Cannot enqueue on stopped ThreadPool");
-            }
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
 
-            tasks_.emplace([task]() { (*task)(); }); // nasty looking lambda function - when the worker threads retrives the task, t executes task. emplace to construct directly in the queue.
-        } 
-        condition_.notify_one();
-        return res;
+    // Fire-and-forget. Throws std::runtime_error once the pool is shutting down.
+    void submit(Task task) {
+        check_running();
+        push(make_node(std::move(task)));
+        wake(1);
+    }
+
+    // Many tasks for the price of one wakeup round: all are queued before any worker is woken.
+    void submit_batch(std::span<Task> tasks) {
+        if (tasks.empty()) return;
+        check_running();
+        for (Task& task : tasks) push(make_node(std::move(task)));
+        wake(tasks.size());
     }
 
-    [[nodiscard]] size_t thread_count() const noexcept { return threads_.size(); } //  get threads_ vector size
-    [[nodiscard]] size_t queue_size() const { // get tasks queue size. must lock. if a thread grabs a task while we're reading, we can crash or corrupt our return value. 
-        std::lock_guard<std::mutex> lock(mutex_); // smart lock, behaves like a unique or shared ptr, automatically lifted upon function termnination. 
-        return tasks_.size();
+    // Submit with a result. The future's shared state costs an allocation, unlike submit().
+    template<typename F, typename... Args>
+    auto enqueue(F&& f, Args&&... args) -> std::future<std::invoke_result_t<F, Args...>> {
+        using return_type = std::invoke_result_t<F, Args...>;
+        std::packaged_task<return_type()> task(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+        std::future<return_type> res = task.get_future();
+        submit(Task([task = std::move(task)]() mutable { task(); }));
+        return res;
     }
 
-    void wait_for_tasks() { // Blocks the calling thread until all takss are processed
-        std::unique_lock<std::mutex> lock(mutex_); // only one thread can access the resource at a tim 
-        // Note this is a lambda function -  void wait(std::unique_lock<std::mutex>& lock, Predicate pred); where predicate is a lambda function that returns a boolean. 
-        condition_.wait(lock, [this] { // suspend the calling thread until a notification is received by condition
-            return tasks_.empty(); // condition_.wait() will keep waiting until tasks.empty() is true. 
-        });
+    [[nodiscard]] size_t thread_count() const noexcept { return threads_.size(); }
+    // Tasks submitted and not yet finished (queued or running).
+    [[nodiscard]] size_t queue_size() const noexcept { return pending_.load(std::memory_order_acquire); }
+
+    // Blocks until every task submitted so far (and anything they submit) has finished.
+    void wait_for_tasks() {
+        for (size_t n = pending_.load(std::memory_order_acquire); n != 0; n = pending_.load(std::memory_order_acquire)) {
+            pending_.wait(n, std::memory_order_acquire);
+        }
     }
 
 private:
-    void worker() {
-        while (true) { 
-            std::function<void()> task; // Declare a function object to hold a task that the worker will execute
-            {
-                std::unique_lock<std::mutex> lock(mutex_); // create a lock on the mutex to ensure exclusive access to the task queue
-                
-                condition_.wait(lock, [this] { // put the thread to sleep unless 'stop' is true or there is at least one task in the queue.
-                    return stop || !tasks_.empty();
-                });
-        
-                if (stop && tasks_.empty()) { // if 'stop' is true and there are no remaining tasks...
-                    return; //exit the worker thread.
-                }
-        
-                task = std::move(tasks_.front()); // move the first task from the queue into 'task' (avoids unnecessary copying)
-                tasks_.pop(); // remove the retrieved task from the queue
-            } // mutex automatically unlocks here as 'lock' goes out of scope
-        
-            task(); // execute the task.
+    struct Worker {
+        pool_detail::WorkDeque deque{k_deque_capacity};
+    };
+
+    inline static thread_local ThreadPool* current_pool_{nullptr};
+    inline static thread_local size_t current_index_{0};
+
+    pool_detail::NodeArena arena_;
+    pool_detail::InjectQueue inject_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::vector<int> cpus_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<uint32_t> epoch_{0};   // bumped on every submit; parked workers wait for it to move
+    std::atomic<uint32_t> sleepers_{0};
+    std::atomic<bool> stop_{false};
+
+    // Work submitted from inside the pool is still accepted while it drains.
+    void check_running() const {
+        if (stop_.load(std::memory_order_acquire) && current_pool_ != this) {
+            throw std::runtime_error("Cannot enqueue on stopped ThreadPool");
         }
-        
     }
 
-    std::vector<std::thread> threads_; // a vector of std::threads
-    std::queue<std::function<void()>> tasks_; // a queue of tasks! 
+    pool_detail::TaskNode* make_node(Task task) {
+        pool_detail::TaskNode* node = arena_.acquire();
+        node->task = std::move(task);
+        pending_.fetch_add(1, std::memory_order_relaxed);
+        return node;
+    }
+
+    void push(pool_detail::TaskNode* node) {
+        if (current_pool_ == this && workers_[current_index_]->deque.push(node)) return;
+        while (!inject_.push(node)) {
+            // Injection queue full: the workers are far behind, so lend a hand rather than block.
+            if (pool_detail::TaskNode* other = inject_.pop()) run(other);
+        }
+    }
 
-    mutable std::mutex mutex_; // Locking a resource so no other threads can grab it. *** We should replace this with a more efficient method for concurrency ***
-    std::condition_variable condition_; /
-    /* std::condition_variable is a synchronization primitive that is used to safely make threads wait until a condition is met instead of busy-waiting. 
-    Threads sleep and are awoken by API calls like notify_one() or notify_all() to 'wake' the threads and respond to a tasks or termination. 
-     */
-    bool stop{false}; // this will be our terminate() flag, when this is true, all woken threads will check it and handle termination/joining.
+    void wake(size_t count) {
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+        uint32_t sleeping = sleepers_.load(std::memory_order_seq_cst);
+        if (sleeping == 0) return;
+        if (count >= sleeping) {
+            epoch_.notify_all();
+        } else {
+            while (count--) epoch_.notify_one();
+        }
+    }
+
+    void run(pool_detail::TaskNode* node) {
+        node->task();
+        node->task.reset();
+        arena_.release(node);
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) pending_.notify_all();
+    }
+
+    pool_detail::TaskNode* find_work(size_t self) noexcept {
+        if (pool_detail::TaskNode* node = workers_[self]->deque.pop()) return node;
+        if (pool_detail::TaskNode* node = inject_.pop()) return node;
+        for (size_t i = 1; i < workers_.size(); ++i) {
+            if (pool_detail::TaskNode* node = workers_[(self + i) % workers_.size()]->deque.steal()) return node;
+        }
+        return nullptr;
+    }
+
+    void worker_loop(size_t self) {
+        current_pool_ = this;
+        current_index_ = self;
+        if (!cpus_.empty()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus_[self % cpus_.size()], &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set); // best effort: unpinned still works
+        }
+        while (true) {
+            pool_detail::TaskNode* node = nullptr;
+            for (int spin = 0; spin < k_spin_rounds && !node; ++spin) {
+                node = find_work(self);
+                if (!node) pool_detail::cpu_relax();
+            }
+            if (node) {
+                run(node);
+                continue;
+            }
+
+            // Park. Reading the epoch before the last look means a submit racing with it either gets
+            // seen by that look or has moved the epoch, in which case wait() returns straight away.
+            uint32_t seen = epoch_.load(std::memory_order_seq_cst);
+            sleepers_.fetch_add(1, std::memory_order_seq_cst);
+            node = find_work(self);
+            if (!node) {
+                if (stop_.load(std::memory_order_acquire)) {
+                    sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+                    return;
+                }
+                epoch_.wait(seen, std::memory_order_seq_cst);
+            }
+            sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+            if (node) run(node);
+        }
+    }
+
+    void shutdown() noexcept {
+        stop_.store(true, std::memory_order_release);
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+        epoch_.notify_all();
+        for (auto& thread : threads_) {
+            if (thread.joinable()) thread.join();
+        }
+        threads_.clear();
+    }
 };
 
 } // namespace threading
@@ -0,0 +1,203 @@
+#ifndef TIMING_WHEEL_HPP
+#define TIMING_WHEEL_HPP
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace ds {
+
+// Intrusive hook for TimingWheel: the timed type derives from it, like HNode for HMap. pprev points at
+// whichever pointer links to this node (a bucket head or the previous node's next), so unlinking needs
+// neither a back-pointer to the bucket nor a doubly-linked head.
+struct TimerNode {
+    TimerNode* next{nullptr};
+    TimerNode** pprev{nullptr};
+    uint64_t deadline{0}; // in ticks
+
+    [[nodiscard]] bool armed() const noexcept { return pprev != nullptr; }
+};
+
+// Hierarchical timing wheel over intrusive T (which must derive from TimerNode): k_levels wheels of
+// k_slots buckets each, level L covering ticks in steps of k_slots^L. A timer lives in the level of the highest base-k_slots digit in which its deadline differs
+// from the current tick, in the bucket named by that digit; when the clock reaches that bucket's
+// boundary the bucket is cascaded, re-filing its timers into lower levels, until they land in level 0
+// on their exact tick. Arm, re-arm and cancel are O(1) list splices; a timer is moved at most k_levels - 1
+// times over its life. A per-level occupancy bitmap lets advance() jump straight over empty stretches.
+//
+// Deadlines are whole ticks - the caller picks the tick length and so the granularity. Deadlines further
+// out than the wheel spans (k_slots^k_levels ticks) stay in the top level, re-filed once per turn.
+template<typename T>
+class TimingWheel {
+public:
+    static constexpr unsigned k_slot_bits = 6;
+    static constexpr size_t k_slots = size_t{1} << k_slot_bits;
+    static constexpr unsigned k_levels = 6;
+
+    explicit TimingWheel(uint64_t now_tick = 0) noexcept : now_(now_tick) {}
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    // Arms `item` for `deadline`, re-arming it if it is already armed. Past deadlines fire on the next advance().
+    void arm(T& item, uint64_t deadline) noexcept {
+        TimerNode& node = item;
+        if (node.armed()) {
+            unlink(node);
+        } else {
+            size_++;
+        }
+        node.deadline = deadline;
+        file(node);
+    }
+
+    void cancel(T& item) noexcept {
+        TimerNode& node = item;
+        if (!node.armed()) return;
+        unlink(node);
+        size_--;
+    }
+
+    // Fires every timer with deadline <= `tick`: each is disarmed, then passed to on_expire (which may re-arm
+    // it or arm others). Stops after `max` timers and returns how many fired; a later call picks up where
+    // this one left off.
+    template<typename OnExpire>
+    size_t advance(uint64_t tick, size_t max, OnExpire&& on_expire) {
+        size_t fired = 0;
+        while (now_ <= tick) {
+            if (size_ == 0) {
+                now_ = tick + 1;
+                break;
+            }
+            uint64_t next = next_event();
+            if (next > tick) {
+                now_ = tick + 1;
+                break;
+            }
+            now_ = next;
+            cascade(now_);
+
+            TimerNode*& head = buckets_[0][now_ & k_mask];
+            while (head) {
+                if (fired == max) return fired;
+                TimerNode& node = *head;
+                unlink(node);
+                size_--;
+                fired++;
+                on_expire(static_cast<T&>(node));
+            }
+            now_++;
+        }
+        return fired;
+    }
+
+    // First tick not yet processed by advance().
+    [[nodiscard]] uint64_t now() const noexcept { return now_; }
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+
+    // Earliest tick >= now() at which advance() has anything to do: a non-empty level-0 bucket, or the
+    // boundary of a non-empty higher-level bucket. Never later than the earliest deadline, so it is when
+    // to wake up next.
+    [[nodiscard]] uint64_t next_event() const noexcept {
+        if ((now_ & k_mask) == 0) return now_; // a boundary may have buckets to cascade
+        for (unsigned level = 0; level < k_levels; ++level) {
+            size_t from = digit(now_, level) + (level == 0 ? 0 : 1);
+            uint64_t pending = from < k_slots ? occupied_[level] >> from << from : 0;
+            uint64_t window = now_ >> shift(level + 1) << shift(level + 1);
+            if (pending) {
+                return window + (static_cast<uint64_t>(std::countr_zero(pending)) << shift(level));
+            }
+            // Only buckets behind the current digit: they come round once this level turns over, and
+            // nothing in a higher level can be due before that.
+            if (occupied_[level] && level + 1 < k_levels) {
+                return window + (uint64_t{1} << shift(level + 1));
+            }
+        }
+        uint64_t top = shift(k_levels - 1);
+        return ((now_ >> top) + 1) << top;
+    }
+
+    // Disarms everything without firing it.
+    void clear() noexcept {
+        for (auto& level : buckets_) {
+            for (TimerNode*& head : level) {
+                while (head) unlink(*head);
+            }
+        }
+        occupied_.fill(0);
+        size_ = 0;
+    }
+
+private:
+    static constexpr uint64_t k_mask = k_slots - 1;
+
+    std::array<std::array<TimerNode*, k_slots>, k_levels> buckets_{};
+    std::array<uint64_t, k_levels> occupied_{}; // bit i set <=> buckets_[level][i] non-empty
+    uint64_t now_;
+    size_t size_{0};
+
+    static constexpr unsigned shift(unsigned level) noexcept { return level * k_slot_bits; }
+    static constexpr size_t digit(uint64_t tick, unsigned level) noexcept {
+        return static_cast<size_t>((tick >> shift(level)) & k_mask);
+    }
+
+    void file(TimerNode& node) noexcept {
+        uint64_t deadline = node.deadline < now_ ? now_ : node.deadline;
+        auto top_bit = static_cast<unsigned>(std::bit_width(deadline ^ now_));
+        unsigned level = top_bit == 0 ? 0 : (top_bit - 1) / k_slot_bits;
+        if (level >= k_levels) level = k_levels - 1;
+        // In the top level the deadline may lie beyond the current turn; its bucket still comes round at the
+        // right time or earlier, and cascading just files it back up there until the turn it's due in.
+        size_t slot = digit(deadline, level);
+
+        TimerNode*& head = buckets_[level][slot];
+        node.next = head;
+        if (head) head->pprev = &node.next;
+        head = &node;
+        node.pprev = &head;
+        occupied_[level] |= uint64_t{1} << slot;
+    }
+
+    void unlink(TimerNode& node) noexcept {
+        *node.pprev = node.next;
+        if (node.next) node.next->pprev = node.pprev;
+        if (!node.next && is_bucket_head(node.pprev)) clear_bit_if_empty(node.pprev);
+        node.next = nullptr;
+        node.pprev = nullptr;
+    }
+
+    [[nodiscard]] bool is_bucket_head(TimerNode** p) const noexcept {
+        auto* first = &buckets_[0][0];
+        auto* last = &buckets_[k_levels - 1][k_slots - 1];
+        return p >= first && p <= last;
+    }
+
+    void clear_bit_if_empty(TimerNode** head) noexcept {
+        if (*head) return;
+        auto idx = static_cast<size_t>(head - &buckets_[0][0]);
+        occupied_[idx / k_slots] &= ~(uint64_t{1} << (idx % k_slots));
+    }
+
+    // Re-files the buckets whose boundary is `tick`, top level first so timers can fall several levels at once.
+    void cascade(uint64_t tick) noexcept {
+        for (unsigned level = k_levels - 1; level > 0; --level) {
+            if (tick & ((uint64_t{1} << shift(level)) - 1)) continue;
+            TimerNode*& head = buckets_[level][digit(tick, level)];
+            TimerNode* list = head;
+            if (!list) continue;
+            head = nullptr;
+            occupied_[level] &= ~(uint64_t{1} << digit(tick, level));
+            while (list) {
+                TimerNode* node = list;
+                list = list->next;
+                file(*node);
+            }
+        }
+    }
+};
+
+} // namespace ds
+
+#endif // TIMING_WHEEL_HPP
@@ -5,45 +5,49 @@
 #include <string_view>
 #include <cstring>
 #include <cassert>
-#include "avl_tree.hpp"
-#include "hash_table.hpp"
+#include <new>
+#include <optional>
+#include <span>
+#include <algorithm>
+#include "btree.hpp"
+#include "listpack.hpp"
+#include "hashtable.hpp"
+#include "flat_hashtable.hpp"
 #include <string>
 #include "common.hpp"
+#include "slab_allocator.hpp"
 
 namespace ds {
 
-// Node structure that preserves the memory layout
-class alignas(max_align_t) ZNode {
-    friend class ZSet;
+// A sorted-set member of a tree-encoded set. The hash index (name -> member) owns it; the B+tree holds
+// {score, pointer} entries ordered by (score, name) and reaches the name through the pointer.
+// The name is stored inline after the struct (one allocation per member, no std::string indirection).
+class ZNode : public HNode<ZNode> {
+    template<template<typename> class> friend class BasicZSet;
 
 private:
-    AVLNode tree_;
-    HNode hash_;
     double score_;
     size_t name_len_;
     char name_[1];  // Flexible array member simulation in C++
 
     // Private constructor - only created through factory function
-    ZNode(double score, size_t len) 
-        : score_(score), name_len_(len) {}
+    ZNode(double score, size_t len, std::uint64_t hcode)
+        : HNode<ZNode>(hcode), score_(score), name_len_(len) {}
 
 public:
-    static ZNode* create(std::string_view name, double score) {
-        void* mem = ::operator new(sizeof(ZNode) + name.length());
-        ZNode* node = new(mem) ZNode(score, name.length());
-        node->tree_ = AVLNode{};
-        node->hash_ = HNode{};
-        node->hash_.hcode = hash_string(
-            reinterpret_cast<const uint8_t*>(name.data()), 
-            name.length()
-        );
+    static std::unique_ptr<ZNode> create(std::string_view name, double score) {
+        void* mem = SlabPool::local().allocate(sizeof(ZNode) + name.length());
+        auto hcode = hash_string(reinterpret_cast<const uint8_t*>(name.data()), name.length());
+        ZNode* node = new(mem) ZNode(score, name.length(), hcode);
         std::memcpy(node->name_, name.data(), name.length());
-        return node;
+        return std::unique_ptr<ZNode>(node);
     }
 
-    static void destroy(ZNode* node) {
+    // Destroying delete: the real allocation size depends on the name, so read it before the node goes away.
+    static void operator delete(ZNode* node, std::destroying_delete_t) noexcept {
+        size_t bytes = sizeof(ZNode) + node->name_len_;
         node->~ZNode();
-        ::operator delete(node);
+        SlabPool::deallocate(node, bytes);
     }
 
     [[nodiscard]] std::string_view name() const {
@@ -56,161 +60,385 @@ public:
     ZNode& operator=(const ZNode&) = delete;
 };
 
-class ZSet {
+// What callers see of a member, whatever the encoding. The name views the set's own storage.
+using ZMember = ZListpack::Member;
+
+// One end of a score interval, e.g. "(1.5" -> {1.5, exclusive}.
+struct ScoreBound {
+    double value;
+    bool exclusive{false};
+};
+
+struct ZTreeEntry {
+    double score;
+    ZNode* node;
+};
+
+struct ZTreeLess {
+    bool operator()(const ZTreeEntry& a, const ZTreeEntry& b) const {
+        if (a.score != b.score) return a.score < b.score;
+        return a.node->name() < b.node->name();
+    }
+};
+
+using ZTree = BPlusTree<ZTreeEntry, ZTreeLess>;
+
+enum class ZEncoding : uint8_t { Listpack, Tree };
+
+// Forward walk over a run of members whose length is known up front (rank and score ranges both compute it
+// in O(log n)). next_batch() hands members out in chunks so the caller can size its output once per chunk
+// instead of growing the response buffer member by member. Any write to the set invalidates the cursor.
+class ZCursor {
 public:
-    ZSet() = default;
-    ~ZSet() { dispose(); }
+    ZCursor() = default;
 
-    ZSet(const ZSet&) = delete;
-    ZSet& operator=(const ZSet&) = delete;
+    static ZCursor over_listpack(const uint8_t* first, uint64_t count) noexcept {
+        ZCursor c;
+        c.lp_ = first;
+        c.remaining_ = first ? count : 0;
+        return c;
+    }
 
-    bool add(std::string_view name, double score);
-    ZNode* lookup(std::string_view name) const;
-    ZNode* pop(std::string_view name);
-    ZNode* query(double score, std::string_view name, int64_t offset) const;
+    static ZCursor over_tree(ZTree::Position first, uint64_t count) noexcept {
+        ZCursor c;
+        c.pos_ = first;
+        c.remaining_ = first.valid() ? count : 0;
+        return c;
+    }
 
-    void dispose() {
-        if (root_) {
-            dispose_tree(root_);
-            root_ = nullptr;
+    [[nodiscard]] uint64_t remaining() const noexcept { return remaining_; }
+
+    // Stop after at most n more members.
+    ZCursor& limit(uint64_t n) noexcept {
+        remaining_ = std::min(remaining_, n);
+        return *this;
+    }
+
+    std::optional<ZMember> next() noexcept {
+        if (remaining_ == 0) return std::nullopt;
+        remaining_--;
+        if (lp_) {
+            ZMember m = ZListpack::read(lp_);
+            lp_ = ZListpack::next(lp_);
+            return m;
+        }
+        const ZTreeEntry& e = pos_.get();
+        ZMember m{e.node->name(), e.score};
+        pos_.advance();
+        return m;
+    }
+
+    // Fills up to out.size() members; returns how many were written (0 once exhausted).
+    size_t next_batch(std::span<ZMember> out) noexcept {
+        size_t n = 0;
+        while (n < out.size()) {
+            auto m = next();
+            if (!m) break;
+            out[n++] = *m;
         }
-        hmap_.dispose();
+        return n;
     }
 
 private:
-    AVLNode* root_{nullptr};
-    HMap hmap_{};
+    const uint8_t* lp_{nullptr};
+    ZTree::Position pos_{};
+    uint64_t remaining_{0};
+};
+
+// Small sets live in a ZListpack: one buffer, ~9 bytes of overhead per member. Past
+// ZListpack::k_max_entries members (or on a name longer than ZListpack::k_max_name) the set converts, once
+// and for good, to the tree encoding: members as ZNodes owned by a name index, ordered by a B+tree whose
+// wide leaves make range scans sequential. Callers never see which one is in use.
+// Index is the name -> member hash backend: the chained HMap or the open-addressing FlatHMap. Both own the
+// members and expose the same insert/find/remove surface, so nothing else here depends on the choice.
+template<template<typename> class Index = HMap>
+class BasicZSet {
+public:
+    BasicZSet() = default;
+    ~BasicZSet() { dispose(); }
+
+    BasicZSet(const BasicZSet&) = delete;
+    BasicZSet& operator=(const BasicZSet&) = delete;
 
-    static void dispose_tree(AVLNode* node);
-    void update_score(ZNode* node, double new_score);
-    void tree_add(ZNode* node);
+    // Returns true if a new member was added, false if an existing member's score was updated.
+    bool add(std::string_view name, double score);
+    std::optional<double> score(std::string_view name);
+    // Returns false if there was no such member.
+    bool remove(std::string_view name);
+    // Replaces the contents with `members`, which must be in strictly ascending (score, name) order with
+    // distinct names - e.g. a set read back from a snapshot. O(n), against O(n log n) for n add() calls.
+    void assign_sorted(std::span<const ZMember> members);
+    // Members from the first one >= (score, name), shifted by `offset` positions, to the end of the set.
+    [[nodiscard]] ZCursor seek(double score, std::string_view name, int64_t offset) const;
+
+    // 0-based position of `name` in ascending (score, name) order.
+    std::optional<uint64_t> rank(std::string_view name);
+    // Members at ranks [start, stop] inclusive, both already clamped to [0, size()).
+    [[nodiscard]] ZCursor range_by_rank(uint64_t start, uint64_t stop) const noexcept;
+    // Members with lo <= score <= hi (either end may be exclusive), in ascending order.
+    [[nodiscard]] ZCursor range_by_score(ScoreBound lo, ScoreBound hi) const;
+    [[nodiscard]] uint64_t count(ScoreBound lo, ScoreBound hi) const;
+    // Returns how many members were removed. O(log n) to find the run, O(log n) per removed member.
+    uint64_t remove_range_by_score(ScoreBound lo, ScoreBound hi);
+
+    [[nodiscard]] size_t size() const noexcept {
+        return encoding_ == ZEncoding::Listpack ? listpack_.size() : static_cast<size_t>(tree_.size());
+    }
+    [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+    [[nodiscard]] ZEncoding encoding() const noexcept { return encoding_; }
+    // Approximate bytes held by the members and the structures indexing them. O(n) for the tree encoding.
+    [[nodiscard]] size_t memory_usage() const;
+    // The same, estimated in O(1) (tree nodes taken as 2/3 full) for memory accounting on every write.
+    [[nodiscard]] size_t approx_bytes() const noexcept {
+        if (encoding_ == ZEncoding::Listpack) return sizeof(*this) + listpack_.bytes();
+        return sizeof(*this) + name_bytes_ + size() * (sizeof(ZNode) + sizeof(ZTreeEntry) * 3 / 2 + sizeof(void*));
+    }
+
+    void dispose() {
+        listpack_.clear();
+        tree_.clear();  // entries only point at members - drop the tree before the owner frees them
+        hmap_.clear();  // the hash index owns every member
+        name_bytes_ = 0;
+        encoding_ = ZEncoding::Listpack;
+    }
 
-    static bool less(const AVLNode* lhs, const AVLNode* rhs);
-    static bool less(const AVLNode* lhs, double score, std::string_view name);
+private:
+    ZEncoding encoding_{ZEncoding::Listpack};
+    ZListpack listpack_;
+    ZTree tree_;
+    Index<ZNode> hmap_{};
+    size_t name_bytes_{0}; // tree encoding: sum of member name lengths
+
+    ZNode* lookup(std::string_view name);
+    void convert_to_tree();
+    void tree_insert(std::string_view name, double score);
+    void erase_node(ZNode* node);
+    [[nodiscard]] ZCursor cursor_at(uint64_t rank, uint64_t count) const noexcept;
+
+    // Members sorting before the bound's edge: score < value, or score <= value with or_equal.
+    [[nodiscard]] uint64_t count_scores_below(double score, bool or_equal) const;
+    template<typename Before>
+    [[nodiscard]] uint64_t count_before(Before&& before) const;
 };
 
-inline bool ZSet::less(const AVLNode* lhs, const AVLNode* rhs) {
-    auto* zl = container_of(lhs, ZNode, tree_);
-    auto* zr = container_of(rhs, ZNode, tree_);
+using ZSet = BasicZSet<HMap>;
+using FlatZSet = BasicZSet<FlatHMap>;
 
-    if (zl->score_ != zr->score_) {
-        return zl->score_ < zr->score_;
+template<template<typename> class Index>
+ZNode* BasicZSet<Index>::lookup(std::string_view name) {
+    if (hmap_.empty()) {
+        return nullptr;
     }
-    return zl->name() < zr->name();
+
+    auto hcode = hash_string(reinterpret_cast<const uint8_t*>(name.data()), name.length());
+    return hmap_.find(hcode, [name](const ZNode& node) { return node.name() == name; });
 }
 
-inline bool ZSet::less(const AVLNode* lhs, double score, std::string_view name) {
-    auto* zl = container_of(lhs, ZNode, tree_);
-    if (zl->score_ != score) {
-        return zl->score_ < score;
+// Both encodings order by (score, name), so one predicate shape drives rank and range queries on either.
+template<template<typename> class Index>
+template<typename Before>
+uint64_t BasicZSet<Index>::count_before(Before&& before) const {
+    if (encoding_ == ZEncoding::Listpack) {
+        return listpack_.count_before(before);
     }
-    return zl->name() < name;
+    return tree_.count_before([&](const ZTreeEntry& e) { return before(ZMember{e.node->name(), e.score}); });
 }
 
-inline bool hcmp(const HNode* node, const HNode* key) {
-    if (node->hcode != key->hcode) return false;
-
-    auto* znode = container_of(node, ZNode, hash_);
-    auto* hkey = container_of(key, HKey, node);
-
-    return znode->name() == hkey->name;
+template<template<typename> class Index>
+ZCursor BasicZSet<Index>::cursor_at(uint64_t rank, uint64_t count) const noexcept {
+    if (rank >= size() || count == 0) return {};
+    if (encoding_ == ZEncoding::Listpack) {
+        return ZCursor::over_listpack(listpack_.data() + listpack_.at(rank), count);
+    }
+    return ZCursor::over_tree(tree_.at(rank), count);
 }
 
-void ZSet::tree_add(ZNode* node) {
-    if (!root_) {
-        root_ = &node->tree_;
-        return;
+template<template<typename> class Index>
+void BasicZSet<Index>::convert_to_tree() {
+    assert(encoding_ == ZEncoding::Listpack);
+    for (size_t off = 0; off < listpack_.bytes(); off = listpack_.next(off)) {
+        ZMember m = listpack_.read(off);
+        tree_insert(m.name, m.score);
     }
+    listpack_.clear();
+    encoding_ = ZEncoding::Tree;
+}
 
-    AVLNode* cur = root_;
-    while (true) {
-        AVLNode** from = less(&node->tree_, cur) ? 
-            &cur->left : &cur->right;
-        if (!*from) {
-            *from = &node->tree_;
-            node->tree_.parent = cur;
-            root_ = avl_fix(&node->tree_);
-            break;
-        }
-        cur = *from;
-    }
+template<template<typename> class Index>
+void BasicZSet<Index>::tree_insert(std::string_view name, double score) {
+    auto node = ZNode::create(name, score);
+    ZNode* raw = node.get();
+    hmap_.insert(std::move(node));
+    tree_.insert(ZTreeEntry{score, raw});
+    name_bytes_ += name.size();
 }
 
-void ZSet::update_score(ZNode* node, double new_score) {
-    if (node->score_ == new_score) {
+template<template<typename> class Index>
+void BasicZSet<Index>::erase_node(ZNode* node) {
+    tree_.erase(ZTreeEntry{node->score_, node}); // compares against node's name, so before freeing it
+    name_bytes_ -= node->name_len_;
+    hmap_.remove(node->hcode(), [node](const ZNode& n) { return &n == node; });
+}
+
+template<template<typename> class Index>
+void BasicZSet<Index>::assign_sorted(std::span<const ZMember> members) {
+    dispose();
+    bool fits = members.size() <= ZListpack::k_max_entries &&
+                std::all_of(members.begin(), members.end(), [](const ZMember& m) { return m.name.size() <= ZListpack::k_max_name; });
+    if (fits) {
+        size_t bytes = 0;
+        for (const ZMember& m : members) bytes += sizeof(double) + 1 + m.name.size();
+        listpack_.reserve(bytes);
+        for (const ZMember& m : members) listpack_.append(m.name, m.score);
         return;
     }
-    root_ = avl_del(&node->tree_);
-    node->score_ = new_score;
-    avl_init(&node->tree_);
-    tree_add(node);
+    encoding_ = ZEncoding::Tree;
+    hmap_.reserve(members.size());
+    size_t i = 0;
+    tree_.assign_sorted(members.size(), [&] {
+        const ZMember& m = members[i++];
+        name_bytes_ += m.name.size();
+        auto node = ZNode::create(m.name, m.score);
+        ZNode* raw = node.get();
+        hmap_.insert(std::move(node));
+        return ZTreeEntry{m.score, raw};
+    });
 }
 
-bool ZSet::add(std::string_view name, double score) {
+template<template<typename> class Index>
+bool BasicZSet<Index>::add(std::string_view name, double score) {
+    if (encoding_ == ZEncoding::Listpack) {
+        size_t off = listpack_.find(name);
+        if (off != ZListpack::npos) {
+            if (listpack_.read(off).score != score) {
+                listpack_.erase_at(off);
+                listpack_.insert(name, score);
+            }
+            return false;
+        }
+        if (name.size() <= ZListpack::k_max_name && listpack_.size() < ZListpack::k_max_entries) {
+            listpack_.insert(name, score);
+            return true;
+        }
+        convert_to_tree();
+    }
+
     if (ZNode* node = lookup(name)) {
-        update_score(node, score);
+        if (node->score_ != score) {
+            // Re-keying in place would break the tree order, so unlink, change the score and re-insert.
+            tree_.erase(ZTreeEntry{node->score_, node});
+            node->score_ = score;
+            tree_.insert(ZTreeEntry{score, node});
+        }
         return false;
     }
-
-    ZNode* node = ZNode::create(name, score);
-    assert(node);
-    hmap_.insert(&node->hash_);
-    tree_add(node);
+    tree_insert(name, score);
     return true;
 }
 
-ZNode* ZSet::lookup(std::string_view name) const {
-    if (!root_) {
-        return nullptr;
+template<template<typename> class Index>
+std::optional<double> BasicZSet<Index>::score(std::string_view name) {
+    if (encoding_ == ZEncoding::Listpack) {
+        size_t off = listpack_.find(name);
+        if (off == ZListpack::npos) return std::nullopt;
+        return listpack_.read(off).score;
     }
+    ZNode* node = lookup(name);
+    if (!node) return std::nullopt;
+    return node->score_;
+}
 
-    HKey key(name);
-    if (HNode* found = hm_lookup(&hmap_, &key.node, hcmp)) {
-        return container_of(found, ZNode, hash_);
+template<template<typename> class Index>
+bool BasicZSet<Index>::remove(std::string_view name) {
+    if (encoding_ == ZEncoding::Listpack) {
+        size_t off = listpack_.find(name);
+        if (off == ZListpack::npos) return false;
+        listpack_.erase_at(off);
+        return true;
     }
-    return nullptr;
+    ZNode* node = lookup(name);
+    if (!node) return false;
+    erase_node(node);
+    return true;
 }
 
-ZNode* ZSet::pop(std::string_view name) {
-    if (!root_) {
-        return nullptr;
-    }
+template<template<typename> class Index>
+ZCursor BasicZSet<Index>::seek(double score, std::string_view name, int64_t offset) const {
+    uint64_t first = count_before([&](const ZMember& m) {
+        return m.score != score ? m.score < score : m.name < name;
+    });
+    if (first >= size()) return {};
+    int64_t rank = static_cast<int64_t>(first) + offset;
+    if (rank < 0 || static_cast<uint64_t>(rank) >= size()) return {};
+    return cursor_at(static_cast<uint64_t>(rank), size() - static_cast<uint64_t>(rank));
+}
 
-    HKey key(name);
-    if (HNode* found = hm_pop(&hmap_, &key.node, hcmp)) {
-        ZNode* node = container_of(found, ZNode, hash_);
-        root_ = avl_del(&node->tree_);
-        return node;
+template<template<typename> class Index>
+std::optional<uint64_t> BasicZSet<Index>::rank(std::string_view name) {
+    if (encoding_ == ZEncoding::Listpack) {
+        size_t off = listpack_.find(name);
+        if (off == ZListpack::npos) return std::nullopt;
+        return listpack_.rank_of(off);
     }
-    return nullptr;
+    ZNode* node = lookup(name);
+    if (!node) return std::nullopt;
+    return tree_.rank_of(ZTreeEntry{node->score_, node});
 }
 
-ZNode* ZSet::query(double score, std::string_view name, int64_t offset) const {
-    AVLNode* found = nullptr;
-    AVLNode* cur = root_;
+template<template<typename> class Index>
+ZCursor BasicZSet<Index>::range_by_rank(uint64_t start, uint64_t stop) const noexcept {
+    if (start > stop) return {};
+    return cursor_at(start, stop - start + 1);
+}
 
-    while (cur) {
-        if (less(cur, score, name)) {
-            cur = cur->right;
-        } else {
-            found = cur;
-            cur = cur->left;
-        }
+template<template<typename> class Index>
+uint64_t BasicZSet<Index>::count_scores_below(double score, bool or_equal) const {
+    if (or_equal) {
+        return count_before([score](const ZMember& m) { return m.score <= score; });
     }
+    return count_before([score](const ZMember& m) { return m.score < score; });
+}
+
+template<template<typename> class Index>
+uint64_t BasicZSet<Index>::count(ScoreBound lo, ScoreBound hi) const {
+    uint64_t begin = count_scores_below(lo.value, lo.exclusive);
+    uint64_t end = count_scores_below(hi.value, !hi.exclusive);
+    return end > begin ? end - begin : 0;
+}
 
-    if (found) {
-        found = avl_offset(found, offset);
+template<template<typename> class Index>
+ZCursor BasicZSet<Index>::range_by_score(ScoreBound lo, ScoreBound hi) const {
+    uint64_t begin = count_scores_below(lo.value, lo.exclusive);
+    uint64_t end = count_scores_below(hi.value, !hi.exclusive);
+    if (end <= begin) return {};
+    return cursor_at(begin, end - begin);
+}
+
+template<template<typename> class Index>
+uint64_t BasicZSet<Index>::remove_range_by_score(ScoreBound lo, ScoreBound hi) {
+    uint64_t begin = count_scores_below(lo.value, lo.exclusive);
+    uint64_t end = count_scores_below(hi.value, !hi.exclusive);
+    if (end <= begin) return 0;
+    uint64_t n = end - begin;
+    if (encoding_ == ZEncoding::Listpack) {
+        listpack_.erase_run(listpack_.at(begin), n);
+        return n;
+    }
+    // Erasing shifts leaf arrays around, so re-select by rank each time rather than holding a position.
+    for (uint64_t i = 0; i < n; ++i) {
+        erase_node(tree_.at(begin).get().node);
     }
-    return found ? container_of(found, ZNode, tree_) : nullptr;
+    return n;
 }
 
-void ZSet::dispose_tree(AVLNode* node) {
-    if (!node) {
-        return;
+template<template<typename> class Index>
+size_t BasicZSet<Index>::memory_usage() const {
+    if (encoding_ == ZEncoding::Listpack) {
+        return sizeof(*this) + listpack_.bytes();
     }
-    dispose_tree(node->left);
-    dispose_tree(node->right);
-    ZNode::destroy(container_of(node, ZNode, tree_));
+    size_t total = sizeof(*this) + tree_.node_bytes();
+    hmap_.for_each([&](const ZNode& node) { total += sizeof(ZNode) + node.name().size(); });
+    return total;
 }
 
 } // namespace ds